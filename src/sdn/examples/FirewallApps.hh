@@ -7,6 +7,7 @@
 #include <fluid/of13msg.hh>
 
 #include "MsgApps.hh"
+#include "ns3/SdnFirewallTable.h"
 
 using namespace ns3;
 
@@ -68,24 +69,19 @@ public:
             uint64_t dst = 0, src = 0;
             uint16_t ethType = 0;
             PacketInEvent* pi = static_cast<PacketInEvent*>(ev);
-            void* ofpip = NULL;
+            fluid_msg::of10::PacketIn ofpi10;
             if (ofversion == fluid_msg::of10::OFP_VERSION) {
-                fluid_msg::of10::PacketIn *ofpi = new fluid_msg::of10::PacketIn();
-                ofpip = ofpi;
-                ofpi->unpack(pi->data);
-                //data = (uint8_t*) ofpi->data();
-                memcpy(((uint8_t*)&dst + 2), (uint8_t*) ofpi->data(), 6);
-                memcpy(((uint8_t*)&src + 2), (uint8_t*) ofpi->data() + 6, 6);
-                memcpy(((uint8_t*)&ethType), (uint8_t*) ofpi->data() + 12, 2);
+                ofpi10.unpack(pi->data);
+                memcpy(((uint8_t*)&dst + 2), (uint8_t*) ofpi10.data(), 6);
+                memcpy(((uint8_t*)&src + 2), (uint8_t*) ofpi10.data() + 6, 6);
+                memcpy(((uint8_t*)&ethType), (uint8_t*) ofpi10.data() + 12, 2);
             }
             else if (ofversion == fluid_msg::of13::OFP_VERSION) {
-                fluid_msg::of13::PacketIn *ofpi = new fluid_msg::of13::PacketIn();
-                ofpip = ofpi;
-                ofpi->unpack(pi->data);
-                //data = (uint8_t*) ofpi->data();
-                memcpy(((uint8_t*) &dst + 2), (uint8_t*) ofpi->data(), 6);
-                memcpy(((uint8_t*) &src + 2), (uint8_t*) ofpi->data() + 6, 6);
-                if (ofpi->match().in_port() == NULL) {
+                fluid_msg::of13::PacketIn ofpi13;
+                ofpi13.unpack(pi->data);
+                memcpy(((uint8_t*) &dst + 2), (uint8_t*) ofpi13.data(), 6);
+                memcpy(((uint8_t*) &src + 2), (uint8_t*) ofpi13.data() + 6, 6);
+                if (ofpi13.match().in_port() == NULL) {
                     return;
                 }
             }
@@ -93,7 +89,7 @@ public:
             PathwaySet::iterator packetInPathway = blacklist.find(std::make_pair(src, dst));
             if(packetInPathway != blacklist.end())
             {
-              install_flow_mod_no_action10(*((fluid_msg::of10::PacketIn*) ofpip), ev->ofconn, src, dst);
+              install_flow_mod_no_action10(ofpi10, ev->ofconn, src, dst);
               //Make a pathway with no action so we'll drop the packet
               return;
             }
@@ -126,4 +122,221 @@ public:
     }
 };
 
+/**
+ * A HashLearningSwitch behind an IPv4 blacklist of source and destination
+ * prefixes, optionally narrowed to a protocol and port ranges, read one rule
+ * per line from a file in the format of SdnFirewallRule::Parse.
+ *
+ * When a switch comes up the blacklist is compiled to a reduced rule set and
+ * pushed as drop flows above the learned ones. Port ranges spanning more
+ * than max_ports_per_rule ports are not worth a flow per port and are left to
+ * the PacketIn path, which looks every IPv4 PacketIn up in the blacklist and
+ * drops the blocked ones with an exact flow.
+ */
+class PrefixFirewall : public HashLearningSwitch {
+public:
+    PrefixFirewall() : drop_priority(1000), max_ports_per_rule(16), compiled_valid(false) {}
+
+    PrefixFirewall(std::string fileName) : drop_priority(1000), max_ports_per_rule(16), compiled_valid(false) {
+        std::ifstream rulesFile(fileName.c_str());
+        if (!rulesFile.is_open()) {
+            NS_ABORT_MSG ("Couldn't read the firewall rules at " << fileName);
+        }
+        std::string line;
+        uint32_t lineNumber = 0;
+        while (getline(rulesFile, line)) {
+            lineNumber++;
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#') {
+                continue;
+            }
+            SdnFirewallRule rule;
+            if (!SdnFirewallRule::Parse(line, rule)) {
+                NS_ABORT_MSG ("Bad firewall rule at " << fileName << ":" << lineNumber << ": " << line);
+            }
+            add_rule(rule);
+        }
+    }
+
+    bool add_rule(const SdnFirewallRule &rule) {
+        compiled_valid = false;
+        return blacklist.Add(rule);
+    }
+
+    void set_drop_priority(uint16_t priority) { drop_priority = priority; }
+    void set_max_ports_per_rule(uint32_t ports) { max_ports_per_rule = ports; }
+    const SdnFirewallTable& get_blacklist() const { return blacklist; }
+
+    virtual void switch_up(Ptr<SdnConnection> ofconn, uint8_t* msg, uint16_t len) {
+        HashLearningSwitch::switch_up(ofconn, msg, len);
+        if (!compiled_valid) {
+            blacklist.Compile(compiled);
+            compiled_valid = true;
+        }
+        for (std::vector<SdnFirewallRule>::const_iterator rule = compiled.begin(); rule != compiled.end(); ++rule) {
+            install_drop_rule(ofconn, *rule);
+        }
+    }
+
+    virtual void packet_in(Ptr<SdnConnection> ofconn, uint8_t* msg, uint16_t len) {
+        PacketInView view;
+        if (parse_packet_in(msg, len, view)) {
+            SdnFirewallRule packet;
+            if (parse_ipv4(view, packet) &&
+                blacklist.Lookup(packet.src, packet.dst, packet.proto,
+                    packet.HasPorts() ? packet.srcPortMin : 0, packet.HasPorts() ? packet.dstPortMin : 0) != NULL) {
+                // Drop this microflow, and the packet if the switch buffered it
+                install_drop_flow(ofconn, packet, 50, 100, view.buffer_id, view.xid);
+                return;
+            }
+        }
+        HashLearningSwitch::packet_in(ofconn, msg, len);
+    }
+
+    /**
+     * Reads the addresses, protocol and TCP or UDP ports of an IPv4 frame into
+     * an exact rule, with every port for other protocols. Returns false for
+     * other frames.
+     */
+    static bool parse_ipv4(const PacketInView &view, SdnFirewallRule &packet) {
+        size_t ip = 14;
+        if (read16(view.frame + 12) == 0x8100) {
+            ip += 4;
+        }
+        if (view.frame_len < ip + 20 || read16(view.frame + ip - 2) != 0x0800) {
+            return false;
+        }
+        size_t transport = ip + (view.frame[ip] & 0x0f) * 4;
+        packet.proto = view.frame[ip + 9];
+        packet.src = read32(view.frame + ip + 12);
+        packet.srcLen = 32;
+        packet.dst = read32(view.frame + ip + 16);
+        packet.dstLen = 32;
+        packet.srcPortMin = packet.dstPortMin = 0;
+        packet.srcPortMax = packet.dstPortMax = 0xffff;
+        if ((packet.proto == 6 || packet.proto == 17) && view.frame_len >= transport + 4) {
+            packet.srcPortMin = packet.srcPortMax = read16(view.frame + transport);
+            packet.dstPortMin = packet.dstPortMax = read16(view.frame + transport + 2);
+        }
+        return true;
+    }
+
+    /**
+     * Pushes one compiled rule as drop flows: one per protocol it covers and,
+     * for port ranges, one per port pair. Returns the number of flows sent.
+     */
+    uint32_t install_drop_rule(Ptr<SdnConnection> ofconn, const SdnFirewallRule &rule) {
+        if (!rule.HasPorts()) {
+            install_drop_flow(ofconn, rule, 0, 0, 0xffffffff, 0);
+            return 1;
+        }
+        bool allSrc = rule.srcPortMin == 0 && rule.srcPortMax == 0xffff;
+        bool allDst = rule.dstPortMin == 0 && rule.dstPortMax == 0xffff;
+        uint32_t srcPorts = allSrc ? 1 : rule.srcPortMax - rule.srcPortMin + 1;
+        uint32_t dstPorts = allDst ? 1 : rule.dstPortMax - rule.dstPortMin + 1;
+        uint8_t protos[] = { 6, 17 };
+        uint32_t numProtos = rule.proto == 0 ? 2 : 1;
+        if ((uint64_t)srcPorts * dstPorts * numProtos > max_ports_per_rule) {
+            return 0;
+        }
+        uint32_t sent = 0;
+        for (uint32_t p = 0; p < numProtos; ++p) {
+            for (uint32_t s = 0; s < srcPorts; ++s) {
+                for (uint32_t d = 0; d < dstPorts; ++d) {
+                    SdnFirewallRule exact = rule;
+                    exact.proto = rule.proto == 0 ? protos[p] : rule.proto;
+                    if (!allSrc) {
+                        exact.srcPortMin = exact.srcPortMax = rule.srcPortMin + s;
+                    }
+                    if (!allDst) {
+                        exact.dstPortMin = exact.dstPortMax = rule.dstPortMin + d;
+                    }
+                    install_drop_flow(ofconn, exact, 0, 0, 0xffffffff, 0);
+                    sent++;
+                }
+            }
+        }
+        return sent;
+    }
+
+    /**
+     * Sends a flow with no actions for a rule whose port ranges are either a
+     * single port or every port.
+     */
+    void install_drop_flow(Ptr<SdnConnection> ofconn, const SdnFirewallRule &rule,
+            uint16_t idle_timeout, uint16_t hard_timeout, uint32_t buffer_id, uint32_t xid) {
+        bool matchSrcPort = !(rule.srcPortMin == 0 && rule.srcPortMax == 0xffff);
+        bool matchDstPort = !(rule.dstPortMin == 0 && rule.dstPortMax == 0xffff);
+        if (ofconn->get_version() == fluid_msg::of10::OFP_VERSION) {
+            fluid_msg::of10::FlowMod fm(xid, 123, fluid_msg::of10::OFPFC_ADD, idle_timeout, hard_timeout,
+                drop_priority, buffer_id, fluid_msg::of10::OFPP_NONE, 0);
+            fluid_msg::of10::Match m;
+            uint32_t wildcards = fluid_msg::of10::OFPFW_ALL & ~fluid_msg::of10::OFPFW_DL_TYPE
+                & ~fluid_msg::of10::OFPFW_NW_SRC_MASK & ~fluid_msg::of10::OFPFW_NW_DST_MASK;
+            wildcards |= (uint32_t)(32 - rule.srcLen) << fluid_msg::of10::OFPFW_NW_SRC_SHIFT;
+            wildcards |= (uint32_t)(32 - rule.dstLen) << fluid_msg::of10::OFPFW_NW_DST_SHIFT;
+            m.dl_type(0x0800);
+            m.nw_src(fluid_msg::IPAddress(rule.src));
+            m.nw_dst(fluid_msg::IPAddress(rule.dst));
+            if (rule.proto != 0) {
+                m.nw_proto(rule.proto);
+                wildcards &= ~fluid_msg::of10::OFPFW_NW_PROTO;
+            }
+            if (matchSrcPort) {
+                m.tp_src(rule.srcPortMin);
+                wildcards &= ~fluid_msg::of10::OFPFW_TP_SRC;
+            }
+            if (matchDstPort) {
+                m.tp_dst(rule.dstPortMin);
+                wildcards &= ~fluid_msg::of10::OFPFW_TP_DST;
+            }
+            // Setting a field only clears its own wildcard bit, so spell the wildcards out
+            m.wildcards(wildcards);
+            fm.match(m);
+            ofconn->send(&fm);
+        }
+        else {
+            fluid_msg::of13::FlowMod fm(xid, 123, 0xffffffffffffffff, 0, fluid_msg::of13::OFPFC_ADD, idle_timeout,
+                hard_timeout, drop_priority, buffer_id, 0, 0, 0);
+            fm.add_oxm_field(new fluid_msg::of13::EthType(0x0800));
+            if (rule.srcLen > 0) {
+                fm.add_oxm_field(new fluid_msg::of13::IPv4Src(fluid_msg::IPAddress(rule.src),
+                    fluid_msg::IPAddress(0xffffffff << (32 - rule.srcLen))));
+            }
+            if (rule.dstLen > 0) {
+                fm.add_oxm_field(new fluid_msg::of13::IPv4Dst(fluid_msg::IPAddress(rule.dst),
+                    fluid_msg::IPAddress(0xffffffff << (32 - rule.dstLen))));
+            }
+            if (rule.proto != 0) {
+                fm.add_oxm_field(new fluid_msg::of13::IPProto(rule.proto));
+            }
+            if (matchSrcPort) {
+                if (rule.proto == 6) {
+                    fm.add_oxm_field(new fluid_msg::of13::TCPSrc(rule.srcPortMin));
+                }
+                else {
+                    fm.add_oxm_field(new fluid_msg::of13::UDPSrc(rule.srcPortMin));
+                }
+            }
+            if (matchDstPort) {
+                if (rule.proto == 6) {
+                    fm.add_oxm_field(new fluid_msg::of13::TCPDst(rule.dstPortMin));
+                }
+                else {
+                    fm.add_oxm_field(new fluid_msg::of13::UDPDst(rule.dstPortMin));
+                }
+            }
+            // No instructions, matching packets are dropped
+            ofconn->send(&fm);
+        }
+    }
+
+private:
+    SdnFirewallTable blacklist;
+    uint16_t drop_priority;                 // Above the learned flows
+    uint32_t max_ports_per_rule;            // Largest port range pushed as flows
+    std::vector<SdnFirewallRule> compiled;  // Blacklist as pushed to switches
+    bool compiled_valid;                    // Whether compiled is up to date with blacklist
+};
+
 #endif
@@ -5,6 +5,8 @@
 #include <fluid/of10msg.hh>
 #include <fluid/util/ethaddr.hh>
 #include <fluid/of13msg.hh>
+#include <list>
+#include "ns3/SdnLearningTable.h"
 
 using namespace ns3;
 
@@ -22,28 +24,24 @@ public:
             uint16_t ethType = 0;
             PacketInEvent* pi = static_cast<PacketInEvent*>(ev);
 
-            void* ofpip = NULL;
+            fluid_msg::of10::PacketIn ofpi10;
+            fluid_msg::of13::PacketIn ofpi13;
             uint16_t in_port = fluid_msg::of10::OFPP_NONE;
             if (ofversion == fluid_msg::of10::OFP_VERSION) {
-                fluid_msg::of10::PacketIn *ofpi = new fluid_msg::of10::PacketIn();
-                ofpip = ofpi;
-                ofpi->unpack(pi->data);
-                memcpy(((uint8_t*) &dst + 2), (uint8_t*) ofpi->data(), 6);
-                memcpy(((uint8_t*) &src + 2), (uint8_t*) ofpi->data() + 6, 6);
-                memcpy(((uint8_t*)&ethType), (uint8_t*) ofpi->data() + 12, 2);
-                in_port = ofpi->in_port();
+                ofpi10.unpack(pi->data);
+                memcpy(((uint8_t*) &dst + 2), (uint8_t*) ofpi10.data(), 6);
+                memcpy(((uint8_t*) &src + 2), (uint8_t*) ofpi10.data() + 6, 6);
+                memcpy(((uint8_t*)&ethType), (uint8_t*) ofpi10.data() + 12, 2);
+                in_port = ofpi10.in_port();
             }
             else if (ofversion == fluid_msg::of13::OFP_VERSION) {
-                fluid_msg::of13::PacketIn *ofpi = new fluid_msg::of13::PacketIn();
-                ;
-                ofpip = ofpi;
-                ofpi->unpack(pi->data);
-                memcpy(((uint8_t*) &dst + 2), (uint8_t*) ofpi->data(), 6);
-                memcpy(((uint8_t*) &src + 2), (uint8_t*) ofpi->data() + 6, 6);
-                if (ofpi->match().in_port() == NULL) {
+                ofpi13.unpack(pi->data);
+                memcpy(((uint8_t*) &dst + 2), (uint8_t*) ofpi13.data(), 6);
+                memcpy(((uint8_t*) &src + 2), (uint8_t*) ofpi13.data() + 6, 6);
+                if (ofpi13.match().in_port() == NULL) {
                     return;
                 }
-                in_port = ofpi->match().in_port()->value();
+                in_port = ofpi13.match().in_port()->value();
             }
 
             // Learn the source
@@ -53,25 +51,21 @@ public:
             L2TABLE::iterator it = l2table->find(dst);
             if (it == l2table->end()) {
                 if (ofversion == fluid_msg::of10::OFP_VERSION) {
-                    flood10(*((fluid_msg::of10::PacketIn*) ofpip), ev->ofconn);
-                    delete (fluid_msg::of10::PacketIn*) ofpip;
+                    flood10(ofpi10, ev->ofconn);
                 }
                 else if (ofversion == fluid_msg::of13::OFP_VERSION) {
-                    flood13(*((fluid_msg::of13::PacketIn*) ofpip), ev->ofconn, in_port);
-                    delete (fluid_msg::of13::PacketIn*) ofpip;
+                    flood13(ofpi13, ev->ofconn, in_port);
                 }
                 return;
             }
 
             if (ofversion == fluid_msg::of10::OFP_VERSION) {
-                install_flow_mod10(*((fluid_msg::of10::PacketIn*) ofpip), ev->ofconn, src,
+                install_flow_mod10(ofpi10, ev->ofconn, src,
                     dst, it->second);
-                delete (fluid_msg::of10::PacketIn*) ofpip;
             }
             else if (ofversion == fluid_msg::of13::OFP_VERSION) {
-                install_flow_mod13(*((fluid_msg::of13::PacketIn*) ofpip), ev->ofconn, src,
+                install_flow_mod13(ofpi13, ev->ofconn, src,
                     dst, it->second);
-                delete (fluid_msg::of13::PacketIn*) ofpip;
             }
         }
         else if (ev->get_type() == EVENT_SWITCH_UP) {
@@ -114,7 +108,9 @@ public:
           fluid_msg::of10::PacketOut po(pi.xid(), pi.buffer_id(), pi.in_port());
           po.data(pi.data(), pi.data_len());
           po.add_action(act);
-          ofconn->send(po.pack(), po.length());
+          uint8_t* poBuffer = po.pack();
+          ofconn->send(poBuffer, po.length());
+          fluid_msg::OFMsg::free_buffer(poBuffer);
         }
         fluid_msg::OFMsg::free_buffer(buffer);
     }
@@ -201,4 +197,239 @@ public:
     }
 };
 
+/**
+ * Fields of a PacketIn a learning switch needs, read in place from the
+ * message without unpacking it. frame points into the message.
+ */
+struct PacketInView {
+    uint8_t version;
+    uint32_t xid;
+    uint32_t buffer_id;
+    uint32_t in_port;
+    const uint8_t* frame;
+    uint16_t frame_len;
+    uint64_t dst;  // MAC address in the low 48 bits
+    uint64_t src;  // MAC address in the low 48 bits
+    uint16_t vlan; // 0 for untagged frames
+};
+
+/**
+ * MultiLearningSwitch on an SdnLearningTable per switch, for large fabrics.
+ * It subscribes to the few message types it handles, PacketIns are read in
+ * place instead of being unpacked with their data, learned addresses age out
+ * and addresses behind a port that goes down are forgotten right away.
+ */
+class HashLearningSwitch: public SdnListener {
+public:
+    HashLearningSwitch() : max_age(Seconds(300)), initial_capacity(1024) {
+        uint8_t versions[] = { fluid_msg::of10::OFP_VERSION, fluid_msg::of13::OFP_VERSION };
+        for (uint32_t i = 0; i < 2; ++i) {
+            Subscribe(versions[i], fluid_msg::of10::OFPT_FEATURES_REPLY, MakeCallback(&HashLearningSwitch::switch_up, this));
+            Subscribe(versions[i], fluid_msg::of10::OFPT_PACKET_IN, MakeCallback(&HashLearningSwitch::packet_in, this));
+        }
+        Subscribe<fluid_msg::of10::PortStatus>(fluid_msg::of10::OFP_VERSION, fluid_msg::of10::OFPT_PORT_STATUS,
+            MakeCallback(&HashLearningSwitch::port_status10, this));
+        Subscribe<fluid_msg::of13::PortStatus>(fluid_msg::of13::OFP_VERSION, fluid_msg::of13::OFPT_PORT_STATUS,
+            MakeCallback(&HashLearningSwitch::port_status13, this));
+    }
+
+    virtual ~HashLearningSwitch() {
+        for (std::list<SdnLearningTable*>::iterator i = tables.begin(); i != tables.end(); ++i) {
+            delete *i;
+        }
+    }
+
+    void set_max_age(Time age) { max_age = age; }
+    void set_initial_capacity(uint32_t capacity) { initial_capacity = capacity; }
+
+    static uint16_t read16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+    static uint32_t read32(const uint8_t* p) {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+    static uint64_t read_mac(const uint8_t* p) {
+        return ((uint64_t)read16(p) << 32) | read32(p + 2);
+    }
+
+    /**
+     * Reads the fields of a 1.0 or 1.3 PacketIn. Returns false if the message
+     * is too short or, for 1.3, its match has no in_port.
+     */
+    static bool parse_packet_in(const uint8_t* msg, size_t len, PacketInView &view) {
+        if (len < 1) {
+            return false;
+        }
+        view.version = msg[0];
+        // Fixed part of the PacketIn, up to the 1.0 in_port or the 1.3 match header
+        size_t fixed = 0;
+        if (view.version == fluid_msg::of10::OFP_VERSION) {
+            fixed = 18;
+        }
+        else if (view.version == fluid_msg::of13::OFP_VERSION) {
+            fixed = 28;
+        }
+        if (fixed == 0 || len < fixed) {
+            return false;
+        }
+        view.xid = read32(msg + 4);
+        view.buffer_id = read32(msg + 8);
+        size_t data;
+        if (view.version == fluid_msg::of10::OFP_VERSION) {
+            view.in_port = read16(msg + 14);
+            data = 18;
+        }
+        else if (view.version == fluid_msg::of13::OFP_VERSION) {
+            uint16_t match_len = read16(msg + 26);
+            view.in_port = fluid_msg::of13::OFPP_ANY;
+            // OXM TLVs follow the match type and length
+            for (size_t oxm = 28; oxm + 4 <= 24 + (size_t)match_len && oxm + 4 <= len; oxm += 4 + msg[oxm + 3]) {
+                if (read32(msg + oxm) == 0x80000004 && oxm + 8 <= len) { // OXM_OF_IN_PORT
+                    view.in_port = read32(msg + oxm + 4);
+                }
+            }
+            if (view.in_port == fluid_msg::of13::OFPP_ANY) {
+                return false;
+            }
+            // Match padded to 8 bytes, then 2 bytes of padding
+            data = 24 + ((match_len + 7) / 8) * 8 + 2;
+        }
+        else {
+            return false;
+        }
+        if (len < data + 14) {
+            return false;
+        }
+        view.frame = msg + data;
+        view.frame_len = len - data;
+        view.dst = read_mac(view.frame);
+        view.src = read_mac(view.frame + 6);
+        view.vlan = 0;
+        if (read16(view.frame + 12) == 0x8100 && view.frame_len >= 16) {
+            view.vlan = read16(view.frame + 14) & 0xfff;
+        }
+        return true;
+    }
+
+    virtual void switch_up(Ptr<SdnConnection> ofconn, uint8_t* msg, uint16_t len) {
+        SdnLearningTable* table = new SdnLearningTable(initial_capacity);
+        table->SetMaxAge(max_age);
+        ofconn->set_application_data(table);
+        tables.push_back(table);
+        if (ofconn->get_version() == fluid_msg::of13::OFP_VERSION) {
+            install_default_flow13(ofconn);
+        }
+    }
+
+    virtual void packet_in(Ptr<SdnConnection> ofconn, uint8_t* msg, uint16_t len) {
+        SdnLearningTable* table = (SdnLearningTable*) ofconn->get_application_data();
+        PacketInView view;
+        if (table == NULL || !parse_packet_in(msg, len, view)) {
+            return;
+        }
+
+        table->Learn(view.src, view.vlan, view.in_port);
+        uint32_t out_port = table->Lookup(view.dst, view.vlan);
+        if (out_port == SDN_LEARNING_NO_PORT) {
+            if (view.version == fluid_msg::of10::OFP_VERSION) {
+                packet_out10(view, ofconn, fluid_msg::of10::OFPP_FLOOD);
+            }
+            else {
+                packet_out13(view, ofconn, fluid_msg::of13::OFPP_FLOOD);
+            }
+            return;
+        }
+
+        if (view.version == fluid_msg::of10::OFP_VERSION) {
+            install_flow_mod10(view, ofconn, out_port);
+        }
+        else {
+            install_flow_mod13(view, ofconn, out_port);
+        }
+    }
+
+    // Hosts behind a port that went away have to be learned again
+    void port_status10(Ptr<SdnConnection> ofconn, fluid_msg::of10::PortStatus &status) {
+        SdnLearningTable* table = (SdnLearningTable*) ofconn->get_application_data();
+        fluid_msg::of10::Port port = status.desc();
+        if (table != NULL && (status.reason() == fluid_msg::of10::OFPPR_DELETE || (port.state() & fluid_msg::of10::OFPPS_LINK_DOWN))) {
+            table->ForgetPort(port.port_no());
+        }
+    }
+
+    void port_status13(Ptr<SdnConnection> ofconn, fluid_msg::of13::PortStatus &status) {
+        SdnLearningTable* table = (SdnLearningTable*) ofconn->get_application_data();
+        fluid_msg::of13::Port port = status.desc();
+        if (table != NULL && (status.reason() == fluid_msg::of13::OFPPR_DELETE || (port.state() & fluid_msg::of13::OFPPS_LINK_DOWN))) {
+            table->ForgetPort(port.port_no());
+        }
+    }
+
+    void install_flow_mod10(const PacketInView &view, Ptr<SdnConnection> ofconn, uint32_t out_port) {
+        fluid_msg::of10::FlowMod fm(view.xid, 123, fluid_msg::of10::OFPFC_ADD, 100, 500, 100,
+            view.buffer_id, 0, 0);
+        fluid_msg::of10::Match m;
+        m.dl_src((uint8_t*) view.frame + 6);
+        m.dl_dst((uint8_t*) view.frame);
+        fm.match(m);
+        fluid_msg::of10::OutputAction act(out_port, 1024);
+        fm.add_action(act);
+        ofconn->send(&fm);
+        if ((int32_t)view.buffer_id == -1) { // Unbuffered, the packet goes back out with the flow
+            packet_out10(view, ofconn, out_port);
+        }
+    }
+
+    void packet_out10(const PacketInView &view, Ptr<SdnConnection> ofconn, uint16_t out_port) {
+        fluid_msg::of10::PacketOut po(view.xid, view.buffer_id, view.in_port);
+        if ((int32_t)view.buffer_id == -1) {
+            po.data((uint8_t*) view.frame, view.frame_len);
+        }
+        fluid_msg::of10::OutputAction act(out_port, 1024);
+        po.add_action(act);
+        ofconn->send(&po);
+    }
+
+    void install_default_flow13(Ptr<SdnConnection> ofconn) {
+        fluid_msg::of13::FlowMod fm(42, 0, 0xffffffffffffffff, 0, fluid_msg::of13::OFPFC_ADD, 0, 0, 0,
+            0xffffffff, 0, 0, 0);
+        fluid_msg::of13::OutputAction *act = new fluid_msg::of13::OutputAction(fluid_msg::of13::OFPP_CONTROLLER,
+            fluid_msg::of13::OFPCML_NO_BUFFER);
+        fluid_msg::of13::ApplyActions *inst = new fluid_msg::of13::ApplyActions();
+        inst->add_action(act);
+        fm.add_instruction(inst);
+        ofconn->send(&fm);
+    }
+
+    void install_flow_mod13(const PacketInView &view, Ptr<SdnConnection> ofconn, uint32_t out_port) {
+        fluid_msg::of13::FlowMod fm(view.xid, 123, 0xffffffffffffffff, 0, fluid_msg::of13::OFPFC_ADD, 100, 500, 100,
+            view.buffer_id, 0, 0, 0);
+        fluid_msg::of13::EthSrc fsrc((uint8_t*) view.frame + 6);
+        fluid_msg::of13::EthDst fdst((uint8_t*) view.frame);
+        fm.add_oxm_field(fsrc);
+        fm.add_oxm_field(fdst);
+        fluid_msg::of13::OutputAction act(out_port, 1024);
+        fluid_msg::of13::ApplyActions inst;
+        inst.add_action(act);
+        fm.add_instruction(inst);
+        ofconn->send(&fm);
+        if ((int32_t)view.buffer_id == -1) { // Unbuffered, the packet goes back out with the flow
+            packet_out13(view, ofconn, out_port);
+        }
+    }
+
+    void packet_out13(const PacketInView &view, Ptr<SdnConnection> ofconn, uint32_t out_port) {
+        fluid_msg::of13::PacketOut po(view.xid, view.buffer_id, view.in_port);
+        if ((int32_t)view.buffer_id == -1) {
+            po.data((uint8_t*) view.frame, view.frame_len);
+        }
+        fluid_msg::of13::OutputAction act(out_port, 1024);
+        po.add_action(act);
+        ofconn->send(&po);
+    }
+
+private:
+    std::list<SdnLearningTable*> tables; // One per switch, also held as the connection's application data
+    Time max_age;
+    uint32_t initial_capacity;
+};
+
 #endif
@@ -12,6 +12,8 @@
 #include <list>
 #include <sys/time.h>
 
+#include "ns3/SdnTopology.h"
+
 using namespace ns3;
 
 #define LLDP_DISCOVERY_ADDRESS "01:80:c2:00:00:0e"
@@ -84,6 +86,7 @@ public:
       xIDs = 0;
       lldpAddress = fluid_msg::EthAddress(LLDP_DISCOVERY_ADDRESS);
       state = STPS_FREE;
+      topology.SetTreeCallback(MakeCallback(&STPApps::treeChanged, this));
     }
 
     //Structure definitions
@@ -95,24 +98,8 @@ public:
     };
     STPState state;
 
-    //A link that the stp switch uses to defined connection in STP
-    //Contains a source and destionation datapath id, a destination port, and a delayvalue
-    struct link{
-      link () : srcDPID(0), dstDPID(0), dstPort(0), delay(0) {}
-      uint64_t srcDPID;
-      uint64_t dstDPID;
-      uint16_t dstPort;
-      uint64_t delay;
-    };
-
-    struct cmp_link {
-      bool operator() (const link &lhs, const link &rhs) const
-      {
-        if(lhs.srcDPID == rhs.srcDPID)
-          return lhs.dstDPID < rhs.dstDPID;
-        return lhs.srcDPID < rhs.srcDPID;
-      }
-    };
+    //A switch port, by datapath id and port number
+    typedef std::pair<uint64_t, uint16_t> SwitchPort;
 
     //Table definition here
     //List of switches. Sorted by DPID. Needs to get all the links on that 
@@ -122,7 +109,6 @@ public:
       Ptr<SdnConnection> switchConn;
       uint64_t DPID;
       uint64_t discoverySentTime;
-      std::set<link, cmp_link> links;
       std::vector<fluid_msg::of10::Port> hostCandidates;
     };
 
@@ -157,7 +143,14 @@ public:
       }
     };
     std::set <STPSwitch*, cmp_DPID> switches;
-    std::set<link, cmp_link> currentTopology;
+    std::map<uint64_t, STPSwitch*> switchesByDPID;
+    std::map<Ptr<SdnConnection>, STPSwitch*> switchesByConn;
+    //Links between switches, with the spanning tree kept up to date as links come and go
+    SdnTopology topology;
+    //Ports flooding is currently allowed on because their link is in the spanning tree
+    std::set<SwitchPort> treePorts;
+    //Ports whose link entered (true) or left (false) the spanning tree since the last update
+    std::map<SwitchPort, bool> pendingTreePorts;
     uint64_t initializeStartTime;
     uint64_t initializeEndTime;
 
@@ -168,32 +161,36 @@ public:
             initializeStartTime = getCurrentTime ();
           }
           SwitchUpEvent* su = static_cast<SwitchUpEvent*>(ev);
-          fluid_msg::of10::FeaturesReply *fReply = new fluid_msg::of10::FeaturesReply();
-          fReply->unpack(su->data);
-          std::cout << "STPApp: Booting up. Found " << fReply->ports().size() << " ports." << std::endl;
+          fluid_msg::of10::FeaturesReply fReply;
+          fReply.unpack(su->data);
+          std::cout << "STPApp: Booting up. Found " << fReply.ports().size() << " ports." << std::endl;
           //Initialize new switch
           STPSwitch* newSwitch = new STPSwitch();
           newSwitch->switchConn = ev->ofconn;
-          newSwitch->DPID = fReply->datapath_id();
-          newSwitch->hostCandidates = fReply->ports();
+          newSwitch->DPID = fReply.datapath_id();
+          newSwitch->hostCandidates = fReply.ports();
           //Add Switch to table
           switches.insert(newSwitch);
-          for(uint32_t i = 0; i < fReply->ports().size(); ++i){
-            fluid_msg::of10::Port currentPort = fReply->ports()[i];
-            turn_off_flooding_via_port_mod(fReply, ev->ofconn, currentPort.port_no());
+          switchesByDPID[newSwitch->DPID] = newSwitch;
+          switchesByConn[ev->ofconn] = newSwitch;
+          topology.AddSwitch(newSwitch->DPID);
+          for(uint32_t i = 0; i < fReply.ports().size(); ++i){
+            fluid_msg::of10::Port currentPort = fReply.ports()[i];
+            turn_off_flooding_via_port_mod(&fReply, ev->ofconn, currentPort.port_no());
             // Probably have to do with changing the ports while using the iterator, however
             // the messages didn't get sent out until after the standard SOL delay.... Hmmmmmmm
           }
           receive_discovery_packets(ev->ofconn);
-          this->flood_discovery_packets(ev->ofconn, newSwitch, fReply->ports());
+          this->flood_discovery_packets(ev->ofconn, newSwitch, fReply.ports());
 
           MultiLearningSwitch::event_callback(ev);
         }
 
         else if (ev->get_type() == EVENT_PACKET_IN) {
-          STPSwitch* thisSwitch = findSTPSwitch(switches,ev->ofconn);
+          STPSwitch* thisSwitch = findSTPSwitch(ev->ofconn);
           PacketInEvent* pi = static_cast<PacketInEvent*>(ev);
-          fluid_msg::of10::PacketIn *ofpi = new fluid_msg::of10::PacketIn();
+          fluid_msg::of10::PacketIn packetIn;
+          fluid_msg::of10::PacketIn *ofpi = &packetIn;
           uint64_t dst = 0, src = 0;
           ofpi->unpack(pi->data);
           memcpy(((uint8_t*) &dst + 2), (uint8_t*) ofpi->data(), 6);
@@ -205,25 +202,19 @@ public:
           if(dstAddress == lldpAddress){ //If we received a discovery packet
             uint64_t dpid = 0; //Get the DPID src from the packet
             memcpy(&dpid, (uint8_t*) ofpi->data() + 14,sizeof(uint64_t));
-            STPSwitch* srcSwitch = findSTPSwitchOnDPID(switches,dpid);
+            STPSwitch* srcSwitch = findSTPSwitchOnDPID(dpid);
             if(srcSwitch && thisSwitch){
               //Make a new link
-              link newLink;
-              newLink.srcDPID = srcSwitch->DPID;
-              newLink.dstDPID = thisSwitch->DPID;
+              SdnTopologyLink newLink;
+              newLink.srcDpid = srcSwitch->DPID;
+              newLink.dstDpid = thisSwitch->DPID;
               newLink.dstPort = ofpi->in_port();
-              newLink.delay = getCurrentTime () - srcSwitch->discoverySentTime;
-
-              if(!srcSwitch->links.insert(newLink).second){ //If there's allready a link listed in here
-                //We need to re-add the port if this happens
-                link oldLink = *(srcSwitch->links.find(newLink));
-                if(oldLink.delay > newLink.delay){
-                  srcSwitch->links.erase(oldLink);
-                  srcSwitch->links.insert(newLink);
-                  scheduleNewTopology(ev);
-                }
-              }
-              else{
+              newLink.cost = getCurrentTime () - srcSwitch->discoverySentTime;
+
+              //Keep the fastest delay seen for a link, unless it moved to another port
+              const SdnTopologyLink* oldLink = topology.FindLink(newLink.srcDpid, newLink.dstDpid);
+              if(!oldLink || oldLink->cost > newLink.cost || oldLink->dstPort != newLink.dstPort){
+                topology.AddLink(newLink);
                 scheduleNewTopology(ev);
               }
               //Remove the hostCandidate from the "externals list". It's now an internal link.
@@ -235,7 +226,7 @@ public:
             }
             return;
           }
-          else if(thisSwitch && findlinkInTopology(thisSwitch,ofpi->in_port()) == currentTopology.end()) { //If not in topology
+          else if(thisSwitch && !treePorts.count(SwitchPort(thisSwitch->DPID, ofpi->in_port()))) { //If not in topology
             std::vector<fluid_msg::of10::Port>::iterator port = findPortViaPortNo(thisSwitch, ofpi->in_port());
             if(port != thisSwitch->hostCandidates.end()){
               MultiLearningSwitch::event_callback(ev);
@@ -255,22 +246,27 @@ public:
 
         else if(ev->get_type() == EVENT_FLOW_REMOVED){
           FlowRemovedEvent* fr = static_cast<FlowRemovedEvent*>(ev);
-          fluid_msg::of10::FlowRemoved *offr = new fluid_msg::of10::FlowRemoved();
-          offr->unpack(fr->data);
+          fluid_msg::of10::FlowRemoved offr;
+          offr.unpack(fr->data);
         }
 
         else if(ev->get_type() == EVENT_PORT_STATUS){
           PortStatusEvent* ps = static_cast<PortStatusEvent*>(ev);
-          fluid_msg::of10::PortStatus *ofps = new fluid_msg::of10::PortStatus();
+          fluid_msg::of10::PortStatus portStatus;
+          fluid_msg::of10::PortStatus *ofps = &portStatus;
           ofps->unpack(ps->data);
           //Get port status down
           if(ofps->reason() == fluid_msg::of10::OFPPR_ADD){
-            //Add links
+            //Add links, discovery finds them
             scheduleNewTopology(ev);
           }
-          else if(ofps->reason() == fluid_msg::of10::OFPPR_DELETE){
+          else if(ofps->reason() == fluid_msg::of10::OFPPR_DELETE ||
+                  (ofps->desc().state() & fluid_msg::of10::OFPPS_LINK_DOWN)){
             //Delete links
-            scheduleNewTopology(ev);
+            STPSwitch* thisSwitch = findSTPSwitch(ev->ofconn);
+            if(thisSwitch && topology.RemovePort(thisSwitch->DPID, ofps->desc().port_no())){
+              scheduleNewTopology(ev);
+            }
           }
         }
 
@@ -378,24 +374,29 @@ public:
       fluid_msg::OFMsg::free_buffer(buffer);
     }
     
-    //Finds the new STP and creates the difference in topologies. Sends the new flows out into the world
+    //Records a change of the spanning tree, applied with the next topology update
+    void treeChanged(const SdnTopologyLink &link, bool added){
+      pendingTreePorts[SwitchPort(link.dstDpid, link.dstPort)] = added;
+    }
+
+    //Applies the spanning tree changes since the last update. Sends the new port configurations out into the world
     void updateTopology(void){
-      //Find our updated topology
-      std::set<link, cmp_link> newTopology = generateTopology();
-      //Get the added and removed links
-      std::pair<std::set<link, cmp_link>,std::set<link, cmp_link> > addedRemoved = generateTopologyDiff(currentTopology,newTopology);
-      //Send added new flows
-      for(std::set<link>::iterator i = addedRemoved.first.begin(); i != addedRemoved.first.end(); i++){
-        updateLink(*i, true);
-      }
-      //Send deleted old flows
-      for(std::set<link>::iterator i = addedRemoved.second.begin(); i != addedRemoved.second.end(); i++){
-        updateLink(*i, false);
+      for(std::map<SwitchPort, bool>::iterator i = pendingTreePorts.begin(); i != pendingTreePorts.end(); ++i){
+        STPSwitch *dstSwitch = findSTPSwitchOnDPID(i->first.first);
+        if(!dstSwitch){
+          continue;
+        }
+        //Allow flooding on ports of the spanning tree, disallow it on the others
+        if(i->second && treePorts.insert(i->first).second){
+          updateNoFloodOnPort(dstSwitch, i->first.second, false);
+        }
+        else if(!i->second && treePorts.erase(i->first)){
+          updateNoFloodOnPort(dstSwitch, i->first.second, true);
+        }
       }
+      pendingTreePorts.clear();
       //Open all the outside host ports
       openTheHostGateways();
-      //Confirm the new topology
-      currentTopology = newTopology;
       state = STPS_FREE;
 
       initializeEndTime = getCurrentTime ();
@@ -403,90 +404,6 @@ public:
       return;
     }
     
-    std::set<link, cmp_link> generateTopology() //Return some structure at some point
-    {
-      std::set<STPSwitch*, cmp_DPID> processed;
-      std::list<STPSwitch*> pending;
-      std::set<link, cmp_link> newTopology;
-      pending.insert(pending.begin(), switches.begin(), switches.end()); //Start with root node
-      while(!pending.empty()){ //Continue untill all pending is empty
-        STPSwitch* currentSwitch = pending.front();
-        pending.pop_front();
-        std::set<STPSwitch*, cmp_DPID> neighbors;
-        //Check every link on this switch
-        for(std::set<link>::iterator i = currentSwitch->links.begin(); i != currentSwitch->links.end(); ++i){
-          bool dstAlreadyInGraph = false;
-          for(std::set<link, cmp_link>::iterator j = newTopology.begin(); j != newTopology.end(); ++j){
-            if(i->dstDPID == (*j).dstDPID){
-              dstAlreadyInGraph = true;
-              break;
-            }
-          }
-          //If the link is connecting us somewhere new
-          if(!dstAlreadyInGraph){
-            //Insert that link into the topology
-            link otherLink = getPairedLink(*i);
-            newTopology.insert(*i);
-            if (otherLink.dstPort != 0) {
-              newTopology.insert(otherLink);
-            }
-            for(std::list<STPSwitch*>::iterator j = pending.begin(); j != pending.end(); ++j){
-            //Mark that destination as a neighbor, and remove from pending
-              if(i->dstDPID == (*j)->DPID){
-                neighbors.insert(*j);
-                j = pending.erase(j);
-              }
-            }
-          }
-        }
-        processed.insert(currentSwitch);
-        pending.insert(pending.begin(),neighbors.begin(),neighbors.end()); //Inserts our now sorted neighbors into the front of pending
-      }
-      return newTopology;
-    }
-    
-    //First element is the added links. 2nd element is the removed links
-    std::pair<std::set<link, cmp_link>,std::set<link, cmp_link> > generateTopologyDiff(std::set<link, cmp_link> oldTopo, std::set<link, cmp_link> newTopo){
-      std::set<link, cmp_link> added;
-      std::set<link, cmp_link> removed;
-      //Find all elements in new but not old
-      for(std::set<link, cmp_link>::iterator i = newTopo.begin(); i != newTopo.end(); ++i){
-        std::set<link, cmp_link>::iterator match = oldTopo.find(*i);
-        if(match == oldTopo.end()){
-          added.insert(*i);
-        }
-      }
-      //Find all elemetns in old but not new
-      for(std::set<link, cmp_link>::iterator i = oldTopo.begin(); i != oldTopo.end(); ++i){
-        std::set<link, cmp_link>::iterator match = newTopo.find(*i);
-        if(match == newTopo.end()){
-          removed.insert(*i);
-        }
-      }
-      std::pair<std::set<link, cmp_link>,std::set<link ,cmp_link> > returnValue(added,removed);
-      return returnValue;
-    }
-    
-    //Allow or disallow different ports based on our spanning tree
-    void updateLink(link link, bool added){
-      STPSwitch *dstSwitch = findSTPSwitchOnDPID(switches,link.dstDPID);
-      updateNoFloodOnPort(dstSwitch, link.dstPort, !added);
-    }
-    
-    // Returns the other single-directional link, creating a bi-directional pair
-    link getPairedLink(link linkA){
-      for (std::set<STPSwitch*, cmp_DPID>::iterator i = switches.begin(); i != switches.end(); ++i) {
-        for(std::set<link, cmp_link>::iterator j = (*i)->links.begin(); j != (*i)->links.end(); ++j){
-          if (j->srcDPID == linkA.dstDPID && j->dstDPID == linkA.srcDPID)
-          {
-            link linkB = *j;
-            return linkB;
-          }
-        }
-      }
-      return link();
-    }
-    
     void openTheHostGateways(){
       for(std::set<STPSwitch*,cmp_DPID>::iterator i = switches.begin(); i != switches.end(); ++i){
         for(std::vector<fluid_msg::of10::Port>::iterator j = (*i)->hostCandidates.begin(); j != (*i)->hostCandidates.end(); ++j){
@@ -521,29 +438,14 @@ public:
       }
     }
     //Find an STPSwitch based on an sdn connection
-    STPSwitch* findSTPSwitch(std::set<STPSwitch*, cmp_DPID> list, Ptr<SdnConnection> sdnConn){
-      for(std::set<STPSwitch*, cmp_DPID>::iterator i = list.begin(); i != list.end(); i++){
-        if((*i)->switchConn->get_id() == sdnConn->get_id())
-          return *i;
-      }
-      return 0;
+    STPSwitch* findSTPSwitch(Ptr<SdnConnection> sdnConn){
+      std::map<Ptr<SdnConnection>, STPSwitch*>::iterator i = switchesByConn.find(sdnConn);
+      return i == switchesByConn.end() ? 0 : i->second;
     }
     //Find STPSwitch based on a dpid
-    STPSwitch* findSTPSwitchOnDPID(std::set<STPSwitch*, cmp_DPID> list, uint64_t dpid){
-      for(std::set<STPSwitch*, cmp_DPID>::iterator i = list.begin(); i != list.end(); i++){
-        if((*i)->DPID == dpid)
-          return *i;
-      }
-      return 0;
-    }
-    //Find a link in the link vector based on a destination switch and it's port number (which should be unique)
-    std::set<link, cmp_link>::iterator findlinkInTopology(STPSwitch* searchSwitch,uint16_t portno){
-      for(std::set<link, cmp_link>::iterator i = currentTopology.begin(); i != currentTopology.end(); i++){
-        if((*i).dstDPID == searchSwitch->DPID && (*i).dstPort == portno){
-          return i;
-        }
-      }
-      return currentTopology.end();
+    STPSwitch* findSTPSwitchOnDPID(uint64_t dpid){
+      std::map<uint64_t, STPSwitch*>::iterator i = switchesByDPID.find(dpid);
+      return i == switchesByDPID.end() ? 0 : i->second;
     }
     //Find a port from the host candidates list on an STPSwitch
     std::vector<fluid_msg::of10::Port>::iterator findPortViaPortNo(STPSwitch* thisSwitch, uint16_t port_no){
@@ -43,8 +43,10 @@
 #include "ns3/SdnController.h"
 #include "ns3/SdnSwitch.h"
 #include "ns3/SdnListener.h"
+#include "ns3/sdn-helper.h"
 
 #include "MsgApps.hh"
+#include "FirewallApps.hh"
 
 using namespace ns3;
 
@@ -102,6 +104,8 @@ enum ControllerApplication
 {
   MSG_APPS,
   STP_APPS,
+  HASH_APPS,
+  PREFIX_FIREWALL,
 } ControllerApplication;
 
 int
@@ -111,6 +115,9 @@ main (int argc, char *argv[])
   uint32_t maxBytes = 5120;
   uint32_t controllerApplication = MSG_APPS;
   uint32_t appChoice = ON_OFF;
+  bool proactive = false;
+  bool directControl = false;
+  std::string firewallRules = "src/sdn/examples/FirewallPrefixes.txt";
 
   uint32_t numHosts    = 90;
   uint32_t numSwitches = 24;
@@ -125,10 +132,13 @@ main (int argc, char *argv[])
   cmd.AddValue ("appChoice",
                 "Application to use: (0) Bulk Send; (1) Ping; (2) On Off", appChoice);
   cmd.AddValue ("controllerApplication",
-                "Controller application that defined behavior: (0) MsgApps; (1) STPApps", controllerApplication);
+                "Controller application that defined behavior: (0) MsgApps; (2) HashLearningSwitch; (3) PrefixFirewall", controllerApplication);
+  cmd.AddValue ("firewallRules", "Blacklist of the PrefixFirewall controller application", firewallRules);
   cmd.AddValue ("numSwitches", "Number of switches", numSwitches);
   cmd.AddValue ("numHosts", "Number of hosts per end switch", numHosts);
   cmd.AddValue ("numControllers", "Number of controllers; switches will be assigned equally across controllers", numControllers);
+  cmd.AddValue ("directControl", "Connect switches to their controller through direct channels instead of TCP", directControl);
+  cmd.AddValue ("proactive", "Preload routes between all hosts into the switches before the simulation starts", proactive);
 
   cmd.Parse (argc,argv);
 
@@ -355,12 +365,25 @@ main (int argc, char *argv[])
 // Install Controller.
 //
   Ptr<SdnListener> sdnListener;
+  std::vector<Ptr<SdnController> > controllers;
   for (uint32_t i = 0; i < controllerNodes.GetN (); ++i)
     {
-      sdnListener = CreateObject<MultiLearningSwitch> ();
+      if (controllerApplication == HASH_APPS)
+        {
+          sdnListener = CreateObject<HashLearningSwitch> ();
+        }
+      else if (controllerApplication == PREFIX_FIREWALL)
+        {
+          sdnListener = CreateObject<PrefixFirewall> (firewallRules);
+        }
+      else
+        {
+          sdnListener = CreateObject<MultiLearningSwitch> ();
+        }
       Ptr<SdnController> sdnC0 = CreateObject<SdnController> (sdnListener);
       sdnC0->SetStartTime (Seconds (0.0));
       controllerNodes.Get(i)->AddApplication (sdnC0);
+      controllers.push_back (sdnC0);
     }
 
 //
@@ -373,6 +396,27 @@ main (int argc, char *argv[])
       switchNodes.Get (j)->AddApplication (sdnS);
     }
 
+  SdnHelper sdnHelper;
+  if (directControl)
+    {
+      for (uint32_t i = 0; i < controllers.size (); ++i)
+        {
+          NodeContainer regionSwitches;
+          for (uint32_t j = i * numConRegions; j < (i + 1) * numConRegions; ++j)
+            {
+              regionSwitches.Add (switchNodes.Get (j));
+            }
+          sdnHelper.InstallDirectControlChannel (regionSwitches, controllers[i]);
+        }
+    }
+
+  if (proactive)
+    {
+      NodeContainer hostNodes (leftNodes, rightNodes);
+      uint32_t numFlows = sdnHelper.InstallProactiveRoutes (switchNodes, hostNodes);
+      NS_LOG_INFO ("Preloaded " << numFlows << " flows.");
+    }
+
 //
 // Now, do the actual simulation.
 //
@@ -0,0 +1,189 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Wall clock cost of the PacketIn path of the two learning switches in
+ * MsgApps.hh, without the simulation around them. The same PacketIns, one
+ * per host and round with a source and destination that both exist, are fed
+ * to:
+ *
+ *  - MultiLearningSwitch: unpack the PacketIn, copy the addresses out,
+ *    learn in and look up an L2TABLE (std::map)
+ *  - HashLearningSwitch: read the PacketIn in place, learn in and look up an
+ *    SdnLearningTable
+ *
+ * Both must resolve the same number of destinations.
+ */
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <sys/time.h>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+
+#include "ns3/SdnController.h"
+#include "ns3/SdnSwitch.h"
+#include "ns3/SdnListener.h"
+#include "ns3/SdnLearningTable.h"
+
+#include "MsgApps.hh"
+
+using namespace ns3;
+
+typedef struct timeval TIMER_TYPE;
+#define TIMER_NOW(_t) gettimeofday (&_t,NULL);
+#define TIMER_SECONDS(_t) ((double)(_t).tv_sec + (_t).tv_usec * 1e-6)
+#define TIMER_DIFF(_t1, _t2) (TIMER_SECONDS (_t1) - TIMER_SECONDS (_t2))
+
+NS_LOG_COMPONENT_DEFINE ("sdn-learning-benchmark");
+
+static void
+HostMac (uint32_t host, uint8_t* mac)
+{
+  mac[0] = 0x02;
+  mac[1] = 0x00;
+  mac[2] = (host >> 24) & 0xff;
+  mac[3] = (host >> 16) & 0xff;
+  mac[4] = (host >> 8) & 0xff;
+  mac[5] = host & 0xff;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numHosts = 100000;
+  uint32_t numPorts = 48;
+  uint32_t rounds = 5;
+  uint32_t ofVersion = 1;
+
+  CommandLine cmd;
+  cmd.AddValue ("numHosts", "Number of hosts behind the switch", numHosts);
+  cmd.AddValue ("numPorts", "Number of switch ports the hosts are spread over", numPorts);
+  cmd.AddValue ("rounds", "Number of times every host sends a PacketIn", rounds);
+  cmd.AddValue ("ofVersion", "OpenFlow version of the PacketIns: (1) 1.0; (4) 1.3", ofVersion);
+  cmd.Parse (argc, argv);
+
+  //Host i sends a 64 byte frame to host i + 1, unbuffered, as a switch with no
+  //buffer space left would
+  std::vector<uint8_t*> messages;
+  std::vector<size_t> lengths;
+  uint8_t frame[64];
+  memset (frame, 0, sizeof (frame));
+  frame[12] = 0x08;
+  for (uint32_t i = 0; i < numHosts; ++i)
+    {
+      HostMac ((i + 1) % numHosts, frame);
+      HostMac (i, frame + 6);
+      uint32_t inPort = 1 + i % numPorts;
+      uint8_t* buffer;
+      size_t length;
+      if (ofVersion == fluid_msg::of13::OFP_VERSION)
+        {
+          fluid_msg::of13::PacketIn pi (i, 0xffffffff, sizeof (frame), fluid_msg::of13::OFPR_NO_MATCH, 0, 0);
+          pi.add_oxm_field (new fluid_msg::of13::InPort (inPort));
+          pi.data (frame, sizeof (frame));
+          buffer = pi.pack ();
+          length = pi.length ();
+        }
+      else
+        {
+          fluid_msg::of10::PacketIn pi (i, 0xffffffff, inPort, sizeof (frame), fluid_msg::of10::OFPR_NO_MATCH);
+          pi.data (frame, sizeof (frame));
+          buffer = pi.pack ();
+          length = pi.length ();
+        }
+      messages.push_back (buffer);
+      lengths.push_back (length);
+    }
+
+  TIMER_TYPE t0, t1, t2;
+  uint64_t mapHits = 0;
+  uint64_t hashHits = 0;
+
+  TIMER_NOW (t0);
+  L2TABLE l2table;
+  for (uint32_t r = 0; r < rounds; ++r)
+    {
+      for (uint32_t i = 0; i < numHosts; ++i)
+        {
+          uint64_t dst = 0, src = 0;
+          uint32_t inPort;
+          if (ofVersion == fluid_msg::of13::OFP_VERSION)
+            {
+              fluid_msg::of13::PacketIn pi;
+              pi.unpack (messages[i]);
+              memcpy (((uint8_t*) &dst + 2), (uint8_t*) pi.data (), 6);
+              memcpy (((uint8_t*) &src + 2), (uint8_t*) pi.data () + 6, 6);
+              inPort = pi.match ().in_port ()->value ();
+            }
+          else
+            {
+              fluid_msg::of10::PacketIn pi;
+              pi.unpack (messages[i]);
+              memcpy (((uint8_t*) &dst + 2), (uint8_t*) pi.data (), 6);
+              memcpy (((uint8_t*) &src + 2), (uint8_t*) pi.data () + 6, 6);
+              inPort = pi.in_port ();
+            }
+          l2table[src] = inPort;
+          if (l2table.find (dst) != l2table.end ())
+            {
+              mapHits++;
+            }
+        }
+    }
+
+  TIMER_NOW (t1);
+  SdnLearningTable table;
+  for (uint32_t r = 0; r < rounds; ++r)
+    {
+      for (uint32_t i = 0; i < numHosts; ++i)
+        {
+          PacketInView view;
+          if (!HashLearningSwitch::parse_packet_in (messages[i], lengths[i], view))
+            {
+              continue;
+            }
+          table.Learn (view.src, view.vlan, view.in_port);
+          if (table.Lookup (view.dst, view.vlan) != SDN_LEARNING_NO_PORT)
+            {
+              hashHits++;
+            }
+        }
+    }
+  TIMER_NOW (t2);
+
+  for (uint32_t i = 0; i < numHosts; ++i)
+    {
+      fluid_msg::OFMsg::free_buffer (messages[i]);
+    }
+
+  uint64_t packetIns = (uint64_t)numHosts * rounds;
+  std::cout << packetIns << " PacketIns from " << numHosts << " hosts" << std::endl;
+  std::cout << "MultiLearningSwitch: " << TIMER_DIFF (t1, t0) << " s, "
+            << 1e9 * TIMER_DIFF (t1, t0) / packetIns << " ns per PacketIn, "
+            << mapHits << " destinations found" << std::endl;
+  std::cout << "HashLearningSwitch:  " << TIMER_DIFF (t2, t1) << " s, "
+            << 1e9 * TIMER_DIFF (t2, t1) / packetIns << " ns per PacketIn, "
+            << hashHits << " destinations found, table capacity " << table.GetCapacity () << std::endl;
+
+  if (mapHits != hashHits)
+    {
+      std::cout << "Mismatch between the two learning tables" << std::endl;
+      return 1;
+    }
+  return 0;
+}
@@ -1,11 +1,385 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Jared Ivey <j.ivey@gatech.edu>
+ *          Michael Riley <mriley7@gatech.edu>
+ */
 
 #include "sdn-helper.h"
 
+#include <algorithm>
+#include <deque>
+#include <map>
+
+#include "ns3/log.h"
+#include "ns3/abort.h"
+#include "ns3/ipv4.h"
+#include "ns3/channel.h"
+#include "ns3/loopback-net-device.h"
+#include "ns3/point-to-point-net-device.h"
+#include "ns3/SdnCommon.h"
+#include "ns3/SdnSwitch.h"
+#include "ns3/SdnSwitch13.h"
+#include "ns3/SdnController.h"
+
 namespace ns3 {
 
-/* ... */
+NS_LOG_COMPONENT_DEFINE ("SdnHelper");
+
+#define SDN_ETHERTYPE_IPV4 0x0800
+#define SDN_ETHERTYPE_ARP 0x0806
+
+/* The device at the other end of a two device channel */
+static Ptr<NetDevice>
+GetRemoteDevice (Ptr<NetDevice> device)
+{
+  Ptr<Channel> channel = device->GetChannel ();
+  if (!channel || channel->GetNDevices () != 2)
+    {
+      return 0;
+    }
+  return channel->GetDevice (0) == device ? channel->GetDevice (1) : channel->GetDevice (0);
+}
+
+/* Network mask of a prefix length, in host order */
+static uint32_t
+PrefixMask (uint8_t length)
+{
+  return length == 0 ? 0 : 0xffffffff << (32 - length);
+}
+
+SdnHelper::SdnHelper ()
+  : m_priority (100),
+    m_cookie (0),
+    m_directDelay (MilliSeconds (1)),
+    m_directDataRate (DataRate (0)),
+    m_directLossRate (0)
+{
+}
+
+void
+SdnHelper::InstallDirectControlChannel (NodeContainer switches, Ptr<SdnController> controller)
+{
+  NS_LOG_FUNCTION (this << controller);
+
+  //Switches connect when they start, with the channel the controller has then
+  controller->SetDirectChannel (m_directDelay, m_directDataRate, m_directLossRate);
+  for (uint32_t s = 0; s < switches.GetN (); ++s)
+    {
+      Ptr<Node> node = switches.Get (s);
+      bool found = false;
+      for (uint32_t i = 0; i < node->GetNApplications (); ++i)
+        {
+          Ptr<SdnSwitch> sdnSwitch = DynamicCast<SdnSwitch> (node->GetApplication (i));
+          Ptr<SdnSwitch13> sdnSwitch13 = DynamicCast<SdnSwitch13> (node->GetApplication (i));
+          if (sdnSwitch)
+            {
+              sdnSwitch->SetDirectController (controller);
+              found = true;
+            }
+          else if (sdnSwitch13)
+            {
+              sdnSwitch13->SetDirectController (controller);
+              found = true;
+            }
+        }
+      NS_ABORT_MSG_UNLESS (found, "SdnHelper::InstallDirectControlChannel(): node " << node->GetId ()
+                           << " runs neither an SdnSwitch nor an SdnSwitch13");
+    }
+}
+
+int64_t
+SdnHelper::AssignStreams (NodeContainer controllers, int64_t stream)
+{
+  NS_LOG_FUNCTION (this << stream);
+  int64_t assigned = 0;
+  for (uint32_t c = 0; c < controllers.GetN (); ++c)
+    {
+      Ptr<Node> node = controllers.Get (c);
+      for (uint32_t i = 0; i < node->GetNApplications (); ++i)
+        {
+          Ptr<SdnController> controller = DynamicCast<SdnController> (node->GetApplication (i));
+          if (controller)
+            {
+              assigned += controller->AssignStreams (stream + assigned);
+            }
+        }
+    }
+  return assigned;
+}
+
+uint16_t
+SdnHelper::GetSwitchPortNumber (Ptr<NetDevice> device)
+{
+  // Walks the devices in the order SdnSwitch::StartApplication adds them as ports
+  if (DynamicCast<LoopbackNetDevice> (device) || DynamicCast<PointToPointNetDevice> (device))
+    {
+      return 0;
+    }
+  Ptr<Node> node = device->GetNode ();
+  uint16_t port = 0;
+  for (uint32_t i = 0; i < node->GetNDevices (); ++i)
+    {
+      Ptr<NetDevice> other = node->GetDevice (i);
+      if (DynamicCast<LoopbackNetDevice> (other) || DynamicCast<PointToPointNetDevice> (other))
+        {
+          continue;
+        }
+      port = SdnCommon::NextPortNumber (port);
+      if (other == device)
+        {
+          return port;
+        }
+    }
+  return 0;
+}
+
+uint32_t
+SdnHelper::InstallProactiveRoutes (NodeContainer switches, NodeContainer hosts)
+{
+  NS_LOG_FUNCTION (this);
+
+  std::map<uint32_t, uint32_t> switchIndex;
+  for (uint32_t i = 0; i < switches.GetN (); ++i)
+    {
+      switchIndex[switches.Get (i)->GetId ()] = i;
+    }
+  std::map<uint32_t, bool> isHost;
+  for (uint32_t i = 0; i < hosts.GetN (); ++i)
+    {
+      isHost[hosts.Get (i)->GetId ()] = true;
+    }
+
+  //Walk the devices of every switch the way the switch numbers its ports
+  std::vector<std::vector<Adjacency> > adjacency (switches.GetN ());
+  std::vector<std::vector<Attachment> > attachments (switches.GetN ());
+  for (uint32_t s = 0; s < switches.GetN (); ++s)
+    {
+      Ptr<Node> node = switches.Get (s);
+      for (uint32_t i = 0; i < node->GetNDevices (); ++i)
+        {
+          Ptr<NetDevice> device = node->GetDevice (i);
+          uint16_t port = GetSwitchPortNumber (device);
+          Ptr<NetDevice> remoteDevice = port ? GetRemoteDevice (device) : 0;
+          if (!remoteDevice)
+            {
+              continue;
+            }
+          Ptr<Node> remoteNode = remoteDevice->GetNode ();
+          std::map<uint32_t, uint32_t>::const_iterator neighbor = switchIndex.find (remoteNode->GetId ());
+          if (neighbor != switchIndex.end ())
+            {
+              Adjacency link;
+              link.neighbor = neighbor->second;
+              link.port = port;
+              adjacency[s].push_back (link);
+            }
+          else if (isHost.find (remoteNode->GetId ()) != isHost.end ())
+            {
+              Ptr<Ipv4> ipv4 = remoteNode->GetObject<Ipv4> ();
+              NS_ABORT_MSG_UNLESS (ipv4, "SdnHelper::InstallProactiveRoutes(): host " << remoteNode->GetId ()
+                                   << " has no IPv4 stack installed");
+              int32_t interface = ipv4->GetInterfaceForDevice (remoteDevice);
+              if (interface < 0 || ipv4->GetNAddresses (interface) == 0)
+                {
+                  NS_LOG_WARN ("Host " << remoteNode->GetId () << " has no address towards switch " << node->GetId ());
+                  continue;
+                }
+              Attachment host;
+              host.address = ipv4->GetAddress (interface, 0).GetLocal ().Get ();
+              host.port = port;
+              attachments[s].push_back (host);
+            }
+        }
+    }
+
+  //Next hop of every switch towards every host: a breadth first search out of
+  //each switch with hosts gives the port each other switch reaches it through
+  std::vector<std::vector<NextHop> > nextHops (switches.GetN ());
+  for (uint32_t d = 0; d < switches.GetN (); ++d)
+    {
+      if (attachments[d].empty ())
+        {
+          continue;
+        }
+      std::vector<uint16_t> toward (switches.GetN (), 0);
+      std::vector<bool> reached (switches.GetN (), false);
+      std::deque<uint32_t> queue;
+      reached[d] = true;
+      queue.push_back (d);
+      while (!queue.empty ())
+        {
+          uint32_t u = queue.front ();
+          queue.pop_front ();
+          for (std::vector<Adjacency>::const_iterator i = adjacency[u].begin (); i != adjacency[u].end (); ++i)
+            {
+              if (reached[i->neighbor])
+                {
+                  continue;
+                }
+              //The neighbor forwards towards d through its own link back to u
+              for (std::vector<Adjacency>::const_iterator j = adjacency[i->neighbor].begin ();
+                   j != adjacency[i->neighbor].end (); ++j)
+                {
+                  if (j->neighbor == u)
+                    {
+                      toward[i->neighbor] = j->port;
+                      reached[i->neighbor] = true;
+                      queue.push_back (i->neighbor);
+                      break;
+                    }
+                }
+            }
+        }
+      for (uint32_t s = 0; s < switches.GetN (); ++s)
+        {
+          if (!reached[s])
+            {
+              continue;
+            }
+          for (std::vector<Attachment>::const_iterator h = attachments[d].begin (); h != attachments[d].end (); ++h)
+            {
+              nextHops[s].push_back (NextHop (h->address, s == d ? h->port : toward[s]));
+            }
+        }
+    }
+
+  uint32_t installed = 0;
+  for (uint32_t s = 0; s < switches.GetN (); ++s)
+    {
+      std::vector<NextHop> &hops = nextHops[s];
+      if (hops.empty ())
+        {
+          continue;
+        }
+      std::sort (hops.begin (), hops.end ());
+      std::vector<NextHop> unique;
+      unique.reserve (hops.size ());
+      for (std::vector<NextHop>::const_iterator i = hops.begin (); i != hops.end (); ++i)
+        {
+          if (!unique.empty () && unique.back ().first == i->first)
+            {
+              NS_LOG_WARN ("Address " << Ipv4Address (i->first) << " is used by more than one host, keeping one");
+              continue;
+            }
+          unique.push_back (*i);
+        }
+
+      std::vector<Route> routes;
+      Aggregate (unique.begin (), unique.end (), 0, 0, routes);
+      NS_LOG_INFO ("Switch " << switches.Get (s)->GetId () << ": " << unique.size () << " hosts in "
+                   << routes.size () << " prefixes");
+      installed += Preload (switches.Get (s), routes);
+    }
+  return installed;
+}
+
+void
+SdnHelper::Aggregate (std::vector<NextHop>::const_iterator begin, std::vector<NextHop>::const_iterator end,
+                      uint32_t prefix, uint8_t length, std::vector<Route> &routes)
+{
+  if (begin == end)
+    {
+      return;
+    }
+  bool uniform = true;
+  for (std::vector<NextHop>::const_iterator i = begin + 1; i != end && uniform; ++i)
+    {
+      uniform = i->second == begin->second;
+    }
+  if (uniform)
+    {
+      Route route;
+      route.prefix = prefix;
+      route.length = length;
+      route.port = begin->second;
+      routes.push_back (route);
+      return;
+    }
+  //Addresses are distinct, so a range of two or more always splits before length 32
+  uint32_t upper = prefix | (1u << (31 - length));
+  std::vector<NextHop>::const_iterator middle = std::lower_bound (begin, end, NextHop (upper, 0));
+  Aggregate (begin, middle, prefix, length + 1, routes);
+  Aggregate (middle, end, upper, length + 1, routes);
+}
 
+uint32_t
+SdnHelper::Preload (Ptr<Node> node, const std::vector<Route> &routes)
+{
+  Ptr<SdnSwitch> sdnSwitch;
+  Ptr<SdnSwitch13> sdnSwitch13;
+  for (uint32_t i = 0; i < node->GetNApplications () && !sdnSwitch && !sdnSwitch13; ++i)
+    {
+      sdnSwitch = DynamicCast<SdnSwitch> (node->GetApplication (i));
+      sdnSwitch13 = DynamicCast<SdnSwitch13> (node->GetApplication (i));
+    }
+  NS_ABORT_MSG_UNLESS (sdnSwitch || sdnSwitch13, "SdnHelper::InstallProactiveRoutes(): node " << node->GetId ()
+                       << " runs neither an SdnSwitch nor an SdnSwitch13");
 
+  const uint16_t ethTypes[] = { SDN_ETHERTYPE_IPV4, SDN_ETHERTYPE_ARP };
+  uint32_t installed = 0;
+  for (std::vector<Route>::const_iterator r = routes.begin (); r != routes.end (); ++r)
+    {
+      for (uint32_t t = 0; t < 2; ++t)
+        {
+          if (sdnSwitch)
+            {
+              fluid_msg::of10::FlowMod fm (0, m_cookie, fluid_msg::of10::OFPFC_ADD, 0, 0, m_priority,
+                                           0xffffffff, fluid_msg::of10::OFPP_NONE, 0);
+              fluid_msg::of10::Match m;
+              m.dl_type (ethTypes[t]);
+              m.nw_dst (fluid_msg::IPAddress (r->prefix));
+              //Setting a field only clears its own wildcard bit, so spell the wildcards out
+              m.wildcards ((fluid_msg::of10::OFPFW_ALL & ~fluid_msg::of10::OFPFW_DL_TYPE & ~fluid_msg::of10::OFPFW_NW_DST_MASK)
+                           | ((uint32_t)(32 - r->length) << fluid_msg::of10::OFPFW_NW_DST_SHIFT));
+              fm.match (m);
+              fluid_msg::of10::OutputAction act (r->port, 1024);
+              fm.add_action (act);
+              sdnSwitch->PreloadFlow (&fm);
+            }
+          else
+            {
+              fluid_msg::of13::FlowMod fm (0, m_cookie, 0xffffffffffffffff, 0, fluid_msg::of13::OFPFC_ADD, 0, 0,
+                                           m_priority, 0xffffffff, 0, 0, 0);
+              fluid_msg::of13::EthType ethType (ethTypes[t]);
+              fm.add_oxm_field (ethType);
+              if (r->length > 0)
+                {
+                  fluid_msg::IPAddress value (r->prefix);
+                  fluid_msg::IPAddress mask (PrefixMask (r->length));
+                  if (ethTypes[t] == SDN_ETHERTYPE_IPV4)
+                    {
+                      fluid_msg::of13::IPv4Dst dst (value, mask);
+                      fm.add_oxm_field (dst);
+                    }
+                  else
+                    {
+                      fluid_msg::of13::ARPTPA tpa (value, mask);
+                      fm.add_oxm_field (tpa);
+                    }
+                }
+              fluid_msg::of13::OutputAction act (r->port, 1024);
+              fluid_msg::of13::ApplyActions inst;
+              inst.add_action (act);
+              fm.add_instruction (inst);
+              sdnSwitch13->PreloadFlow (&fm);
+            }
+          installed++;
+        }
+    }
+  return installed;
 }
 
+} //End namespace ns3
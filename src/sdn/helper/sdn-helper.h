@@ -1,12 +1,160 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Jared Ivey <j.ivey@gatech.edu>
+ *          Michael Riley <mriley7@gatech.edu>
+ */
+
 #ifndef SDN_HELPER_H
 #define SDN_HELPER_H
 
+//Stdlib packages
+#include <stdint.h>
+#include <vector>
+//NS3 objects
+#include "ns3/node-container.h"
+#include "ns3/net-device.h"
+#include "ns3/nstime.h"
+#include "ns3/data-rate.h"
+
 namespace ns3 {
 
-/* ... */
+class SdnController;
 
-}
+/**
+ * \ingroup sdn
+ *
+ * \brief Configures SDN fabrics.
+ *
+ * Proactive routing compiles shortest path routes between every pair of hosts
+ * of a static fabric and preloads them into the flow tables of its SdnSwitch
+ * and SdnSwitch13 applications, so traffic is forwarded from the first packet
+ * on without a single PacketIn or FlowMod.
+ *
+ * Routes follow the fewest switch hops to the switch a host is attached to.
+ * Each switch gets one rule per IPv4 prefix rather than per host pair: the
+ * next hops of all hosts are laid out on a binary trie of their addresses and
+ * every largest subtree whose hosts share a next hop becomes a single prefix
+ * rule, so hosts numbered by attachment point collapse to a rule or two per
+ * port. Every prefix is installed twice, matching IPv4 packets on their
+ * destination and ARP packets on their target address, so address resolution
+ * reaches the target host directly instead of being flooded.
+ *
+ * A direct control channel connects switches to their controller without TCP:
+ * each OpenFlow message is handed to the other end by a scheduled event after
+ * the channel's serialization time and delay, dropped with the channel's loss
+ * rate. Messages keep their content, order and handling, only the segments,
+ * acknowledgments and retransmission timers of the TCP stacks are gone.
+ */
+class SdnHelper
+{
+public:
+  SdnHelper ();
 
-#endif /* SDN_HELPER_H */
+  /**
+   * \param priority Priority of the preloaded flows. Defaults to 100
+   */
+  void SetProactivePriority (uint16_t priority) { m_priority = priority; }
+  /**
+   * \param cookie Cookie of the preloaded flows, to tell them apart in flow stats
+   */
+  void SetProactiveCookie (uint64_t cookie) { m_cookie = cookie; }
+
+  /**
+   * \param delay One way delay of direct control channels. Defaults to 1 ms
+   */
+  void SetDirectChannelDelay (Time delay) { m_directDelay = delay; }
+  /**
+   * \param dataRate Byte rate of direct control channels in each direction, taking precedence over
+   * the SdnConnection ChannelDataRate attribute. Defaults to 0, which keeps the attribute
+   */
+  void SetDirectChannelDataRate (DataRate dataRate) { m_directDataRate = dataRate; }
+  /**
+   * \param lossRate Probability a direct control channel drops a message. Defaults to 0
+   */
+  void SetDirectChannelLossRate (double lossRate) { m_directLossRate = lossRate; }
+
+  /**
+   * \brief Connects switches to a controller through direct control channels. The switches
+   * keep their point to point link to the controller, which then carries no control traffic.
+   * Call after the switch applications are installed and before they start.
+   * \param switches Nodes running an SdnSwitch or SdnSwitch13
+   * \param controller The controller, already installed on its node
+   */
+  void InstallDirectControlChannel (NodeContainer switches, Ptr<SdnController> controller);
+  /**
+   * \brief Assigns fixed random variable streams to the controllers of some nodes: their
+   * service times and the message drops of their direct control channels
+   * \param controllers Nodes running an SdnController
+   * \param stream First stream index to use
+   * \return The number of stream indices assigned
+   */
+  int64_t AssignStreams (NodeContainer controllers, int64_t stream);
+
+  /**
+   * \brief Computes routes between every pair of hosts and preloads them into the switches.
+   * Call after the switch applications are installed and before the simulation runs.
+   * \param switches Nodes running an SdnSwitch or SdnSwitch13, wired to each other and to the hosts
+   * \param hosts Nodes with an IPv4 address on their device towards their switch
+   * \return The number of flows installed over all switches
+   */
+  uint32_t InstallProactiveRoutes (NodeContainer switches, NodeContainer hosts);
 
+  /**
+   * \brief The port number a switch gives a device when it starts: data plane
+   * devices are numbered from 1 in device order, skipping the controller port.
+   * \param device A device of a switch node
+   * \return The port number, or 0 for a loopback or controller device
+   */
+  static uint16_t GetSwitchPortNumber (Ptr<NetDevice> device);
+
+private:
+  /// \brief A switch to switch link, from the switch holding it
+  struct Adjacency
+  {
+    uint32_t neighbor; //!< Index of the switch at the other end
+    uint16_t port;     //!< Port the link leaves from
+  };
+  /// \brief A host port of a switch
+  struct Attachment
+  {
+    uint32_t address;  //!< IPv4 address of the host
+    uint16_t port;     //!< Port the host is reached through
+  };
+  /// \brief A destination prefix and the port it leaves from
+  struct Route
+  {
+    uint32_t prefix;   //!< Prefix value
+    uint8_t length;    //!< Prefix length in bits
+    uint16_t port;     //!< Output port
+  };
+  typedef std::pair<uint32_t, uint16_t> NextHop; //!< Host address and output port
+
+  /**
+   * \brief Covers sorted host addresses with the fewest disjoint prefixes of a uniform next hop
+   */
+  static void Aggregate (std::vector<NextHop>::const_iterator begin, std::vector<NextHop>::const_iterator end,
+                         uint32_t prefix, uint8_t length, std::vector<Route> &routes);
+  uint32_t Preload (Ptr<Node> node, const std::vector<Route> &routes);
+
+  uint16_t m_priority; //!< Priority of the preloaded flows
+  uint64_t m_cookie;   //!< Cookie of the preloaded flows
+  Time m_directDelay;         //!< One way delay of direct control channels
+  DataRate m_directDataRate;  //!< Byte rate of direct control channels
+  double m_directLossRate;    //!< Message loss probability of direct control channels
+};
+
+} //End namespace ns3
+#endif /* SDN_HELPER_H */
@@ -208,9 +208,8 @@ Flow::getDurationNSec ()
   return (Simulator::Now ().GetNanoSeconds () - install_time_nsec) % NANOTOSECS;
 }
 
-fluid_msg::of10::FlowStats*
+fluid_msg::of10::FlowStats
 Flow::convertToFlowStats ()
 {
-  fluid_msg::of10::FlowStats* flowStats = new fluid_msg::of10::FlowStats (table_id_, getDurationSec (), getDurationNSec (), priority_, idle_timeout_, hard_timeout_, cookie_, packet_count_, byte_count_);
-  return flowStats;
+  return fluid_msg::of10::FlowStats (table_id_, getDurationSec (), getDurationNSec (), priority_, idle_timeout_, hard_timeout_, cookie_, packet_count_, byte_count_);
 }
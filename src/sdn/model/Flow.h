@@ -31,7 +31,10 @@
 //NS3 Classes
 #include "ns3/simulator.h"
 #include "ns3/packet.h"
-#include "ns3/event-id.h"
+//Stdlib packages
+#include <vector>
+//Sdn classes
+#include "SdnFlowKey.h"
 
 using namespace ns3;
 
@@ -55,12 +58,15 @@ public:
  *
  */
   Flow ()
-  : nw_src_mask (0xffffffff),
+  : entry_id (0),
+    nw_src_mask (0xffffffff),
     nw_dst_mask (0xffffffff),
     match (),
-    actions ()
+    actions (),
+    rewrites_headers (false)
   {
     install_time_nsec = Simulator::Now().GetNanoSeconds();
+    last_used_nsec = install_time_nsec;
   }
   /**
   * \brief Grabs the total time alive in seconds
@@ -74,9 +80,9 @@ public:
   uint64_t getDurationNSec();
   /**
   * \brief Creates a flowstats object from the flow
-  * \return Pointer to a FlowStats object. Defined in libfluid library
+  * \return A FlowStats object. Defined in libfluid library
   */
-  fluid_msg::of10::FlowStats* convertToFlowStats(); //Conversion function to make stats
+  fluid_msg::of10::FlowStats convertToFlowStats(); //Conversion function to make stats
   /**
   * \brief Non-Strict match on a packet
   * \return boolean match
@@ -103,18 +109,21 @@ public:
   uint64_t duration_sec_;        //!< Seconds component of the duration to live
   uint64_t duration_nsec_;       //!< NanoSeconds component of the duration to live
   uint64_t install_time_nsec;    //!< Simulator time the flow is install in nanoseconds
+  uint64_t last_used_nsec;       //!< Simulator time the flow last matched a packet, in nanoseconds
   uint16_t priority_;            //!< Priority level within the flow table for rule resolution
   uint16_t idle_timeout_;        //!< Inactivity timeout in seconds
   uint16_t hard_timeout_;        //!< Hard garenteed timeout in seconds
   uint64_t cookie_;              //!< A controller specified cookie unique per each flow
   uint64_t packet_count_;        //!< A count of packets handled by this flow
   uint64_t byte_count_;          //!< A count of bytes in the packets handled by this flow
+  uint64_t entry_id;             //!< Table assigned insertion order, used to break priority ties
   uint32_t nw_src_mask;          //!< A subnet mask of source IP addresses. Specified as 111 ----- 100
   uint32_t nw_dst_mask;          //!< A subnet mask of destination IP addresses. Specified as 111 ----- 100
-  EventId idle_timeout_event;    //!< An NS3 event to fire a timeout if the idle time is reached
-  EventId hard_timeout_event;    //!< An NS3 event to fire a timeout if the hard time is reached
   fluid_msg::of10::Match match;  //!< A libfluid match object of packets features we match
+  SdnFlowMatch compiled_match;   //!< The match compiled for the table classifier
   fluid_msg::ActionList actions; //!< A libfluid ActionList (vector of actions) to apply to a packet. Only applies if the match is correct
+  std::vector<uint16_t> output_ports; //!< Ports of the output actions, compiled at FlowMod time
+  bool rewrites_headers;         //!< True if the actions hold anything besides outputs
   
 
 };
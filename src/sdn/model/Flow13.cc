@@ -652,9 +652,8 @@ Flow13::getDurationNSec ()
   return (Simulator::Now ().GetNanoSeconds () - install_time_nsec) % NANOTOSECS;
 }
 
-fluid_msg::of13::FlowStats*
+fluid_msg::of13::FlowStats
 Flow13::convertToFlowStats ()
 {
-  fluid_msg::of13::FlowStats* flowStats = new fluid_msg::of13::FlowStats (table_id_, getDurationSec (), getDurationNSec (), priority_, idle_timeout_, hard_timeout_, flags_, cookie_, packet_count_, byte_count_);
-  return flowStats;
+  return fluid_msg::of13::FlowStats (table_id_, getDurationSec (), getDurationNSec (), priority_, idle_timeout_, hard_timeout_, flags_, cookie_, packet_count_, byte_count_);
 }
@@ -0,0 +1,163 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SdnBufferPool.h"
+#include "ns3/log.h"
+#include "ns3/abort.h"
+#include "ns3/simulator.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("SdnBufferPool");
+
+SdnBufferPool::SdnBufferPool ()
+  : m_oldest (SDN_NO_BUFFER),
+    m_newest (SDN_NO_BUFFER),
+    m_used (0),
+    m_maxAge (Seconds (1))
+{
+}
+
+void
+SdnBufferPool::SetCapacity (uint32_t capacity)
+{
+  NS_ABORT_MSG_UNLESS (capacity <= SDN_MAX_BUFFER_SLOTS, "Buffer pool capacity cannot exceed " << SDN_MAX_BUFFER_SLOTS);
+  NS_ABORT_MSG_UNLESS (m_used == 0, "Buffer pool capacity cannot change while packets are buffered");
+  m_slots.assign (capacity, Slot ());
+  m_free.clear ();
+  m_free.reserve (capacity);
+  //Hand out low slots first
+  for (uint32_t i = capacity; i > 0; --i)
+    {
+      m_slots[i - 1].generation = 0;
+      m_free.push_back (i - 1);
+    }
+  m_oldest = m_newest = SDN_NO_BUFFER;
+}
+
+uint32_t
+SdnBufferPool::Store (Ptr<const Packet> packet, uint32_t inPort)
+{
+  if (m_free.empty ())
+    {
+      if (m_oldest == SDN_NO_BUFFER ||
+          Simulator::Now () - m_slots[m_oldest].stored < m_maxAge)
+        {
+          NS_LOG_DEBUG ("All " << m_slots.size () << " buffers in use, sending the packet unbuffered");
+          return SDN_NO_BUFFER;
+        }
+      uint32_t oldest = m_oldest;
+      Ptr<const Packet> evicted = m_slots[oldest].packet;
+      Release (oldest);
+      NS_LOG_DEBUG ("Reclaimed buffer slot " << oldest);
+      if (!m_evict.IsNull ())
+        {
+          m_evict (evicted);
+        }
+    }
+
+  uint32_t index = m_free.back ();
+  m_free.pop_back ();
+  Slot &slot = m_slots[index];
+  slot.packet = packet->Copy ();
+  slot.stored = Simulator::Now ();
+  slot.inPort = inPort;
+  slot.generation++;
+  Link (index);
+  m_used++;
+  return ((uint32_t)slot.generation << 16) | index;
+}
+
+Ptr<Packet>
+SdnBufferPool::Take (uint32_t bufferId, uint32_t *inPort)
+{
+  uint32_t index = bufferId & 0xffff;
+  if (bufferId == SDN_NO_BUFFER || index >= m_slots.size ())
+    {
+      return 0;
+    }
+  Slot &slot = m_slots[index];
+  if (!slot.packet || slot.generation != (uint16_t)(bufferId >> 16))
+    {
+      return 0;
+    }
+  Ptr<Packet> packet = slot.packet;
+  if (inPort)
+    {
+      *inPort = slot.inPort;
+    }
+  Release (index);
+  return packet;
+}
+
+void
+SdnBufferPool::Clear (void)
+{
+  while (m_oldest != SDN_NO_BUFFER)
+    {
+      Release (m_oldest);
+    }
+}
+
+void
+SdnBufferPool::Link (uint32_t index)
+{
+  Slot &slot = m_slots[index];
+  slot.prev = m_newest;
+  slot.next = SDN_NO_BUFFER;
+  if (m_newest != SDN_NO_BUFFER)
+    {
+      m_slots[m_newest].next = index;
+    }
+  else
+    {
+      m_oldest = index;
+    }
+  m_newest = index;
+}
+
+void
+SdnBufferPool::Unlink (uint32_t index)
+{
+  Slot &slot = m_slots[index];
+  if (slot.prev != SDN_NO_BUFFER)
+    {
+      m_slots[slot.prev].next = slot.next;
+    }
+  else
+    {
+      m_oldest = slot.next;
+    }
+  if (slot.next != SDN_NO_BUFFER)
+    {
+      m_slots[slot.next].prev = slot.prev;
+    }
+  else
+    {
+      m_newest = slot.prev;
+    }
+}
+
+void
+SdnBufferPool::Release (uint32_t index)
+{
+  Unlink (index);
+  m_slots[index].packet = 0;
+  m_free.push_back (index);
+  m_used--;
+}
+
+} //End namespace ns3
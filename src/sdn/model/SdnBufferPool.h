@@ -0,0 +1,133 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_BUFFER_POOL_H
+#define SDN_BUFFER_POOL_H
+
+//Stdlib packages
+#include <stdint.h>
+#include <vector>
+//NS3 objects
+#include "ns3/ptr.h"
+#include "ns3/packet.h"
+#include "ns3/nstime.h"
+#include "ns3/callback.h"
+
+#define SDN_NO_BUFFER 0xffffffff     //!< buffer_id of a packet that is not buffered
+#define SDN_MAX_BUFFER_SLOTS 0xffff  //!< Largest pool, slot indexes fit in the low 16 bits of a buffer_id
+
+namespace ns3 {
+
+/**
+ * \ingroup sdn
+ *
+ * \brief Fixed-capacity store for the packets a switch sent to the controller
+ * in PacketIn messages.
+ *
+ * The buffer_id handed out is the slot index in the low 16 bits and a per-slot
+ * generation in the high 16 bits, so a FlowMod or PacketOut naming a buffer
+ * that was released and reused since is recognized as stale instead of
+ * picking up someone else's packet. Free slots are kept on a stack and used
+ * slots on a list in storage order, so storing, taking and reclaiming are all
+ * O(1).
+ *
+ * When every slot is in use, the oldest packet is reclaimed if it has been
+ * buffered for at least the maximum age, as a controller that has not
+ * answered by then is not going to. Otherwise Store fails and the caller sends
+ * the packet unbuffered.
+ */
+class SdnBufferPool
+{
+public:
+  typedef Callback<void, Ptr<const Packet> > EvictCallback; //!< Called for each packet reclaimed before use
+
+  SdnBufferPool ();
+
+  /**
+   * \brief Sets the number of slots. Only allowed while no packet is buffered.
+   * \param capacity Number of slots, at most SDN_MAX_BUFFER_SLOTS. Zero disables buffering.
+   */
+  void SetCapacity (uint32_t capacity);
+  /**
+   * \return The number of slots
+   */
+  uint32_t GetCapacity (void) const { return m_slots.size (); }
+  /**
+   * \param maxAge Age from which a buffered packet may be reclaimed for a new one
+   */
+  void SetMaxAge (Time maxAge) { m_maxAge = maxAge; }
+  /**
+   * \return Age from which a buffered packet may be reclaimed for a new one
+   */
+  Time GetMaxAge (void) const { return m_maxAge; }
+  /**
+   * \param cb Receives every packet reclaimed without having been taken
+   */
+  void SetEvictCallback (EvictCallback cb) { m_evict = cb; }
+
+  /**
+   * \brief Buffers a copy of a packet
+   * \param packet The packet
+   * \param inPort The port the packet arrived on
+   * \return The buffer_id of the packet, or SDN_NO_BUFFER if no slot is available
+   */
+  uint32_t Store (Ptr<const Packet> packet, uint32_t inPort);
+  /**
+   * \brief Removes a packet from the pool
+   * \param bufferId A buffer_id returned by Store
+   * \param inPort Receives the port the packet arrived on, if not 0
+   * \return The packet, or 0 if the buffer_id is unknown, stale or was already taken
+   */
+  Ptr<Packet> Take (uint32_t bufferId, uint32_t *inPort = 0);
+  /**
+   * \return The number of buffered packets
+   */
+  uint32_t GetOccupancy (void) const { return m_used; }
+  /**
+   * \brief Drops every buffered packet
+   */
+  void Clear (void);
+
+private:
+  /// \brief One buffer slot, linked in storage order while used
+  struct Slot
+  {
+    Ptr<Packet> packet;  //!< The buffered packet, 0 while the slot is free
+    Time stored;         //!< Time the packet was buffered
+    uint32_t inPort;     //!< Port the packet arrived on
+    uint16_t generation; //!< Bumped on every store, high half of the buffer_id
+    uint32_t prev;       //!< Previously stored slot, or SDN_NO_BUFFER
+    uint32_t next;       //!< Next stored slot, or SDN_NO_BUFFER
+  };
+
+  void Link (uint32_t index);
+  void Unlink (uint32_t index);
+  void Release (uint32_t index);
+
+  SdnBufferPool (const SdnBufferPool &);
+  SdnBufferPool& operator= (const SdnBufferPool &);
+
+  std::vector<Slot> m_slots;     //!< Every slot, allocated once
+  std::vector<uint32_t> m_free;  //!< Indexes of the free slots
+  uint32_t m_oldest;             //!< First used slot in storage order, or SDN_NO_BUFFER
+  uint32_t m_newest;             //!< Last used slot in storage order, or SDN_NO_BUFFER
+  uint32_t m_used;               //!< Number of used slots
+  Time m_maxAge;                 //!< Age from which the oldest packet may be reclaimed
+  EvictCallback m_evict;         //!< Reclaimed packet handler
+};
+
+} //End namespace ns3
+#endif /* SDN_BUFFER_POOL_H */
@@ -0,0 +1,89 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SdnColorTag.h"
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (SdnColorTag);
+
+SdnColorTag::SdnColorTag ()
+  : m_red (0),
+    m_green (0),
+    m_blue (0)
+{
+}
+
+SdnColorTag::SdnColorTag (uint8_t red, uint8_t green, uint8_t blue)
+  : m_red (red),
+    m_green (green),
+    m_blue (blue)
+{
+}
+
+TypeId
+SdnColorTag::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SdnColorTag")
+    .SetParent<Tag> ()
+    .AddConstructor<SdnColorTag> ()
+  ;
+  return tid;
+}
+
+TypeId
+SdnColorTag::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+SdnColorTag::GetSerializedSize (void) const
+{
+  return 3;
+}
+
+void
+SdnColorTag::Serialize (TagBuffer i) const
+{
+  i.WriteU8 (m_red);
+  i.WriteU8 (m_green);
+  i.WriteU8 (m_blue);
+}
+
+void
+SdnColorTag::Deserialize (TagBuffer i)
+{
+  m_red = i.ReadU8 ();
+  m_green = i.ReadU8 ();
+  m_blue = i.ReadU8 ();
+}
+
+void
+SdnColorTag::Print (std::ostream &os) const
+{
+  os << "rgb=" << (uint32_t)m_red << "," << (uint32_t)m_green << "," << (uint32_t)m_blue;
+}
+
+void
+SdnColorTag::SetColor (uint8_t red, uint8_t green, uint8_t blue)
+{
+  m_red = red;
+  m_green = green;
+  m_blue = blue;
+}
+
+} //End namespace ns3
@@ -0,0 +1,74 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_COLOR_TAG_H
+#define SDN_COLOR_TAG_H
+
+#include "ns3/tag.h"
+#include <iostream>
+
+namespace ns3 {
+
+/**
+ * \ingroup sdn
+ *
+ * \brief Packet tag holding the RGB color a visualizer draws a control packet with.
+ *
+ * Replaces the separate RColorTag, GColorTag and BColorTag, so a colored
+ * packet carries one tag instead of three. Only added when the SdnConnection
+ * ColorTags attribute is set.
+ */
+class SdnColorTag : public Tag
+{
+public:
+  SdnColorTag ();
+  /**
+   * \param red Red component
+   * \param green Green component
+   * \param blue Blue component
+   */
+  SdnColorTag (uint8_t red, uint8_t green, uint8_t blue);
+
+  /**
+   * \brief Get the type ID.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (TagBuffer i) const;
+  virtual void Deserialize (TagBuffer i);
+  virtual void Print (std::ostream &os) const;
+
+  /**
+   * \brief Sets all three components
+   * \param red Red component
+   * \param green Green component
+   * \param blue Blue component
+   */
+  void SetColor (uint8_t red, uint8_t green, uint8_t blue);
+  uint8_t GetRed (void) const { return m_red; }     //!< \return The red component
+  uint8_t GetGreen (void) const { return m_green; } //!< \return The green component
+  uint8_t GetBlue (void) const { return m_blue; }   //!< \return The blue component
+
+private:
+  uint8_t m_red;   //!< Red component
+  uint8_t m_green; //!< Green component
+  uint8_t m_blue;  //!< Blue component
+};
+
+} //End namespace ns3
+#endif /* SDN_COLOR_TAG_H */
@@ -36,4 +36,11 @@ SdnCommon::GenerateXId (void)
   return xIDs; 
 }
 
+uint16_t
+SdnCommon::NextPortNumber (uint16_t lastPort)
+{
+  lastPort++;
+  return lastPort == OFCONTROLLERPORT ? ++lastPort : lastPort;
+}
+
 } //  namespace ns3
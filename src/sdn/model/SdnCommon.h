@@ -43,6 +43,9 @@
 #include <fluid/of10msg.hh>
 //C++ Libraries
 #include <map>
+
+#define OFCONTROLLERPORT 6633 //!< TCP port controllers listen on, never given to a switch port
+
 namespace ns3 {
 
 class Socket;
@@ -73,6 +76,13 @@ public:
    * \return a new unique xID within int form
   */
   static int GenerateXId (void);
+  /**
+   * \brief Numbers the ports of a switch in the order they are added, from one and
+   * skipping OFCONTROLLERPORT. Shared by the switches and SdnHelper so they agree
+   * \param lastPort The number of the previously added port, 0 for the first one
+   * \return The number of the next port
+   */
+  static uint16_t NextPortNumber (uint16_t lastPort);
 
 };
 
@@ -18,9 +18,7 @@
  */
 
 #include "SdnConnection.h"
-  #include "ns3/packet-bcolor-tag.h"
-  #include "ns3/packet-gcolor-tag.h"
-  #include "ns3/packet-rcolor-tag.h"
+#include "SdnColorTag.h"
 
 namespace ns3 {
 
@@ -74,6 +72,12 @@ void
 SdnConnection::DoDispose (void)
 {
   NS_LOG_FUNCTION (this);
+  m_flushEvent.Cancel ();
+  m_drainEvent.Cancel ();
+  m_txQueue.clear ();
+  //The two ends of a direct channel hold each other
+  m_peer = 0;
+  m_receiveCallback = MakeNullCallback<void, Ptr<SdnConnection> > ();
 
   Object::DoDispose ();
 }
@@ -84,6 +88,43 @@ SdnConnection::GetTypeId (void)
   static TypeId tid = TypeId ("ns3::SdnConnection")
     .SetParent<Object> ()
     .AddConstructor<SdnConnection> ()
+    .AddAttribute ("Batching",
+                   "Queue outgoing OpenFlow messages and send them together in one packet per flush.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&SdnConnection::m_batching),
+                   MakeBooleanChecker ())
+    .AddAttribute ("BatchThreshold",
+                   "Number of queued bytes that flushes the batch right away.",
+                   UintegerValue (1460),
+                   MakeUintegerAccessor (&SdnConnection::m_batchThreshold),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("ColorTags",
+                   "Tag every outgoing packet with an SdnColorTag for visualizers, by OpenFlow version.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&SdnConnection::m_colorTags),
+                   MakeBooleanChecker ())
+    .AddAttribute ("ChannelDataRate",
+                   "Byte rate at which the control channel serves queued messages. Zero means no byte limit.",
+                   DataRateValue (DataRate (0)),
+                   MakeDataRateAccessor (&SdnConnection::m_channelDataRate),
+                   MakeDataRateChecker ())
+    .AddAttribute ("ChannelMessageRate",
+                   "Messages per second the control channel serves. Zero means no message limit.",
+                   DoubleValue (0),
+                   MakeDoubleAccessor (&SdnConnection::m_channelMessageRate),
+                   MakeDoubleChecker<double> (0))
+    .AddTraceSource ("TxQueueDepth",
+                     "Number of messages waiting for the control channel",
+                     MakeTraceSourceAccessor (&SdnConnection::m_txQueueDepth),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("TxQueueLatency",
+                     "A message left the queue, with the time it waited for the control channel",
+                     MakeTraceSourceAccessor (&SdnConnection::m_txLatencyTrace),
+                     "ns3::SdnConnection::LatencyTracedCallback")
+    .AddTraceSource ("DirectDrop",
+                     "A message the direct control channel dropped",
+                     MakeTraceSourceAccessor (&SdnConnection::m_directDropTrace),
+                     "ns3::Packet::TracedCallback")
   ;
   return tid;
 }
@@ -102,8 +143,8 @@ SdnConnection::SdnConnection (Ptr<Socket> socket)
   this->set_version (0);
   this->m_applicationData = NULL;
 
-  this->m_lastSendTime = Seconds(0.0);
-  this->m_consecutivePause = 0;
+  this->m_batchVersion = 0;
+  this->m_directLossRate = 0;
 }
 
 SdnConnection::SdnConnection (Ptr<NetDevice> device,
@@ -121,8 +162,8 @@ SdnConnection::SdnConnection (Ptr<NetDevice> device,
   this->set_version (0);
   this->m_applicationData = NULL;
 
-  this->m_lastSendTime = Seconds(0.0);
-  this->m_consecutivePause = 0;
+  this->m_batchVersion = 0;
+  this->m_directLossRate = 0;
 }
 
 SdnConnection::SdnConnection ()
@@ -139,8 +180,8 @@ SdnConnection::SdnConnection ()
   this->set_version (0);
   this->m_applicationData = NULL;
 
-  this->m_lastSendTime = Seconds(0.0);
-  this->m_consecutivePause = 0;
+  this->m_batchVersion = 0;
+  this->m_directLossRate = 0;
 }
 
 SdnConnection::~SdnConnection ()
@@ -225,15 +266,57 @@ SdnConnection::send (void* data, size_t len, uint8_t version )
 {
   NS_LOG_FUNCTION (this << data << len);
 
+  if (m_batching)
+    {
+      return queue ((uint8_t *)data, len, version);
+    }
   Ptr<Packet> packet = Create<Packet> ((uint8_t *)data, len);
 
   return send (packet, version);
 }
 
+uint32_t
+SdnConnection::queue (uint8_t* data, size_t len, uint8_t version)
+{
+  NS_LOG_FUNCTION (this << len);
+
+  //A packet carries a single version tag
+  if (!m_batch.empty () && version != m_batchVersion)
+    {
+      flush ();
+    }
+  m_batch.insert (m_batch.end (), data, data + len);
+  m_batchVersion = version;
+
+  //A barrier leaves right away together with everything queued before it
+  uint8_t type = SdnMessageStream::GetType (data);
+  bool barrier = (SdnMessageStream::GetVersion (data) == fluid_msg::of13::OFP_VERSION) ?
+    (type == fluid_msg::of13::OFPT_BARRIER_REQUEST || type == fluid_msg::of13::OFPT_BARRIER_REPLY) :
+    (type == fluid_msg::of10::OFPT_BARRIER_REQUEST || type == fluid_msg::of10::OFPT_BARRIER_REPLY);
+  if (barrier || m_batch.size () >= m_batchThreshold)
+    {
+      flush ();
+    }
+  else if (!m_flushEvent.IsRunning ())
+    {
+      m_flushEvent = Simulator::ScheduleNow (&SdnConnection::flush, this);
+    }
+  return len;
+}
+
 void
-SdnConnection::StaggerSend (Ptr<Packet> p, uint8_t version)
+SdnConnection::flush ()
 {
-    send (p, version);
+  NS_LOG_FUNCTION (this << m_batch.size ());
+
+  m_flushEvent.Cancel ();
+  if (m_batch.empty ())
+    {
+      return;
+    }
+  Ptr<Packet> packet = Create<Packet> (&m_batch[0], m_batch.size ());
+  m_batch.clear ();
+  send (packet, m_batchVersion);
 }
 
 uint32_t
@@ -250,62 +333,38 @@ SdnConnection::send (fluid_msg::OFMsg* msg)
   else{
 	  version = 0;
   }
-  return send (msg->pack(), msg->length(), version);
-
+  //The data is copied into the packet, so the packed buffer is released right away
+  uint8_t* buffer = msg->pack();
+  uint32_t sent = send (buffer, msg->length(), version);
+  fluid_msg::OFMsg::free_buffer (buffer);
+  return sent;
 }
 
 uint32_t
 SdnConnection::send(Ptr<Packet> p, uint8_t version )
 {
-    Time currentTime = Simulator::Now ();
-    Ptr<Packet> copyPacket = p->Copy ();
-
-    RColorTag rcolor;
-    GColorTag gcolor;
-    BColorTag bcolor;
-
-    if (version == 1){
-        rcolor.SetRColorValue(255);
-        copyPacket->AddPacketTag(rcolor);
-        gcolor.SetGColorValue(0);
-        copyPacket->AddPacketTag(gcolor);
-        bcolor.SetBColorValue(255);
-        copyPacket->AddPacketTag(bcolor);
-    }
-    else if (version == 4){
-        rcolor.SetRColorValue(0);
-        copyPacket->AddPacketTag(rcolor);
-        gcolor.SetGColorValue(255);
-        copyPacket->AddPacketTag(gcolor);
-        bcolor.SetBColorValue(255);
-        copyPacket->AddPacketTag(bcolor);
-    }
-    else{
-        rcolor.SetRColorValue(255);
-        copyPacket->AddPacketTag(rcolor);
-        gcolor.SetGColorValue(255);
-        copyPacket->AddPacketTag(gcolor);
-        bcolor.SetBColorValue(0);
-        copyPacket->AddPacketTag(bcolor);
-    }
-
- 
-    if (currentTime == m_lastSendTime)
-      {
-        m_consecutivePause++;
-        Simulator::ScheduleWithContext (m_id, MicroSeconds (m_consecutivePause),
-        	&SdnConnection::StaggerSend, this, copyPacket, version);
-        return copyPacket->GetSize ();
-      }
-    else
+    Ptr<Packet> copyPacket = p;
+    if (m_colorTags)
       {
-	NS_LOG_DEBUG ("Sending packet on socket of size " << copyPacket->GetSize ()
-		<<  " from connection id=" << get_id ());
-        m_lastSendTime = Simulator::Now ();
-        m_consecutivePause = 0;
-        ++m_sent;
-        return m_socket->Send(copyPacket);
+        //Tagged on a copy so the caller's packet is left alone
+        copyPacket = p->Copy ();
+        if (version == 1)
+          {
+            copyPacket->AddPacketTag (SdnColorTag (255, 0, 255));
+          }
+        else if (version == 4)
+          {
+            copyPacket->AddPacketTag (SdnColorTag (0, 255, 255));
+          }
+        else
+          {
+            copyPacket->AddPacketTag (SdnColorTag (255, 255, 0));
+          }
       }
+
+    TxEntry entry;
+    entry.packet = copyPacket;
+    return enqueue (entry);
 }
 
 uint32_t
@@ -322,37 +381,89 @@ SdnConnection::sendOnNetDevice (Ptr<Packet> p)
 {
   NS_LOG_FUNCTION (this << p);
 
-  ++m_sent;
-
-  NS_LOG_DEBUG ("Sending packet on netdevice of size " << p->GetSize() << 
-                " from connection id=" << get_id ());
-
-  Address src, dst;
-  uint16_t protocol_number;
-  Ptr<Packet> pktToSend = filter (p, &src, &dst, &protocol_number);
-  
   NS_ASSERT_MSG (get_device(), "Attempting to send on NetDevice without a NetDevice");
 
-  Time currentTime = Simulator::Now ();
-  if (currentTime == m_lastSendTime)
+  Address src, dst;
+  uint16_t protocol;
+  Ptr<Packet> packet = filter (p, &src, &dst, &protocol);
+  if (!packet)
     {
-      m_consecutivePause++;
-      Simulator::ScheduleWithContext (m_id, TimeStep (m_consecutivePause),
-	      &SdnConnection::StaggerSendOnNetDevice, this, p);
-      return p->GetSize();
+      NS_LOG_WARN ("Dropping a packet too short to hold an Ethernet header");
+      return 0;
     }
-  else
+
+  //Data plane frames skip the control channel queue, the device queues and paces them itself
+  ++m_sent;
+  NS_LOG_DEBUG ("Sending packet on netdevice of size " << packet->GetSize () <<
+                " from connection id=" << get_id ());
+  get_device ()->SendFrom (packet, src, dst, protocol);
+  return packet->GetSize ();
+}
+
+uint32_t
+SdnConnection::enqueue (TxEntry &entry)
+{
+  NS_LOG_FUNCTION (this << entry.packet);
+
+  entry.enqueued = Simulator::Now ();
+  m_txQueue.push_back (entry);
+  m_txQueueDepth = m_txQueue.size ();
+  if (!m_drainEvent.IsRunning ())
     {
-      m_lastSendTime = Simulator::Now ();
-      m_consecutivePause = 0;
-      return get_device()->SendFrom(pktToSend, src, dst, protocol_number);
+      drain ();
     }
+  return entry.packet->GetSize ();
 }
 
 void
-SdnConnection::StaggerSendOnNetDevice (Ptr<Packet> p)
+SdnConnection::drain ()
 {
-    sendOnNetDevice (p);
+  NS_LOG_FUNCTION (this);
+
+  while (!m_txQueue.empty () && m_channelFreeAt <= Simulator::Now ())
+    {
+      TxEntry entry = m_txQueue.front ();
+      m_txQueue.pop_front ();
+      m_txQueueDepth = m_txQueue.size ();
+      m_txLatencyTrace (entry.packet, Simulator::Now () - entry.enqueued);
+
+      //The channel is busy with this message for its service time
+      Time service = Seconds (0);
+      if (m_channelDataRate.GetBitRate () > 0)
+        {
+          service += m_channelDataRate.CalculateBytesTxTime (entry.packet->GetSize ());
+        }
+      if (m_channelMessageRate > 0)
+        {
+          service += Seconds (1.0 / m_channelMessageRate);
+        }
+      m_channelFreeAt = Simulator::Now () + service;
+
+      ++m_sent;
+      if (m_peer)
+        {
+          if (m_directLossRate > 0 && m_directLoss->GetValue () < m_directLossRate)
+            {
+              NS_LOG_DEBUG ("Direct channel dropped a packet of size " << entry.packet->GetSize () <<
+                            " from connection id=" << get_id ());
+              m_directDropTrace (entry.packet);
+              continue;
+            }
+          //Messages are served in order and all take the same delay, so they arrive in order
+          Simulator::Schedule (service + m_directDelay, &SdnConnection::deliver, m_peer, entry.packet);
+        }
+      else
+        {
+          NS_LOG_DEBUG ("Sending packet on socket of size " << entry.packet->GetSize ()
+                        <<  " from connection id=" << get_id ());
+          m_socket->Send (entry.packet);
+        }
+    }
+  //A send above may have queued more and scheduled the drain already
+  if (!m_txQueue.empty () && !m_drainEvent.IsRunning ())
+    {
+      m_drainEvent = Simulator::Schedule (m_channelFreeAt - Simulator::Now (), &SdnConnection::drain, this);
+    }
 }
 
 Ptr<Packet>
@@ -468,12 +579,74 @@ void SdnConnection::set_application_data (void* data)
   this->m_applicationData = data;
 }
 
+void
+SdnConnection::connect_direct (Ptr<SdnConnection> peer, Time delay, DataRate dataRate, double lossRate,
+                               Ptr<UniformRandomVariable> loss)
+{
+  NS_LOG_FUNCTION (this << peer << delay << dataRate << lossRate << loss);
+
+  m_peer = peer;
+  m_directDelay = delay;
+  if (dataRate.GetBitRate () != 0)
+    {
+      m_channelDataRate = dataRate;
+    }
+  m_directLossRate = lossRate;
+  m_directLoss = loss;
+}
+
+bool
+SdnConnection::is_direct ()
+{
+  return m_peer != 0;
+}
+
+void
+SdnConnection::set_receive_callback (Callback<void, Ptr<SdnConnection> > cb)
+{
+  NS_LOG_FUNCTION (this);
+
+  m_receiveCallback = cb;
+}
+
+void
+SdnConnection::deliver (Ptr<Packet> p)
+{
+  NS_LOG_FUNCTION (this << p);
+
+  NS_LOG_DEBUG ("Direct channel delivered a packet of size " << p->GetSize () << " to connection id=" << get_id ());
+  receive (p);
+  if (!m_receiveCallback.IsNull ())
+    {
+      m_receiveCallback (this);
+    }
+}
+
+void
+SdnConnection::receive (Ptr<Packet> p)
+{
+  NS_LOG_FUNCTION (this << p);
+  m_rxStream.Append (p);
+}
+
+uint8_t*
+SdnConnection::next_message ()
+{
+  uint8_t* message = m_rxStream.Next ();
+  if (message)
+    {
+      ++m_recv;
+    }
+  return message;
+}
+
 void
 SdnConnection::close ()
 {
   NS_LOG_FUNCTION (this);
 
   set_state (fluid_base::OFConnection::STATE_DOWN);
+  m_rxStream.Clear ();
 }
 
 } // End of namespace ns3
@@ -28,10 +28,16 @@
 #include "ns3/ethernet-header.h"
 #include "ns3/ethernet-trailer.h"
 #include "ns3/llc-snap-header.h"
+#include "ns3/data-rate.h"
+#include "ns3/traced-value.h"
+#include "ns3/traced-callback.h"
 
 //NS3 utilities
 #include "ns3/log.h"
 
+//Sdn classes
+#include "SdnMessageStream.h"
+
 //libfluid libraries
 #include <fluid/of10msg.hh>
 #include <fluid/of13msg.hh>
@@ -39,6 +45,7 @@
 
 //C++ Libraries
 #include <vector>
+#include <deque>
 #include <map>
 
 //Openflow global definitions
@@ -169,27 +176,32 @@ public:
   Ptr<NetDevice> get_device();
 
   /**
-  * \brief Send data to through the connection/Net Device. This data gets encapsulated into an OFMsg before being sent
+  * \brief Send data to through the connection/Net Device. This data gets encapsulated into an OFMsg before being sent.
+  * With batching enabled the data is queued instead, see flush.
   * \param data the binary data to send
   * \param len length of the binary data (in bytes)
-  * \return Number of bytes sent. See ns3::Socket
+  * \return Number of bytes sent or queued. See ns3::Socket
   */
   uint32_t send (void* data, size_t len, uint8_t version = 0);
 
   /**
-  * \brief Stagger sending of packets to account for difference in real time versus simulation time in controller applications
-  * \param p Smart pointer to packet
+  * \brief Send every queued message as a single packet. With batching enabled this happens on its own
+  * after a barrier, once the queue reaches the batch threshold, or after the events already due at the
+  * current time step have run.
   */
-  void StaggerSend (Ptr<Packet> p, uint8_t verion=0);
+  void flush ();
+
   /**
   * \brief Send an OFMsg to through the connection/Net Device.
-  * \param msg A libfluid defined OFMsg that is predefined
+  * \param msg A libfluid defined OFMsg that is predefined. Only read, the caller keeps ownership, so
+  * replies are usually automatic objects
   * \return Number of bytes sent. See ns3::Socket
   */
   uint32_t send (fluid_msg::OFMsg* msg);
   /**
-  * \brief Send an OFMsg to through the connection/Net Device.
-  * \param msg A libfluid defined OFMsg that is predefined
+  * \brief Send a packet holding OpenFlow messages through the connection/Net Device.
+  * \param p The packet. Sent as is, not copied, unless ColorTags is set
+  * \param version OpenFlow version of the messages, picks the color tag
   * \return Number of bytes sent. See ns3::Socket
   */
   uint32_t send (Ptr<Packet> p, uint8_t version = 0);
@@ -200,17 +212,46 @@ public:
   */
   uint32_t sendOnNetDevice (void* data, size_t len);
   /**
-  * \brief Send data directly from a netdevice, bypassing the socket.
+  * \brief Send data directly from a netdevice, bypassing the socket and the control channel queue.
   * \param packet Packet to send
-  \return 0 if sent successfully. See ns3::NetDevice
+  \return Size of the frame sent, 0 if it was too short to send
   */
   uint32_t sendOnNetDevice (Ptr<Packet> p);
-  
+
   /**
-  * \brief Stagger sending of packets to account for simultaneous packet sends
-  * \param packet Packet to send
+  * \brief Pairs the connection with its other end for a direct control channel. Messages then go
+  * straight into the receive stream of the peer, a delay after the channel finishes serving them,
+  * instead of through the socket. Set up both ends, each with the parameters of its direction.
+  * \param peer The connection at the other end
+  * \param delay Time a message takes to reach the peer once served
+  * \param dataRate Byte rate the channel serves messages at. Overrides ChannelDataRate, unless 0,
+  * which keeps the rate set through the attribute (no limit by default)
+  * \param lossRate Probability a message is dropped on the way
+  * \param loss Draws the drops. Owned by the controller, so SdnController::AssignStreams covers it
+  */
+  void connect_direct (Ptr<SdnConnection> peer, Time delay, DataRate dataRate, double lossRate,
+                       Ptr<UniformRandomVariable> loss);
+  /**
+  * \brief Whether messages go through a direct control channel rather than the socket
+  */
+  bool is_direct ();
+  /**
+  * \brief Set the function called after a direct channel delivers data to the receive stream. It
+  * takes the messages off with next_message, as a socket receive callback would.
+  * \param cb The callback
+  */
+  void set_receive_callback (Callback<void, Ptr<SdnConnection> > cb);
+
+  /**
+  * \brief Append data read from the socket to the receive stream of the connection
+  * \param p Smart pointer to the received packet
+  */
+  void receive (Ptr<Packet> p);
+  /**
+  * \brief Take the next complete OpenFlow message off the receive stream
+  * \return The start of the message, valid until the next call to receive, or 0 if no complete message is buffered
   */
-  void StaggerSendOnNetDevice (Ptr<Packet> p);
+  uint8_t* next_message ();
 
   /**
    * At times, the controller may want switches to send packets that it
@@ -268,7 +309,48 @@ public:
   uint32_t m_sent; //!< amount of packets sent on connection
   uint32_t m_recv; //!< amount of packets receieved on connection
 
+  /**
+   * TracedCallback signature for a message leaving the send queue.
+   *
+   * \param [in] packet The message.
+   * \param [in] delay Time the message waited in the queue.
+   */
+  typedef void (* LatencyTracedCallback)(Ptr<const Packet> packet, Time delay);
+
 private:
+  /// \brief A message waiting for the control channel
+  struct TxEntry
+  {
+    Ptr<Packet> packet; //!< The message
+    Time enqueued;      //!< Time the message was queued
+  };
+
+  /**
+  * \brief Append a message to the send queue, sending it right away if the channel is idle
+  * \param entry The message, its enqueue time is set here
+  * \return Size of the message
+  */
+  uint32_t enqueue (TxEntry &entry);
+  /**
+  * \brief Send queued messages for as long as the channel is idle, then wait for it to free up
+  */
+  void drain ();
+
+  /**
+  * \brief Hand data sent by the peer over a direct channel to the receive stream
+  * \param p The data
+  */
+  void deliver (Ptr<Packet> p);
+
+  /**
+  * \brief Queue a message for the next flush
+  * \param data the binary message
+  * \param len length of the message (in bytes)
+  * \param version OpenFlow version the packet is tagged with
+  * \return len
+  */
+  uint32_t queue (uint8_t* data, size_t len, uint8_t version);
+
   Ptr<Socket> m_socket; //!< IPv4 Socket
   Ptr<NetDevice> m_device;
 
@@ -279,9 +361,29 @@ private:
   void* m_applicationData; //!< Generic data for use by the SDN application
 
   std::vector< Ptr<SdnTimedCallback> > m_timedCallbacks;
-
-  Time		m_lastSendTime; //!< Last time a packet was sent from this connection
-  uint64_t	m_consecutivePause; //!< Consecutive timestep stagger for simultaneous message sends
+  SdnMessageStream m_rxStream; //!< Received bytes not yet handled, framed into OpenFlow messages
+
+  bool m_batching; //!< Queue outgoing messages and send them together on flush
+  uint32_t m_batchThreshold; //!< Queued bytes that trigger a flush
+  std::vector<uint8_t> m_batch; //!< Messages queued for the next flush
+  uint8_t m_batchVersion; //!< Version the queued messages will be tagged with
+  EventId m_flushEvent; //!< Pending flush at the current time step
+  bool m_colorTags; //!< Tag outgoing packets with an SdnColorTag
+
+  std::deque<TxEntry> m_txQueue; //!< Messages waiting for the control channel
+  DataRate m_channelDataRate; //!< Bytes the channel serves per second, 0 for no limit
+  double m_channelMessageRate; //!< Messages the channel serves per second, 0 for no limit
+  Time m_channelFreeAt; //!< Time the channel finishes serving the last message sent
+  EventId m_drainEvent; //!< Pending drain, running only while messages wait for the channel
+  TracedValue<uint32_t> m_txQueueDepth; //!< Messages waiting for the control channel
+  TracedCallback<Ptr<const Packet>, Time> m_txLatencyTrace; //!< Fired as a message leaves the queue
+
+  Ptr<SdnConnection> m_peer; //!< Other end of a direct control channel, 0 when sending through the socket
+  Time m_directDelay; //!< Time a message takes to reach the peer once served
+  double m_directLossRate; //!< Probability a message to the peer is dropped
+  Ptr<UniformRandomVariable> m_directLoss; //!< Draws the message drops
+  Callback<void, Ptr<SdnConnection> > m_receiveCallback; //!< Called after a direct channel delivers data
+  TracedCallback<Ptr<const Packet> > m_directDropTrace; //!< Fired for a message the direct channel drops
 };
 
 } // namespace ns3
@@ -34,22 +34,83 @@ SdnController::GetTypeId (void)
   static TypeId tid = TypeId ("ns3::SdnController")
     .SetParent<Application> ()
     .AddConstructor<SdnController> ()
+    .AddAttribute ("Workers",
+                   "Workers of the processing model. Zero handles every message the moment it is received.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&SdnController::m_nWorkers),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("QueueLimit",
+                   "Messages a worker holds, the one in service included, before dropping new ones. Zero means no limit.",
+                   UintegerValue (1000),
+                   MakeUintegerAccessor (&SdnController::m_queueLimit),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("Sharding",
+                   "How messages are spread over the workers.",
+                   EnumValue (SHARD_BY_SWITCH),
+                   MakeEnumAccessor (&SdnController::m_sharding),
+                   MakeEnumChecker (SHARD_BY_SWITCH, "Switch",
+                                    SHARD_ROUND_ROBIN, "RoundRobin",
+                                    SHARD_LEAST_LOADED, "LeastLoaded"))
+    .AddAttribute ("ServiceTime",
+                   "Seconds a worker spends on a message without a service time of its own.",
+                   StringValue ("ns3::ConstantRandomVariable[Constant=0.0]"),
+                   MakePointerAccessor (&SdnController::m_serviceTime),
+                   MakePointerChecker<RandomVariableStream> ())
+    .AddAttribute ("PacketInServiceTime",
+                   "Seconds a worker spends on a packet in message. Unset means ServiceTime.",
+                   PointerValue (),
+                   MakePointerAccessor (&SdnController::m_packetInServiceTime),
+                   MakePointerChecker<RandomVariableStream> ())
+    .AddTraceSource ("QueueDepth",
+                     "Number of messages queued or in service over all workers",
+                     MakeTraceSourceAccessor (&SdnController::m_queueDepth),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("WorkerQueueDepth",
+                     "The queue of a worker changed, with its number of messages queued or in service",
+                     MakeTraceSourceAccessor (&SdnController::m_workerDepthTrace),
+                     "ns3::SdnController::WorkerDepthTracedCallback")
+    .AddTraceSource ("QueueWait",
+                     "A message started service, with the time it waited for its worker",
+                     MakeTraceSourceAccessor (&SdnController::m_waitTrace),
+                     "ns3::SdnController::WaitTracedCallback")
+    .AddTraceSource ("QueueDrop",
+                     "A message was dropped at the full queue of its worker",
+                     MakeTraceSourceAccessor (&SdnController::m_dropTrace),
+                     "ns3::SdnController::DropTracedCallback")
   ;
   return tid;
 }
 
 SdnController::SdnController (Ptr<SdnListener> listener)
-: ofsc (fluid_base::OFServerSettings ()),
+: m_directDelay (MilliSeconds (1)),
+  m_directDataRate (DataRate (0)),
+  m_directLossRate (0),
+  m_directLoss (CreateObject<UniformRandomVariable> ()),
+  m_nWorkers (0),
+  m_queueLimit (1000),
+  m_sharding (SHARD_BY_SWITCH),
+  m_nextWorker (0),
+  ofsc (fluid_base::OFServerSettings ()),
   event_listener (listener)
 {
   NS_LOG_FUNCTION (this);
+  InitMessageHandlers ();
 }
 
 SdnController::SdnController ()
-: ofsc (fluid_base::OFServerSettings ())
+: m_directDelay (MilliSeconds (1)),
+  m_directDataRate (DataRate (0)),
+  m_directLossRate (0),
+  m_directLoss (CreateObject<UniformRandomVariable> ()),
+  m_nWorkers (0),
+  m_queueLimit (1000),
+  m_sharding (SHARD_BY_SWITCH),
+  m_nextWorker (0),
+  ofsc (fluid_base::OFServerSettings ())
 {
   NS_LOG_FUNCTION (this);
   event_listener = CreateObject<BaseLearningSwitch> ();
+  InitMessageHandlers ();
 }
 
 SdnController::~SdnController ()
@@ -68,6 +129,18 @@ SdnController::DoDispose (void)
 	      << " Not my system ID so no dispose yet" << std::endl;
       return;
     }
+  for (std::vector<Ptr<SdnConnection> >::iterator i = m_directConnections.begin (); i != m_directConnections.end (); ++i)
+    {
+      (*i)->Dispose ();
+    }
+  m_directConnections.clear ();
+  for (std::vector<Worker>::iterator i = m_workers.begin (); i != m_workers.end (); ++i)
+    {
+      i->done.Cancel ();
+    }
+  m_workers.clear ();
+  m_shards.clear ();
+  m_typeServiceTimes.clear ();
   Application::DoDispose ();
 }
 
@@ -110,16 +183,42 @@ SdnController::HandleAccept (Ptr<Socket> s, const Address& from)
       m_switchMap[s] = c;
 
       m_switchMap[s]->set_state (fluid_base::OFConnection::STATE_HANDSHAKE);
-      fluid_msg::of10::Hello* helloMessage = new fluid_msg::of10::Hello (SdnCommon::GenerateXId());
-      if (helloMessage)
-      	{
-	  NS_LOG_INFO ("Controller sending Hello message");
-	  m_switchMap[s]->send (helloMessage);
-	  NS_LOG_INFO (Simulator::Now().GetSeconds() << " Connection accepted");
-      	}
+      fluid_msg::of10::Hello helloMessage (SdnCommon::GenerateXId());
+      NS_LOG_INFO ("Controller sending Hello message");
+      m_switchMap[s]->send (&helloMessage);
+      NS_LOG_INFO (Simulator::Now().GetSeconds() << " Connection accepted");
     }
 }
 
+void
+SdnController::SetDirectChannel (Time delay, DataRate dataRate, double lossRate)
+{
+  NS_LOG_FUNCTION (this << delay << dataRate << lossRate);
+  m_directDelay = delay;
+  m_directDataRate = dataRate;
+  m_directLossRate = lossRate;
+}
+
+Ptr<SdnConnection>
+SdnController::ConnectDirect (Ptr<SdnConnection> switchConn)
+{
+  NS_LOG_FUNCTION (this << switchConn);
+
+  Ptr<SdnConnection> c = CreateObject<SdnConnection> ();
+  c->connect_direct (switchConn, m_directDelay, m_directDataRate, m_directLossRate, m_directLoss);
+  switchConn->connect_direct (c, m_directDelay, m_directDataRate, m_directLossRate, m_directLoss);
+  c->set_receive_callback (MakeCallback (&SdnController::HandleMessages, this));
+  m_directConnections.push_back (c);
+
+  //From here on the same as a switch accepted over TCP
+  c->set_state (fluid_base::OFConnection::STATE_HANDSHAKE);
+  fluid_msg::of10::Hello helloMessage (SdnCommon::GenerateXId());
+  NS_LOG_INFO ("Controller sending Hello message");
+  c->send (&helloMessage);
+  NS_LOG_INFO (Simulator::Now().GetSeconds() << " Direct connection accepted");
+  return c;
+}
+
 void SdnController::HandlePeerClose (Ptr<Socket> socket)
 {
   NS_LOG_FUNCTION (this << socket);
@@ -149,107 +248,295 @@ SdnController::HandleRead (Ptr<Socket> socket)
                        InetSocketAddress::ConvertFrom (from).GetPort ());
         }
 
-      packet->RemoveAllPacketTags ();
-      packet->RemoveAllByteTags ();
-
       NS_LOG_DEBUG ("Controller recv " << packet->GetSize () << " bytes");
+      c->receive (packet);
+    }
+  HandleMessages (c);
+}
+
+void
+SdnController::HandleMessages (Ptr<SdnConnection> c)
+{
+  NS_LOG_FUNCTION (this << c);
 
-      uint8_t buffer[packet->GetSize ()];
-      packet->CopyData (buffer,packet->GetSize ());
-      fluid_msg::OFMsg* message = new fluid_msg::OFMsg (buffer);
+  //Messages can span or share segments, the connection hands back whole ones
+  uint8_t* buffer;
+  while ((buffer = c->next_message ()))
+    {
+      uint8_t type = SdnMessageStream::GetType (buffer);
       if (c->get_state () == fluid_base::OFConnection::STATE_HANDSHAKE)
         {
-          if (ofsc.handshake () && message->type () == fluid_msg::of10::OFPT_HELLO)
+          if (ofsc.handshake () && type == fluid_msg::of10::OFPT_HELLO)
             {
-              fluid_msg::of10::Hello* helloMessage = new fluid_msg::of10::Hello ();
-              helloMessage->unpack(buffer);
-              
-              if (OFHandle_Hello_Reply (socket, message)) return;
+              fluid_msg::OFMsg message (buffer);
+              OFHandle_Hello_Reply (c, &message);
             }
-          else if (message->type () == fluid_msg::of10::OFPT_FEATURES_REPLY)
+          else if (type == fluid_msg::of10::OFPT_FEATURES_REPLY)
             {
-              fluid_msg::of10::FeaturesReply* featuresReply = new fluid_msg::of10::FeaturesReply ();
-              featuresReply->unpack(buffer);
-              OFHandle_Features_Reply (socket, featuresReply);
+              fluid_msg::of10::FeaturesReply featuresReply;
+              featuresReply.unpack(buffer);
+              OFHandle_Features_Reply (c, &featuresReply);
 
               // With the connection established, report SwitchUpEvent to the SdnListener.
               NS_LOG_INFO( Simulator::Now ().GetSeconds () << " SWITCH_UP_EVENT" );
-              SwitchUpEvent* sue = new SwitchUpEvent (c, (void*)featuresReply->pack(), featuresReply->length());
-              Simulator::ScheduleNow ( &SdnListener::event_callback, event_listener, sue);
+              if (!event_listener->Dispatch (c, buffer))
+                {
+                  SwitchUpEvent sue (c, buffer, SdnMessageStream::GetLength (buffer));
+                  event_listener->event_callback (&sue);
+                }
             }
           else
             {
-              if ( OFHandle_Errors (socket,
-                                    message->xid(),
-                                    fluid_msg::of10::OFPET_HELLO_FAILED,
-                                    fluid_msg::of10::OFPHFC_INCOMPATIBLE) ) return;
+              OFHandle_Errors (c,
+                               SdnMessageStream::GetXid (buffer),
+                               fluid_msg::of10::OFPET_HELLO_FAILED,
+                               fluid_msg::of10::OFPHFC_INCOMPATIBLE);
             }
         }
       else if (c->get_state () == fluid_base::OFConnection::STATE_RUNNING)
         {
-          if (message->type () == fluid_msg::of10::OFPT_PACKET_IN)
-            {
-              fluid_msg::of10::PacketIn* packetIn = new fluid_msg::of10::PacketIn ();
-              packetIn->unpack(buffer);
-              PacketInEvent* pie = new PacketInEvent (c, (void*)packetIn->pack(), packetIn->length());
-              Simulator::ScheduleNow ( &SdnListener::event_callback, event_listener, pie);
-            }
-          else if (message->type () == fluid_msg::of10::OFPT_FLOW_REMOVED)
-            {
-              fluid_msg::of10::FlowRemoved* flowRemoved = new fluid_msg::of10::FlowRemoved ();
-              flowRemoved->unpack(buffer);
-              FlowRemovedEvent* fre = new FlowRemovedEvent (c, (void*)flowRemoved->pack(), flowRemoved->length());
-              Simulator::ScheduleNow ( &SdnListener::event_callback, event_listener, fre);
-            }
-          else if (message->type () == fluid_msg::of10::OFPT_PORT_STATUS)
+          if (m_nWorkers == 0)
             {
-              fluid_msg::of10::PortStatus* portStat = new fluid_msg::of10::PortStatus ();
-              portStat->unpack(buffer);
-              PortStatusEvent* pse = new PortStatusEvent (c, (void*)portStat->pack(), portStat->length());
-              Simulator::ScheduleNow ( &SdnListener::event_callback, event_listener, pse);
+              HandleMessage (c, buffer);
             }
-          else if (message->type () == fluid_msg::of10::OFPT_STATS_REPLY)
+          else
             {
-              fluid_msg::of10::StatsReply* statsReply = new fluid_msg::of10::StatsReply ();
-              statsReply->unpack(buffer);
-              StatsReplyEvent* sre = new StatsReplyEvent (c, (void*)statsReply->pack(), statsReply->length());
-              Simulator::ScheduleNow ( &SdnListener::event_callback, event_listener, sre);
+              Enqueue (c, buffer);
             }
         }
       else
         {
           c->set_state (fluid_base::OFConnection::STATE_DOWN);
         }
-      delete (message);
     }
 }
 
-int
-SdnController::OFHandle_Hello_Reply (Ptr<Socket> socket, fluid_msg::OFMsg* message)
+void
+SdnController::HandleMessage (Ptr<SdnConnection> c, uint8_t* buffer)
+{
+  //Types the listener subscribed to skip the events
+  if (event_listener->Dispatch (c, buffer))
+    {
+      return;
+    }
+  uint32_t key = ((uint32_t)SdnMessageStream::GetVersion (buffer) << 8) | SdnMessageStream::GetType (buffer);
+  if (key < m_messageHandlers.size () && m_messageHandlers[key])
+    {
+      (this->*m_messageHandlers[key]) (c, buffer);
+    }
+}
+
+void
+SdnController::Enqueue (Ptr<SdnConnection> c, uint8_t* buffer)
 {
-  NS_LOG_FUNCTION (this << socket << message);
+  NS_LOG_FUNCTION (this << c);
 
-  Ptr<SdnConnection> c = m_switchMap[socket];
-  fluid_msg::of10::Hello* helloMessage = static_cast<fluid_msg::of10::Hello*> (message);
+  if (m_workers.empty ())
+    {
+      m_workers.resize (m_nWorkers);
+    }
+  uint32_t index = PickWorker (c);
+  Worker &worker = m_workers[index];
+  if (m_queueLimit > 0 && worker.queue.size () >= m_queueLimit)
+    {
+      NS_LOG_DEBUG ("Worker " << index << " full, dropping a message from connection id=" << c->get_id ());
+      m_dropTrace (index, SdnMessageStream::GetType (buffer));
+      return;
+    }
 
-  if (helloMessage && NegotiateVersion (helloMessage))
+  Job job;
+  job.connection = c;
+  job.message.assign (buffer, buffer + SdnMessageStream::GetLength (buffer));
+  job.arrived = Simulator::Now ();
+  worker.queue.push_back (job);
+  ++m_queueDepth;
+  m_workerDepthTrace (index, worker.queue.size ());
+  if (worker.queue.size () == 1)
     {
-      fluid_msg::of10::FeaturesRequest* featureRequest = new fluid_msg::of10::FeaturesRequest (SdnCommon::GenerateXId());
+      StartService (index);
+    }
+}
 
-      if (featureRequest)
+uint32_t
+SdnController::PickWorker (Ptr<SdnConnection> c)
+{
+  uint32_t index = 0;
+  switch (m_sharding)
+    {
+    case SHARD_ROUND_ROBIN:
+      index = m_nextWorker++ % m_workers.size ();
+      break;
+    case SHARD_LEAST_LOADED:
+      for (uint32_t i = 1; i < m_workers.size (); ++i)
         {
-          return c->send(featureRequest);
+          if (m_workers[i].queue.size () < m_workers[index].queue.size ())
+            {
+              index = i;
+            }
         }
+      break;
+    default:
+      {
+        //Connection ids interleave with those of other nodes, so assign workers in turn instead
+        std::map<Ptr<SdnConnection>, uint32_t>::iterator shard = m_shards.find (c);
+        if (shard == m_shards.end ())
+          {
+            shard = m_shards.insert (std::make_pair (c, m_nextWorker++ % m_workers.size ())).first;
+          }
+        index = shard->second;
+      }
+      break;
     }
-  return 0;
+  return index;
 }
 
 void
-SdnController::OFHandle_Features_Reply (Ptr<Socket> socket, fluid_msg::OFMsg* message)
+SdnController::StartService (uint32_t index)
 {
-  NS_LOG_FUNCTION (this << socket << message);
+  Worker &worker = m_workers[index];
+  Job &job = worker.queue.front ();
+  uint8_t* buffer = &job.message[0];
+  uint8_t type = SdnMessageStream::GetType (buffer);
+  m_waitTrace (index, type, Simulator::Now () - job.arrived);
+
+  double service = 0;
+  Ptr<RandomVariableStream> serviceTime = GetServiceTime (SdnMessageStream::GetVersion (buffer), type);
+  if (serviceTime)
+    {
+      service = std::max (serviceTime->GetValue (), 0.0);
+    }
+  worker.done = Simulator::Schedule (Seconds (service), &SdnController::FinishService, this, index);
+}
 
-  Ptr<SdnConnection> c = m_switchMap[socket];
+void
+SdnController::FinishService (uint32_t index)
+{
+  NS_LOG_FUNCTION (this << index);
+
+  Job job;
+  job.connection = m_workers[index].queue.front ().connection;
+  job.message.swap (m_workers[index].queue.front ().message);
+  m_workers[index].queue.pop_front ();
+  --m_queueDepth;
+  m_workerDepthTrace (index, m_workers[index].queue.size ());
+
+  //The switch may have gone down while the message waited
+  if (job.connection->get_state () == fluid_base::OFConnection::STATE_RUNNING)
+    {
+      HandleMessage (job.connection, &job.message[0]);
+    }
+  if (!m_workers[index].queue.empty ())
+    {
+      StartService (index);
+    }
+}
+
+Ptr<RandomVariableStream>
+SdnController::GetServiceTime (uint8_t version, uint8_t type) const
+{
+  std::map<uint16_t, Ptr<RandomVariableStream> >::const_iterator i = m_typeServiceTimes.find (version << 8 | type);
+  if (i != m_typeServiceTimes.end ())
+    {
+      return i->second;
+    }
+  //Packet in has the same type number in every version
+  if (type == fluid_msg::of10::OFPT_PACKET_IN && m_packetInServiceTime)
+    {
+      return m_packetInServiceTime;
+    }
+  return m_serviceTime;
+}
+
+void
+SdnController::SetServiceTime (uint8_t version, uint8_t type, Ptr<RandomVariableStream> serviceTime)
+{
+  NS_LOG_FUNCTION (this << (uint32_t)version << (uint32_t)type << serviceTime);
+  m_typeServiceTimes[version << 8 | type] = serviceTime;
+}
+
+int64_t
+SdnController::AssignStreams (int64_t stream)
+{
+  NS_LOG_FUNCTION (this << stream);
+  int64_t assigned = 0;
+  if (m_serviceTime)
+    {
+      m_serviceTime->SetStream (stream + assigned++);
+    }
+  if (m_packetInServiceTime)
+    {
+      m_packetInServiceTime->SetStream (stream + assigned++);
+    }
+  m_directLoss->SetStream (stream + assigned++);
+  for (std::map<uint16_t, Ptr<RandomVariableStream> >::iterator i = m_typeServiceTimes.begin (); i != m_typeServiceTimes.end (); ++i)
+    {
+      i->second->SetStream (stream + assigned++);
+    }
+  return assigned;
+}
+
+void
+SdnController::OFHandle_Packet_In (Ptr<SdnConnection> c, uint8_t* buffer)
+{
+  PacketInEvent pie (c, buffer, SdnMessageStream::GetLength (buffer));
+  event_listener->event_callback (&pie);
+}
+
+void
+SdnController::OFHandle_Flow_Removed (Ptr<SdnConnection> c, uint8_t* buffer)
+{
+  FlowRemovedEvent fre (c, buffer, SdnMessageStream::GetLength (buffer));
+  event_listener->event_callback (&fre);
+}
+
+void
+SdnController::OFHandle_Port_Status (Ptr<SdnConnection> c, uint8_t* buffer)
+{
+  PortStatusEvent pse (c, buffer, SdnMessageStream::GetLength (buffer));
+  event_listener->event_callback (&pse);
+}
+
+void
+SdnController::OFHandle_Stats_Reply (Ptr<SdnConnection> c, uint8_t* buffer)
+{
+  StatsReplyEvent sre (c, buffer, SdnMessageStream::GetLength (buffer));
+  event_listener->event_callback (&sre);
+}
+
+void
+SdnController::InitMessageHandlers (void)
+{
+  uint32_t of10 = (uint32_t)fluid_msg::of10::OFP_VERSION << 8;
+  uint32_t of13 = (uint32_t)fluid_msg::of13::OFP_VERSION << 8;
+  m_messageHandlers.assign (of13 + fluid_msg::of13::OFPT_METER_MOD + 1, 0);
+  m_messageHandlers[of10 | fluid_msg::of10::OFPT_PACKET_IN] = &SdnController::OFHandle_Packet_In;
+  m_messageHandlers[of10 | fluid_msg::of10::OFPT_FLOW_REMOVED] = &SdnController::OFHandle_Flow_Removed;
+  m_messageHandlers[of10 | fluid_msg::of10::OFPT_PORT_STATUS] = &SdnController::OFHandle_Port_Status;
+  m_messageHandlers[of10 | fluid_msg::of10::OFPT_STATS_REPLY] = &SdnController::OFHandle_Stats_Reply;
+  m_messageHandlers[of13 | fluid_msg::of13::OFPT_PACKET_IN] = &SdnController::OFHandle_Packet_In;
+  m_messageHandlers[of13 | fluid_msg::of13::OFPT_FLOW_REMOVED] = &SdnController::OFHandle_Flow_Removed;
+  m_messageHandlers[of13 | fluid_msg::of13::OFPT_PORT_STATUS] = &SdnController::OFHandle_Port_Status;
+  m_messageHandlers[of13 | fluid_msg::of13::OFPT_MULTIPART_REPLY] = &SdnController::OFHandle_Stats_Reply;
+}
+
+int
+SdnController::OFHandle_Hello_Reply (Ptr<SdnConnection> c, fluid_msg::OFMsg* message)
+{
+  NS_LOG_FUNCTION (this << c << message);
+  fluid_msg::of10::Hello* helloMessage = static_cast<fluid_msg::of10::Hello*> (message);
+
+  if (helloMessage && NegotiateVersion (helloMessage))
+    {
+      fluid_msg::of10::FeaturesRequest featureRequest (SdnCommon::GenerateXId());
+      return c->send(&featureRequest);
+    }
+  return 0;
+}
+
+void
+SdnController::OFHandle_Features_Reply (Ptr<SdnConnection> c, fluid_msg::OFMsg* message)
+{
+  NS_LOG_FUNCTION (this << c << message);
 
   c->set_version (message->version ());
   c->set_state (fluid_base::OFConnection::STATE_RUNNING);
@@ -262,21 +549,13 @@ SdnController::OFHandle_Features_Reply (Ptr<Socket> socket, fluid_msg::OFMsg* me
 }
 
 int
-SdnController::OFHandle_Errors (Ptr<Socket> socket, int xid, uint16_t err_type, uint16_t code)
+SdnController::OFHandle_Errors (Ptr<SdnConnection> c, int xid, uint16_t err_type, uint16_t code)
 {
-  NS_LOG_FUNCTION (this << socket << err_type << code);
-
-  Ptr<SdnConnection> c = m_switchMap[socket];
+  NS_LOG_FUNCTION (this << c << err_type << code);
 
   c->set_state (fluid_base::OFConnection::STATE_FAILED);
-  fluid_msg::of10::Error* errorResponse = new fluid_msg::of10::Error (xid,
-                                                                      err_type,
-                                                                      code);
-  if (errorResponse)
-    {
-      return c->send(errorResponse);
-    }
-  return 0;
+  fluid_msg::of10::Error errorResponse (xid, err_type, code);
+  return c->send(&errorResponse);
 }
 
 bool
@@ -48,6 +48,9 @@
 #include "ns3/string.h"
 #include "ns3/integer.h"
 #include "ns3/uinteger.h"
+#include "ns3/pointer.h"
+#include "ns3/traced-value.h"
+#include "ns3/traced-callback.h"
 
 //libfluid libraries
 #include <fluid/of10/openflow-10.h>
@@ -58,10 +61,12 @@
 
 //C++ Libraries
 #include <map>
+#include <vector>
+#include <deque>
+#include <algorithm>
 
 //Openflow global definitions
 #define OFVERSION 0x01 //Openflow version 10
-#define OFCONTROLLERPORT 6633 //Openflow version 10 port
 namespace ns3 {
 
 class SdnConnection;
@@ -73,10 +78,27 @@ class SdnListener;
  *
  * This application is meant to represent a Controller within an Openflow-enabled network
  * Every SdnController must come with an SdnListener to define the behavior of the controller
+ *
+ * By default messages are handled the moment they are received. With Workers set, the messages of
+ * running connections go through a processing model instead: they are queued at one of a number of
+ * workers, each serving its queue in order and handling a message once a service time drawn for its
+ * type has passed, so replies leave only then and a controller can saturate. Messages arriving at a
+ * full queue are dropped. The Sharding attribute picks the worker: per switch keeps the messages of
+ * a switch in order, round robin and least loaded spread a busy switch over all workers but may
+ * reorder its messages. Handshake messages are always handled on receipt.
  */
 
 class SdnController : public Application
 {
+public:
+  /// \brief How the processing model picks the worker of a message
+  enum ShardingPolicy
+  {
+    SHARD_BY_SWITCH,    //!< All messages of a connection go to one worker, connections assigned in turn
+    SHARD_ROUND_ROBIN,  //!< Messages go to the workers in turn
+    SHARD_LEAST_LOADED  //!< Messages go to the worker with the shortest queue
+  };
+
 protected:
   /**
    * \brief Handles the deconstructing inheritance from ns3::object
@@ -92,40 +114,143 @@ private:
    */
   virtual void StopApplication (void);
   /**
-   * \brief Given the current state of the SdnConnection, either handle internet processing (OFHandle), or create an event for the SdnListener to handle data from the read.
+   * \brief Reads what the socket has into its connection and handles the messages
    * \param socket Socket object we're receiving from
    */
   void HandleRead (Ptr<Socket> socket);
+  /**
+   * \brief Takes the complete OpenFlow messages off the connection and, given its current state, either handles them here (OFHandle) or passes them to the SdnListener, through the handlers it subscribed to their type if any and as an event otherwise.
+   * \param c The connection that received data
+   */
+  void HandleMessages (Ptr<SdnConnection> c);
   /**
    * \brief Negotiate the openflow version with the switch, and create a feature request to the switch.
-   * \param socket Socket object we're receiving from
+   * \param c The connection we're receiving from
    * \param message The hello message we initially received
    * \return 0 if feature request did not send correctly, non-zero otherwise
    */
-  int  OFHandle_Hello_Reply (Ptr<Socket> socket, fluid_msg::OFMsg* message);
+  int  OFHandle_Hello_Reply (Ptr<SdnConnection> c, fluid_msg::OFMsg* message);
   /**
    * \brief Negotiate the openflow version with the switch, and create a feature request to the switch.
-   * \param socket Socket object we're receiving from
+   * \param c The connection we're receiving from
    * \param message The features reply message we initially received
    * \return 0 if feature request did not send correctly, non-zero otherwise
    */
-  void OFHandle_Features_Reply (Ptr<Socket> socket, fluid_msg::OFMsg* message);
+  void OFHandle_Features_Reply (Ptr<SdnConnection> c, fluid_msg::OFMsg* message);
   /**
    * \brief If a libfluid error message gets sent during handshaking, return an error repsonse
-   * \param socket Socket object we're receiving from
+   * \param c The connection we're receiving from
    * \param xid The unique id of the original error message
    * \param err_type The type of error received
    * \param code The error code to parse the specific type of error being handled
    * \return 0 if error reponse was not sent, return non-zero otherwise
    */
-  int  OFHandle_Errors (Ptr<Socket> socket, int xid, uint16_t err_type, uint16_t code);
+  int  OFHandle_Errors (Ptr<SdnConnection> c, int xid, uint16_t err_type, uint16_t code);
   /**
    * \brief A boolean checker to make sure that we have compatible versions of openflow running on both sides
    * \brief message A message from the switch we're nogotiating with. Always carrys the version number within
    * \return True if versions are compatible, false otherwise
    */
   bool NegotiateVersion (fluid_msg::OFMsg* message);
+  /**
+   * \brief Hands a packet in message to the SdnListener as a PacketInEvent on the stack
+   * \param c The connection the message arrived on
+   * \param buffer The message, owned by the connection
+   */
+  void OFHandle_Packet_In (Ptr<SdnConnection> c, uint8_t* buffer);
+  /**
+   * \brief Hands a flow removed message to the SdnListener as a FlowRemovedEvent on the stack
+   * \param c The connection the message arrived on
+   * \param buffer The message, owned by the connection
+   */
+  void OFHandle_Flow_Removed (Ptr<SdnConnection> c, uint8_t* buffer);
+  /**
+   * \brief Hands a port status message to the SdnListener as a PortStatusEvent on the stack
+   * \param c The connection the message arrived on
+   * \param buffer The message, owned by the connection
+   */
+  void OFHandle_Port_Status (Ptr<SdnConnection> c, uint8_t* buffer);
+  /**
+   * \brief Hands a stats reply message to the SdnListener as a StatsReplyEvent on the stack
+   * \param c The connection the message arrived on
+   * \param buffer The message, owned by the connection
+   */
+  void OFHandle_Stats_Reply (Ptr<SdnConnection> c, uint8_t* buffer);
+  /**
+   * \brief Hands a message of a running connection to the SdnListener
+   * \param c The connection the message arrived on
+   * \param buffer The message
+   */
+  void HandleMessage (Ptr<SdnConnection> c, uint8_t* buffer);
+  /**
+   * \brief Fills m_messageHandlers
+   */
+  void InitMessageHandlers (void);
+
+  /// \brief A message waiting for a worker
+  struct Job
+  {
+    Ptr<SdnConnection> connection; //!< The connection the message arrived on
+    std::vector<uint8_t> message;  //!< Copy of the message, the connection reuses its buffer
+    Time arrived;                  //!< Time the message was queued
+  };
+  /// \brief A worker of the processing model, serving the job at the head of its queue
+  struct Worker
+  {
+    std::deque<Job> queue; //!< Jobs in arrival order, the first one in service
+    EventId done;          //!< End of the service of the first job
+  };
+
+  /**
+   * \brief Queues a message of a running connection at a worker, or drops it if the queue is full
+   * \param c The connection the message arrived on
+   * \param buffer The message, copied
+   */
+  void Enqueue (Ptr<SdnConnection> c, uint8_t* buffer);
+  /**
+   * \param c The connection a message arrived on
+   * \return The worker to queue the message at, by the Sharding policy
+   */
+  uint32_t PickWorker (Ptr<SdnConnection> c);
+  /**
+   * \brief Starts serving the first job of a worker
+   * \param index The worker
+   */
+  void StartService (uint32_t index);
+  /**
+   * \brief Handles the job in service at a worker and starts the next one
+   * \param index The worker
+   */
+  void FinishService (uint32_t index);
+  /**
+   * \param version OpenFlow version of a message
+   * \param type Type of the message
+   * \return The service time to draw for the message
+   */
+  Ptr<RandomVariableStream> GetServiceTime (uint8_t version, uint8_t type) const;
+
+  typedef void (SdnController::*MessageHandler) (Ptr<SdnConnection> c, uint8_t* buffer); //!< Handler of one OpenFlow message type
+  std::vector<MessageHandler> m_messageHandlers; //!< Event handlers of running connections indexed by version << 8 | type, 0 for ignored types
   std::map<Ptr<Socket>, Ptr<SdnConnection> > m_switchMap; //!< A map of socket objects we receive data from to SdnConnections to encapsulate the connection
+  std::vector<Ptr<SdnConnection> > m_directConnections; //!< Connections of switches attached through a direct control channel
+  Time m_directDelay; //!< One way delay of direct control channels
+  DataRate m_directDataRate; //!< Byte rate of direct control channels, 0 to keep the ChannelDataRate of the connections
+  double m_directLossRate; //!< Probability a direct control channel drops a message
+  Ptr<UniformRandomVariable> m_directLoss; //!< Draws the drops of every direct control channel
+
+  uint32_t m_nWorkers; //!< Workers of the processing model, 0 to handle messages on receipt
+  uint32_t m_queueLimit; //!< Messages a worker holds, the one in service included, 0 for no limit
+  enum ShardingPolicy m_sharding; //!< How messages are spread over the workers
+  Ptr<RandomVariableStream> m_serviceTime; //!< Service time of messages without one of their own, in seconds
+  Ptr<RandomVariableStream> m_packetInServiceTime; //!< Service time of packet in messages, 0 to use m_serviceTime
+  std::map<uint16_t, Ptr<RandomVariableStream> > m_typeServiceTimes; //!< Service times by version << 8 | type
+  std::vector<Worker> m_workers; //!< Workers of the processing model, created with the first message
+  std::map<Ptr<SdnConnection>, uint32_t> m_shards; //!< Worker of each connection under SHARD_BY_SWITCH
+  uint32_t m_nextWorker; //!< Next worker to assign, to a connection or to a message under SHARD_ROUND_ROBIN
+  TracedValue<uint32_t> m_queueDepth; //!< Messages queued or in service over all workers
+  TracedCallback<uint32_t, uint32_t> m_workerDepthTrace; //!< Fired as the queue of a worker changes
+  TracedCallback<uint32_t, uint8_t, Time> m_waitTrace; //!< Fired as a message starts service
+  TracedCallback<uint32_t, uint8_t> m_dropTrace; //!< Fired for a message dropped at a full queue
   fluid_base::OFServerSettings ofsc;
   Ptr<SdnListener> event_listener; //!< The listener that defines the controller behavior when handling most SdnSwitch messages
   
@@ -135,10 +260,65 @@ public:
    * \return the object TypeId
    */
   static TypeId GetTypeId (void);
+
+  /**
+   * TracedCallback signature for the queue of a worker changing.
+   *
+   * \param [in] worker The worker.
+   * \param [in] depth Messages queued or in service at the worker.
+   */
+  typedef void (* WorkerDepthTracedCallback)(uint32_t worker, uint32_t depth);
+  /**
+   * TracedCallback signature for a message starting service.
+   *
+   * \param [in] worker The worker serving it.
+   * \param [in] type The OpenFlow message type.
+   * \param [in] wait Time the message waited in the queue.
+   */
+  typedef void (* WaitTracedCallback)(uint32_t worker, uint8_t type, Time wait);
+  /**
+   * TracedCallback signature for a message dropped at a full queue.
+   *
+   * \param [in] worker The worker it was meant for.
+   * \param [in] type The OpenFlow message type.
+   */
+  typedef void (* DropTracedCallback)(uint32_t worker, uint8_t type);
+
   SdnController (Ptr<SdnListener> listener);
   SdnController ();
   virtual ~SdnController ();
 
+  /**
+   * \brief Sets the channel of the switches that connect directly from now on
+   * \param delay One way delay
+   * \param dataRate Byte rate in each direction. 0 keeps the ChannelDataRate attribute of the connections
+   * \param lossRate Probability a message is dropped, in each direction
+   */
+  void SetDirectChannel (Time delay, DataRate dataRate, double lossRate);
+  /**
+   * \brief Accepts a switch over a direct control channel rather than TCP, and starts the handshake.
+   * Only works within one simulation process: the channel is a scheduled event, not a link.
+   * \param switchConn The connection of the switch, not yet connected to anything
+   * \return The connection of the controller to the switch
+   */
+  Ptr<SdnConnection> ConnectDirect (Ptr<SdnConnection> switchConn);
+
+  /**
+   * \brief Sets the service time of one message type in the processing model, over the
+   * PacketInServiceTime and ServiceTime attributes
+   * \param version OpenFlow version of the messages
+   * \param type Message type in that version
+   * \param serviceTime Service time in seconds, negative draws count as 0
+   */
+  void SetServiceTime (uint8_t version, uint8_t type, Ptr<RandomVariableStream> serviceTime);
+  /**
+   * \brief Assigns fixed random variable streams to the service times and to the message
+   * drops of the direct control channels
+   * \param stream First stream index to use
+   * \return The number of stream indices assigned
+   */
+  int64_t AssignStreams (int64_t stream);
+
   void HandleAccept (Ptr<Socket> s, const Address& from);
   void HandlePeerClose (Ptr<Socket> socket);
   void HandlePeerError (Ptr<Socket> socket);
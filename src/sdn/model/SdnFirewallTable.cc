@@ -0,0 +1,440 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SdnFirewallTable.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <sstream>
+
+#define SDN_FIREWALL_NONE 0xffffffff //!< No node or rule
+#define SDN_FIREWALL_TCP 6
+#define SDN_FIREWALL_UDP 17
+
+namespace ns3 {
+
+/* Network mask of a prefix length */
+static uint32_t
+PrefixMask (uint8_t length)
+{
+  return length == 0 ? 0 : 0xffffffff << (32 - length);
+}
+
+static bool
+PrefixCovers (uint32_t prefix, uint8_t length, uint32_t other, uint8_t otherLength)
+{
+  return length <= otherLength && ((prefix ^ other) & PrefixMask (length)) == 0;
+}
+
+static std::string
+Trim (const std::string &text)
+{
+  size_t first = text.find_first_not_of (" \t\r\n");
+  if (first == std::string::npos)
+    {
+      return "";
+    }
+  return text.substr (first, text.find_last_not_of (" \t\r\n") - first + 1);
+}
+
+static bool
+ParsePrefix (const std::string &text, uint32_t &prefix, uint8_t &length)
+{
+  unsigned a, b, c, d, len = 32;
+  char tail;
+  int fields = sscanf (text.c_str (), "%u.%u.%u.%u/%u%c", &a, &b, &c, &d, &len, &tail);
+  if ((fields != 4 && fields != 5) || a > 255 || b > 255 || c > 255 || d > 255 || len > 32)
+    {
+      return false;
+    }
+  if (fields == 4 && text.find ('/') != std::string::npos)
+    {
+      return false;
+    }
+  length = len;
+  prefix = ((a << 24) | (b << 16) | (c << 8) | d) & PrefixMask (length);
+  return true;
+}
+
+static bool
+ParsePorts (const std::string &text, uint16_t &min, uint16_t &max)
+{
+  if (text == "*")
+    {
+      min = 0;
+      max = 0xffff;
+      return true;
+    }
+  unsigned low, high;
+  char tail;
+  int fields = sscanf (text.c_str (), "%u-%u%c", &low, &high, &tail);
+  if (fields == 1)
+    {
+      high = low;
+    }
+  else if (fields != 2)
+    {
+      return false;
+    }
+  if (low > high || high > 0xffff)
+    {
+      return false;
+    }
+  min = low;
+  max = high;
+  return true;
+}
+
+/* Merges sibling prefixes of every length, longest first, into their parent */
+static void
+MergeSiblings (std::map<uint8_t, std::set<uint32_t> > &byLength)
+{
+  for (uint8_t length = 32; length > 0; --length)
+    {
+      std::map<uint8_t, std::set<uint32_t> >::iterator level = byLength.find (length);
+      if (level == byLength.end ())
+        {
+          continue;
+        }
+      uint32_t bit = 1u << (32 - length);
+      std::set<uint32_t> kept;
+      for (std::set<uint32_t>::const_iterator i = level->second.begin (); i != level->second.end (); ++i)
+        {
+          //Prefixes of one length are sorted, a sibling with the bit set comes right after
+          std::set<uint32_t>::const_iterator next = i;
+          ++next;
+          if (!(*i & bit) && next != level->second.end () && *next == (*i | bit))
+            {
+              byLength[length - 1].insert (*i);
+              i = next;
+            }
+          else
+            {
+              kept.insert (*i);
+            }
+        }
+      level->second.swap (kept);
+    }
+}
+
+bool
+SdnFirewallRule::Covers (const SdnFirewallRule &other) const
+{
+  if (!PrefixCovers (src, srcLen, other.src, other.srcLen)
+      || !PrefixCovers (dst, dstLen, other.dst, other.dstLen))
+    {
+      return false;
+    }
+  if (proto != 0 && proto != other.proto)
+    {
+      return false;
+    }
+  if (!HasPorts ())
+    {
+      return true;
+    }
+  //Port ranges only match TCP and UDP, so other must be limited to those too
+  bool otherTransport = other.HasPorts () || other.proto == SDN_FIREWALL_TCP || other.proto == SDN_FIREWALL_UDP;
+  return otherTransport
+         && srcPortMin <= other.srcPortMin && other.srcPortMax <= srcPortMax
+         && dstPortMin <= other.dstPortMin && other.dstPortMax <= dstPortMax;
+}
+
+bool
+SdnFirewallRule::Parse (const std::string &line, SdnFirewallRule &rule)
+{
+  std::vector<std::string> fields;
+  std::stringstream stream (line);
+  std::string field;
+  while (std::getline (stream, field, ','))
+    {
+      fields.push_back (Trim (field));
+    }
+  if (fields.size () < 2 || fields.size () > 5)
+    {
+      return false;
+    }
+
+  SdnFirewallRule parsed;
+  if (!ParsePrefix (fields[0], parsed.src, parsed.srcLen) || !ParsePrefix (fields[1], parsed.dst, parsed.dstLen))
+    {
+      return false;
+    }
+  if (fields.size () > 2 && fields[2] != "*")
+    {
+      if (fields[2] == "tcp")
+        {
+          parsed.proto = SDN_FIREWALL_TCP;
+        }
+      else if (fields[2] == "udp")
+        {
+          parsed.proto = SDN_FIREWALL_UDP;
+        }
+      else if (fields[2] == "icmp")
+        {
+          parsed.proto = 1;
+        }
+      else
+        {
+          char* end;
+          unsigned long proto = strtoul (fields[2].c_str (), &end, 10);
+          if (*end != '\0' || proto == 0 || proto > 255)
+            {
+              return false;
+            }
+          parsed.proto = proto;
+        }
+    }
+  if (fields.size () > 3 && !ParsePorts (fields[3], parsed.dstPortMin, parsed.dstPortMax))
+    {
+      return false;
+    }
+  if (fields.size () > 4 && !ParsePorts (fields[4], parsed.srcPortMin, parsed.srcPortMax))
+    {
+      return false;
+    }
+  if (parsed.HasPorts () && parsed.proto != 0 && parsed.proto != SDN_FIREWALL_TCP && parsed.proto != SDN_FIREWALL_UDP)
+    {
+      return false;
+    }
+  rule = parsed;
+  return true;
+}
+
+bool
+SdnFirewallRule::operator< (const SdnFirewallRule &other) const
+{
+  if (src != other.src) return src < other.src;
+  if (srcLen != other.srcLen) return srcLen < other.srcLen;
+  if (dst != other.dst) return dst < other.dst;
+  if (dstLen != other.dstLen) return dstLen < other.dstLen;
+  if (proto != other.proto) return proto < other.proto;
+  if (srcPortMin != other.srcPortMin) return srcPortMin < other.srcPortMin;
+  if (srcPortMax != other.srcPortMax) return srcPortMax < other.srcPortMax;
+  if (dstPortMin != other.dstPortMin) return dstPortMin < other.dstPortMin;
+  return dstPortMax < other.dstPortMax;
+}
+
+bool
+SdnFirewallRule::operator== (const SdnFirewallRule &other) const
+{
+  return !(*this < other) && !(other < *this);
+}
+
+SdnFirewallTable::Node::Node ()
+  : next (SDN_FIREWALL_NONE)
+{
+  child[0] = SDN_FIREWALL_NONE;
+  child[1] = SDN_FIREWALL_NONE;
+}
+
+SdnFirewallTable::SdnFirewallTable ()
+{
+  Clear ();
+}
+
+uint32_t
+SdnFirewallTable::NewNode (void)
+{
+  m_nodes.push_back (Node ());
+  return m_nodes.size () - 1;
+}
+
+uint32_t
+SdnFirewallTable::Walk (uint32_t root, uint32_t address, uint8_t length)
+{
+  uint32_t node = root;
+  for (uint8_t depth = 0; depth < length; ++depth)
+    {
+      uint32_t bit = (address >> (31 - depth)) & 1;
+      if (m_nodes[node].child[bit] == SDN_FIREWALL_NONE)
+        {
+          //NewNode may move the array, index it again after
+          uint32_t created = NewNode ();
+          m_nodes[node].child[bit] = created;
+        }
+      node = m_nodes[node].child[bit];
+    }
+  return node;
+}
+
+bool
+SdnFirewallTable::Add (SdnFirewallRule rule)
+{
+  rule.src &= PrefixMask (rule.srcLen);
+  rule.dst &= PrefixMask (rule.dstLen);
+
+  uint32_t srcNode = Walk (0, rule.src, rule.srcLen);
+  if (m_nodes[srcNode].next == SDN_FIREWALL_NONE)
+    {
+      uint32_t root = NewNode ();
+      m_nodes[srcNode].next = root;
+    }
+  uint32_t dstNode = Walk (m_nodes[srcNode].next, rule.dst, rule.dstLen);
+  for (uint32_t i = m_nodes[dstNode].next; i != SDN_FIREWALL_NONE; i = m_nextRule[i])
+    {
+      if (m_rules[i] == rule)
+        {
+          return false;
+        }
+    }
+  m_rules.push_back (rule);
+  m_nextRule.push_back (m_nodes[dstNode].next);
+  m_nodes[dstNode].next = m_rules.size () - 1;
+  return true;
+}
+
+const SdnFirewallRule*
+SdnFirewallTable::Lookup (uint32_t src, uint32_t dst, uint8_t proto, uint16_t srcPort, uint16_t dstPort) const
+{
+  bool transport = proto == SDN_FIREWALL_TCP || proto == SDN_FIREWALL_UDP;
+  uint32_t srcNode = 0;
+  for (uint8_t srcDepth = 0; ; ++srcDepth)
+    {
+      uint32_t dstNode = m_nodes[srcNode].next;
+      for (uint8_t dstDepth = 0; dstNode != SDN_FIREWALL_NONE; ++dstDepth)
+        {
+          for (uint32_t i = m_nodes[dstNode].next; i != SDN_FIREWALL_NONE; i = m_nextRule[i])
+            {
+              const SdnFirewallRule &rule = m_rules[i];
+              if ((rule.proto == 0 || rule.proto == proto)
+                  && (!rule.HasPorts ()
+                      || (transport
+                          && rule.srcPortMin <= srcPort && srcPort <= rule.srcPortMax
+                          && rule.dstPortMin <= dstPort && dstPort <= rule.dstPortMax)))
+                {
+                  return &rule;
+                }
+            }
+          if (dstDepth == 32)
+            {
+              break;
+            }
+          dstNode = m_nodes[dstNode].child[(dst >> (31 - dstDepth)) & 1];
+        }
+      if (srcDepth == 32)
+        {
+          break;
+        }
+      srcNode = m_nodes[srcNode].child[(src >> (31 - srcDepth)) & 1];
+      if (srcNode == SDN_FIREWALL_NONE)
+        {
+          break;
+        }
+    }
+  return 0;
+}
+
+bool
+SdnFirewallTable::IsCovered (const SdnFirewallRule &rule, uint32_t index) const
+{
+  //Only rules at prefixes of rule's own prefixes can cover it
+  uint32_t srcNode = 0;
+  for (uint8_t srcDepth = 0; srcNode != SDN_FIREWALL_NONE; ++srcDepth)
+    {
+      uint32_t dstNode = m_nodes[srcNode].next;
+      for (uint8_t dstDepth = 0; dstNode != SDN_FIREWALL_NONE; ++dstDepth)
+        {
+          for (uint32_t i = m_nodes[dstNode].next; i != SDN_FIREWALL_NONE; i = m_nextRule[i])
+            {
+              if (i != index && m_rules[i].Covers (rule))
+                {
+                  return true;
+                }
+            }
+          if (dstDepth == rule.dstLen)
+            {
+              break;
+            }
+          dstNode = m_nodes[dstNode].child[(rule.dst >> (31 - dstDepth)) & 1];
+        }
+      if (srcDepth == rule.srcLen)
+        {
+          break;
+        }
+      srcNode = m_nodes[srcNode].child[(rule.src >> (31 - srcDepth)) & 1];
+    }
+  return false;
+}
+
+void
+SdnFirewallTable::Compile (std::vector<SdnFirewallRule> &rules) const
+{
+  rules.clear ();
+
+  //Rules by everything but the destination, then merge destinations
+  typedef std::map<SdnFirewallRule, std::map<uint8_t, std::set<uint32_t> > > PrefixGroups;
+  PrefixGroups byDst;
+  for (uint32_t i = 0; i < m_rules.size (); ++i)
+    {
+      if (IsCovered (m_rules[i], i))
+        {
+          continue;
+        }
+      SdnFirewallRule key = m_rules[i];
+      key.dst = 0;
+      key.dstLen = 0;
+      byDst[key][m_rules[i].dstLen].insert (m_rules[i].dst);
+    }
+
+  //Then by everything but the source, and merge sources
+  PrefixGroups bySrc;
+  for (PrefixGroups::iterator group = byDst.begin (); group != byDst.end (); ++group)
+    {
+      MergeSiblings (group->second);
+      for (std::map<uint8_t, std::set<uint32_t> >::const_iterator level = group->second.begin ();
+           level != group->second.end (); ++level)
+        {
+          for (std::set<uint32_t>::const_iterator dst = level->second.begin (); dst != level->second.end (); ++dst)
+            {
+              SdnFirewallRule key = group->first;
+              key.src = 0;
+              key.srcLen = 0;
+              key.dst = *dst;
+              key.dstLen = level->first;
+              bySrc[key][group->first.srcLen].insert (group->first.src);
+            }
+        }
+    }
+
+  for (PrefixGroups::iterator group = bySrc.begin (); group != bySrc.end (); ++group)
+    {
+      MergeSiblings (group->second);
+      for (std::map<uint8_t, std::set<uint32_t> >::const_iterator level = group->second.begin ();
+           level != group->second.end (); ++level)
+        {
+          for (std::set<uint32_t>::const_iterator src = level->second.begin (); src != level->second.end (); ++src)
+            {
+              SdnFirewallRule rule = group->first;
+              rule.src = *src;
+              rule.srcLen = level->first;
+              rules.push_back (rule);
+            }
+        }
+    }
+}
+
+void
+SdnFirewallTable::Clear (void)
+{
+  m_nodes.assign (1, Node ());
+  m_rules.clear ();
+  m_nextRule.clear ();
+}
+
+} //End namespace ns3
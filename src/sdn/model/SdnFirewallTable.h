@@ -0,0 +1,157 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_FIREWALL_TABLE_H
+#define SDN_FIREWALL_TABLE_H
+
+//Stdlib packages
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup sdn
+ *
+ * \brief One blacklist entry: IPv4 traffic from a source prefix to a
+ * destination prefix, optionally narrowed to an IP protocol and port ranges.
+ * Addresses are in host order. The default rule matches every IPv4 packet.
+ */
+struct SdnFirewallRule
+{
+  SdnFirewallRule ()
+    : src (0), srcLen (0), dst (0), dstLen (0), proto (0),
+      srcPortMin (0), srcPortMax (0xffff), dstPortMin (0), dstPortMax (0xffff) {}
+  uint32_t src;        //!< Source prefix
+  uint8_t srcLen;      //!< Source prefix length, 0 to 32
+  uint32_t dst;        //!< Destination prefix
+  uint8_t dstLen;      //!< Destination prefix length, 0 to 32
+  uint8_t proto;       //!< IP protocol, 0 for any
+  uint16_t srcPortMin; //!< Lowest TCP or UDP source port
+  uint16_t srcPortMax; //!< Highest TCP or UDP source port
+  uint16_t dstPortMin; //!< Lowest TCP or UDP destination port
+  uint16_t dstPortMax; //!< Highest TCP or UDP destination port
+
+  /**
+   * \return True if the rule only matches some ports, and so only TCP and UDP
+   */
+  bool HasPorts (void) const
+  {
+    return srcPortMin != 0 || srcPortMax != 0xffff || dstPortMin != 0 || dstPortMax != 0xffff;
+  }
+  /**
+   * \param other Another rule
+   * \return True if every packet other matches is matched by this rule too
+   */
+  bool Covers (const SdnFirewallRule &other) const;
+  /**
+   * \brief Parses "src/len,dst/len[,proto[,dstport[-dstport][,srcport[-srcport]]]]",
+   * where proto is a number, tcp, udp or *, and a missing /len means /32
+   * \param line The rule text
+   * \param rule Receives the rule
+   * \return True if the line is a well formed rule
+   */
+  static bool Parse (const std::string &line, SdnFirewallRule &rule);
+
+  bool operator< (const SdnFirewallRule &other) const;
+  bool operator== (const SdnFirewallRule &other) const;
+};
+
+/**
+ * \ingroup sdn
+ *
+ * \brief IPv4 blacklist of a controller, looked up by source and destination
+ * prefix and, within a prefix pair, by protocol and port range.
+ *
+ * Rules sit in a two level binary trie: a trie on the source address, where
+ * the node of each source prefix that has rules roots a trie on the
+ * destination address holding the rules at the node of their destination
+ * prefix. A lookup follows the packet's source address and, at each source
+ * prefix on the way that has rules, its destination address, checking the
+ * rules met against the protocol and ports. A packet is thus decided in one
+ * walk of the address bits per source prefix covering it, however many rules
+ * the table has. Nodes are indices into one array, so the tries hold no
+ * pointers and are freed in one go.
+ *
+ * Compile reduces the rule set to what a switch has to hold: rules covered by
+ * another rule are dropped and sibling prefixes with the same protocol and
+ * ports are merged into their parent, on destinations and then on sources.
+ */
+class SdnFirewallTable
+{
+public:
+  SdnFirewallTable ();
+
+  /**
+   * \brief Adds a rule. Address bits past the prefix lengths are ignored
+   * \param rule The rule
+   * \return False if the table already has the same rule
+   */
+  bool Add (SdnFirewallRule rule);
+  /**
+   * \param src Source address
+   * \param dst Destination address
+   * \param proto IP protocol
+   * \param srcPort TCP or UDP source port, 0 for other protocols
+   * \param dstPort TCP or UDP destination port, 0 for other protocols
+   * \return The first rule found to match, or 0 if the packet is allowed. Valid until the next Add
+   */
+  const SdnFirewallRule* Lookup (uint32_t src, uint32_t dst, uint8_t proto, uint16_t srcPort, uint16_t dstPort) const;
+  /**
+   * \param rules Receives a reduced set of rules matching the same packets as the table
+   */
+  void Compile (std::vector<SdnFirewallRule> &rules) const;
+  /**
+   * \brief Removes every rule
+   */
+  void Clear (void);
+
+  /**
+   * \return The number of rules
+   */
+  uint32_t GetNRules (void) const { return m_rules.size (); }
+  /**
+   * \return The number of trie nodes, to size the table's memory
+   */
+  uint32_t GetNNodes (void) const { return m_nodes.size (); }
+
+private:
+  /// \brief A node of either trie
+  struct Node
+  {
+    Node ();
+    uint32_t child[2]; //!< Nodes one bit longer, if any
+    uint32_t next;     //!< Source trie: root of its destination trie; destination trie: first of its rules
+  };
+
+  uint32_t NewNode (void);
+  /**
+   * \brief Finds the node of a prefix below root, creating the missing ones
+   */
+  uint32_t Walk (uint32_t root, uint32_t address, uint8_t length);
+  /**
+   * \return True if a rule other than the one at index covers rule
+   */
+  bool IsCovered (const SdnFirewallRule &rule, uint32_t index) const;
+
+  std::vector<Node> m_nodes;            //!< Nodes of every trie, m_nodes[0] is the source root
+  std::vector<SdnFirewallRule> m_rules; //!< Rules in the order added
+  std::vector<uint32_t> m_nextRule;     //!< Next rule at the same destination node
+};
+
+} //End namespace ns3
+#endif /* SDN_FIREWALL_TABLE_H */
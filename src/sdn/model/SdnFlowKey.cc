@@ -0,0 +1,367 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SdnFlowKey.h"
+#include "ns3/hash.h"
+#include "ns3/log.h"
+
+#include <fluid/of10/openflow-10.h>
+#include <fluid/of13/openflow-13.h>
+#include <fluid/of13/of13match.hh>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("SdnFlowKey");
+
+/* Copies a field of n bytes into value and mask. The value is stored masked
+ * so equal matches always compare equal bytewise. */
+static inline void
+set_field (uint8_t *value, uint8_t *mask, const uint8_t *v, const uint8_t *m, uint32_t n)
+{
+  for (uint32_t i = 0; i < n; ++i)
+    {
+      mask[i] = m[i];
+      value[i] = v[i] & m[i];
+    }
+}
+
+static inline void
+set_field32 (uint8_t *value, uint8_t *mask, uint32_t v, uint32_t m)
+{
+  set_field (value, mask, (const uint8_t *)&v, (const uint8_t *)&m, sizeof (uint32_t));
+}
+
+std::size_t
+SdnFlowKeyHash::operator() (const SdnFlowKey &key) const
+{
+  return Hash32 ((const char *)&key, sizeof (SdnFlowKey));
+}
+
+SdnFlowMatch::SdnFlowMatch ()
+  : m_value (),
+    m_mask (),
+    m_metadata (0),
+    m_metadataMask (0)
+{
+}
+
+SdnFlowMatch
+SdnFlowMatch::FromOf10 (fluid_msg::of10::Match match, uint32_t nwSrcIgnore, uint32_t nwDstIgnore)
+{
+  SdnFlowMatch compiled;
+  SdnFlowKey &value = compiled.m_value;
+  SdnFlowKey &mask = compiled.m_mask;
+  uint32_t wildcards = match.wildcards ();
+
+  if (!(wildcards & fluid_msg::of10::OFPFW_IN_PORT))
+    {
+      value.in_port = match.in_port ();
+      mask.in_port = 0xffffffff;
+    }
+  if (!(wildcards & fluid_msg::of10::OFPFW_DL_SRC))
+    {
+      std::memcpy (value.dl_src, match.dl_src ().get_data (), sizeof (value.dl_src));
+      std::memset (mask.dl_src, 0xff, sizeof (mask.dl_src));
+    }
+  if (!(wildcards & fluid_msg::of10::OFPFW_DL_DST))
+    {
+      std::memcpy (value.dl_dst, match.dl_dst ().get_data (), sizeof (value.dl_dst));
+      std::memset (mask.dl_dst, 0xff, sizeof (mask.dl_dst));
+    }
+  if (!(wildcards & fluid_msg::of10::OFPFW_DL_VLAN))
+    {
+      value.dl_vlan = match.dl_vlan ();
+      mask.dl_vlan = 0xffff;
+    }
+  if (!(wildcards & fluid_msg::of10::OFPFW_DL_VLAN_PCP))
+    {
+      value.dl_vlan_pcp = match.dl_vlan_pcp ();
+      mask.dl_vlan_pcp = 0xff;
+    }
+  if (!(wildcards & fluid_msg::of10::OFPFW_DL_TYPE))
+    {
+      value.dl_type = match.dl_type ();
+      mask.dl_type = 0xffff;
+    }
+  if (!(wildcards & fluid_msg::of10::OFPFW_NW_TOS))
+    {
+      value.nw_tos = match.nw_tos ();
+      mask.nw_tos = 0xff;
+    }
+  if (!(wildcards & fluid_msg::of10::OFPFW_NW_PROTO))
+    {
+      value.nw_proto = match.nw_proto ();
+      mask.nw_proto = 0xff;
+    }
+  if (!(wildcards & fluid_msg::of10::OFPFW_TP_SRC))
+    {
+      value.tp_src = match.tp_src ();
+      mask.tp_src = 0xffff;
+    }
+  if (!(wildcards & fluid_msg::of10::OFPFW_TP_DST))
+    {
+      value.tp_dst = match.tp_dst ();
+      mask.tp_dst = 0xffff;
+    }
+  set_field32 (value.nw_src, mask.nw_src, match.nw_src ().getIPv4 (), ~nwSrcIgnore);
+  set_field32 (value.nw_dst, mask.nw_dst, match.nw_dst ().getIPv4 (), ~nwDstIgnore);
+  return compiled;
+}
+
+SdnFlowMatch
+SdnFlowMatch::FromOf13 (fluid_msg::of13::Match match)
+{
+  SdnFlowMatch compiled;
+  SdnFlowKey &value = compiled.m_value;
+  SdnFlowKey &mask = compiled.m_mask;
+  uint8_t allOnes[16];
+  std::memset (allOnes, 0xff, sizeof (allOnes));
+
+  for (uint32_t field = 0; field <= fluid_msg::of13::OFPXMT_OFB_IPV6_EXTHDR; ++field)
+    {
+      fluid_msg::of13::OXMTLV *tlv = match.oxm_field (field);
+      if (!tlv)
+        {
+          continue;
+        }
+      switch (field)
+        {
+        case fluid_msg::of13::OFPXMT_OFB_IN_PORT:
+          value.in_port = dynamic_cast<fluid_msg::of13::InPort *> (tlv)->value ();
+          mask.in_port = 0xffffffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_IN_PHY_PORT:
+          value.in_port = dynamic_cast<fluid_msg::of13::InPhyPort *> (tlv)->value ();
+          mask.in_port = 0xffffffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_METADATA:
+          {
+            // Metadata is pipeline state rather than a header field, so it is kept out of the key
+            fluid_msg::of13::Metadata *oxm = dynamic_cast<fluid_msg::of13::Metadata *> (tlv);
+            compiled.m_metadataMask = oxm->has_mask () ? oxm->mask () : 0xffffffffffffffffULL;
+            compiled.m_metadata = oxm->value () & compiled.m_metadataMask;
+            break;
+          }
+        case fluid_msg::of13::OFPXMT_OFB_ETH_DST:
+          {
+            fluid_msg::of13::EthDst *oxm = dynamic_cast<fluid_msg::of13::EthDst *> (tlv);
+            set_field (value.dl_dst, mask.dl_dst, oxm->value ().get_data (),
+                       oxm->has_mask () ? oxm->mask ().get_data () : allOnes, sizeof (value.dl_dst));
+            break;
+          }
+        case fluid_msg::of13::OFPXMT_OFB_ETH_SRC:
+          {
+            fluid_msg::of13::EthSrc *oxm = dynamic_cast<fluid_msg::of13::EthSrc *> (tlv);
+            set_field (value.dl_src, mask.dl_src, oxm->value ().get_data (),
+                       oxm->has_mask () ? oxm->mask ().get_data () : allOnes, sizeof (value.dl_src));
+            break;
+          }
+        case fluid_msg::of13::OFPXMT_OFB_ETH_TYPE:
+          value.dl_type = dynamic_cast<fluid_msg::of13::EthType *> (tlv)->value ();
+          mask.dl_type = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_VLAN_VID:
+          {
+            fluid_msg::of13::VLANVid *oxm = dynamic_cast<fluid_msg::of13::VLANVid *> (tlv);
+            mask.dl_vlan = oxm->has_mask () ? oxm->mask () : 0xffff;
+            value.dl_vlan = oxm->value () & mask.dl_vlan;
+            break;
+          }
+        case fluid_msg::of13::OFPXMT_OFB_VLAN_PCP:
+          value.dl_vlan_pcp = dynamic_cast<fluid_msg::of13::VLANPcp *> (tlv)->value ();
+          mask.dl_vlan_pcp = 0xff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_IP_DSCP:
+          value.nw_tos |= (dynamic_cast<fluid_msg::of13::IPDSCP *> (tlv)->value () << 2) & 0xfc;
+          mask.nw_tos |= 0xfc;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_IP_ECN:
+          value.nw_tos |= dynamic_cast<fluid_msg::of13::IPECN *> (tlv)->value () & 0x03;
+          mask.nw_tos |= 0x03;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_IP_PROTO:
+          value.nw_proto = dynamic_cast<fluid_msg::of13::IPProto *> (tlv)->value ();
+          mask.nw_proto = 0xff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_ARP_OP:
+          value.nw_proto = (uint8_t)dynamic_cast<fluid_msg::of13::ARPOp *> (tlv)->value ();
+          mask.nw_proto = 0xff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_IPV4_SRC:
+          {
+            fluid_msg::of13::IPv4Src *oxm = dynamic_cast<fluid_msg::of13::IPv4Src *> (tlv);
+            set_field32 (value.nw_src, mask.nw_src, oxm->value ().getIPv4 (),
+                         oxm->has_mask () ? oxm->mask ().getIPv4 () : 0xffffffff);
+            break;
+          }
+        case fluid_msg::of13::OFPXMT_OFB_IPV4_DST:
+          {
+            fluid_msg::of13::IPv4Dst *oxm = dynamic_cast<fluid_msg::of13::IPv4Dst *> (tlv);
+            set_field32 (value.nw_dst, mask.nw_dst, oxm->value ().getIPv4 (),
+                         oxm->has_mask () ? oxm->mask ().getIPv4 () : 0xffffffff);
+            break;
+          }
+        case fluid_msg::of13::OFPXMT_OFB_ARP_SPA:
+          {
+            fluid_msg::of13::ARPSPA *oxm = dynamic_cast<fluid_msg::of13::ARPSPA *> (tlv);
+            set_field32 (value.nw_src, mask.nw_src, oxm->value ().getIPv4 (),
+                         oxm->has_mask () ? oxm->mask ().getIPv4 () : 0xffffffff);
+            break;
+          }
+        case fluid_msg::of13::OFPXMT_OFB_ARP_TPA:
+          {
+            fluid_msg::of13::ARPTPA *oxm = dynamic_cast<fluid_msg::of13::ARPTPA *> (tlv);
+            set_field32 (value.nw_dst, mask.nw_dst, oxm->value ().getIPv4 (),
+                         oxm->has_mask () ? oxm->mask ().getIPv4 () : 0xffffffff);
+            break;
+          }
+        case fluid_msg::of13::OFPXMT_OFB_TCP_SRC:
+          value.tp_src = dynamic_cast<fluid_msg::of13::TCPSrc *> (tlv)->value ();
+          mask.tp_src = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_TCP_DST:
+          value.tp_dst = dynamic_cast<fluid_msg::of13::TCPDst *> (tlv)->value ();
+          mask.tp_dst = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_UDP_SRC:
+          value.tp_src = dynamic_cast<fluid_msg::of13::UDPSrc *> (tlv)->value ();
+          mask.tp_src = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_UDP_DST:
+          value.tp_dst = dynamic_cast<fluid_msg::of13::UDPDst *> (tlv)->value ();
+          mask.tp_dst = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_SCTP_SRC:
+          value.tp_src = dynamic_cast<fluid_msg::of13::SCTPSrc *> (tlv)->value ();
+          mask.tp_src = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_SCTP_DST:
+          value.tp_dst = dynamic_cast<fluid_msg::of13::SCTPDst *> (tlv)->value ();
+          mask.tp_dst = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_ICMPV4_TYPE:
+          value.tp_src = dynamic_cast<fluid_msg::of13::ICMPv4Type *> (tlv)->value ();
+          mask.tp_src = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_ICMPV4_CODE:
+          value.tp_dst = dynamic_cast<fluid_msg::of13::ICMPv4Code *> (tlv)->value ();
+          mask.tp_dst = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_ICMPV6_TYPE:
+          value.tp_src = dynamic_cast<fluid_msg::of13::ICMPv6Type *> (tlv)->value ();
+          mask.tp_src = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_ICMPV6_CODE:
+          value.tp_dst = dynamic_cast<fluid_msg::of13::ICMPv6Code *> (tlv)->value ();
+          mask.tp_dst = 0xffff;
+          break;
+        case fluid_msg::of13::OFPXMT_OFB_IPV6_SRC:
+          {
+            fluid_msg::of13::IPv6Src *oxm = dynamic_cast<fluid_msg::of13::IPv6Src *> (tlv);
+            set_field (value.nw_src, mask.nw_src, oxm->value ().getIPv6 (),
+                       oxm->has_mask () ? oxm->mask ().getIPv6 () : allOnes, sizeof (value.nw_src));
+            break;
+          }
+        case fluid_msg::of13::OFPXMT_OFB_IPV6_DST:
+          {
+            fluid_msg::of13::IPv6Dst *oxm = dynamic_cast<fluid_msg::of13::IPv6Dst *> (tlv);
+            set_field (value.nw_dst, mask.nw_dst, oxm->value ().getIPv6 (),
+                       oxm->has_mask () ? oxm->mask ().getIPv6 () : allOnes, sizeof (value.nw_dst));
+            break;
+          }
+        case fluid_msg::of13::OFPXMT_OFB_IPV6_FLABEL:
+          {
+            fluid_msg::of13::IPV6Flabel *oxm = dynamic_cast<fluid_msg::of13::IPV6Flabel *> (tlv);
+            mask.ipv6_flabel = oxm->has_mask () ? oxm->mask () : 0xffffffff;
+            value.ipv6_flabel = oxm->value () & mask.ipv6_flabel;
+            break;
+          }
+        default:
+          NS_LOG_WARN ("OXM field " << field << " is not supported by the classifier, treating it as a wildcard");
+          break;
+        }
+    }
+  return compiled;
+}
+
+/* Reads an IPv4 or ARP address back out of its host order key slot */
+static inline uint32_t
+get_field32 (const uint8_t *slot)
+{
+  uint32_t address;
+  std::memcpy (&address, slot, sizeof (address));
+  return address;
+}
+
+void
+SdnFlowMatch::ToOf13 (const SdnFlowKey &key, fluid_msg::of13::Match &match)
+{
+  match.add_oxm_field (new fluid_msg::of13::InPort (key.in_port));
+  match.add_oxm_field (new fluid_msg::of13::EthDst (fluid_msg::EthAddress (key.dl_dst)));
+  match.add_oxm_field (new fluid_msg::of13::EthSrc (fluid_msg::EthAddress (key.dl_src)));
+  match.add_oxm_field (new fluid_msg::of13::EthType (key.dl_type));
+
+  if (key.dl_type == ETH_TYPE_IPV4 || key.dl_type == ETH_TYPE_IPV6)
+    {
+      match.add_oxm_field (new fluid_msg::of13::IPDSCP (key.nw_tos >> 2));
+      match.add_oxm_field (new fluid_msg::of13::IPECN (key.nw_tos & 0x03));
+      match.add_oxm_field (new fluid_msg::of13::IPProto (key.nw_proto));
+      if (key.dl_type == ETH_TYPE_IPV4)
+        {
+          match.add_oxm_field (new fluid_msg::of13::IPv4Src (fluid_msg::IPAddress (get_field32 (key.nw_src))));
+          match.add_oxm_field (new fluid_msg::of13::IPv4Dst (fluid_msg::IPAddress (get_field32 (key.nw_dst))));
+        }
+      else
+        {
+          match.add_oxm_field (new fluid_msg::of13::IPv6Src (fluid_msg::IPAddress ((uint8_t *)key.nw_src)));
+          match.add_oxm_field (new fluid_msg::of13::IPv6Dst (fluid_msg::IPAddress ((uint8_t *)key.nw_dst)));
+          match.add_oxm_field (new fluid_msg::of13::IPV6Flabel (key.ipv6_flabel));
+        }
+      switch (key.nw_proto)
+        {
+        case IP_PROTO_TCP:
+          match.add_oxm_field (new fluid_msg::of13::TCPSrc (key.tp_src));
+          match.add_oxm_field (new fluid_msg::of13::TCPDst (key.tp_dst));
+          break;
+        case IP_PROTO_UDP:
+          match.add_oxm_field (new fluid_msg::of13::UDPSrc (key.tp_src));
+          match.add_oxm_field (new fluid_msg::of13::UDPDst (key.tp_dst));
+          break;
+        case IP_PROTO_ICMP:
+          if (key.dl_type == ETH_TYPE_IPV4)
+            {
+              match.add_oxm_field (new fluid_msg::of13::ICMPv4Type ((uint8_t)key.tp_src));
+              match.add_oxm_field (new fluid_msg::of13::ICMPv4Code ((uint8_t)key.tp_dst));
+            }
+          break;
+        case IP_PROTO_ICMPV6:
+          if (key.dl_type == ETH_TYPE_IPV6)
+            {
+              match.add_oxm_field (new fluid_msg::of13::ICMPv6Type ((uint8_t)key.tp_src));
+              match.add_oxm_field (new fluid_msg::of13::ICMPv6Code ((uint8_t)key.tp_dst));
+            }
+          break;
+        }
+    }
+  else if (key.dl_type == ETH_TYPE_ARP)
+    {
+      match.add_oxm_field (new fluid_msg::of13::ARPOp (key.nw_proto));
+      match.add_oxm_field (new fluid_msg::of13::ARPSPA (fluid_msg::IPAddress (get_field32 (key.nw_src))));
+      match.add_oxm_field (new fluid_msg::of13::ARPTPA (fluid_msg::IPAddress (get_field32 (key.nw_dst))));
+    }
+}
+
+} //End namespace ns3
@@ -0,0 +1,213 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_FLOW_KEY_H
+#define SDN_FLOW_KEY_H
+
+//Stdlib packages
+#include <stdint.h>
+#include <cstring>
+//libfluid packages
+#include <fluid/of10/of10match.hh>
+#include <fluid/of13/of13match.hh>
+
+#define ETH_TYPE_IPV4 0x0800 //!< dl_type of an IPv4 packet
+#define ETH_TYPE_ARP  0x0806 //!< dl_type of an ARP packet
+#define ETH_TYPE_IPV6 0x86DD //!< dl_type of an IPv6 packet
+
+#define IP_PROTO_ICMP   1    //!< nw_proto of ICMP, ports hold type and code
+#define IP_PROTO_TCP    6    //!< nw_proto of TCP
+#define IP_PROTO_UDP    17   //!< nw_proto of UDP
+#define IP_PROTO_ICMPV6 58   //!< nw_proto of ICMPv6, ports hold type and code
+
+namespace ns3 {
+
+/**
+ * \ingroup sdn
+ *
+ * \brief Fixed layout set of header fields a packet is classified on.
+ *
+ * Holds the union of the OpenFlow 1.0 twelve-tuple and the OpenFlow 1.3 OXM
+ * fields the switches understand. Network addresses share one 16 byte slot
+ * each: IPv4 and ARP addresses use the first four bytes in host order, IPv6
+ * addresses use all sixteen. The layout has no padding holes and fills
+ * exactly SDN_FLOW_KEY_WORDS aligned 64 bit words (one cache line), so keys
+ * can be hashed bytewise and compared a word at a time.
+ */
+struct alignas (8) SdnFlowKey
+{
+  SdnFlowKey ()
+  {
+    std::memset (this, 0, sizeof (SdnFlowKey));
+  }
+
+  uint32_t in_port;     //!< Ingress switch port
+  uint16_t dl_type;     //!< Ethernet frame type
+  uint16_t dl_vlan;     //!< VLAN id
+  uint8_t dl_src[6];    //!< Ethernet source address
+  uint8_t dl_vlan_pcp;  //!< VLAN priority
+  uint8_t nw_tos;       //!< Full IP ToS byte (DSCP and ECN)
+  uint8_t dl_dst[6];    //!< Ethernet destination address
+  uint8_t nw_proto;     //!< IP protocol, or ARP opcode
+  uint8_t pad;          //!< Unused, always zero
+  uint16_t tp_src;      //!< Transport source port, or ICMP type
+  uint16_t tp_dst;      //!< Transport destination port, or ICMP code
+  uint32_t ipv6_flabel; //!< IPv6 flow label
+  uint8_t nw_src[16];   //!< Network source address
+  uint8_t nw_dst[16];   //!< Network destination address
+
+  /**
+   * \brief Reads one 64 bit word of the key
+   * \param i Word index, below SDN_FLOW_KEY_WORDS
+   * \return The word
+   */
+  uint64_t GetWord (uint32_t i) const
+  {
+    uint64_t word;
+    std::memcpy (&word, (const uint8_t *)this + i * sizeof (uint64_t), sizeof (uint64_t));
+    return word;
+  }
+  /**
+   * \brief Writes one 64 bit word of the key
+   * \param i Word index, below SDN_FLOW_KEY_WORDS
+   * \param word The word
+   */
+  void SetWord (uint32_t i, uint64_t word)
+  {
+    std::memcpy ((uint8_t *)this + i * sizeof (uint64_t), &word, sizeof (uint64_t));
+  }
+};
+
+#define SDN_FLOW_KEY_WORDS 8 //!< Number of 64 bit words in an SdnFlowKey
+
+static_assert (sizeof (SdnFlowKey) == SDN_FLOW_KEY_WORDS * sizeof (uint64_t), "SdnFlowKey must stay packed");
+
+/**
+ * \brief Hash functor so an SdnFlowKey can index an unordered container
+ */
+struct SdnFlowKeyHash
+{
+  std::size_t operator() (const SdnFlowKey &key) const;
+};
+
+/**
+ * \brief Bytewise equality of two keys
+ */
+struct SdnFlowKeyEqual
+{
+  bool operator() (const SdnFlowKey &lhs, const SdnFlowKey &rhs) const
+  {
+    return std::memcmp (&lhs, &rhs, sizeof (SdnFlowKey)) == 0;
+  }
+};
+
+/**
+ * \ingroup sdn
+ *
+ * \brief A flow match compiled down to a value and a bitmask over SdnFlowKey.
+ *
+ * A mask bit set to one means the packet bit must equal the value bit. The
+ * value is stored pre-masked, so two matches with the same mask can be
+ * compared directly and a packet key masked with it can be used as a hash
+ * lookup key.
+ */
+class SdnFlowMatch
+{
+public:
+  /**
+   * \brief Constructor. The default match is fully wildcarded.
+   */
+  SdnFlowMatch ();
+  /**
+   * \brief Compiles an OpenFlow 1.0 match
+   * \param match The libfluid match, with its wildcards
+   * \param nwSrcIgnore Bits of the IPv4 source the match does not care about
+   * \param nwDstIgnore Bits of the IPv4 destination the match does not care about
+   * \return The compiled match
+   */
+  static SdnFlowMatch FromOf10 (fluid_msg::of10::Match match, uint32_t nwSrcIgnore, uint32_t nwDstIgnore);
+  /**
+   * \brief Compiles an OpenFlow 1.3 match. Metadata is kept apart from the key,
+   * see MatchesMetadata. Other fields with no slot in SdnFlowKey are logged and
+   * treated as wildcards.
+   * \param match The libfluid match holding the OXM fields
+   * \return The compiled match
+   */
+  static SdnFlowMatch FromOf13 (fluid_msg::of13::Match match);
+  /**
+   * \brief Describes a packet key as an exact OpenFlow 1.3 match, with the
+   * OXM fields whose prerequisites the packet meets
+   * \param key The key extracted from the packet
+   * \param match Receives the OXM fields
+   */
+  static void ToOf13 (const SdnFlowKey &key, fluid_msg::of13::Match &match);
+  /**
+   * \brief Checks a packet key against this match
+   * \param packet The key extracted from the packet
+   * \return True if every cared-for bit of the packet equals the match value
+   */
+  bool Matches (const SdnFlowKey &packet) const
+  {
+    //No early exit, so the loop compiles to straight-line (vectorizable) code
+    uint64_t diff = 0;
+    for (uint32_t i = 0; i < SDN_FLOW_KEY_WORDS; ++i)
+      {
+        diff |= (packet.GetWord (i) & m_mask.GetWord (i)) ^ m_value.GetWord (i);
+      }
+    return diff == 0;
+  }
+  /**
+   * \brief Checks the pipeline metadata of a packet against this match. Metadata
+   * is written between tables rather than parsed from the packet, so it is not
+   * part of SdnFlowKey and must be checked on top of Matches.
+   * \param metadata The metadata the packet carries into the table
+   * \return True if every cared-for metadata bit equals the match value
+   */
+  bool MatchesMetadata (uint64_t metadata) const
+  {
+    return (metadata & m_metadataMask) == m_metadata;
+  }
+  /**
+   * \brief Masks a packet key with an arbitrary mask
+   * \param packet The key extracted from the packet
+   * \param mask The mask to apply
+   * \param result Receives packet & mask
+   */
+  static void ApplyMask (const SdnFlowKey &packet, const SdnFlowKey &mask, SdnFlowKey &result)
+  {
+    for (uint32_t i = 0; i < SDN_FLOW_KEY_WORDS; ++i)
+      {
+        result.SetWord (i, packet.GetWord (i) & mask.GetWord (i));
+      }
+  }
+  /**
+   * \return The pre-masked value of this match
+   */
+  const SdnFlowKey& GetValue (void) const { return m_value; }
+  /**
+   * \return The mask of this match
+   */
+  const SdnFlowKey& GetMask (void) const { return m_mask; }
+
+private:
+  SdnFlowKey m_value; //!< Field values, already masked
+  SdnFlowKey m_mask;  //!< One bits are compared, zero bits are wildcarded
+  uint64_t m_metadata;     //!< OpenFlow 1.3 metadata value, already masked
+  uint64_t m_metadataMask; //!< Metadata bits compared, zero if metadata is wildcarded
+};
+
+} //End namespace ns3
+#endif /* SDN_FLOW_KEY_H */
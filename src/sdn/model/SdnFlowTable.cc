@@ -30,131 +30,231 @@ SdnFlowTable::SdnFlowTable (Ptr<SdnSwitch> parentSwitch)
   m_active_count = 0;
   m_lookup_count = 0;
   m_matched_count = 0;
+  m_packet_total = 0;
+  m_byte_total = 0;
+  m_cache_hits = 0;
+  m_cache_misses = 0;
+  m_tupleSpaceLookup = false;
+  m_nextEntryId = 0;
+  m_microflowCacheSize = 0;
+  m_updateDepth = 0;
+  m_cacheStale = false;
+}
 
+/* Bits of an IPv4 address ignored by a match, from the OFPFW_NW_*_MASK count */
+static inline uint32_t
+nw_ignore_mask (uint32_t wildcards, uint32_t mask, uint32_t shift)
+{
+  uint32_t bits = (wildcards & mask) >> shift;
+  return bits >= 32 ? 0xffffffff : (1u << bits) - 1;
+}
+
+/* Compiles the match of a FlowMod the same way addFlow stores it */
+static SdnFlowMatch
+compile_match (fluid_msg::of10::Match match)
+{
+  match.dl_vlan (0); // Hack since ns-3 doesn't currently support VLAN
+  return SdnFlowMatch::FromOf10 (match,
+                                 nw_ignore_mask (match.wildcards (), fluid_msg::of10::OFPFW_NW_SRC_MASK, fluid_msg::of10::OFPFW_NW_SRC_SHIFT),
+                                 nw_ignore_mask (match.wildcards (), fluid_msg::of10::OFPFW_NW_DST_MASK, fluid_msg::of10::OFPFW_NW_DST_SHIFT));
 }
 
-std::set<Flow, cmp_priority>
+/* Summarizes the actions of a flow so output-only flows are forwarded without
+ * walking the libfluid action list for every packet */
+static void
+compile_actions (Flow &flow)
+{
+  flow.output_ports.clear ();
+  flow.rewrites_headers = false;
+  std::list<fluid_msg::Action*> action_list = flow.actions.action_list ();
+  for (std::list<fluid_msg::Action*>::iterator j = action_list.begin (); j != action_list.end (); j++)
+    {
+      if ((*j)->type () == fluid_msg::of10::OFPAT_OUTPUT)
+        {
+          flow.output_ports.push_back (((fluid_msg::of10::OutputAction*)(*j))->port ());
+        }
+      else
+        {
+          flow.rewrites_headers = true;
+        }
+    }
+}
+
+void
+SdnFlowTable::setTupleSpaceLookup (bool enable)
+{
+  m_classifier.Clear ();
+  m_microflowCache.clear ();
+  m_tupleSpaceLookup = enable;
+  if (enable)
+    {
+      for (FlowRules::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+        {
+          m_classifier.Insert (&i->second);
+        }
+    }
+}
+
+std::vector<Flow>
 SdnFlowTable::flows ()
 {
-  return m_flow_table_rules;
+  std::vector<Flow> flows;
+  for (FlowRules::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+    {
+      flows.push_back (i->second);
+    }
+  return flows;
+}
+
+void
+SdnFlowTable::beginUpdate (void)
+{
+  m_updateDepth++;
 }
 
-//Returns the out port. If not, return OFPP_NONE
-std::vector<uint16_t>
-SdnFlowTable::handlePacket (Ptr<Packet> pkt, uint16_t inPort)
+void
+SdnFlowTable::endUpdate (void)
 {
-  DestructHeader (pkt);
-  fluid_msg::of10::Match inputFields = getPacketFields (inPort);
-  std::set<Flow, cmp_priority>::iterator flow_rule = m_flow_table_rules.begin ();
-  std::vector<uint16_t> outPorts;
-  for (std::set<Flow, cmp_priority>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+  NS_ASSERT (m_updateDepth > 0);
+  if (--m_updateDepth == 0 && m_cacheStale)
     {
-      m_lookup_count++;
-      Flow tempFlow = *i;
-      if (Flow::pkt_match (tempFlow,inputFields))
+      m_microflowCache.clear ();
+      m_cacheStale = false;
+    }
+}
+
+void
+SdnFlowTable::invalidateCache (void)
+{
+  if (m_updateDepth > 0)
+    {
+      m_cacheStale = true;
+      return;
+    }
+  m_microflowCache.clear ();
+}
+
+void
+SdnFlowTable::setMicroflowCacheSize (uint32_t size)
+{
+  m_microflowCache.clear ();
+  m_microflowCacheSize = size;
+}
+
+//Fills in the out ports of the matched flow. Returns false on a miss
+bool
+SdnFlowTable::handlePacket (Ptr<Packet> pkt, uint16_t inPort, std::vector<uint16_t> &outPorts)
+{
+  SdnFlowKey key;
+  SdnPacketParser::Parse (pkt, inPort, key);
+  outPorts.clear ();
+  m_lookup_count++;
+  // Counters and timers are not part of the set ordering, so the stored flow is updated in place
+  Flow *flow = const_cast<Flow *> (lookupCachedFlow (key));
+  if (!flow)
+    {
+      return false;
+    }
+  m_matched_count++;
+  flow->packet_count_++;
+  flow->byte_count_ += pkt->GetSize ();
+  m_packet_total++;
+  m_byte_total += pkt->GetSize ();
+  if (!flow->rewrites_headers)
+    {
+      //Output-only actions were resolved to ports when the flow was added
+      outPorts = flow->output_ports;
+    }
+  else
+    {
+      //Header rewrites need the headers taken off the packet
+      DestructHeader (pkt);
+      std::list<fluid_msg::Action*> action_list = flow->actions.action_list ();
+      for (std::list<fluid_msg::Action*>::iterator j = action_list.begin (); j != action_list.end (); j++)
         {
-          m_matched_count++;
-          tempFlow.packet_count_++;
-          tempFlow.byte_count_ += pkt->GetSize ();
-          std::list<fluid_msg::Action*> action_list = tempFlow.actions.action_list ();
-          for (std::list<fluid_msg::Action*>::iterator j = action_list.begin (); j != action_list.end (); j++)
+          fluid_msg::Action* action = *j;
+          if (action->type () == fluid_msg::of10::OFPAT_OUTPUT)
             {
-              fluid_msg::Action* action = *j;
-              if (action->type () == fluid_msg::of10::OFPAT_OUTPUT)
-                {
-                  uint16_t outPort = handleAction (pkt,action);
-                  outPorts.push_back(outPort);
-                }
-              else
-                {
-                  handleAction (pkt,action);
-                }
+              uint16_t outPort = handleAction (pkt,action);
+              outPorts.push_back(outPort);
             }
-          if (tempFlow.idle_timeout_ != 0)
+          else
             {
-              tempFlow.idle_timeout_event.Cancel ();
-              tempFlow.idle_timeout_event = Simulator::Schedule (Seconds (tempFlow.idle_timeout_),&SdnFlowTable::IdleTimeOutEvent,this,tempFlow);
+              handleAction (pkt,action);
             }
         }
+      RestructHeader (pkt);
     }
-  RestructHeader (pkt);
-  return outPorts;
+  //The idle timeout checks this when it fires, so a busy flow costs no scheduler operations
+  flow->last_used_nsec = Simulator::Now ().GetNanoSeconds ();
+  return true;
 }
 
-//Need to rewrite to make header objects that serialize the iterator, then use their attributes.
-fluid_msg::of10::Match
-SdnFlowTable::getPacketFields (uint16_t inPort)
+const Flow*
+SdnFlowTable::lookupFlow (const SdnFlowKey &key)
 {
-  fluid_msg::of10::Match match;
-  match.in_port (inPort);
-  if (!m_tcpHeader.isEmpty) //TCP case
+  if (m_tupleSpaceLookup)
     {
-      match.tp_src (m_tcpHeader.header.GetSourcePort ());
-      match.tp_dst (m_tcpHeader.header.GetDestinationPort ());
+      return m_classifier.Lookup (key);
     }
-  if (!m_udpHeader.isEmpty) //UDP case
+  //The rules are kept in lookup order, so the first match is the best one
+  for (FlowRules::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
     {
-      match.tp_src (m_udpHeader.header.GetSourcePort ());
-      match.tp_dst (m_udpHeader.header.GetDestinationPort ());
-    }
-  if (!m_ipv4Header.isEmpty) //IPv4 case
-    {
-      match.nw_tos (m_ipv4Header.header.GetTos ()); //zero out the last 2 bits that are ignored by the ToS
-      if (!match.nw_proto ())
+      if (i->second.compiled_match.Matches (key))
         {
-          match.nw_proto (m_ipv4Header.header.GetProtocol ());
+          return &i->second;
         }
-      match.nw_src (fluid_msg::IPAddress (m_ipv4Header.header.GetSource ().Get ()));
-      match.nw_dst (fluid_msg::IPAddress (m_ipv4Header.header.GetDestination ().Get ()));
-
-      if ((m_ipv4Header.header.GetProtocol () == 1) && (!m_icmpv4Header.isEmpty))
-	{
-	  match.tp_src (m_icmpv4Header.header.GetType ());
-	  match.tp_dst (m_icmpv4Header.header.GetCode ());
-	}
     }
-  if (!m_ipv6Header.isEmpty) //IPv6 case
+  return NULL;
+}
+
+//The cache holds pointers into m_flow_table_rules, so any change to the table empties it
+const Flow*
+SdnFlowTable::lookupCachedFlow (const SdnFlowKey &key)
+{
+  NS_ASSERT_MSG (m_updateDepth == 0, "Packet lookup in the middle of a flow mod batch");
+  if (m_microflowCacheSize == 0)
     {
-      uint8_t sourceBuffer[16];
-      m_ipv6Header.header.GetSourceAddress ().GetBytes (sourceBuffer);
-      match.nw_src (fluid_msg::IPAddress (sourceBuffer));
-      uint8_t destinationBuffer[16];
-      m_ipv6Header.header.GetDestinationAddress ().GetBytes (destinationBuffer);
-      match.nw_dst (fluid_msg::IPAddress (destinationBuffer));
+      return lookupFlow (key);
     }
-  if (!m_arpHeader.isEmpty) //Arp case
+  MicroflowCache::iterator cached = m_microflowCache.find (key);
+  if (cached != m_microflowCache.end ())
     {
-      match.nw_proto ((uint8_t)(m_arpHeader.header.IsRequest () ? ArpHeader::ARP_TYPE_REQUEST : ArpHeader::ARP_TYPE_REPLY));
-
-      match.nw_src (fluid_msg::IPAddress (m_arpHeader.header.GetSourceIpv4Address ().Get ()));
-      match.nw_dst (fluid_msg::IPAddress (m_arpHeader.header.GetDestinationIpv4Address ().Get ()));
+      m_cache_hits++;
+      return cached->second;
     }
-  if (!m_ethHeader.isEmpty) //IPv6 case
+  m_cache_misses++;
+  const Flow *flow = lookupFlow (key);
+  if (m_microflowCache.size () >= m_microflowCacheSize)
     {
-      uint8_t srcAddr[6];
-      m_ethHeader.header.GetSource ().CopyTo (srcAddr);
-      uint8_t dstAddr[6];
-      m_ethHeader.header.GetDestination ().CopyTo (dstAddr);
-      match.dl_src (fluid_msg::EthAddress (srcAddr));
-      match.dl_dst (fluid_msg::EthAddress (dstAddr));
-      match.dl_type(m_ethHeader.header.GetLengthType ());
-
-      //No VLAN header accessor yet
-      match.dl_vlan (0);
+      m_microflowCache.clear ();
     }
-  return match;
+  m_microflowCache[key] = flow;
+  return flow;
 }
 
 std::vector<Flow>
-SdnFlowTable::matchingFlows (fluid_msg::of10::Match match)
+SdnFlowTable::matchingFlows (fluid_msg::of10::Match match, uint16_t outPort)
 {
   std::vector<Flow> matchingFlows;
-  for (std::set<Flow, cmp_priority>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+  if (outPort != fluid_msg::of10::OFPP_NONE)
+    {
+      std::vector<FlowRules::iterator> candidates;
+      m_flow_table_rules.FindByOutPort (outPort, candidates);
+      for (std::vector<FlowRules::iterator>::iterator i = candidates.begin (); i != candidates.end (); i++)
+        {
+          if (Flow::pkt_match ((*i)->second,match))
+            {
+              matchingFlows.push_back ((*i)->second);
+            }
+        }
+      return matchingFlows;
+    }
+  for (FlowRules::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
     {
-      Flow tempFlow = *i;
-      if (Flow::pkt_match (tempFlow,match))
+      if (Flow::pkt_match (i->second,match))
         {
-          matchingFlows.push_back (tempFlow);
+          matchingFlows.push_back (i->second);
         }
     }
   return matchingFlows;
@@ -451,26 +551,19 @@ SdnFlowTable::RestructHeader (Ptr<Packet> pkt)
   m_udpHeader.isEmpty = true;
 }
 
-fluid_msg::of10::TableStats*
+fluid_msg::of10::TableStats
 SdnFlowTable::convertToTableStats ()
 {
   std::stringstream ss;
   ss << m_tableid;
-  return new fluid_msg::of10::TableStats (m_tableid,ss.str ().c_str (),m_wildcards,m_max_entries,m_active_count,m_lookup_count,m_matched_count);
+  return fluid_msg::of10::TableStats (m_tableid,ss.str ().c_str (),m_wildcards,m_max_entries,m_active_count,m_lookup_count,m_matched_count);
 }
 
 //Checks if this flow will conflict with a current flow of the same priority
 bool
 SdnFlowTable::conflictingEntry (Flow flow)
 {
-  for (std::set<Flow, cmp_priority>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
-    {
-      if (Flow::strict_match (flow,*i))
-        {
-          return true;
-        }
-    }
-  return false;
+  return m_flow_table_rules.FindStrict (flow.compiled_match, flow.priority_) != m_flow_table_rules.end ();
 }
 
 Flow
@@ -489,23 +582,32 @@ SdnFlowTable::addFlow (fluid_msg::of10::FlowMod* message)
 
   newFlow.match = message->match ();
   newFlow.match.dl_vlan (0); // Hack since ns-3 doesn't currently support VLAN
-  newFlow.nw_src_mask = 0xFFFFFFF >> (32 - ((newFlow.match.wildcards () & fluid_msg::of10::OFPFW_NW_SRC_MASK) >> fluid_msg::of10::OFPFW_NW_SRC_SHIFT) - 1);
-  newFlow.nw_dst_mask = 0xFFFFFFF >> (32 - ((newFlow.match.wildcards () & fluid_msg::of10::OFPFW_NW_DST_MASK) >> fluid_msg::of10::OFPFW_NW_DST_SHIFT) - 1);
+  newFlow.nw_src_mask = nw_ignore_mask (newFlow.match.wildcards (), fluid_msg::of10::OFPFW_NW_SRC_MASK, fluid_msg::of10::OFPFW_NW_SRC_SHIFT);
+  newFlow.nw_dst_mask = nw_ignore_mask (newFlow.match.wildcards (), fluid_msg::of10::OFPFW_NW_DST_MASK, fluid_msg::of10::OFPFW_NW_DST_SHIFT);
+  newFlow.compiled_match = SdnFlowMatch::FromOf10 (newFlow.match, newFlow.nw_src_mask, newFlow.nw_dst_mask);
   newFlow.actions = message->actions ();
+  compile_actions (newFlow);
 
-  if ((message->flags () & fluid_msg::of10::OFPFF_CHECK_OVERLAP) && conflictingEntry (newFlow))
+  FlowRules::iterator identical = m_flow_table_rules.FindStrict (newFlow.compiled_match, newFlow.priority_);
+  if (identical != m_flow_table_rules.end ())
     {
-      return Flow ();
+      if (message->flags () & fluid_msg::of10::OFPFF_CHECK_OVERLAP)
+        {
+          return Flow ();
+        }
+      //An identical flow is replaced, counters included
+      removeFlow (identical);
     }
+  newFlow.entry_id = m_nextEntryId++;
   if (newFlow.idle_timeout_ != 0)
     {
-      newFlow.idle_timeout_event = Simulator::Schedule (Seconds (newFlow.idle_timeout_),&SdnFlowTable::IdleTimeOutEvent,this,newFlow);
+      scheduleTimer (newFlow.priority_, newFlow.entry_id, SdnTimer::IDLE_TIMEOUT, Seconds (newFlow.idle_timeout_));
     }
   if (newFlow.hard_timeout_ != 0)
     {
-      newFlow.hard_timeout_event = Simulator::Schedule (Seconds (newFlow.hard_timeout_),&SdnFlowTable::HardTimeOutEvent,this,newFlow);
+      scheduleTimer (newFlow.priority_, newFlow.entry_id, SdnTimer::HARD_TIMEOUT, Seconds (newFlow.hard_timeout_));
     }
-  m_flow_table_rules.insert (newFlow);
+  insertFlow (newFlow);
   m_active_count++;
   return newFlow;
 }
@@ -514,72 +616,189 @@ Flow
 SdnFlowTable::modifyFlow (fluid_msg::of10::FlowMod* message)
 {
   NS_LOG_DEBUG ("Modifying flow on switch at time" << Simulator::Now ().GetSeconds ());
-  for (std::set<Flow, cmp_priority>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+  Flow modified;
+  bool found = false;
+  FlowRules::iterator end = m_flow_table_rules.PriorityEnd (message->priority ());
+  for (FlowRules::iterator i = m_flow_table_rules.PriorityBegin (message->priority ()); i != end; i++)
     {
-      Flow flow = *i;
-      if (flow.priority_ == message->priority () && Flow::pkt_match (flow,message->match ()))
+      if (Flow::pkt_match (i->second,message->match ()))
         {
-          flow.actions = message->actions ();
-          flow.cookie_ = message->cookie ();
-          if (flow.idle_timeout_ != 0)
-            {
-              flow.idle_timeout_event.Cancel ();
-              flow.idle_timeout_event = Simulator::Schedule (Seconds (flow.idle_timeout_),&SdnFlowTable::IdleTimeOutEvent,this,flow);
-            }
-          if (flow.hard_timeout_ != 0)
-            {
-              flow.hard_timeout_event.Cancel ();
-              flow.hard_timeout_event = Simulator::Schedule (Seconds (flow.hard_timeout_),&SdnFlowTable::HardTimeOutEvent,this,flow);
-            }
-          return flow;
+          updateFlow (i, message);
+          modified = i->second;
+          found = true;
         }
     }
-  return Flow ();
+  //A modify that matches nothing behaves as an add
+  return found ? modified : addFlow (message);
+}
+
+Flow
+SdnFlowTable::modifyFlowStrict (fluid_msg::of10::FlowMod* message)
+{
+  NS_LOG_DEBUG ("Strictly modifying flow on switch at time" << Simulator::Now ().GetSeconds ());
+  FlowRules::iterator i = m_flow_table_rules.FindStrict (compile_match (message->match ()), message->priority ());
+  if (i == m_flow_table_rules.end ())
+    {
+      return addFlow (message);
+    }
+  updateFlow (i, message);
+  return i->second;
 }
 
 void
 SdnFlowTable::deleteFlow (fluid_msg::of10::FlowMod* message)
 {
   NS_LOG_DEBUG ("Deleting flow on switch at time" << Simulator::Now ().GetSeconds ());
-  for (std::set<Flow, cmp_priority>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+  //Gather candidates first, from the out port index when the message filters on one
+  std::vector<FlowRules::iterator> candidates;
+  if (message->out_port () != fluid_msg::of10::OFPP_NONE)
+    {
+      m_flow_table_rules.FindByOutPort (message->out_port (), candidates);
+    }
+  else
     {
-      Flow flow = *i;
-      if (flow.priority_ == message->priority () && Flow::pkt_match (flow,message->match ()))
+      FlowRules::iterator end = m_flow_table_rules.PriorityEnd (message->priority ());
+      for (FlowRules::iterator i = m_flow_table_rules.PriorityBegin (message->priority ()); i != end; i++)
         {
-          if (flow.idle_timeout_ != 0)
-            {
-              flow.idle_timeout_event.Cancel ();
-            }
-          if (flow.hard_timeout_ != 0)
-            {
-              flow.hard_timeout_event.Cancel ();
-            }
-          m_flow_table_rules.erase (flow);
+          candidates.push_back (i);
         }
     }
+  for (std::vector<FlowRules::iterator>::iterator i = candidates.begin (); i != candidates.end (); i++)
+    {
+      if ((*i)->second.priority_ == message->priority () && Flow::pkt_match ((*i)->second,message->match ()))
+        {
+          removeFlow (*i);
+        }
+    }
+}
+
+void
+SdnFlowTable::deleteFlowStrict (fluid_msg::of10::FlowMod* message)
+{
+  NS_LOG_DEBUG ("Strictly deleting flow on switch at time" << Simulator::Now ().GetSeconds ());
+  FlowRules::iterator i = m_flow_table_rules.FindStrict (compile_match (message->match ()), message->priority ());
+  if (i == m_flow_table_rules.end ())
+    {
+      return;
+    }
+  const std::vector<uint16_t> &ports = i->second.output_ports;
+  if (message->out_port () != fluid_msg::of10::OFPP_NONE
+      && std::find (ports.begin (), ports.end (), message->out_port ()) == ports.end ())
+    {
+      return;
+    }
+  removeFlow (i);
+}
+
+SdnFlowTable::FlowRules::iterator
+SdnFlowTable::insertFlow (const Flow &flow)
+{
+  invalidateCache ();
+  FlowRules::iterator stored = m_flow_table_rules.Insert (flow);
+  if (m_tupleSpaceLookup)
+    {
+      m_classifier.Insert (&stored->second);
+    }
+  return stored;
+}
+
+void
+SdnFlowTable::eraseFlow (FlowRules::iterator flow)
+{
+  invalidateCache ();
+  if (m_tupleSpaceLookup)
+    {
+      m_classifier.Remove (&flow->second);
+    }
+  m_flow_table_rules.Erase (flow);
+}
+
+void
+SdnFlowTable::removeFlow (FlowRules::iterator flow)
+{
+  //Pending timers of the flow find it gone and do nothing
+  m_packet_total -= flow->second.packet_count_;
+  m_byte_total -= flow->second.byte_count_;
+  eraseFlow (flow);
   m_active_count--;
 }
 
+//Match and priority are unchanged, so neither the classifier nor the microflow cache need updating
+void
+SdnFlowTable::updateFlow (FlowRules::iterator i, fluid_msg::of10::FlowMod* message)
+{
+  Flow &flow = i->second;
+  std::vector<uint16_t> oldPorts = flow.output_ports;
+  flow.actions = message->actions ();
+  compile_actions (flow);
+  m_flow_table_rules.Reindex (i, oldPorts);
+  flow.cookie_ = message->cookie ();
+  //Restarts the idle time, the pending idle timer re-checks it. Timeouts are unchanged, as in the spec.
+  flow.last_used_nsec = Simulator::Now ().GetNanoSeconds ();
+}
+
 void
-SdnFlowTable::IdleTimeOutEvent (Flow flow)
+SdnFlowTable::IdleTimeOutEvent (uint16_t priority, uint64_t entryId)
 {
+  FlowRules::iterator i = m_flow_table_rules.Find (priority, entryId);
+  if (i == m_flow_table_rules.end ())
+    {
+      return;
+    }
+  Flow &flow = i->second;
+  Time expiry = NanoSeconds (flow.last_used_nsec) + Seconds (flow.idle_timeout_);
+  if (expiry > Simulator::Now ())
+    {
+      //Used since this timer was scheduled, check again when it would go idle
+      scheduleTimer (priority, entryId, SdnTimer::IDLE_TIMEOUT, expiry - Simulator::Now ());
+      return;
+    }
   NS_LOG_DEBUG ("Idle timeout event of flow at time " << Simulator::Now ().GetSeconds ());
-  TimeOutEvent (flow, fluid_msg::of10::OFPRR_IDLE_TIMEOUT);
+  TimeOutEvent (i, fluid_msg::of10::OFPRR_IDLE_TIMEOUT);
 }
 
 void
-SdnFlowTable::HardTimeOutEvent (Flow flow)
+SdnFlowTable::HardTimeOutEvent (uint16_t priority, uint64_t entryId)
 {
   NS_LOG_DEBUG ("Hard timeout event of flow at time " << Simulator::Now ().GetSeconds ());
-  TimeOutEvent (flow, fluid_msg::of10::OFPRR_HARD_TIMEOUT);
+  FlowRules::iterator i = m_flow_table_rules.Find (priority, entryId);
+  if (i != m_flow_table_rules.end ())
+    {
+      TimeOutEvent (i, fluid_msg::of10::OFPRR_HARD_TIMEOUT);
+    }
 }
 
 void
-SdnFlowTable::TimeOutEvent (Flow flow, uint8_t reason)
+SdnFlowTable::TimeOutEvent (FlowRules::iterator flow, uint8_t reason)
 {
-  m_flow_table_rules.erase (flow);
-  m_parentSwitch->SendFlowRemovedMessageToController (flow,reason);
+  Flow removed = flow->second;
+  removeFlow (flow);
   //Send a flow removed message back to controller
+  m_parentSwitch->SendFlowRemovedMessageToController (removed,reason);
+}
+
+void
+SdnFlowTable::expireTimer (SdnTimer timer)
+{
+  if (timer.kind == SdnTimer::IDLE_TIMEOUT)
+    {
+      IdleTimeOutEvent (timer.priority, timer.entry_id);
+    }
+  else
+    {
+      HardTimeOutEvent (timer.priority, timer.entry_id);
+    }
+}
+
+void
+SdnFlowTable::scheduleTimer (uint16_t priority, uint64_t entryId, uint8_t kind, Time delay)
+{
+  SdnTimer timer;
+  timer.entry_id = entryId;
+  timer.priority = priority;
+  timer.table_id = 0;
+  timer.kind = kind;
+  m_parentSwitch->GetTimerWheel ().Schedule (delay, timer);
 }
 
 } //End ns3 namespace
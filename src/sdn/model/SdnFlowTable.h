@@ -22,6 +22,7 @@
 //Stdlib packages
 #include <map>
 #include <stack>
+#include <unordered_map>
 //ns3 utilities
 #include "ns3/ptr.h"
 #include "ns3/packet.h"
@@ -39,20 +40,15 @@
 //Sdn classes
 #include "Flow.h"
 #include "SdnCommon.h"
+#include "SdnFlowKey.h"
+#include "SdnTupleSpace.h"
+#include "SdnRuleStore.h"
+#include "SdnPacketParser.h"
+#include "SdnTimerWheel.h"
 
 namespace ns3 {
 
 class SdnSwitch;
-/**
- * A comparators for flows. Sort via priority
- */
-struct cmp_priority
-{
-  bool operator() (const Flow &lhs, const Flow &rhs) const
-  {
-    return lhs.priority_ <= rhs.priority_;
-  }
-};
 
 /**
  * \ingroup sdn
@@ -70,9 +66,11 @@ public:
   /**
    * \brief reads a packet and commits the actions given the flows in the flow table
    * \param pkt The packet to read
-   * \return The ports  the switch must outport the packet from. If no outport is discerned, the vector will be empty
+   * \param outPorts Receives the ports the switch must outport the packet from. Empty for a flow
+   * without actions, which drops the packet
+   * \return True if a flow matched the packet, false on a table miss
    */
-  std::vector<uint16_t> handlePacket (Ptr<Packet> pkt, uint16_t inPort);
+  bool handlePacket (Ptr<Packet> pkt, uint16_t inPort, std::vector<uint16_t> &outPorts);
   /**
    * \brief Getter for tableID
    * \return tableID
@@ -93,11 +91,40 @@ public:
    * \param wc Wildcard to set to
    */
   void setWildcards (uint32_t wc) { m_wildcards = wc; }
+  /**
+   * \brief Selects how packets are classified against the flow table
+   * \param enable True to use the tuple space classifier, false for a linear scan
+   */
+  void setTupleSpaceLookup (bool enable);
+  /**
+   * \brief Getter for the classifier selection
+   * \return True if the tuple space classifier is in use
+   */
+  bool getTupleSpaceLookup (void) const { return m_tupleSpaceLookup; }
+  /**
+   * \brief Sizes the exact match cache consulted before the classifier
+   * \param size Maximum number of cached packet keys. Zero disables the cache
+   */
+  void setMicroflowCacheSize (uint32_t size);
+  /**
+   * \brief Getter for the exact match cache size
+   * \return The maximum number of cached packet keys
+   */
+  uint32_t getMicroflowCacheSize (void) const { return m_microflowCacheSize; }
+  /**
+   * \brief Starts a batch of flow mods. Until the matching endUpdate the microflow cache is
+   * only marked stale instead of emptied on every change, so no packet may be looked up meanwhile.
+   */
+  void beginUpdate (void);
+  /**
+   * \brief Ends a batch of flow mods, emptying the microflow cache once if the table changed
+   */
+  void endUpdate (void);
   /**
    * \brief Creates a tablestats object describing the flow table
-   * \return A new table stats object
+   * \return The table stats object
    */
-  fluid_msg::of10::TableStats* convertToTableStats();
+  fluid_msg::of10::TableStats convertToTableStats();
   /**
    * \brief Applies an action to a packet. Main entry point to other more specific action handlers
    * \param pkt The packet to modify
@@ -108,9 +135,19 @@ public:
   /**
    * \brief Finds a vector of flows in the table that will match to this specific match
    * \param match The match object that describes what we're looking for from the flows
+   * \param outPort Only return flows with an output action to this port. OFPP_NONE for any
    * \return A vector of all matching flows
    */
-  std::vector<Flow> matchingFlows(fluid_msg::of10::Match match);
+  std::vector<Flow> matchingFlows(fluid_msg::of10::Match match, uint16_t outPort = fluid_msg::of10::OFPP_NONE);
+  /**
+   * \brief Hands the stats of every flow matchingFlows would return to a writer, one flow at a
+   * time and without copying the flows
+   * \param match The match object that describes what we're looking for from the flows
+   * \param outPort Only visit flows with an output action to this port. OFPP_NONE for any
+   * \param writer Anything with an Add (fluid_msg::of10::FlowStats), usually an SdnMultipartWriter
+   */
+  template <typename Writer>
+  void writeFlowStats(fluid_msg::of10::Match match, uint16_t outPort, Writer &writer);
   /**
    * \brief A check to find whether a flow will conflict with any allready in the flow table
    * \param flow The possibly offending new flow
@@ -129,28 +166,55 @@ public:
    * \return The modified flow
    */
   Flow modifyFlow(fluid_msg::of10::FlowMod* message);
-  //Flow modifyFlowStrict(fluid_msg::of10::FlowMod* message);
+  /**
+   * \brief Modifies the flow with exactly the match and priority of the message
+   * \param message The flowmod message that defines the modified flow
+   * \return The modified flow
+   */
+  Flow modifyFlowStrict(fluid_msg::of10::FlowMod* message);
     /**
    * \brief Deletes a flow in the table
    * \param message The flowmod message that defines the flow to delete
    */
   void deleteFlow(fluid_msg::of10::FlowMod* message);
-  //void deleteFlowStrict(fluid_msg::of10::FlowMod* message);
+  /**
+   * \brief Deletes the flow with exactly the match and priority of the message
+   * \param message The flowmod message that defines the flow to delete
+   */
+  void deleteFlowStrict(fluid_msg::of10::FlowMod* message);
   /**
    * \brief Getter for all the flows in the table
-   * \return m_table_flow_rules
+   * \return Copies of the flows, highest priority first
+   */
+  std::vector<Flow> flows();
+  /**
+   * \brief Handles a flow timeout taken off the switch timer wheel
+   * \param timer The expired timer, ignored if its flow is gone
    */
-  std::set<Flow, cmp_priority> flows();
+  void expireTimer(SdnTimer timer);
   //stat entries
   uint32_t m_max_entries;   //!< A count of all flow entries in the table
   uint32_t m_active_count;  //!< A count of all active flow entries in the table 
   uint64_t m_lookup_count;  //!< A count of all lookups done in the table
   uint64_t m_matched_count; //!< A count of all total matches completed in the table
+  uint64_t m_packet_total;  //!< Packet count summed over the flows in the table, kept up to date for aggregate stats
+  uint64_t m_byte_total;    //!< Byte count summed over the flows in the table, kept up to date for aggregate stats
+  uint64_t m_cache_hits;    //!< A count of lookups answered by the microflow cache
+  uint64_t m_cache_misses;  //!< A count of lookups that fell through the microflow cache
 private:
+  typedef std::unordered_map<SdnFlowKey, const Flow*, SdnFlowKeyHash, SdnFlowKeyEqual> MicroflowCache; //!< Packet key to resolved flow (NULL on a table miss)
+  typedef SdnRuleStore<Flow> FlowRules;            //!< Flow storage with its priority, strict match and out port indexes
   Ptr<SdnSwitch> m_parentSwitch;                   //!< The owning SdnSwitch of this table     
-  std::set<Flow, cmp_priority> m_flow_table_rules; //!< The actual set of all flows in the flow table. Sorted by priority
+  FlowRules m_flow_table_rules;                    //!< The actual set of all flows in the flow table. Sorted by priority
   uint8_t m_tableid;                               //!< Unique ID for flow tables
   uint32_t m_wildcards;                            //!< Wildcard rules for matches to ignore. NOT IMPLEMENTED
+  bool m_tupleSpaceLookup;                         //!< Whether handlePacket uses m_classifier instead of a linear scan
+  uint64_t m_nextEntryId;                          //!< Insertion counter handed out as Flow::entry_id
+  SdnTupleSpace<Flow> m_classifier;                //!< Tuple space index over m_flow_table_rules
+  MicroflowCache m_microflowCache;                 //!< Exact match cache in front of lookupFlow
+  uint32_t m_microflowCacheSize;                   //!< Capacity of m_microflowCache, zero when disabled
+  uint32_t m_updateDepth;                          //!< Nesting depth of beginUpdate calls
+  bool m_cacheStale;                               //!< Table changed during the current batch
   template <class T> struct TempHeader { TempHeader() : isEmpty(true), header() {} bool isEmpty = true; T header; };
   TempHeader<EthernetHeader>  m_ethHeader;         //!< Private EthernetHeader for grabbing information out of the packet
   TempHeader<Ipv4Header> m_ipv4Header;             //!< Private Ipv4Header for grabbing information out of the packet
@@ -161,12 +225,43 @@ private:
   TempHeader<TcpHeader>  m_tcpHeader;              //!< Private TcpHeader for grabbing information out of the packet
   TempHeader<UdpHeader>  m_udpHeader;              //!< Private UdpHeader for grabbing information out of the packet
   /**
-   * \brief Creates a match object from the tempheader information 
-   * \param inPort This field needs to go in the match in addition to the packet fields, but it is not
-   * 			readily available from the packet information.
-   * \return A match object matching whatever information could be discerned from the current packet
+   * \brief Finds the flow a packet is handled by, using the selected classifier
+   * \param key The key extracted from the packet
+   * \return The highest priority matching flow, the oldest one on ties. NULL if none match
+   */
+  const Flow* lookupFlow (const SdnFlowKey &key);
+  /**
+   * \brief Finds the flow a packet is handled by, consulting the microflow cache first
+   * \param key The key extracted from the packet
+   * \return The same flow lookupFlow would return
+   */
+  const Flow* lookupCachedFlow (const SdnFlowKey &key);
+  /**
+   * \brief Empties the microflow cache after a table change, or defers that to endUpdate
+   */
+  void invalidateCache (void);
+  /**
+   * \brief Stores a flow in the table and in the classifier
+   * \param flow The flow to store. Its entry_id must already be assigned
+   * \return Handle to the stored flow
+   */
+  FlowRules::iterator insertFlow (const Flow &flow);
+  /**
+   * \brief Removes a flow from the table and from the classifier
+   * \param flow Handle to the stored flow
    */
-  fluid_msg::of10::Match getPacketFields (uint16_t inPort);
+  void eraseFlow (FlowRules::iterator flow);
+  /**
+   * \brief Cancels the timers of a flow and removes it, without notifying the controller
+   * \param flow Handle to the stored flow
+   */
+  void removeFlow (FlowRules::iterator flow);
+  /**
+   * \brief Applies the actions and cookie of a modify message to a stored flow
+   * \param flow Handle to the stored flow
+   * \param message The flowmod message
+   */
+  void updateFlow (FlowRules::iterator flow, fluid_msg::of10::FlowMod* message);
   /**
    * \brief Action handler for an output action
    * \param pkt The packet being modified from the action
@@ -245,18 +340,57 @@ private:
    */
   void RestructHeader (Ptr<Packet> pkt);
   /**
-   * \brief Idle Time Out Event hook. Gets invoked whenever a flow has reached it's idle time without any activity.
+   * \brief Idle Time Out Event hook. Gets invoked once the idle time has passed since the flow was
+   * installed or last checked. Flows used since then go back on the timer wheel until their idle time would run out.
+   * \param priority Priority of the flow
+   * \param entryId Entry id of the flow
    */
-  void IdleTimeOutEvent(Flow flow);
+  void IdleTimeOutEvent(uint16_t priority, uint64_t entryId);
   /**
    * \brief Hard Time Out Event hook. Gets invoked whenever a flow has reached it's hard time
+   * \param priority Priority of the flow
+   * \param entryId Entry id of the flow
    */
-  void HardTimeOutEvent(Flow flow);
+  void HardTimeOutEvent(uint16_t priority, uint64_t entryId);
   /**
    * \brief Generic timeout. Deletes a flow and asks the owning switch to send a notification to the controller
    */
-  void TimeOutEvent(Flow flow, uint8_t reason);
+  void TimeOutEvent(FlowRules::iterator flow, uint8_t reason);
+  /**
+   * \brief Puts a timeout of a flow on the switch timer wheel
+   * \param priority Priority of the flow
+   * \param entryId Entry id of the flow
+   * \param kind SdnTimer::IDLE_TIMEOUT or SdnTimer::HARD_TIMEOUT
+   * \param delay Time until the timeout is due
+   */
+  void scheduleTimer(uint16_t priority, uint64_t entryId, uint8_t kind, Time delay);
 };
 
+template <typename Writer>
+void
+SdnFlowTable::writeFlowStats (fluid_msg::of10::Match match, uint16_t outPort, Writer &writer)
+{
+  if (outPort != fluid_msg::of10::OFPP_NONE)
+    {
+      std::vector<FlowRules::iterator> candidates;
+      m_flow_table_rules.FindByOutPort (outPort, candidates);
+      for (std::vector<FlowRules::iterator>::iterator i = candidates.begin (); i != candidates.end (); i++)
+        {
+          if (Flow::pkt_match ((*i)->second,match))
+            {
+              writer.Add ((*i)->second.convertToFlowStats ());
+            }
+        }
+      return;
+    }
+  for (FlowRules::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+    {
+      if (Flow::pkt_match (i->second,match))
+        {
+          writer.Add (i->second.convertToFlowStats ());
+        }
+    }
+}
+
 } //End namespace ns3
 #endif
@@ -26,8 +26,6 @@ NS_LOG_COMPONENT_DEFINE ("SdnFlowTable13");
 
 NS_OBJECT_ENSURE_REGISTERED (SdnFlowTable13);
 
-std::map<uint32_t, std::vector< Ptr<SdnFlowTable13> > > SdnFlowTable13::g_flowTables;
-
 TypeId SdnFlowTable13::GetTypeId (void)
 {
   static TypeId tid = TypeId ("ns3::SdnFlowTable13")
@@ -44,21 +42,27 @@ SdnFlowTable13::SdnFlowTable13 (Ptr<SdnSwitch13> parentSwitch)
   m_active_count = 0;
   m_lookup_count = 0;
   m_matched_count = 0;
+  m_packet_total = 0;
+  m_byte_total = 0;
   m_tableid = 0;
+  m_tupleSpaceLookup = false;
+  m_nextEntryId = 0;
+  m_portLive = MakeCallback (&SdnSwitch13::IsPortLive, PeekPointer (parentSwitch));
+  m_groupLive = MakeCallback (&SdnSwitch13::IsGroupLive, PeekPointer (parentSwitch));
 }
 
-Ptr<SdnFlowTable13>
-SdnFlowTable13::addTablesForNewSwitch(Ptr<SdnSwitch13> parent)
+void
+SdnFlowTable13::setTupleSpaceLookup (bool enable)
 {
-	uint32_t datapathId = parent->getDatapathID ();
-	g_flowTables[datapathId] = std::vector< Ptr<SdnFlowTable13> > ();
-	for (uint32_t i = 0; i < 64; ++i)
-	{
-		Ptr<SdnFlowTable13> newTable = Create<SdnFlowTable13> (parent);
-		newTable->setTableID (i);
-		g_flowTables[datapathId].push_back (newTable);
-	}
-	return g_flowTables[datapathId].at(0);
+  m_classifier.Clear ();
+  m_tupleSpaceLookup = enable;
+  if (enable)
+    {
+      for (std::set<Flow13, cmp_priority13>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+        {
+          m_classifier.Insert (&(*i));
+        }
+    }
 }
 
 std::set<Flow13, cmp_priority13>
@@ -67,231 +71,97 @@ SdnFlowTable13::flows ()
   return m_flow_table_rules;
 }
 
-//Returns the out port. If not, return OFPP_NONE
-fluid_msg::ActionSet*
-SdnFlowTable13::handlePacket (Ptr<Packet> pkt, fluid_msg::ActionSet *action_set, uint32_t inPort)
+void
+SdnFlowTable13::handlePacket (Ptr<Packet> pkt, const SdnFlowKey &key, SdnPipelineState &state, uint32_t inPort)
 {
-  DestructHeader (pkt);
-  fluid_msg::of13::Match inputFields = getPacketFields (inPort);
-  std::set<Flow13, cmp_priority13>::iterator flow_rule = m_flow_table_rules.begin ();
-  std::vector<uint32_t> outPorts;
-  for (std::set<Flow13, cmp_priority13>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+  m_lookup_count++;
+  state.nextTable = -1;
+  // Counters and timers are not part of the set ordering, so the stored flow is updated in place
+  Flow13 *flow = const_cast<Flow13 *> (lookupFlow (key, state.metadata));
+  if (!flow)
     {
-      m_lookup_count++;
-      Flow13 tempFlow = *i;
-      if (Flow13::pkt_match (tempFlow,inputFields))
+      return;
+    }
+  m_matched_count++;
+  flow->packet_count_++;
+  flow->byte_count_ += pkt->GetSize ();
+  m_packet_total++;
+  m_byte_total += pkt->GetSize ();
+  //Ordered as the spec executes them: apply, clear, write, write-metadata, goto
+  const std::set<fluid_msg::of13::Instruction*, fluid_msg::of13::comp_inst_set_order> &instruction_list = flow->instructions.instruction_set ();
+  for (std::set<fluid_msg::of13::Instruction*, fluid_msg::of13::comp_inst_set_order>::const_iterator j = instruction_list.begin ();
+       j != instruction_list.end (); j++)
+    {
+      fluid_msg::of13::Instruction* instruction = *j;
+      switch (instruction->type ())
         {
-          m_matched_count++;
-          tempFlow.packet_count_++;
-          tempFlow.byte_count_ += pkt->GetSize ();
-          std::set<fluid_msg::of13::Instruction*, fluid_msg::of13::comp_inst_set_order> instruction_list = tempFlow.instructions.instruction_set ();
-          for (std::set<fluid_msg::of13::Instruction*, fluid_msg::of13::comp_inst_set_order>::iterator j = instruction_list.begin ();
-        		  j != instruction_list.end (); j++)
-          {
-        	  fluid_msg::of13::Instruction* instruction = *j;
-        	  // Required by OpenFlow 1.3.0
-        	  if (instruction->type () == fluid_msg::of13::OFPIT_GOTO_TABLE)
-        	  {
-        		  // Try the next specified table
-        		  fluid_msg::of13::GoToTable *gotoTable = dynamic_cast<fluid_msg::of13::GoToTable *> (instruction);
-        		  return g_flowTables[m_parentSwitch->getDatapathID()].at(gotoTable->table_id ())->handlePacket(pkt, action_set, inPort);
-        	  }
-        	  // Required by OpenFlow 1.3.0
-        	  else if (instruction->type () == fluid_msg::of13::OFPIT_WRITE_ACTIONS)
-        	  {
-        		  fluid_msg::of13::WriteActions *writeAction = dynamic_cast<fluid_msg::of13::WriteActions *> (instruction);
-        		  fluid_msg::ActionSet newActionSet = writeAction->actions();
-        		  for (std::set<fluid_msg::Action*, fluid_msg::comp_action_set_order>::iterator k = newActionSet.action_set ().begin ();
-        				  k != newActionSet.action_set ().end (); k++)
-				  {
-        			  fluid_msg::Action* action = *k;
-        			  action_set->add_action(action);
-				  }
-        	  }
-        	  // Additional instructions are optional for OpenFlow 1.3.0
-        	  else if (instruction->type () == fluid_msg::of13::OFPIT_METER)
-        	  {
-
-        	  }
-        	  else if (instruction->type () == fluid_msg::of13::OFPIT_APPLY_ACTIONS)
-        	  {
-        		  RestructHeader(pkt);
-        		  fluid_msg::of13::ApplyActions* applyAction = dynamic_cast<fluid_msg::of13::ApplyActions*> (instruction);
-        		  fluid_msg::ActionList actions(applyAction->actions());
-                  std::vector<uint32_t> outPorts = handleActions(pkt, &actions);
-
-                  if (!outPorts.empty())
-                  {
-                	  m_parentSwitch->HandlePorts (pkt, outPorts, inPort);
-                  }
-                  DestructHeader(pkt);
-        	  }
-        	  else if (instruction->type () == fluid_msg::of13::OFPIT_CLEAR_ACTIONS)
-        	  {
-
-        	  }
-        	  else if (instruction->type () == fluid_msg::of13::OFPIT_WRITE_METADATA)
-        	  {
-
-        	  }
-
-          }
-          if (tempFlow.idle_timeout_ != 0)
+          // Required by OpenFlow 1.3.0
+          case fluid_msg::of13::OFPIT_GOTO_TABLE:
+            {
+              fluid_msg::of13::GoToTable *gotoTable = static_cast<fluid_msg::of13::GoToTable *> (instruction);
+              state.nextTable = gotoTable->table_id ();
+              break;
+            }
+          // Required by OpenFlow 1.3.0
+          case fluid_msg::of13::OFPIT_WRITE_ACTIONS:
+            {
+              fluid_msg::of13::WriteActions *writeAction = static_cast<fluid_msg::of13::WriteActions *> (instruction);
+              fluid_msg::ActionSet newActionSet = writeAction->actions ();
+              for (std::set<fluid_msg::Action*, fluid_msg::comp_action_set_order>::iterator k = newActionSet.action_set ().begin ();
+                   k != newActionSet.action_set ().end (); k++)
+                {
+                  state.actionSet.add_action ((*k)->clone ()); //The flow keeps its own actions
+                }
+              break;
+            }
+          // Additional instructions are optional for OpenFlow 1.3.0
+          case fluid_msg::of13::OFPIT_APPLY_ACTIONS:
+            {
+              fluid_msg::of13::ApplyActions* applyAction = static_cast<fluid_msg::of13::ApplyActions*> (instruction);
+              fluid_msg::ActionList actions (applyAction->actions ());
+              std::vector<uint32_t> outPorts = handleActions (pkt, key, &actions);
+              if (!outPorts.empty ())
+                {
+                  m_parentSwitch->HandlePorts (pkt, outPorts, inPort);
+                }
+              break;
+            }
+          case fluid_msg::of13::OFPIT_CLEAR_ACTIONS:
+            state.actionSet = fluid_msg::ActionSet ();
+            break;
+          case fluid_msg::of13::OFPIT_WRITE_METADATA:
             {
-              tempFlow.idle_timeout_event.Cancel ();
-              tempFlow.idle_timeout_event = Simulator::Schedule (Seconds (tempFlow.idle_timeout_),&SdnFlowTable13::IdleTimeOutEvent,this,tempFlow);
+              fluid_msg::of13::WriteMetadata *writeMetadata = static_cast<fluid_msg::of13::WriteMetadata *> (instruction);
+              state.metadata = (state.metadata & ~writeMetadata->metadata_mask ()) |
+                (writeMetadata->metadata () & writeMetadata->metadata_mask ());
+              break;
             }
+          case fluid_msg::of13::OFPIT_METER:
+          default:
+            break;
         }
     }
-  RestructHeader (pkt);
-  return action_set;
+  //The idle timeout checks this when it fires, so a busy flow costs no scheduler operations
+  flow->last_used_nsec = Simulator::Now ().GetNanoSeconds ();
 }
 
-//Need to rewrite to make header objects that serialize the iterator, then use their attributes.
-fluid_msg::of13::Match
-SdnFlowTable13::getPacketFields (uint32_t inPort)
+const Flow13*
+SdnFlowTable13::lookupFlow (const SdnFlowKey &key, uint64_t metadata)
 {
- 	 fluid_msg::of13::Match match;
- 
- 	  fluid_msg::of13::InPort *InPort_oxmtlv = dynamic_cast<fluid_msg::of13::InPort *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_IN_PORT));
- 	  InPort_oxmtlv->value(inPort);
- 	  match.add_oxm_field(InPort_oxmtlv);
-
-	  fluid_msg::of13::InPhyPort *InPhyPort_oxmtlv = dynamic_cast<fluid_msg::of13::InPhyPort *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_IN_PHY_PORT));
-	  InPhyPort_oxmtlv->value(inPort);
-	  match.add_oxm_field(InPhyPort_oxmtlv);
- 
- 	  if (!m_tcpHeader.isEmpty) //TCP case
- 	    {
- 	      fluid_msg::of13::TCPDst *Dst_oxmtlv = dynamic_cast<fluid_msg::of13::TCPDst *>(fluid_msg::of13::Match::make_oxm_tlv (fluid_msg::of13::OFPXMT_OFB_TCP_DST));
- 	      Dst_oxmtlv -> value(m_tcpHeader.header.GetDestinationPort());
- 	      match.add_oxm_field(Dst_oxmtlv);
- 
- 	      fluid_msg::of13::TCPSrc *Src_oxmtlv = dynamic_cast<fluid_msg::of13::TCPSrc *>(fluid_msg::of13::Match::make_oxm_tlv (fluid_msg::of13::OFPXMT_OFB_TCP_SRC));
- 	      Src_oxmtlv -> value(m_tcpHeader.header.GetSourcePort());
- 	      match.add_oxm_field(Src_oxmtlv);
- 	    }
- 	  if (!m_udpHeader.isEmpty) //UDP case
- 	    {
- 	      fluid_msg::of13::UDPDst *Dst_oxmtlv = dynamic_cast<fluid_msg::of13::UDPDst *>(fluid_msg::of13::Match::make_oxm_tlv (fluid_msg::of13::OFPXMT_OFB_UDP_DST));
- 	      Dst_oxmtlv -> value(m_udpHeader.header.GetDestinationPort());
- 	      match.add_oxm_field(Dst_oxmtlv);
- 
- 	      fluid_msg::of13::UDPSrc *Src_oxmtlv = dynamic_cast<fluid_msg::of13::UDPSrc *>(fluid_msg::of13::Match::make_oxm_tlv (fluid_msg::of13::OFPXMT_OFB_UDP_SRC));
- 	      Src_oxmtlv -> value(m_udpHeader.header.GetSourcePort());
- 	      match.add_oxm_field(Src_oxmtlv);
- 	    }
- 
- 	  if (!m_ipv4Header.isEmpty) //IPv4 case
- 	    {
- 		  fluid_msg::of13::IPDSCP *Dscp_oxmtlv = dynamic_cast<fluid_msg::of13::IPDSCP *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_IP_DSCP));
- 		  Dscp_oxmtlv->value(m_ipv4Header.header.GetDscp());
- 		  match.add_oxm_field(Dscp_oxmtlv);
- 
- 		  fluid_msg::of13::IPECN *Ecn_oxmtlv = dynamic_cast<fluid_msg::of13::IPECN *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_IP_ECN));
- 		  Ecn_oxmtlv->value(m_ipv4Header.header.GetEcn());
- 		  match.add_oxm_field(Ecn_oxmtlv);
- 
- 	      if (!match.ip_proto ())
- 	        {
- 	    	  fluid_msg::of13::IPProto *IPpro_oxmtlv = dynamic_cast<fluid_msg::of13::IPProto *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_IP_PROTO));
- 	    	  Ecn_oxmtlv->value(m_ipv4Header.header.GetProtocol());
- 	    	  match.add_oxm_field(IPpro_oxmtlv);
- 	        }
- 
- 		  fluid_msg::of13::IPv4Src *Src_oxmtlv = dynamic_cast<fluid_msg::of13::IPv4Src *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_IPV4_SRC));
- 		  Src_oxmtlv->value(m_ipv4Header.header.GetSource().Get());
- 		  match.add_oxm_field(Src_oxmtlv);
- 
- 		  fluid_msg::of13::IPv4Dst *Dst_oxmtlv = dynamic_cast<fluid_msg::of13::IPv4Dst *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_IPV4_DST));
- 		  Dst_oxmtlv->value(fluid_msg::IPAddress(m_ipv4Header.header.GetDestination().Get()));
- 		  match.add_oxm_field(Dst_oxmtlv);
- 
- 
- 	      if ((m_ipv4Header.header.GetProtocol () == 1) && (!m_icmpv4Header.isEmpty))
- 		    {
- 	    	  fluid_msg::of13::ICMPv4Type *Type_oxmtlv = dynamic_cast<fluid_msg::of13::ICMPv4Type *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_ICMPV4_TYPE));
- 	    	  Type_oxmtlv->value(m_icmpv4Header.header.GetType ());
- 	    	  match.add_oxm_field(Type_oxmtlv);
- 
- 	    	  fluid_msg::of13::ICMPv4Code *Code_oxmtlv = dynamic_cast<fluid_msg::of13::ICMPv4Code *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_ICMPV4_CODE));
- 	    	  Type_oxmtlv->value(m_icmpv4Header.header.GetCode ());
- 	    	  match.add_oxm_field(Code_oxmtlv);
- 		    }
- 	    }
- 	  if (!m_ipv6Header.isEmpty) //IPv6 case
- 	    {
- 	      uint8_t sourceBuffer[16];
- 	      m_ipv6Header.header.GetSourceAddress ().GetBytes (sourceBuffer);
- 		  fluid_msg::of13::IPv6Src *Src_oxmtlv = dynamic_cast<fluid_msg::of13::IPv6Src *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_IPV6_SRC));
- 		  Src_oxmtlv->value(fluid_msg::IPAddress(sourceBuffer));
- 		  match.add_oxm_field(Src_oxmtlv);
- 
- 	      uint8_t destinationBuffer[16];
- 	      m_ipv6Header.header.GetDestinationAddress ().GetBytes (destinationBuffer);
- 		  fluid_msg::of13::IPv6Dst *Dst_oxmtlv = dynamic_cast<fluid_msg::of13::IPv6Dst *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_IPV6_DST));
- 		  Dst_oxmtlv->value(fluid_msg::IPAddress(destinationBuffer));
- 		  match.add_oxm_field(Dst_oxmtlv);
- 
- 		  fluid_msg::of13::IPV6Flabel *Flabel_oxmtlv = dynamic_cast<fluid_msg::of13::IPV6Flabel *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_IPV6_FLABEL));
- 		  Flabel_oxmtlv->value(m_ipv6Header.header.GetFlowLabel());
- 		  match.add_oxm_field(Flabel_oxmtlv);
- 	    }
- 	  if (!m_arpHeader.isEmpty) //Arp case
- 	    {
- 
- 		  fluid_msg::of13::ARPOp *Op_oxmtlv = dynamic_cast<fluid_msg::of13::ARPOp *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_ARP_OP));
- 		  Op_oxmtlv->value((uint16_t)m_arpHeader.header.IsRequest () ? ArpHeader::ARP_TYPE_REQUEST: ArpHeader::ARP_TYPE_REPLY);
- 		  match.add_oxm_field(Op_oxmtlv); //????
- 
- 	      //match.nw_proto ((uint8_t)(m_arpHeader.header.IsRequest () ? ArpHeader::ARP_TYPE_REQUEST : ArpHeader::ARP_TYPE_REPLY));
- 
- 		  fluid_msg::of13::ARPSPA *SPA_oxmtlv = dynamic_cast<fluid_msg::of13::ARPSPA *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_ARP_SPA));
- 		  SPA_oxmtlv->value(fluid_msg::IPAddress(m_arpHeader.header.GetSourceIpv4Address().Get()));
- 		  match.add_oxm_field(SPA_oxmtlv);
- 
- 		  fluid_msg::of13::ARPTPA *TPA_oxmtlv = dynamic_cast<fluid_msg::of13::ARPTPA *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_ARP_TPA));
- 		  TPA_oxmtlv->value(fluid_msg::IPAddress(m_arpHeader.header.GetDestinationIpv4Address().Get()));
- 		  match.add_oxm_field(TPA_oxmtlv);
- 
- 		  uint8_t srcAddr[6];
- 		  m_arpHeader.header.GetSourceHardwareAddress().CopyTo(srcAddr);
- 		  fluid_msg::of13::ARPSHA *SHA_oxmtlv = dynamic_cast<fluid_msg::of13::ARPSHA *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_ARP_SHA));
- 		  SHA_oxmtlv->value(fluid_msg::EthAddress(srcAddr));
- 		  match.add_oxm_field(SHA_oxmtlv);
- 
- 		  uint8_t dstAddr[6];
- 		  m_arpHeader.header.GetDestinationHardwareAddress().CopyTo(dstAddr);
- 		  fluid_msg::of13::ARPTHA *THA_oxmtlv = dynamic_cast<fluid_msg::of13::ARPTHA *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_ARP_THA));
- 		  THA_oxmtlv->value(fluid_msg::EthAddress(dstAddr));
- 		  match.add_oxm_field(THA_oxmtlv);
- 
- 	    }
- 	  if (!m_ethHeader.isEmpty) //Ethernet case
- 	    {
- 	      uint8_t srcAddr[6];
- 	      m_ethHeader.header.GetSource ().CopyTo (srcAddr);
- 	      uint8_t dstAddr[6];
- 	      m_ethHeader.header.GetDestination ().CopyTo (dstAddr);
- 
- 		  fluid_msg::of13::EthSrc *Src_oxmtlv = dynamic_cast<fluid_msg::of13::EthSrc *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_ETH_SRC));
- 		  Src_oxmtlv->value(fluid_msg::EthAddress(srcAddr));
- 		  match.add_oxm_field(Src_oxmtlv);
- 
- 		  fluid_msg::of13::EthDst *Dst_oxmtlv = dynamic_cast<fluid_msg::of13::EthDst *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_ETH_DST));
- 		  Dst_oxmtlv->value(fluid_msg::EthAddress(dstAddr));
- 		  match.add_oxm_field(Dst_oxmtlv);
- 
- 		  fluid_msg::of13::EthType *Type_oxmtlv = dynamic_cast<fluid_msg::of13::EthType *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_ETH_TYPE));
- 		  Type_oxmtlv->value(m_ethHeader.header.GetLengthType ());
- 		  match.add_oxm_field(Type_oxmtlv);
- 
- 	      //No VLAN header accessor yet
- 		  fluid_msg::of13::VLANVid *Vid_oxmtlv = dynamic_cast<fluid_msg::of13::VLANVid *>(fluid_msg::of13::Match::make_oxm_tlv(fluid_msg::of13::OFPXMT_OFB_VLAN_VID));
- 		  Vid_oxmtlv->value(0);
- 		  match.add_oxm_field(Vid_oxmtlv);
- 	    }
- 	  return match;
+  if (m_tupleSpaceLookup)
+    {
+      return m_classifier.Lookup (key, metadata);
+    }
+  const Flow13 *best = NULL;
+  for (std::set<Flow13, cmp_priority13>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+    {
+      if (i->compiled_match.Matches (key) && i->compiled_match.MatchesMetadata (metadata)
+          && (!best || SdnTupleSpace<Flow13>::Precedes (&(*i), best)))
+        {
+          best = &(*i);
+        }
+    }
+  return best;
 }
 
 std::vector<Flow13>
@@ -312,7 +182,7 @@ SdnFlowTable13::matchingFlows (fluid_msg::of13::Match match)
 //ACTION HANDLERS
 
 std::vector<uint32_t>
-SdnFlowTable13::handleActions (Ptr<Packet> pkt,fluid_msg::ActionSet* action_set)
+SdnFlowTable13::handleActions (Ptr<Packet> pkt,const SdnFlowKey &key,fluid_msg::ActionSet* action_set)
 {
   std::vector<uint32_t> outPorts;
   uint32_t length = 0;
@@ -333,7 +203,7 @@ SdnFlowTable13::handleActions (Ptr<Packet> pkt,fluid_msg::ActionSet* action_set)
 			case fluid_msg::of13::OFPAT_GROUP:
 			{
 				fluid_msg::of13::GroupAction* groupAction = dynamic_cast<fluid_msg::of13::GroupAction*>(action);
-				std::vector<uint32_t> extraPorts = handleGroupAction (pkt,groupAction);
+				std::vector<uint32_t> extraPorts = handleGroupAction (pkt,key,groupAction);
 				for (std::vector<uint32_t>::iterator extraPort = extraPorts.begin(); extraPort != extraPorts.end(); ++extraPort)
 			      {
 				    outPorts.push_back(*extraPort);
@@ -348,7 +218,7 @@ SdnFlowTable13::handleActions (Ptr<Packet> pkt,fluid_msg::ActionSet* action_set)
 }
 
 std::vector<uint32_t>
-SdnFlowTable13::handleActions (Ptr<Packet> pkt,fluid_msg::ActionList* action_list)
+SdnFlowTable13::handleActions (Ptr<Packet> pkt,const SdnFlowKey &key,fluid_msg::ActionList* action_list)
 {
   std::vector<uint32_t> outPorts;
   uint32_t length = 0;
@@ -369,7 +239,7 @@ SdnFlowTable13::handleActions (Ptr<Packet> pkt,fluid_msg::ActionList* action_lis
 			case fluid_msg::of13::OFPAT_GROUP:
 			{
 				fluid_msg::of13::GroupAction* groupAction = dynamic_cast<fluid_msg::of13::GroupAction*>(action);
-				std::vector<uint32_t> extraPorts = handleGroupAction (pkt,groupAction);
+				std::vector<uint32_t> extraPorts = handleGroupAction (pkt,key,groupAction);
 				for (std::vector<uint32_t>::iterator extraPort = extraPorts.begin(); extraPort != extraPorts.end(); ++extraPort)
 			      {
 				    outPorts.push_back(*extraPort);
@@ -394,168 +264,41 @@ SdnFlowTable13::handleOutputAction (Ptr<Packet> pkt,fluid_msg::of13::OutputActio
 }
 
 std::vector<uint32_t>
-SdnFlowTable13::handleGroupAction (Ptr<Packet> pkt,fluid_msg::of13::GroupAction* action)
+SdnFlowTable13::handleGroupAction (Ptr<Packet> pkt,const SdnFlowKey &key,fluid_msg::of13::GroupAction* action)
 {
   std::vector<uint32_t> outPorts;
-  // Figure out which group table to gather action buckets from.
-  if (m_groupTable.count(action->group_id()))
+  Ptr<SdnGroup13> group = m_parentSwitch->GetGroup (action->group_id ());
+  if (!group)
     {
-	  for (std::vector<fluid_msg::of13::Bucket>::iterator i = m_groupTable[action->group_id()]->m_groupDesc.buckets().begin ();
-			  i != m_groupTable[action->group_id()]->m_groupDesc.buckets().end(); i++)
-	    {
-		  fluid_msg::ActionSet action_set = i->get_actions();
-		  std::vector<uint32_t> extraPorts = handleActions (pkt, &action_set);
-		  for (std::vector<uint32_t>::iterator extraPort = extraPorts.begin(); extraPort != extraPorts.end(); ++extraPort)
-			{
-			  outPorts.push_back(*extraPort);
-			}
-	    }
+      return outPorts;
     }
-  return outPorts;
-}
-
-//Utility methods to deconstruct/reconstruct headers
-Ptr<Packet>
-SdnFlowTable13::DestructHeader (Ptr<Packet> pkt)
-{
-  PacketMetadata metadata (pkt->GetUid (),pkt->GetSize ());
-  PacketMetadata::ItemIterator iterator = pkt->BeginItem ();
-  PacketMetadata::Item item;
-  while (iterator.HasNext ())
+  if (group->GetType () == fluid_msg::of13::OFPGT_ALL)
     {
-      item = iterator.Next ();
-      if (item.type != PacketMetadata::Item::HEADER)
-        {
-          continue;
-        }
-      else if (item.tid.GetName () == "ns3::TcpHeader" && pkt->PeekHeader (m_tcpHeader.header))
-        {
-          pkt->RemoveHeader (m_tcpHeader.header);
-          m_tcpHeader.isEmpty = false;
-        }
-      else if (item.tid.GetName () == "ns3::UdpHeader" && pkt->PeekHeader (m_udpHeader.header))
-        {
-          pkt->RemoveHeader (m_udpHeader.header);
-          m_udpHeader.isEmpty = false;
-        }
-      else if (item.tid.GetName () == "ns3::Ipv4Header" && pkt->PeekHeader (m_ipv4Header.header))
-        {
-          pkt->RemoveHeader (m_ipv4Header.header);
-          m_ipv4Header.isEmpty = false;
-        }
-      else if (item.tid.GetName () == "ns3::Icmpv4Header" && pkt->PeekHeader (m_icmpv4Header.header))
-        {
-          pkt->RemoveHeader (m_icmpv4Header.header);
-          m_icmpv4Header.isEmpty = false;
-        }
-      else if (item.tid.GetName () == "ns3::Ipv6Header" && pkt->PeekHeader (m_ipv6Header.header))
-        {
-          pkt->RemoveHeader (m_ipv6Header.header);
-          m_ipv6Header.isEmpty = false;
-        }
-      else if (item.tid.GetName () == "ns3::Ipv6ExtensionHeader" && pkt->PeekHeader (m_ipv6ExtHeader.header))
-        {
-          pkt->RemoveHeader (m_ipv6ExtHeader.header);
-          m_ipv6ExtHeader.isEmpty = false;
-        }
-      else if (item.tid.GetName () == "ns3::Ipv6OptionHeader" && pkt->PeekHeader (m_ipv6OptHeader.header))
-        {
-          pkt->RemoveHeader (m_ipv6OptHeader.header);
-          m_ipv6OptHeader.isEmpty = false;
-        }
-      else if (item.tid.GetName () == "ns3::Icmpv6Header" && pkt->PeekHeader (m_icmpv6Header.header))
-        {
-          pkt->RemoveHeader (m_icmpv6Header.header);
-          m_icmpv6Header.isEmpty = false;
-        }
-      else if (item.tid.GetName () == "ns3::ArpHeader"  && pkt->PeekHeader (m_arpHeader.header))
-        {
-          pkt->RemoveHeader (m_arpHeader.header);
-          m_arpHeader.isEmpty = false;
-        }
-      else if (item.tid.GetName () == "ns3::EthernetHeader" && pkt->PeekHeader (m_ethHeader.header))
-        {
-          pkt->RemoveHeader (m_ethHeader.header);
-          m_ethHeader.isEmpty = false;
-        }
-      else if (item.tid.GetName () == "ns3::LlcSnapHeader")
+      group->Count (-1, pkt->GetSize ());
+      for (uint32_t i = 0; i < group->GetNBuckets (); ++i)
         {
+          SdnGroup13::Bucket &bucket = group->GetBucket (i);
+          bucket.packetCount++;
+          bucket.byteCount += pkt->GetSize ();
+          std::vector<uint32_t> extraPorts = handleActions (pkt, key, &bucket.actions);
+          outPorts.insert (outPorts.end (), extraPorts.begin (), extraPorts.end ());
         }
+      return outPorts;
     }
-  return pkt;
-}
 
-//Does the opposite, re-adds the headers we need
-void
-SdnFlowTable13::RestructHeader (Ptr<Packet> pkt)
-{
-  if (!m_udpHeader.isEmpty)
+  int32_t chosen = group->ChooseBucket (key, m_portLive, m_groupLive);
+  group->Count (chosen, pkt->GetSize ());
+  if (chosen >= 0)
     {
-      pkt->AddHeader (m_udpHeader.header);
+      outPorts = handleActions (pkt, key, &group->GetBucket (chosen).actions);
     }
-  if (!m_tcpHeader.isEmpty)
-    {
-      pkt->AddHeader (m_tcpHeader.header);
-    }
-  if (!m_icmpv6Header.isEmpty)
-    {
-      pkt->AddHeader (m_icmpv6Header.header);
-    }
-  if (!m_ipv6OptHeader.isEmpty)
-    {
-      pkt->AddHeader (m_ipv6OptHeader.header);
-    }
-  if (!m_ipv6ExtHeader.isEmpty)
-    {
-      pkt->AddHeader (m_ipv6ExtHeader.header);
-    }
-  if (!m_icmpv4Header.isEmpty)
-    {
-      pkt->AddHeader (m_icmpv4Header.header);
-    }
-  if (!m_ipv6Header.isEmpty)
-    {
-      pkt->AddHeader (m_ipv6Header.header);
-    }
-  if (!m_ipv4Header.isEmpty)
-    {
-      pkt->AddHeader (m_ipv4Header.header);
-    }
-  if (!m_arpHeader.isEmpty)
-    {
-      pkt->AddHeader (m_arpHeader.header);
-    }
-  if (!m_ethHeader.isEmpty)
-    {
-      pkt->AddHeader (m_ethHeader.header);
-    }
-  //Clear out headers so they're useful for the next read
-  m_ethHeader.header = EthernetHeader ();
-  m_ethHeader.isEmpty = true;
-  m_ipv4Header.header = Ipv4Header ();
-  m_ipv4Header.isEmpty = true;
-  m_ipv6Header.header = Ipv6Header ();
-  m_ipv6Header.isEmpty = true;
-  m_arpHeader.header = ArpHeader ();
-  m_arpHeader.isEmpty = true;
-  m_tcpHeader.header = TcpHeader ();
-  m_tcpHeader.isEmpty = true;
-  m_udpHeader.header = UdpHeader ();
-  m_udpHeader.isEmpty = true;
+  return outPorts;
 }
 
-fluid_msg::of13::TableStats*
-SdnFlowTable13::convertToTableStats (uint8_t whichTable)
+fluid_msg::of13::TableStats
+SdnFlowTable13::convertToTableStats (void)
 {
-	uint32_t datapathId = m_parentSwitch->getDatapathID();
-	if (g_flowTables.count(datapathId))
-	  {
-		  return new fluid_msg::of13::TableStats (whichTable,
-				  g_flowTables[datapathId].at(whichTable)->m_active_count,
-				  g_flowTables[datapathId].at(whichTable)->m_lookup_count,
-				  g_flowTables[datapathId].at(whichTable)->m_matched_count);
-	  }
-	return NULL;
+  return fluid_msg::of13::TableStats (m_tableid, m_active_count, m_lookup_count, m_matched_count);
 }
 
 //Checks if this flow will conflict with a current flow of the same priority
@@ -587,6 +330,7 @@ SdnFlowTable13::addFlow (fluid_msg::of13::FlowMod* message)
   newFlow.byte_count_ = 0;
 
   newFlow.match = message->match ();
+  newFlow.compiled_match = SdnFlowMatch::FromOf13 (newFlow.match);
   newFlow.instructions = message->instructions ();
   //newFlow.match.dl_vlan (0); // Hack since ns-3 doesn't currently support VLAN
   //newFlow.actions = message->actions ();
@@ -599,15 +343,16 @@ SdnFlowTable13::addFlow (fluid_msg::of13::FlowMod* message)
     {
       deleteFlow (message);
     }
+  newFlow.entry_id = m_nextEntryId++;
   if (newFlow.idle_timeout_ != 0)
     {
-      newFlow.idle_timeout_event = Simulator::Schedule (Seconds (newFlow.idle_timeout_),&SdnFlowTable13::IdleTimeOutEvent,this,newFlow);
+      scheduleTimer (newFlow.priority_, newFlow.entry_id, SdnTimer::IDLE_TIMEOUT, Seconds (newFlow.idle_timeout_));
     }
   if (newFlow.hard_timeout_ != 0)
     {
-      newFlow.hard_timeout_event = Simulator::Schedule (Seconds (newFlow.hard_timeout_),&SdnFlowTable13::HardTimeOutEvent,this,newFlow);
+      scheduleTimer (newFlow.priority_, newFlow.entry_id, SdnTimer::HARD_TIMEOUT, Seconds (newFlow.hard_timeout_));
     }
-  m_flow_table_rules.insert (newFlow);
+  insertFlow (newFlow);
   m_active_count++;
   return newFlow;
 }
@@ -618,21 +363,14 @@ SdnFlowTable13::modifyFlow (fluid_msg::of13::FlowMod* message)
   NS_LOG_DEBUG ("Modifying flow on switch at time" << Simulator::Now ().GetSeconds ());
   for (std::set<Flow13, cmp_priority13>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
     {
-      Flow13 flow = *i;
-      if (flow.priority_ == message->priority () && Flow13::pkt_match (flow,message->match ()))
+      if (i->priority_ == message->priority () && Flow13::pkt_match (*i,message->match ()))
         {
+          // Instructions, cookie and timers are not part of the set ordering, so the stored flow is updated in place
+          Flow13 &flow = const_cast<Flow13 &> (*i);
           flow.instructions = message->instructions ();
           flow.cookie_ = message->cookie ();
-          if (flow.idle_timeout_ != 0)
-            {
-              flow.idle_timeout_event.Cancel ();
-              flow.idle_timeout_event = Simulator::Schedule (Seconds (flow.idle_timeout_),&SdnFlowTable13::IdleTimeOutEvent,this,flow);
-            }
-          if (flow.hard_timeout_ != 0)
-            {
-              flow.hard_timeout_event.Cancel ();
-              flow.hard_timeout_event = Simulator::Schedule (Seconds (flow.hard_timeout_),&SdnFlowTable13::HardTimeOutEvent,this,flow);
-            }
+          //Restarts the idle time, the pending idle timer re-checks it. Timeouts are unchanged, as in the spec.
+          flow.last_used_nsec = Simulator::Now ().GetNanoSeconds ();
           return flow;
         }
     }
@@ -643,91 +381,114 @@ void
 SdnFlowTable13::deleteFlow (fluid_msg::of13::FlowMod* message)
 {
   NS_LOG_DEBUG ("Deleting flow on switch at time" << Simulator::Now ().GetSeconds ());
-  for (std::set<Flow13, cmp_priority13>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+  for (std::set<Flow13, cmp_priority13>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); )
     {
-      Flow13 flow = *i;
-      if (flow.priority_ == message->priority () && Flow13::pkt_match (flow,message->match ()))
+      if (i->priority_ == message->priority () && Flow13::pkt_match (*i,message->match ()))
         {
-          if (flow.idle_timeout_ != 0)
-            {
-              flow.idle_timeout_event.Cancel ();
-            }
-          if (flow.hard_timeout_ != 0)
-            {
-              flow.hard_timeout_event.Cancel ();
-            }
-          m_flow_table_rules.erase (flow);
+          //Pending timers of the flow find it gone and do nothing
+          eraseFlow (i++);
+          m_active_count--;
+        }
+      else
+        {
+          i++;
         }
     }
-  m_active_count--;
 }
 
-Ptr<SdnGroup13>
-SdnFlowTable13::addGroup (fluid_msg::of13::GroupMod* message)
+void
+SdnFlowTable13::insertFlow (const Flow13 &flow)
 {
-  NS_LOG_DEBUG ("Adding new group on switch at time" << Simulator::Now ().GetSeconds ());
-  Ptr<SdnGroup13> newGroup = CreateObject<SdnGroup13> (message);
-
-  // If matching group already exists, cannot add.
-  if (m_groupTable.count(message->group_id()))
-	{
-	  return newGroup;
-	}
-
-  m_groupTable[message->group_id()] = newGroup;
-  return m_groupTable[message->group_id()];
+  std::set<Flow13, cmp_priority13>::iterator stored = m_flow_table_rules.insert (flow).first;
+  if (m_tupleSpaceLookup)
+    {
+      m_classifier.Insert (&(*stored));
+    }
 }
 
-Ptr<SdnGroup13>
-SdnFlowTable13::modifyGroup (fluid_msg::of13::GroupMod* message)
+void
+SdnFlowTable13::eraseFlow (std::set<Flow13, cmp_priority13>::iterator flow)
 {
-  NS_LOG_DEBUG ("Modifying group on switch at time" << Simulator::Now ().GetSeconds ());
-  Ptr<SdnGroup13> newGroup = CreateObject<SdnGroup13> (message);
-
-  // If no matching group already exists, cannot modify.
-  if (m_groupTable.count(newGroup->m_groupDesc.group_id()) == 0)
-	{
-	  return newGroup;
-	}
+  m_packet_total -= flow->packet_count_;
+  m_byte_total -= flow->byte_count_;
+  if (m_tupleSpaceLookup)
+    {
+      m_classifier.Remove (&(*flow));
+    }
+  m_flow_table_rules.erase (flow);
+}
 
-  m_groupTable[newGroup->m_groupDesc.group_id()] = newGroup;
-  return m_groupTable[newGroup->m_groupDesc.group_id()];
+std::set<Flow13, cmp_priority13>::iterator
+SdnFlowTable13::findFlow (uint16_t priority, uint64_t entryId)
+{
+  Flow13 probe;
+  probe.priority_ = priority;
+  probe.entry_id = entryId;
+  return m_flow_table_rules.find (probe);
 }
 
 void
-SdnFlowTable13::deleteGroup (fluid_msg::of13::GroupMod* message)
+SdnFlowTable13::IdleTimeOutEvent (uint16_t priority, uint64_t entryId)
 {
-  NS_LOG_DEBUG ("Deleting group on switch at time" << Simulator::Now ().GetSeconds ());
-  if (message->group_id() == fluid_msg::of13::OFPG_ALL)
+  std::set<Flow13, cmp_priority13>::iterator i = findFlow (priority, entryId);
+  if (i == m_flow_table_rules.end ())
     {
-	  m_groupTable.clear();
+      return;
     }
-  else if (m_groupTable.count(message->group_id()))
+  Time expiry = NanoSeconds (i->last_used_nsec) + Seconds (i->idle_timeout_);
+  if (expiry > Simulator::Now ())
     {
-	  m_groupTable.erase(message->group_id());
+      //Used since this timer was scheduled, check again when it would go idle
+      scheduleTimer (priority, entryId, SdnTimer::IDLE_TIMEOUT, expiry - Simulator::Now ());
+      return;
     }
+  NS_LOG_DEBUG ("Idle timeout event of flow at time " << Simulator::Now ().GetSeconds ());
+  TimeOutEvent (i, fluid_msg::of13::OFPRR_IDLE_TIMEOUT);
 }
 
 void
-SdnFlowTable13::IdleTimeOutEvent (Flow13 flow)
+SdnFlowTable13::HardTimeOutEvent (uint16_t priority, uint64_t entryId)
 {
-  NS_LOG_DEBUG ("Idle timeout event of flow at time " << Simulator::Now ().GetSeconds ());
-  TimeOutEvent (flow, fluid_msg::of13::OFPRR_IDLE_TIMEOUT);
+  NS_LOG_DEBUG ("Hard timeout event of flow at time " << Simulator::Now ().GetSeconds ());
+  std::set<Flow13, cmp_priority13>::iterator i = findFlow (priority, entryId);
+  if (i != m_flow_table_rules.end ())
+    {
+      TimeOutEvent (i, fluid_msg::of13::OFPRR_HARD_TIMEOUT);
+    }
 }
 
 void
-SdnFlowTable13::HardTimeOutEvent (Flow13 flow)
+SdnFlowTable13::TimeOutEvent (std::set<Flow13, cmp_priority13>::iterator flow, uint8_t reason)
 {
-  NS_LOG_DEBUG ("Hard timeout event of flow at time " << Simulator::Now ().GetSeconds ());
-  TimeOutEvent (flow, fluid_msg::of13::OFPRR_HARD_TIMEOUT);
+  Flow13 removed = *flow;
+  eraseFlow (flow);
+  m_active_count--;
+  //Send a flow removed message back to controller
+  m_parentSwitch->SendFlowRemovedMessageToController (removed,reason);
 }
 
 void
-SdnFlowTable13::TimeOutEvent (Flow13 flow, uint8_t reason)
+SdnFlowTable13::expireTimer (SdnTimer timer)
 {
-  m_flow_table_rules.erase (flow);
-  m_parentSwitch->SendFlowRemovedMessageToController (flow,reason);
-  //Send a flow removed message back to controller
+  if (timer.kind == SdnTimer::IDLE_TIMEOUT)
+    {
+      IdleTimeOutEvent (timer.priority, timer.entry_id);
+    }
+  else
+    {
+      HardTimeOutEvent (timer.priority, timer.entry_id);
+    }
+}
+
+void
+SdnFlowTable13::scheduleTimer (uint16_t priority, uint64_t entryId, uint8_t kind, Time delay)
+{
+  SdnTimer timer;
+  timer.entry_id = entryId;
+  timer.priority = priority;
+  timer.table_id = m_tableid;
+  timer.kind = kind;
+  m_parentSwitch->GetTimerWheel ().Schedule (delay, timer);
 }
 
 } //End ns3 namespace
@@ -44,21 +44,38 @@
 #include "Flow13.h"
 #include "SdnGroup13.h"
 #include "SdnCommon.h"
+#include "SdnFlowKey.h"
+#include "SdnTupleSpace.h"
+#include "SdnRuleStore.h"
+#include "SdnPacketParser.h"
+#include "SdnTimerWheel.h"
 
 namespace ns3 {
 
 class SdnSwitch13;
 /**
- * A comparators for flows. Sort via priority
+ * A comparators for flows. Sort via priority, highest first, then by insertion order
  */
 struct cmp_priority13
 {
   bool operator() (const Flow13 &lhs, const Flow13 &rhs) const
   {
-    return lhs.priority_ <= rhs.priority_;
+    return SdnRuleOrderLess () (SdnRuleOrder (lhs.priority_, lhs.entry_id), SdnRuleOrder (rhs.priority_, rhs.entry_id));
   }
 };
 
+/**
+ * \brief What a packet carries from one table of an OpenFlow 1.3 pipeline to the next.
+ * Lives on the stack of SdnSwitch13::HandlePacket for the whole walk through the pipeline.
+ */
+struct SdnPipelineState
+{
+  SdnPipelineState () : metadata (0), nextTable (-1) {}
+  uint64_t metadata;              //!< Written by WRITE_METADATA instructions
+  int32_t nextTable;              //!< Table named by the GOTO_TABLE instruction of the matched flow, -1 if none
+  fluid_msg::ActionSet actionSet; //!< Built up by WRITE_ACTIONS and CLEAR_ACTIONS, executed once the pipeline ends
+};
+
 /**
  * \ingroup sdn
  * \defgroup SdnFlowTable13
@@ -71,7 +88,7 @@ struct cmp_priority13
 class SdnFlowTable13 : public Object
 {
 public:
-  SdnFlowTable13() {}
+  SdnFlowTable13() : m_tupleSpaceLookup (false), m_nextEntryId (0) {}
   SdnFlowTable13(Ptr<SdnSwitch13> parentSwitch);
   /**
    * \brief Get the type ID.
@@ -79,14 +96,18 @@ public:
    */
   static TypeId GetTypeId (void);
 
-  static Ptr<SdnFlowTable13> addTablesForNewSwitch (Ptr<SdnSwitch13> parent);
-  static std::map<uint32_t, std::vector< Ptr<SdnFlowTable13> > > g_flowTables;
   /**
-   * \brief reads a packet and commits the actions given the flows in the flow table
+   * \brief Runs a packet through this table only. Apply-actions are executed right away, the
+   * other instructions of the matched flow update the pipeline state. The switch moves on to
+   * state.nextTable, if set.
    * \param pkt The packet to read
-   * \return The ports  the switch must outport the packet from. If no outport is discerned, the vector will be empty
+   * \param key The fields parsed from the packet once by the switch, shared by every table it visits.
+   * Apply-actions only output and group, so they never leave it stale; implementing set-field,
+   * push/pop or dec TTL means parsing the packet again before the next table
+   * \param state The pipeline state of the packet. nextTable is reset on entry
+   * \param inPort The port the packet arrived on
    */
-  fluid_msg::ActionSet* handlePacket (Ptr<Packet> pkt, fluid_msg::ActionSet *action_set, uint32_t inPort);
+  void handlePacket (Ptr<Packet> pkt, const SdnFlowKey &key, SdnPipelineState &state, uint32_t inPort);
   /**
    * \brief Getter for tableID
    * \return tableID
@@ -97,25 +118,46 @@ public:
    * \param tid TableID to set to
    */
   void setTableID (uint32_t tid) { m_tableid = tid; }
+  /**
+   * \brief Selects how packets are classified against the flow table
+   * \param enable True to use the tuple space classifier, false for a linear scan
+   */
+  void setTupleSpaceLookup (bool enable);
+  /**
+   * \brief Getter for the classifier selection
+   * \return True if the tuple space classifier is in use
+   */
+  bool getTupleSpaceLookup (void) const { return m_tupleSpaceLookup; }
   /**
    * \brief Creates a tablestats object describing the flow table
-   * \return A new table stats object
+   * \return The table stats object
    */
-  fluid_msg::of13::TableStats* convertToTableStats(uint8_t whichTable = 0);
+  fluid_msg::of13::TableStats convertToTableStats(void);
   /**
    * \brief Applies an action to a packet. Main entry point to other more specific action handlers
    * \param pkt The packet to modify
+   * \param key The fields the switch parsed from the packet, hashed by SELECT groups
    * \action The action to apply to the packet
    * \return An outport if one is set. OFPP_NONE otherwise
    */
-  std::vector<uint32_t> handleActions(Ptr<Packet> pkt,fluid_msg::ActionSet* action_set);
-  std::vector<uint32_t> handleActions(Ptr<Packet> pkt,fluid_msg::ActionList* action_list);
+  std::vector<uint32_t> handleActions(Ptr<Packet> pkt,const SdnFlowKey &key,fluid_msg::ActionSet* action_set);
+  std::vector<uint32_t> handleActions(Ptr<Packet> pkt,const SdnFlowKey &key,fluid_msg::ActionList* action_list);
   /**
    * \brief Finds a vector of flows in the table that will match to this specific match
    * \param match The match object that describes what we're looking for from the flows
    * \return A vector of all matching flows
    */
   std::vector<Flow13> matchingFlows(fluid_msg::of13::Match match);
+  /**
+   * \brief Hands the stats of every flow a flow stats request selects to a writer, one flow at a
+   * time and without copying the flows
+   * \param match The match object that describes what we're looking for from the flows
+   * \param cookie Cookie the flows must have, in the bits set in cookieMask
+   * \param cookieMask Bits of the cookie to check, 0 for any cookie
+   * \param writer Anything with an Add (fluid_msg::of13::FlowStats), usually an SdnMultipartWriter
+   */
+  template <typename Writer>
+  void writeFlowStats(fluid_msg::of13::Match match, uint64_t cookie, uint64_t cookieMask, Writer &writer);
   /**
    * \brief A check to find whether a flow will conflict with any allready in the flow table
    * \param flow The possibly offending new flow
@@ -141,68 +183,32 @@ public:
    */
   void deleteFlow(fluid_msg::of13::FlowMod* message);
   //void deleteFlowStrict(fluid_msg::of13::FlowMod* message);
-  /**
-   * \brief Adds a new group into the table
-   * \param message The groupmod message that defines the new group to add
-   * \return The newly created group
-   */
-  Ptr<SdnGroup13> addGroup(fluid_msg::of13::GroupMod* message);
-  /**
-   * \brief Modifies a group in the table
-   * \param message The groupmod message that defines the modified group
-   * \return The modified group
-   */
-  Ptr<SdnGroup13> modifyGroup(fluid_msg::of13::GroupMod* message);
-    /**
-   * \brief Deletes a group in the table
-   * \param message The groupmod message that defines the group to delete
-   */
-  void deleteGroup(fluid_msg::of13::GroupMod* message);
   /**
    * \brief Getter for all the flows in the table
    * \return m_table_flow_rules
    */
   std::set<Flow13, cmp_priority13> flows();
+  /**
+   * \brief Handles a flow timeout taken off the switch timer wheel
+   * \param timer The expired timer, ignored if its flow is gone
+   */
+  void expireTimer(SdnTimer timer);
   //stat entries
   uint32_t m_max_entries;   //!< A count of all flow entries in the table
   uint32_t m_active_count;  //!< A count of all active flow entries in the table 
   uint64_t m_lookup_count;  //!< A count of all lookups done in the table
   uint64_t m_matched_count; //!< A count of all total matches completed in the table
-  std::map<uint32_t, Ptr<SdnGroup13> > m_groupTable;
+  uint64_t m_packet_total;  //!< Packet count summed over the flows in the table, kept up to date for aggregate stats
+  uint64_t m_byte_total;    //!< Byte count summed over the flows in the table, kept up to date for aggregate stats
 private:
   Ptr<SdnSwitch13> m_parentSwitch;                   //!< The owning SdnSwitch of this table
   std::set<Flow13, cmp_priority13> m_flow_table_rules; //!< The actual set of all flows in the flow table. Sorted by priority
   uint8_t m_tableid;                               //!< Unique ID for flow tables
-  template <class T> struct TempHeader { TempHeader() : isEmpty(true), header() {} bool isEmpty; T header; };
-  TempHeader<EthernetHeader>  m_ethHeader;         //!< Private EthernetHeader for grabbing information out of the packet
-  TempHeader<Ipv4Header> m_ipv4Header;             //!< Private Ipv4Header for grabbing information out of the packet
-  TempHeader<Icmpv4Header> m_icmpv4Header;         //!< Private Icmpv4Header for grabbing information out of the packet
-  TempHeader<Ipv6Header> m_ipv6Header;             //!< Private Ipv6Header for grabbing information out of the packet
-  TempHeader<Ipv6ExtensionHeader> m_ipv6ExtHeader; //!< Private Ipv6Header for grabbing information out of the packet
-  TempHeader<Ipv6OptionHeader> m_ipv6OptHeader;    //!< Private Ipv6Header for grabbing information out of the packet
-  TempHeader<Icmpv6Header> m_icmpv6Header;         //!< Private Icmpv6Header for grabbing information out of the packet
-  TempHeader<ArpHeader>  m_arpHeader;              //!< Private ArpHeader for grabbing information out of the packet
-  TempHeader<TcpHeader>  m_tcpHeader;              //!< Private TcpHeader for grabbing information out of the packet
-  TempHeader<UdpHeader>  m_udpHeader;              //!< Private UdpHeader for grabbing information out of the packet
-public:
-  /**
-   * \brief Creates a match object from the tempheader information 
-   * \param inPort This field needs to go in the match in addition to the packet fields, but it is not
-   * 			readily available from the packet information.
-   * \return A match object matching whatever information could be discerned from the current packet
-   */
-  fluid_msg::of13::Match getPacketFields (uint32_t inPort);
-  /**
-   * \brief Removes the TempHeaders from an actual packet so we can use them for analysis
-   * \param pkt The packet containing the headers we're interested in
-   * \return The Packet with the relevant headers removed
-   */
-  Ptr<Packet> DestructHeader (Ptr<Packet> pkt);
-  /**
-   * \brief Add the TempHeaders back onto a packet. Should always be called soon after DestructHeader
-   * \param pkt The destructed packet ready to be reconstructed
-   */
-  void RestructHeader (Ptr<Packet> pkt);
+  bool m_tupleSpaceLookup;                         //!< Whether handlePacket uses m_classifier instead of a linear scan
+  uint64_t m_nextEntryId;                          //!< Insertion counter handed out as Flow13::entry_id
+  SdnTupleSpace<Flow13> m_classifier;              //!< Tuple space index over m_flow_table_rules
+  SdnGroup13::LivenessCallback m_portLive;         //!< Watched port liveness, for group bucket selection
+  SdnGroup13::LivenessCallback m_groupLive;        //!< Watched group liveness, for group bucket selection
 private:
   /**
    * \brief Action handler for an output action
@@ -213,23 +219,73 @@ private:
   /**
    * \brief Action handler for a group action
    * \param pkt The packet being modified from the action
+   * \param key The fields the switch parsed from the packet, hashed by SELECT groups
    * \param action The Group action being executed
    */
-  std::vector<uint32_t> handleGroupAction (Ptr<Packet> pkt,fluid_msg::of13::GroupAction* action);
+  std::vector<uint32_t> handleGroupAction (Ptr<Packet> pkt,const SdnFlowKey &key,fluid_msg::of13::GroupAction* action);
+  /**
+   * \brief Finds the flow a packet is handled by, using the selected classifier
+   * \param key The key extracted from the packet
+   * \param metadata The pipeline metadata the packet carries into this table
+   * \return The highest priority matching flow, the oldest one on ties. NULL if none match
+   */
+  const Flow13* lookupFlow (const SdnFlowKey &key, uint64_t metadata);
+  /**
+   * \brief Stores a flow in the table and in the classifier
+   * \param flow The flow to store. Its entry_id must already be assigned
+   */
+  void insertFlow (const Flow13 &flow);
+  /**
+   * \brief Removes a flow from the table and from the classifier
+   * \param flow Iterator to the stored flow
+   */
+  void eraseFlow (std::set<Flow13, cmp_priority13>::iterator flow);
+  /**
+   * \brief Finds a stored flow from its priority and entry id
+   * \return Iterator to the flow, or the end of m_flow_table_rules if it is gone
+   */
+  std::set<Flow13, cmp_priority13>::iterator findFlow (uint16_t priority, uint64_t entryId);
 
   /**
-   * \brief Idle Time Out Event hook. Gets invoked whenever a flow has reached it's idle time without any activity.
+   * \brief Idle Time Out Event hook. Gets invoked once the idle time has passed since the flow was
+   * installed or last checked. Flows used since then go back on the timer wheel until their idle time would run out.
+   * \param priority Priority of the flow
+   * \param entryId Entry id of the flow
    */
-  void IdleTimeOutEvent(Flow13 flow);
+  void IdleTimeOutEvent(uint16_t priority, uint64_t entryId);
   /**
    * \brief Hard Time Out Event hook. Gets invoked whenever a flow has reached it's hard time
+   * \param priority Priority of the flow
+   * \param entryId Entry id of the flow
    */
-  void HardTimeOutEvent(Flow13 flow);
+  void HardTimeOutEvent(uint16_t priority, uint64_t entryId);
   /**
    * \brief Generic timeout. Deletes a flow and asks the owning switch to send a notification to the controller
    */
-  void TimeOutEvent(Flow13 flow, uint8_t reason);
+  void TimeOutEvent(std::set<Flow13, cmp_priority13>::iterator flow, uint8_t reason);
+  /**
+   * \brief Puts a timeout of a flow on the switch timer wheel
+   * \param priority Priority of the flow
+   * \param entryId Entry id of the flow
+   * \param kind SdnTimer::IDLE_TIMEOUT or SdnTimer::HARD_TIMEOUT
+   * \param delay Time until the timeout is due
+   */
+  void scheduleTimer(uint16_t priority, uint64_t entryId, uint8_t kind, Time delay);
 };
 
+template <typename Writer>
+void
+SdnFlowTable13::writeFlowStats (fluid_msg::of13::Match match, uint64_t cookie, uint64_t cookieMask, Writer &writer)
+{
+  for (std::set<Flow13, cmp_priority13>::iterator i = m_flow_table_rules.begin (); i != m_flow_table_rules.end (); i++)
+    {
+      if ((i->cookie_ & cookieMask) == (cookie & cookieMask) && Flow13::pkt_match (*i,match))
+        {
+          //Stats are not part of the set ordering
+          writer.Add (const_cast<Flow13 &> (*i).convertToFlowStats ());
+        }
+    }
+}
+
 } //End namespace ns3
 #endif
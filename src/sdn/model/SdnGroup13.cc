@@ -17,6 +17,10 @@
  */
 
 #include "SdnGroup13.h"
+#include "ns3/log.h"
+#include "ns3/hash.h"
+
+#include <algorithm>
 
 namespace ns3 {
 
@@ -40,6 +44,7 @@ SdnGroup13::SdnGroup13()
   m_byteCount = 0;
   m_durationSec = 0;
   m_durationNanoSec = 0;
+  m_type = fluid_msg::of13::OFPGT_ALL;
 }
 
 SdnGroup13::SdnGroup13(fluid_msg::of13::GroupMod *groupMod)
@@ -49,8 +54,123 @@ SdnGroup13::SdnGroup13(fluid_msg::of13::GroupMod *groupMod)
   m_byteCount = 0;
   m_durationSec = 0;
   m_durationNanoSec = 0;
+  m_type = groupMod->group_type();
+  m_groupDesc.type(groupMod->group_type());
   m_groupDesc.group_id(groupMod->group_id());
   m_groupDesc.buckets(groupMod->buckets());
+
+  //Decode the actions once instead of on every packet
+  std::vector<fluid_msg::of13::Bucket> buckets = groupMod->buckets();
+  m_buckets.resize (buckets.size ());
+  uint32_t weightSum = 0;
+  for (uint32_t i = 0; i < buckets.size (); ++i)
+    {
+      Bucket &bucket = m_buckets[i];
+      bucket.actions = buckets[i].get_actions();
+      bucket.weight = buckets[i].weight();
+      bucket.watchPort = buckets[i].watch_port();
+      bucket.watchGroup = buckets[i].watch_group();
+      bucket.packetCount = 0;
+      bucket.byteCount = 0;
+      weightSum += bucket.weight;
+      m_weightEnd.push_back (weightSum);
+    }
+}
+
+bool
+SdnGroup13::IsLive (const Bucket &bucket, LivenessCallback portLive, LivenessCallback groupLive) const
+{
+  if (bucket.watchPort != fluid_msg::of13::OFPP_ANY && !portLive.IsNull () && !portLive (bucket.watchPort))
+    {
+      return false;
+    }
+  if (bucket.watchGroup != fluid_msg::of13::OFPG_ANY && !groupLive.IsNull () && !groupLive (bucket.watchGroup))
+    {
+      return false;
+    }
+  return true;
 }
 
+int32_t
+SdnGroup13::ChooseBucket (const SdnFlowKey &key, LivenessCallback portLive, LivenessCallback groupLive)
+{
+  if (m_buckets.empty ())
+    {
+      return -1;
+    }
+  switch (m_type)
+    {
+    case fluid_msg::of13::OFPGT_INDIRECT:
+      return 0;
+    case fluid_msg::of13::OFPGT_FF:
+      for (uint32_t i = 0; i < m_buckets.size (); ++i)
+        {
+          if (IsLive (m_buckets[i], portLive, groupLive))
+            {
+              return i;
+            }
+        }
+      return -1;
+    case fluid_msg::of13::OFPGT_SELECT:
+      {
+        uint32_t total = m_weightEnd.back ();
+        if (total == 0)
+          {
+            return -1;
+          }
+        //The ingress port is left out so a flow hashes the same wherever it enters
+        SdnFlowKey flow = key;
+        flow.in_port = 0;
+        uint32_t hash = Hash32 ((const char *)&flow, sizeof (flow));
+        uint32_t chosen = std::upper_bound (m_weightEnd.begin (), m_weightEnd.end (), hash % total) - m_weightEnd.begin ();
+        if (IsLive (m_buckets[chosen], portLive, groupLive))
+          {
+            return chosen;
+          }
+        //Spread the flows of a dead bucket over the live ones, by weight
+        uint32_t liveTotal = 0;
+        for (uint32_t i = 0; i < m_buckets.size (); ++i)
+          {
+            if (IsLive (m_buckets[i], portLive, groupLive))
+              {
+                liveTotal += m_buckets[i].weight;
+              }
+          }
+        if (liveTotal == 0)
+          {
+            return -1;
+          }
+        uint32_t point = hash % liveTotal;
+        for (uint32_t i = 0; i < m_buckets.size (); ++i)
+          {
+            if (m_buckets[i].weight == 0 || !IsLive (m_buckets[i], portLive, groupLive))
+              {
+                continue;
+              }
+            if (point < m_buckets[i].weight)
+              {
+                return i;
+              }
+            point -= m_buckets[i].weight;
+          }
+        return -1;
+      }
+    default:
+      NS_LOG_WARN ("Unknown group type " << (uint32_t)m_type << ", the packet goes through no bucket");
+      return -1;
+    }
 }
+
+void
+SdnGroup13::Count (int32_t bucket, uint32_t bytes)
+{
+  m_packetCount++;
+  m_byteCount += bytes;
+  if (bucket >= 0)
+    {
+      m_buckets[bucket].packetCount++;
+      m_buckets[bucket].byteCount += bytes;
+    }
+}
+
+} //End namespace ns3
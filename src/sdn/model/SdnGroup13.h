@@ -19,16 +19,20 @@
 #ifndef SDNGROUP13_H
 #define SDNGROUP13_H
 
+//Stdlib packages
+#include <vector>
 //ns3 utilities
 #include "ns3/ptr.h"
 #include "ns3/object.h"
 #include "ns3/packet.h"
 #include "ns3/type-id.h"
+#include "ns3/callback.h"
 //libfluid packages
 #include <fluid/of13msg.hh>
 #include <fluid/of13/of13common.hh>
 #include <fluid/of13/openflow-13.h>
 #include "SdnCommon.h"
+#include "SdnFlowKey.h"
 
 namespace ns3 {
 
@@ -36,11 +40,32 @@ namespace ns3 {
  * \ingroup sdn
  * \defgroup SdnGroup13
  *
+ * An OpenFlow 1.3 group entry. The buckets of the GroupMod are decoded once
+ * into action sets the table applies directly, and the group type decides
+ * which of them a packet goes through:
+ *  - ALL runs every bucket,
+ *  - SELECT runs one bucket, picked by a hash of the packet's flow fields
+ *    weighted by the bucket weights, so every packet of a flow takes the same path,
+ *  - INDIRECT runs its single bucket,
+ *  - FAST_FAILOVER runs the first bucket whose watched port or group is live.
  */
 
 class SdnGroup13 : public Object
 {
 public:
+  typedef Callback<bool, uint32_t> LivenessCallback; //!< Tells whether a watched port or group can forward
+
+  /// \brief A bucket, decoded for the packet path, with its counters
+  struct Bucket
+  {
+    fluid_msg::ActionSet actions; //!< Actions applied to a packet going through the bucket
+    uint16_t weight;              //!< Share of a SELECT group's traffic
+    uint32_t watchPort;           //!< Port the bucket's liveness follows, or OFPP_ANY
+    uint32_t watchGroup;          //!< Group the bucket's liveness follows, or OFPG_ANY
+    uint64_t packetCount;         //!< Packets processed by the bucket
+    uint64_t byteCount;           //!< Bytes processed by the bucket
+  };
+
 	SdnGroup13();
 
 	SdnGroup13(fluid_msg::of13::GroupMod *groupMod);
@@ -50,6 +75,36 @@ public:
    * \return the object TypeId
    */
   static TypeId GetTypeId (void);
+
+  /**
+   * \return The OFPGT group type
+   */
+  uint8_t GetType (void) const { return m_type; }
+  /**
+   * \return The number of buckets
+   */
+  uint32_t GetNBuckets (void) const { return m_buckets.size (); }
+  /**
+   * \param i Bucket index, below GetNBuckets
+   * \return The bucket
+   */
+  Bucket& GetBucket (uint32_t i) { return m_buckets[i]; }
+  /**
+   * \brief Picks the one bucket a SELECT, INDIRECT or FAST_FAILOVER group runs
+   * for a packet. Buckets whose watched port or group is down are skipped.
+   * \param key The fields parsed from the packet, hashed by SELECT groups
+   * \param portLive Liveness of a watched port
+   * \param groupLive Liveness of a watched group
+   * \return The bucket index, or -1 if no bucket can take the packet
+   */
+  int32_t ChooseBucket (const SdnFlowKey &key, LivenessCallback portLive, LivenessCallback groupLive);
+  /**
+   * \brief Counts a packet on the group and on one of its buckets
+   * \param bucket Bucket index, or -1 for the group alone
+   * \param bytes Size of the packet
+   */
+  void Count (int32_t bucket, uint32_t bytes);
+
   fluid_msg::of13::GroupDesc m_groupDesc;
   uint32_t m_refCount;       //!< Number of flows or groups that directly forward to this group
   uint64_t m_packetCount;    //!< Number of packets processed by group
@@ -58,6 +113,15 @@ public:
   uint32_t m_durationNanoSec;//!< Time group has been alive in nanoseconds beyond m_durationSec
 
 private:
+  /**
+   * \param bucket A bucket of this group
+   * \return True unless the port or group the bucket watches is down
+   */
+  bool IsLive (const Bucket &bucket, LivenessCallback portLive, LivenessCallback groupLive) const;
+
+  uint8_t m_type;                    //!< OFPGT group type
+  std::vector<Bucket> m_buckets;     //!< Buckets in GroupMod order
+  std::vector<uint32_t> m_weightEnd; //!< Running sum of the weights up to each bucket, for SELECT
 };
 
 } //End namespace ns3
@@ -0,0 +1,216 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SdnLearningTable.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("SdnLearningTable");
+
+SdnLearningTable::SdnLearningTable (uint32_t capacity)
+  : m_size (0),
+    m_maxAge (Seconds (300).GetNanoSeconds ())
+{
+  uint32_t slots = 16;
+  while (slots < capacity)
+    {
+      slots <<= 1;
+    }
+  m_slots.resize (slots);
+  m_mask = slots - 1;
+}
+
+uint32_t
+SdnLearningTable::Home (uint64_t key) const
+{
+  //64-bit finalizer, spreads MAC addresses of a single vendor over the whole table
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return (uint32_t)key & m_mask;
+}
+
+uint32_t
+SdnLearningTable::Find (uint64_t key) const
+{
+  uint32_t i = Home (key);
+  while (m_slots[i].used && m_slots[i].key != key)
+    {
+      i = (i + 1) & m_mask;
+    }
+  return i;
+}
+
+bool
+SdnLearningTable::IsAged (const Slot &slot, int64_t now) const
+{
+  return m_maxAge != 0 && now - slot.lastSeen >= m_maxAge;
+}
+
+bool
+SdnLearningTable::Learn (uint64_t mac, uint16_t vlan, uint32_t port)
+{
+  uint64_t key = MakeKey (mac, vlan);
+  int64_t now = Simulator::Now ().GetNanoSeconds ();
+  uint32_t i = Find (key);
+  Slot &slot = m_slots[i];
+  if (slot.used)
+    {
+      bool moved = slot.port != port || IsAged (slot, now);
+      slot.port = port;
+      slot.lastSeen = now;
+      return moved;
+    }
+  if ((m_size + 1) * 10 > m_slots.size () * 7)
+    {
+      //Make room from aged out entries first, grow only if that is not enough
+      if (Expire () == 0 || (m_size + 1) * 10 > m_slots.size () * 5)
+        {
+          Resize (m_slots.size () * 2);
+        }
+      i = Find (key);
+    }
+  Slot &added = m_slots[i];
+  added.key = key;
+  added.port = port;
+  added.lastSeen = now;
+  added.used = true;
+  m_size++;
+  return true;
+}
+
+uint32_t
+SdnLearningTable::Lookup (uint64_t mac, uint16_t vlan)
+{
+  uint32_t i = Find (MakeKey (mac, vlan));
+  if (!m_slots[i].used)
+    {
+      return SDN_LEARNING_NO_PORT;
+    }
+  if (IsAged (m_slots[i], Simulator::Now ().GetNanoSeconds ()))
+    {
+      NS_LOG_DEBUG ("Address " << mac << " on vlan " << vlan << " aged out");
+      Remove (i);
+      return SDN_LEARNING_NO_PORT;
+    }
+  return m_slots[i].port;
+}
+
+bool
+SdnLearningTable::Forget (uint64_t mac, uint16_t vlan)
+{
+  uint32_t i = Find (MakeKey (mac, vlan));
+  if (!m_slots[i].used)
+    {
+      return false;
+    }
+  Remove (i);
+  return true;
+}
+
+uint32_t
+SdnLearningTable::ForgetPort (uint32_t port)
+{
+  uint32_t removed = 0;
+  for (uint32_t i = 0; i < m_slots.size (); )
+    {
+      //Remove shifts a later entry into slot i, so only move on when it stays
+      if (m_slots[i].used && m_slots[i].port == port)
+        {
+          Remove (i);
+          removed++;
+        }
+      else
+        {
+          i++;
+        }
+    }
+  return removed;
+}
+
+uint32_t
+SdnLearningTable::Expire (void)
+{
+  if (m_maxAge == 0)
+    {
+      return 0;
+    }
+  int64_t now = Simulator::Now ().GetNanoSeconds ();
+  uint32_t removed = 0;
+  for (uint32_t i = 0; i < m_slots.size (); )
+    {
+      if (m_slots[i].used && IsAged (m_slots[i], now))
+        {
+          Remove (i);
+          removed++;
+        }
+      else
+        {
+          i++;
+        }
+    }
+  NS_LOG_DEBUG ("Expired " << removed << " entries, " << m_size << " left");
+  return removed;
+}
+
+void
+SdnLearningTable::Clear (void)
+{
+  m_slots.assign (m_slots.size (), Slot ());
+  m_size = 0;
+}
+
+void
+SdnLearningTable::Remove (uint32_t index)
+{
+  m_slots[index].used = false;
+  m_size--;
+  //Backward shift: pull up every following entry whose probe sequence passes the hole
+  uint32_t hole = index;
+  for (uint32_t i = (index + 1) & m_mask; m_slots[i].used; i = (i + 1) & m_mask)
+    {
+      uint32_t home = Home (m_slots[i].key);
+      if (((i - home) & m_mask) >= ((i - hole) & m_mask))
+        {
+          m_slots[hole] = m_slots[i];
+          m_slots[i].used = false;
+          hole = i;
+        }
+    }
+}
+
+void
+SdnLearningTable::Resize (uint32_t capacity)
+{
+  NS_LOG_DEBUG ("Growing from " << m_slots.size () << " to " << capacity << " slots");
+  std::vector<Slot> old;
+  old.swap (m_slots);
+  m_slots.resize (capacity);
+  m_mask = capacity - 1;
+  for (std::vector<Slot>::iterator i = old.begin (); i != old.end (); ++i)
+    {
+      if (i->used)
+        {
+          m_slots[Find (i->key)] = *i;
+        }
+    }
+}
+
+} //End namespace ns3
@@ -0,0 +1,143 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_LEARNING_TABLE_H
+#define SDN_LEARNING_TABLE_H
+
+//Stdlib packages
+#include <stdint.h>
+#include <vector>
+//NS3 objects
+#include "ns3/nstime.h"
+
+#define SDN_LEARNING_NO_PORT 0xffffffff //!< Lookup result for an unknown or aged out address
+
+namespace ns3 {
+
+/**
+ * \ingroup sdn
+ *
+ * \brief MAC learning table of a controller, mapping a MAC address and VLAN
+ * to the switch port the address was last seen on.
+ *
+ * Entries live in one flat array, open addressed with linear probing on a
+ * hash of the 48-bit address and 12-bit VLAN id, so learning and looking up
+ * an address touch one or two cache lines and allocate nothing. Removal
+ * shifts the following entries back instead of leaving tombstones. The array
+ * doubles once it is 70% full, after first dropping aged out entries.
+ *
+ * An entry ages out once it has not been learned again for the maximum age.
+ * Aging is lazy: a lookup that finds an aged out entry removes it and reports
+ * the address unknown, and Expire sweeps the whole table on demand.
+ */
+class SdnLearningTable
+{
+public:
+  /**
+   * \param capacity Number of entries to size the table for. Rounded up to a power of two
+   */
+  SdnLearningTable (uint32_t capacity = 1024);
+
+  /**
+   * \param maxAge Time after which an entry that was not learned again is forgotten. Zero keeps entries forever
+   */
+  void SetMaxAge (Time maxAge) { m_maxAge = maxAge.GetNanoSeconds (); }
+  /**
+   * \return Time after which an entry that was not learned again is forgotten
+   */
+  Time GetMaxAge (void) const { return NanoSeconds (m_maxAge); }
+
+  /**
+   * \brief Records that an address was seen on a port, restarting its age
+   * \param mac The MAC address, in the low 48 bits
+   * \param vlan The VLAN id, 0 for untagged frames
+   * \param port The switch port
+   * \return True if the address was unknown or moved to another port
+   */
+  bool Learn (uint64_t mac, uint16_t vlan, uint32_t port);
+  /**
+   * \param mac The MAC address, in the low 48 bits
+   * \param vlan The VLAN id, 0 for untagged frames
+   * \return The port the address was last seen on, or SDN_LEARNING_NO_PORT
+   */
+  uint32_t Lookup (uint64_t mac, uint16_t vlan);
+  /**
+   * \brief Removes one address
+   * \param mac The MAC address, in the low 48 bits
+   * \param vlan The VLAN id, 0 for untagged frames
+   * \return True if the address was known
+   */
+  bool Forget (uint64_t mac, uint16_t vlan);
+  /**
+   * \brief Removes every address learned on a port, as when the port goes down
+   * \param port The switch port
+   * \return The number of addresses removed
+   */
+  uint32_t ForgetPort (uint32_t port);
+  /**
+   * \brief Removes every aged out entry
+   * \return The number of entries removed
+   */
+  uint32_t Expire (void);
+  /**
+   * \brief Removes every entry
+   */
+  void Clear (void);
+
+  /**
+   * \return The number of entries, aged out ones not yet removed included
+   */
+  uint32_t GetSize (void) const { return m_size; }
+  /**
+   * \return The number of slots
+   */
+  uint32_t GetCapacity (void) const { return m_slots.size (); }
+
+private:
+  /// \brief One slot of the open addressed array
+  struct Slot
+  {
+    Slot () : key (0), lastSeen (0), port (0), used (false) {}
+    uint64_t key;     //!< Address and VLAN, see MakeKey
+    int64_t lastSeen; //!< Time the address was last learned, in nanoseconds
+    uint32_t port;    //!< Port the address was last seen on
+    bool used;        //!< Whether the slot holds an entry
+  };
+
+  static uint64_t MakeKey (uint64_t mac, uint16_t vlan)
+  {
+    return ((mac & 0xffffffffffffULL) << 12) | (vlan & 0xfff);
+  }
+  uint32_t Home (uint64_t key) const;
+  /**
+   * \return The slot holding the key, or the empty slot ending its probe sequence
+   */
+  uint32_t Find (uint64_t key) const;
+  bool IsAged (const Slot &slot, int64_t now) const;
+  /**
+   * \brief Empties a slot and shifts the entries after it back into place
+   */
+  void Remove (uint32_t index);
+  void Resize (uint32_t capacity);
+
+  std::vector<Slot> m_slots; //!< The entries, a power of two in size
+  uint32_t m_mask;           //!< m_slots.size () - 1
+  uint32_t m_size;           //!< Used slots
+  int64_t m_maxAge;          //!< Age limit in nanoseconds, 0 for none
+};
+
+} //End namespace ns3
+#endif /* SDN_LEARNING_TABLE_H */
@@ -44,9 +44,40 @@ void
 SdnListener::DoDispose (void)
 {
   NS_LOG_FUNCTION (this);
+  m_handlers.clear ();
   Object::DoDispose ();
 }
 
+void
+SdnListener::Subscribe (uint8_t version, uint8_t type, MessageCallback cb)
+{
+  NS_LOG_FUNCTION (this << (uint32_t)version << (uint32_t)type);
+
+  uint32_t key = ((uint32_t)version << 8) | type;
+  if (key >= m_handlers.size ())
+    {
+      m_handlers.resize (key + 1);
+    }
+  m_handlers[key].push_back (cb);
+}
+
+bool
+SdnListener::Dispatch (Ptr<SdnConnection> ofconn, uint8_t* message)
+{
+  uint32_t key = ((uint32_t)SdnMessageStream::GetVersion (message) << 8) | SdnMessageStream::GetType (message);
+  if (key >= m_handlers.size () || m_handlers[key].empty ())
+    {
+      return false;
+    }
+  uint16_t length = SdnMessageStream::GetLength (message);
+  //Index rather than iterate, a handler may subscribe more handlers
+  for (uint32_t i = 0; i < m_handlers[key].size (); ++i)
+    {
+      m_handlers[key][i] (ofconn, message, length);
+    }
+  return true;
+}
+
 NS_OBJECT_ENSURE_REGISTERED (BaseLearningSwitch);
 
 TypeId BaseLearningSwitch::GetTypeId (void)
@@ -33,6 +33,7 @@
 
 //C++ libraries
 #include <map>
+#include <vector>
 
 namespace ns3 {
 
@@ -92,11 +93,7 @@ public:
     this->len = len;
   }
 
-  virtual ~PacketInEvent ()
-  {
-  }
-
-  uint8_t* data; //!< Compact data of PacketInEvent
+  uint8_t* data; //!< Compact data of PacketInEvent, the message in the connection buffer, valid during the callback only
   size_t len;    //!< Size of data
 };
 
@@ -116,11 +113,7 @@ public:
     this->len = len;
   }
 
-  virtual ~SwitchUpEvent ()
-  {
-  }
-
-  uint8_t* data; //!< Compact data of SwitchUpEvent
+  uint8_t* data; //!< Compact data of SwitchUpEvent, the message in the connection buffer, valid during the callback only
   size_t len;    //!< Size of data
 };
 
@@ -153,11 +146,7 @@ public:
     this->len = len;
   }
 
-  virtual ~FlowRemovedEvent ()
-  {
-  }
-
-  uint8_t* data; //!< Compact data of FlowRemovedEvent
+  uint8_t* data; //!< Compact data of FlowRemovedEvent, the message in the connection buffer, valid during the callback only
   size_t len;    //!< Size of data
 };
 
@@ -176,11 +165,7 @@ public:
     this->len = len;
   }
 
-  virtual ~PortStatusEvent ()
-  {
-  }
-
-  uint8_t* data; //!< Compact data of PortStatusEvent
+  uint8_t* data; //!< Compact data of PortStatusEvent, the message in the connection buffer, valid during the callback only
   size_t len;    //!< Size of data
 };
 /**
@@ -198,11 +183,7 @@ public:
     this->len = len;
   }
 
-  virtual ~StatsReplyEvent ()
-  {
-  }
-
-  uint8_t* data; //!< Compact data of StatsReplyEvent
+  uint8_t* data; //!< Compact data of StatsReplyEvent, the message in the connection buffer, valid during the callback only
   size_t len;    //!< Size of data
 };
 /**
@@ -213,6 +194,11 @@ public:
  * SdnListeners handle ControllerEvents, and those handlers define Controller behavior
  * BaseLearningSwitch extends SdnListener and is used as the default Controller behavior in most examples
  * See sdn/examples for *.hh files that define custom Controllers
+ *
+ * A listener can subscribe handlers to the (version, message type) pairs it
+ * cares about. The controller hands a message with subscribed handlers to them
+ * in place, straight out of the connection buffer, without building an event.
+ * Messages of every other type still reach event_callback as events.
  */
 class SdnListener : public Object
 {
@@ -220,6 +206,12 @@ protected:
   virtual void DoDispose (void);
 
 public:
+  /**
+   * Handler of one raw message: the connection, the message and its length.
+   * The message is only valid for the duration of the call.
+   */
+  typedef Callback<void, Ptr<SdnConnection>, uint8_t*, uint16_t> MessageCallback;
+
   static TypeId GetTypeId (void);
   /**
    * \brief Get the type ID.
@@ -230,6 +222,46 @@ public:
    * \brief Inheritable function that handles our variety of controller events. The main reason to inherit SdnListener
    */
   virtual void event_callback (ControllerEvent* ev) { }
+
+  /**
+   * \brief Subscribes a handler to the raw messages of one type
+   * \param version OpenFlow version of the messages
+   * \param type Message type, as numbered by that version
+   * \param cb The handler, called in subscription order with the other handlers of the type
+   */
+  void Subscribe (uint8_t version, uint8_t type, MessageCallback cb);
+  /**
+   * \brief Subscribes a handler to the messages of one type, unpacked into a
+   * libfluid message on the stack of the dispatch for each call
+   * \tparam Message The libfluid message class, e.g. fluid_msg::of10::PortStatus
+   * \param version OpenFlow version of the messages
+   * \param type Message type, as numbered by that version
+   * \param cb The handler
+   */
+  template <typename Message>
+  void Subscribe (uint8_t version, uint8_t type, Callback<void, Ptr<SdnConnection>, Message&> cb)
+  {
+    Subscribe (version, type, MakeBoundCallback (&SdnListener::UnpackAndCall<Message>, cb));
+  }
+  /**
+   * \brief Hands a message to the handlers subscribed to its version and type
+   * \param ofconn The connection the message arrived on
+   * \param message The message
+   * \return True if at least one handler was called, false if the message is left to event_callback
+   */
+  bool Dispatch (Ptr<SdnConnection> ofconn, uint8_t* message);
+
+private:
+  template <typename Message>
+  static void UnpackAndCall (Callback<void, Ptr<SdnConnection>, Message&> cb,
+                             Ptr<SdnConnection> ofconn, uint8_t* message, uint16_t length)
+  {
+    Message unpacked;
+    unpacked.unpack (message);
+    cb (ofconn, unpacked);
+  }
+
+  std::vector<std::vector<MessageCallback> > m_handlers; //!< Handlers indexed by version << 8 | type
 };
 /**
  * \ingroup SdnListener
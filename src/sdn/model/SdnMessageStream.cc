@@ -0,0 +1,84 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <cstring>
+#include "SdnMessageStream.h"
+#include "ns3/log.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("SdnMessageStream");
+
+SdnMessageStream::SdnMessageStream ()
+  : m_head (0),
+    m_tail (0)
+{
+}
+
+void
+SdnMessageStream::Append (Ptr<const Packet> packet)
+{
+  uint32_t size = packet->GetSize ();
+  if (m_head == m_tail)
+    {
+      m_head = m_tail = 0;
+    }
+  else if (m_head > 0 && m_tail + size > m_buffer.size ())
+    {
+      //Move the partial message to the front before growing the buffer
+      std::memmove (&m_buffer[0], &m_buffer[m_head], m_tail - m_head);
+      m_tail -= m_head;
+      m_head = 0;
+    }
+  if (m_tail + size > m_buffer.size ())
+    {
+      m_buffer.resize (m_tail + size);
+    }
+  packet->CopyData (&m_buffer[m_tail], size);
+  m_tail += size;
+}
+
+uint8_t*
+SdnMessageStream::Next (void)
+{
+  if (m_tail - m_head < SDN_OF_HEADER_LEN)
+    {
+      return 0;
+    }
+  uint8_t* message = &m_buffer[m_head];
+  uint16_t length = GetLength (message);
+  if (length < SDN_OF_HEADER_LEN)
+    {
+      //No way to find the next message boundary, the stream is lost
+      NS_LOG_WARN ("Dropping " << m_tail - m_head << " bytes after a message of length " << length);
+      Clear ();
+      return 0;
+    }
+  if (m_tail - m_head < length)
+    {
+      return 0;
+    }
+  m_head += length;
+  return message;
+}
+
+void
+SdnMessageStream::Clear (void)
+{
+  m_head = m_tail = 0;
+}
+
+} //End namespace ns3
@@ -0,0 +1,100 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_MESSAGE_STREAM_H
+#define SDN_MESSAGE_STREAM_H
+
+//Stdlib packages
+#include <stdint.h>
+#include <vector>
+//NS3 objects
+#include "ns3/ptr.h"
+#include "ns3/packet.h"
+
+#define SDN_OF_HEADER_LEN 8 //!< Size of the header every OpenFlow message starts with
+
+namespace ns3 {
+
+/**
+ * \ingroup sdn
+ *
+ * \brief Reassembles OpenFlow messages from the byte stream of a control connection.
+ *
+ * A TCP socket hands data up in arbitrary chunks: one read can hold several
+ * messages, or end in the middle of one. Received packets are appended to a
+ * single buffer that is reused for the lifetime of the connection, and Next
+ * returns each complete message in place, framed by the length field of its
+ * header, without copying it again or allocating a message object to read
+ * that header.
+ */
+class SdnMessageStream
+{
+public:
+  SdnMessageStream ();
+
+  /**
+   * \brief Appends received bytes to the stream. Invalidates every pointer
+   * returned by Next so far.
+   * \param packet The received data, without tags
+   */
+  void Append (Ptr<const Packet> packet);
+  /**
+   * \brief Takes the next complete message off the stream
+   * \return The start of the message, valid until the next call to Append or
+   * Clear, or 0 if no complete message is buffered
+   */
+  uint8_t* Next (void);
+  /**
+   * \return The number of buffered bytes not returned by Next yet
+   */
+  uint32_t GetBuffered (void) const { return m_tail - m_head; }
+  /**
+   * \brief Drops every buffered byte
+   */
+  void Clear (void);
+
+  /**
+   * \param message Start of an OpenFlow message
+   * \return The OpenFlow version of the message
+   */
+  static uint8_t GetVersion (const uint8_t* message) { return message[0]; }
+  /**
+   * \param message Start of an OpenFlow message
+   * \return The message type
+   */
+  static uint8_t GetType (const uint8_t* message) { return message[1]; }
+  /**
+   * \param message Start of an OpenFlow message
+   * \return The message length, header included
+   */
+  static uint16_t GetLength (const uint8_t* message) { return (uint16_t)((message[2] << 8) | message[3]); }
+  /**
+   * \param message Start of an OpenFlow message
+   * \return The transaction id of the message
+   */
+  static uint32_t GetXid (const uint8_t* message)
+  {
+    return ((uint32_t)message[4] << 24) | ((uint32_t)message[5] << 16) | ((uint32_t)message[6] << 8) | message[7];
+  }
+
+private:
+  std::vector<uint8_t> m_buffer; //!< Received bytes, grown once and reused
+  uint32_t m_head;               //!< Offset of the first byte not returned by Next
+  uint32_t m_tail;               //!< Offset one past the last received byte
+};
+
+} //End namespace ns3
+#endif /* SDN_MESSAGE_STREAM_H */
@@ -0,0 +1,114 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_MULTIPART_WRITER_H
+#define SDN_MULTIPART_WRITER_H
+
+//Stdlib packages
+#include <stdint.h>
+#include <vector>
+//NS3 objects
+#include "ns3/ptr.h"
+//Sdn classes
+#include "SdnConnection.h"
+
+#define SDN_MAX_MESSAGE_LEN 0xffff //!< Largest OpenFlow message, its length field is 16 bits
+#define SDN_REPLY_MORE 0x0001      //!< OFPSF_REPLY_MORE (1.0) and OFPMPF_REPLY_MORE (1.3), more replies follow
+
+namespace ns3 {
+
+/**
+ * \ingroup sdn
+ *
+ * \brief Streams the entries of a stats (1.0) or multipart (1.3) reply over as
+ * many messages as it takes.
+ *
+ * Entries are collected until the next one would push the reply past the
+ * OpenFlow message size limit, then the reply is sent flagged REPLY_MORE and
+ * the next one started. Finish sends the last reply without the flag, empty if
+ * need be, so the controller always sees the end of the transaction. Only one
+ * reply worth of entries is held at a time, however many the table has.
+ *
+ * \tparam Reply The reply message, constructible from (xid, flags, std::vector<Entry>)
+ * \tparam Entry The reply entry, with a length () in bytes
+ */
+template <typename Reply, typename Entry>
+class SdnMultipartWriter
+{
+public:
+  /**
+   * \param connection The control connection the replies go out on
+   * \param xid The xid of the request, shared by every reply
+   * \param headerLength Size of the reply with no entries
+   * \param maxLength Largest reply to send
+   */
+  SdnMultipartWriter (Ptr<SdnConnection> connection, uint32_t xid, uint32_t headerLength,
+                      uint32_t maxLength = SDN_MAX_MESSAGE_LEN)
+    : m_connection (connection),
+      m_xid (xid),
+      m_headerLength (headerLength),
+      m_maxLength (maxLength),
+      m_length (headerLength),
+      m_sent (0)
+  {
+  }
+
+  /**
+   * \brief Adds an entry, sending the reply collected so far first if the entry does not fit
+   * \param entry The entry
+   */
+  void Add (Entry entry)
+  {
+    if (!m_entries.empty () && m_length + entry.length () > m_maxLength)
+      {
+        Send (SDN_REPLY_MORE);
+      }
+    m_length += entry.length ();
+    m_entries.push_back (entry);
+  }
+  /**
+   * \brief Sends the last reply of the transaction
+   */
+  void Finish (void)
+  {
+    Send (0);
+  }
+  /**
+   * \return The number of replies sent so far
+   */
+  uint32_t GetNSent (void) const { return m_sent; }
+
+private:
+  void Send (uint16_t flags)
+  {
+    Reply reply (m_xid, flags, m_entries);
+    m_connection->send (&reply);
+    m_entries.clear ();
+    m_length = m_headerLength;
+    m_sent++;
+  }
+
+  Ptr<SdnConnection> m_connection; //!< Where the replies go
+  uint32_t m_xid;                  //!< xid of the request
+  uint32_t m_headerLength;         //!< Size of an empty reply
+  uint32_t m_maxLength;            //!< Size limit of one reply
+  uint32_t m_length;               //!< Size of the reply being collected
+  uint32_t m_sent;                 //!< Replies sent
+  std::vector<Entry> m_entries;    //!< Entries of the reply being collected, reused across replies
+};
+
+} //End namespace ns3
+#endif /* SDN_MULTIPART_WRITER_H */
@@ -0,0 +1,133 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SdnPacketParser.h"
+
+namespace ns3 {
+
+#define ETH_HEADER_LEN 14
+#define LLC_SNAP_HEADER_LEN 8
+#define IPV6_HEADER_LEN 40
+
+static inline uint16_t
+read16 (const uint8_t *p)
+{
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t
+read32 (const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/* IPv4 and ARP addresses are kept in host order, as Ipv4Address::Get () returns them */
+static inline void
+store_ipv4 (uint8_t *slot, const uint8_t *p)
+{
+  uint32_t address = read32 (p);
+  std::memcpy (slot, &address, sizeof (address));
+}
+
+/* Reads ports, or ICMP type and code, from the first bytes of the transport header */
+static inline void
+parse_transport (const uint8_t *p, uint32_t len, uint8_t proto, SdnFlowKey &key)
+{
+  if (len < 4)
+    {
+      return;
+    }
+  if (proto == IP_PROTO_TCP || proto == IP_PROTO_UDP)
+    {
+      key.tp_src = read16 (p);
+      key.tp_dst = read16 (p + 2);
+    }
+  else if (proto == IP_PROTO_ICMP || proto == IP_PROTO_ICMPV6)
+    {
+      key.tp_src = p[0];
+      key.tp_dst = p[1];
+    }
+}
+
+void
+SdnPacketParser::Parse (Ptr<const Packet> pkt, uint32_t inPort, SdnFlowKey &key)
+{
+  key = SdnFlowKey ();
+  key.in_port = inPort;
+
+  uint8_t buffer[MAX_PARSE_LEN];
+  uint32_t len = pkt->CopyData (buffer, MAX_PARSE_LEN);
+  if (len < ETH_HEADER_LEN)
+    {
+      return;
+    }
+
+  //Ethernet case
+  std::memcpy (key.dl_dst, buffer, 6);
+  std::memcpy (key.dl_src, buffer + 6, 6);
+  uint16_t type = read16 (buffer + 12);
+  uint32_t offset = ETH_HEADER_LEN;
+  if (type <= 1500)
+    {
+      //802.3 length interpretation, the type follows in the LLC/SNAP header
+      if (len < ETH_HEADER_LEN + LLC_SNAP_HEADER_LEN)
+        {
+          return;
+        }
+      type = read16 (buffer + ETH_HEADER_LEN + 6);
+      offset += LLC_SNAP_HEADER_LEN;
+    }
+  key.dl_type = type;
+  //No VLAN header in ns-3 yet, dl_vlan stays 0
+
+  const uint8_t *p = buffer + offset;
+  len -= offset;
+  if (type == ETH_TYPE_IPV4 && len >= 20)
+    {
+      uint32_t ihl = (p[0] & 0x0f) * 4;
+      key.nw_tos = p[1];
+      key.nw_proto = p[9];
+      store_ipv4 (key.nw_src, p + 12);
+      store_ipv4 (key.nw_dst, p + 16);
+      //Only the first fragment carries the transport header
+      if ((read16 (p + 6) & 0x1fff) == 0 && ihl >= 20 && len > ihl)
+        {
+          parse_transport (p + ihl, len - ihl, key.nw_proto, key);
+        }
+    }
+  else if (type == ETH_TYPE_IPV6 && len >= IPV6_HEADER_LEN)
+    {
+      key.nw_tos = (uint8_t)(((p[0] & 0x0f) << 4) | (p[1] >> 4));
+      key.ipv6_flabel = read32 (p) & 0x000fffff;
+      key.nw_proto = p[6];
+      std::memcpy (key.nw_src, p + 8, 16);
+      std::memcpy (key.nw_dst, p + 24, 16);
+      parse_transport (p + IPV6_HEADER_LEN, len - IPV6_HEADER_LEN, key.nw_proto, key);
+    }
+  else if (type == ETH_TYPE_ARP && len >= 8)
+    {
+      //Sender and target protocol addresses follow hardware addresses of p[4] bytes
+      uint32_t hlen = p[4];
+      key.nw_proto = (uint8_t)read16 (p + 6);
+      if (p[5] == 4 && len >= 16 + 2 * hlen)
+        {
+          store_ipv4 (key.nw_src, p + 8 + hlen);
+          store_ipv4 (key.nw_dst, p + 12 + 2 * hlen);
+        }
+    }
+}
+
+} //End namespace ns3
@@ -0,0 +1,58 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_PACKET_PARSER_H
+#define SDN_PACKET_PARSER_H
+
+//ns3 utilities
+#include "ns3/ptr.h"
+#include "ns3/packet.h"
+//Sdn classes
+#include "SdnFlowKey.h"
+
+namespace ns3 {
+
+/**
+ * \ingroup sdn
+ *
+ * \brief Read-only extraction of the classifier key from a frame.
+ *
+ * The parser copies the leading bytes of the packet once and decodes the
+ * Ethernet (optionally LLC/SNAP), IPv4, IPv6, ARP, TCP, UDP, ICMPv4 and
+ * ICMPv6 fields from fixed offsets. The packet itself is not modified, so
+ * unlike SdnFlowTable::DestructHeader no header has to be removed and
+ * serialized back afterwards.
+ */
+class SdnPacketParser
+{
+public:
+  /**
+   * Enough bytes for Ethernet, LLC/SNAP, an IPv4 header with options and
+   * the first four bytes of the transport header.
+   */
+  static const uint32_t MAX_PARSE_LEN = 96;
+
+  /**
+   * \brief Fills a key from the headers found at the front of a frame
+   * \param pkt The frame, starting with its Ethernet header
+   * \param inPort The switch port the frame arrived on
+   * \param key Receives the extracted fields. Fields of absent headers are zero
+   */
+  static void Parse (Ptr<const Packet> pkt, uint32_t inPort, SdnFlowKey &key);
+};
+
+} //End namespace ns3
+#endif /* SDN_PACKET_PARSER_H */
@@ -92,12 +92,11 @@ SdnPort::DoDispose (void)
   Object::DoDispose ();
 }
 
-fluid_msg::of10::PortStats*
+fluid_msg::of10::PortStats
 SdnPort::convertToPortStats()
   {
     NS_LOG_FUNCTION (this);
-    fluid_msg::of10::PortStats* portStats = new fluid_msg::of10::PortStats(m_fluidPort.port_no(), m_tx_stats, m_err_stats, m_collisions);
-    return portStats;
+    return fluid_msg::of10::PortStats(m_fluidPort.port_no(), m_tx_stats, m_err_stats, m_collisions);
   }
 
 Ptr<NetDevice> SdnPort::getDevice (void)
@@ -195,11 +195,9 @@ public:
   uint32_t sendOnPort (void* data, size_t len);
   /**
    * \brief Creates a PortsStats object 
-   * \param data A byte array of data to send
-   * \param len A size type of how long the data is
-   * \return The length of data sent. 0 if not sent
+   * \return The port statistics
    */
-  fluid_msg::of10::PortStats* convertToPortStats (void);
+  fluid_msg::of10::PortStats convertToPortStats (void);
 
 private:
   Ptr<NetDevice> m_device;                //!< The netdevice this port will point to. Held for convience sake
@@ -0,0 +1,258 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_RULE_STORE_H
+#define SDN_RULE_STORE_H
+
+//Stdlib packages
+#include <map>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+//Sdn classes
+#include "SdnFlowKey.h"
+
+namespace ns3 {
+
+/**
+ * \brief Position of a rule in the table. Higher priority first, then older first.
+ */
+struct SdnRuleOrder
+{
+  SdnRuleOrder (uint16_t p, uint64_t id) : priority (p), entry_id (id) {}
+  uint16_t priority; //!< Rule priority
+  uint64_t entry_id; //!< Insertion order, unique per table
+};
+
+/**
+ * \brief Strict weak ordering of SdnRuleOrder, highest priority first
+ */
+struct SdnRuleOrderLess
+{
+  bool operator() (const SdnRuleOrder &lhs, const SdnRuleOrder &rhs) const
+  {
+    if (lhs.priority != rhs.priority)
+      {
+        return lhs.priority > rhs.priority;
+      }
+    return lhs.entry_id < rhs.entry_id;
+  }
+};
+
+/**
+ * \ingroup sdn
+ *
+ * \brief Flow rule storage with several indexes over the same entries.
+ *
+ * Entries live in a map ordered by priority (descending) and insertion
+ * order, which is both the packet lookup order and the handle type: map
+ * nodes never move, so iterators and entry pointers stay valid until the
+ * entry is erased. Two secondary indexes point back into that map:
+ *
+ * - a hash on the exact compiled match plus priority, which is what the
+ *   strict FlowMod commands and the duplicate check on add look for;
+ * - an ordered index on each output port of an entry, for the out_port
+ *   filter of deletes and flow statistics requests.
+ *
+ * T must expose a compiled_match (SdnFlowMatch), a priority_, an entry_id
+ * and an output_ports vector, none of which may change while the entry is
+ * stored except through Reindex.
+ */
+template <class T>
+class SdnRuleStore
+{
+public:
+  typedef std::map<SdnRuleOrder, T, SdnRuleOrderLess> Rules; //!< Entries in lookup order
+  typedef typename Rules::iterator iterator;                 //!< Stable handle to an entry
+  typedef typename Rules::const_iterator const_iterator;     //!< Stable read-only handle
+
+  SdnRuleStore () {}
+
+  /**
+   * \brief Stores an entry. Its entry_id must already be assigned.
+   * \param entry The entry to copy in
+   * \return The handle of the stored entry
+   */
+  iterator Insert (const T &entry)
+  {
+    iterator stored = m_rules.insert (std::make_pair (SdnRuleOrder (entry.priority_, entry.entry_id), entry)).first;
+    m_strict[StrictKey (stored->second.compiled_match, stored->second.priority_)] = stored;
+    IndexPorts (stored);
+    return stored;
+  }
+
+  /**
+   * \brief Removes an entry from every index
+   * \param entry The handle of the entry
+   */
+  void Erase (iterator entry)
+  {
+    typename StrictIndex::iterator strict = m_strict.find (StrictKey (entry->second.compiled_match, entry->second.priority_));
+    if (strict != m_strict.end () && strict->second == entry)
+      {
+        m_strict.erase (strict);
+      }
+    UnindexPorts (entry);
+    m_rules.erase (entry);
+  }
+
+  /**
+   * \brief Refreshes the output port index after the actions of an entry changed
+   * \param entry The handle of the entry
+   * \param oldPorts The output ports the entry was indexed under
+   */
+  void Reindex (iterator entry, const std::vector<uint16_t> &oldPorts)
+  {
+    for (std::vector<uint16_t>::const_iterator p = oldPorts.begin (); p != oldPorts.end (); ++p)
+      {
+        m_outPorts.erase (OutPortKey (*p, entry->first));
+      }
+    IndexPorts (entry);
+  }
+
+  /**
+   * \brief Finds the entry with exactly this match and priority
+   * \return Its handle, or end () if there is none
+   */
+  iterator FindStrict (const SdnFlowMatch &match, uint16_t priority)
+  {
+    typename StrictIndex::iterator strict = m_strict.find (StrictKey (match, priority));
+    return strict == m_strict.end () ? m_rules.end () : strict->second;
+  }
+
+  /**
+   * \brief Finds an entry from its priority and entry id
+   * \return Its handle, or end () if it is no longer stored
+   */
+  iterator Find (uint16_t priority, uint64_t entryId)
+  {
+    return m_rules.find (SdnRuleOrder (priority, entryId));
+  }
+
+  /**
+   * \return The first entry of the given priority, or the first entry below it
+   */
+  iterator PriorityBegin (uint16_t priority)
+  {
+    return m_rules.lower_bound (SdnRuleOrder (priority, 0));
+  }
+
+  /**
+   * \return The first entry with a priority below the given one
+   */
+  iterator PriorityEnd (uint16_t priority)
+  {
+    return m_rules.upper_bound (SdnRuleOrder (priority, (uint64_t)-1));
+  }
+
+  /**
+   * \brief Collects the entries that output to a port, in lookup order
+   * \param port The output port
+   * \param result Receives the handles
+   */
+  void FindByOutPort (uint16_t port, std::vector<iterator> &result)
+  {
+    typename OutPortIndex::iterator i = m_outPorts.lower_bound (OutPortKey (port, SdnRuleOrder (0xffff, 0)));
+    for (; i != m_outPorts.end () && i->first.first == port; ++i)
+      {
+        result.push_back (i->second);
+      }
+  }
+
+  iterator begin (void) { return m_rules.begin (); }
+  iterator end (void) { return m_rules.end (); }
+  const_iterator begin (void) const { return m_rules.begin (); }
+  const_iterator end (void) const { return m_rules.end (); }
+  uint32_t size (void) const { return m_rules.size (); }
+
+  /**
+   * \brief Removes every entry
+   */
+  void Clear (void)
+  {
+    m_strict.clear ();
+    m_outPorts.clear ();
+    m_rules.clear ();
+  }
+
+private:
+  /// \brief Exact match and priority of an entry
+  struct StrictKey
+  {
+    StrictKey (const SdnFlowMatch &match, uint16_t p) : value (match.GetValue ()), mask (match.GetMask ()), priority (p) {}
+    SdnFlowKey value;  //!< Pre-masked match value
+    SdnFlowKey mask;   //!< Match mask
+    uint16_t priority; //!< Entry priority
+  };
+  struct StrictKeyHash
+  {
+    std::size_t operator() (const StrictKey &key) const
+    {
+      SdnFlowKeyHash hash;
+      return hash (key.value) ^ (hash (key.mask) * 31) ^ key.priority;
+    }
+  };
+  struct StrictKeyEqual
+  {
+    bool operator() (const StrictKey &lhs, const StrictKey &rhs) const
+    {
+      SdnFlowKeyEqual equal;
+      return lhs.priority == rhs.priority && equal (lhs.value, rhs.value) && equal (lhs.mask, rhs.mask);
+    }
+  };
+  typedef std::unordered_map<StrictKey, iterator, StrictKeyHash, StrictKeyEqual> StrictIndex;
+
+  typedef std::pair<uint16_t, SdnRuleOrder> OutPortKey;
+  struct OutPortKeyLess
+  {
+    bool operator() (const OutPortKey &lhs, const OutPortKey &rhs) const
+    {
+      if (lhs.first != rhs.first)
+        {
+          return lhs.first < rhs.first;
+        }
+      return SdnRuleOrderLess () (lhs.second, rhs.second);
+    }
+  };
+  typedef std::map<OutPortKey, iterator, OutPortKeyLess> OutPortIndex;
+
+  void IndexPorts (iterator entry)
+  {
+    const std::vector<uint16_t> &ports = entry->second.output_ports;
+    for (std::vector<uint16_t>::const_iterator p = ports.begin (); p != ports.end (); ++p)
+      {
+        m_outPorts[OutPortKey (*p, entry->first)] = entry;
+      }
+  }
+  void UnindexPorts (iterator entry)
+  {
+    const std::vector<uint16_t> &ports = entry->second.output_ports;
+    for (std::vector<uint16_t>::const_iterator p = ports.begin (); p != ports.end (); ++p)
+      {
+        m_outPorts.erase (OutPortKey (*p, entry->first));
+      }
+  }
+
+  SdnRuleStore (const SdnRuleStore &);
+  SdnRuleStore& operator= (const SdnRuleStore &);
+
+  Rules m_rules;           //!< The entries, in lookup order
+  StrictIndex m_strict;    //!< Entries keyed on exact match and priority
+  OutPortIndex m_outPorts; //!< Entries keyed on each of their output ports
+};
+
+} //End namespace ns3
+#endif /* SDN_RULE_STORE_H */
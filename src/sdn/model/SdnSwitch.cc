@@ -20,6 +20,7 @@
 #include "SdnSwitch.h"
 #include "SdnController.h"
 #include "SdnConnection.h"
+#include "SdnMultipartWriter.h"
 #include "ns3/log.h"
 #include "ns3/socket.h"
 #include "ns3/socket-factory.h"
@@ -30,6 +31,8 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/layer2-p2p-module.h"
 #include "ns3/ipv4.h"
+#include "ns3/trace-source-accessor.h"
+#include <algorithm>
 
 #include "fluid/util/ethaddr.hh"
 
@@ -40,8 +43,7 @@ namespace ns3 {
 #define MB 8000000
 #define mb 1000000
 
-#define MAX_BUFFERS 1000000000
-
+#define DEFAULT_MISS_SEND_LEN 128 //OFP_DEFAULT_MISS_SEND_LEN of the specification
 #ifndef INT16_MAX
 #define INT16_MAX 32767
 #endif
@@ -63,6 +65,57 @@ TypeId SdnSwitch::GetTypeId (void)
                    BooleanValue (false),
                    MakeBooleanAccessor (&SdnSwitch::m_kernel),
                    MakeBooleanChecker ())
+    .AddAttribute ("TupleSpaceLookup",
+                   "Classify packets with tuple space search instead of a linear scan of the flow table.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&SdnSwitch::SetTupleSpaceLookup,
+                                        &SdnSwitch::GetTupleSpaceLookup),
+                   MakeBooleanChecker ())
+    .AddAttribute ("TimeoutGranularity",
+                   "Tick length of the timing wheel that expires idle and hard flow timeouts.",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&SdnSwitch::SetTimeoutGranularity,
+                                     &SdnSwitch::GetTimeoutGranularity),
+                   MakeTimeChecker ())
+    .AddAttribute ("BufferCapacity",
+                   "Number of packets the switch can hold for the controller to refer to by buffer_id. Zero sends every packet whole.",
+                   UintegerValue (256),
+                   MakeUintegerAccessor (&SdnSwitch::SetBufferCapacity,
+                                         &SdnSwitch::GetBufferCapacity),
+                   MakeUintegerChecker<uint32_t> (0, SDN_MAX_BUFFER_SLOTS))
+    .AddAttribute ("BufferMaxAge",
+                   "Time after which a buffered packet the controller has not used may be reclaimed for a new one.",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&SdnSwitch::SetBufferMaxAge,
+                                     &SdnSwitch::GetBufferMaxAge),
+                   MakeTimeChecker ())
+    .AddAttribute ("PacketInData",
+                   "Whether PacketIn messages carry the first miss_send_len bytes of the packet. When false a buffered packet is reported by its buffer_id only.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&SdnSwitch::m_packetInData),
+                   MakeBooleanChecker ())
+    .AddTraceSource ("BufferOccupancy",
+                     "Number of packets held for the controller",
+                     MakeTraceSourceAccessor (&SdnSwitch::m_bufferOccupancy),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("BufferEviction",
+                     "A buffered packet was reclaimed before the controller used it",
+                     MakeTraceSourceAccessor (&SdnSwitch::m_bufferEvictionTrace),
+                     "ns3::Packet::TracedCallback")
+    .AddAttribute ("MicroflowCacheSize",
+                   "Number of exact packet keys cached in front of the flow table. Zero disables the cache.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&SdnSwitch::SetMicroflowCacheSize,
+                                         &SdnSwitch::GetMicroflowCacheSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddTraceSource ("MicroflowCacheHits",
+                     "Number of packets resolved by the microflow cache",
+                     MakeTraceSourceAccessor (&SdnSwitch::m_microflowHits),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("MicroflowCacheMisses",
+                     "Number of packets that missed the microflow cache",
+                     MakeTraceSourceAccessor (&SdnSwitch::m_microflowMisses),
+                     "ns3::TracedValueCallback::Uint32")
   ;
   return tid;
 }
@@ -73,20 +126,30 @@ SdnSwitch::SdnSwitch () : m_flowTable(this)
   PacketMetadata::Enable();
   m_datapathID =  getNewDatapathID ();
   m_vendor = 0xFFFF;
-  m_missSendLen = INT16_MAX;
+  m_missSendLen = DEFAULT_MISS_SEND_LEN;
+  m_packetInData = true;
   m_recvEvent = EventId ();
   TOTAL_PORTS = 0;
   m_controllerConn = CreateObject<SdnConnection> ();
 
-  m_bufferIdStream = CreateObject<UniformRandomVariable> ();
-  m_bufferIdStream->SetAttribute("Min", DoubleValue(0.0));
-  m_bufferIdStream->SetAttribute("Max", DoubleValue(MAX_BUFFERS));
-  m_switchFeatures.n_buffers = MAX_BUFFERS;
+  m_switchFeatures.n_buffers = 0;
+  m_bufferPool.SetEvictCallback (MakeCallback (&SdnSwitch::HandleBufferEviction, this));
 
   m_kernel = false;
-
-  m_pendingPacket = 0;
-  m_pendingBytes = 0;
+  m_tupleSpaceLookup = false;
+  m_timerWheel.SetExpireCallback (MakeCallback (&SdnSwitch::HandleFlowTimer, this));
+  m_timerWheel.SetTickCallback (MakeCallback (&SdnSwitch::FlushFlowRemoved, this));
+
+  m_messageHandlers.assign (fluid_msg::of10::OFPT_QUEUE_GET_CONFIG_REPLY + 1, 0);
+  m_messageHandlers[fluid_msg::of10::OFPT_HELLO] = &SdnSwitch::OFHandle_Hello_Request;
+  m_messageHandlers[fluid_msg::of10::OFPT_FEATURES_REQUEST] = &SdnSwitch::OFHandle_Feature_Request;
+  m_messageHandlers[fluid_msg::of10::OFPT_GET_CONFIG_REQUEST] = &SdnSwitch::OFHandle_Get_Config_Request;
+  m_messageHandlers[fluid_msg::of10::OFPT_SET_CONFIG] = &SdnSwitch::OFHandle_Set_Config;
+  m_messageHandlers[fluid_msg::of10::OFPT_FLOW_MOD] = &SdnSwitch::OFHandle_Flow_Mod;
+  m_messageHandlers[fluid_msg::of10::OFPT_STATS_REQUEST] = &SdnSwitch::OFHandle_Stats_Request;
+  m_messageHandlers[fluid_msg::of10::OFPT_PACKET_OUT] = &SdnSwitch::OFHandle_Packet_Out;
+  m_messageHandlers[fluid_msg::of10::OFPT_PORT_MOD] = &SdnSwitch::OFHandle_Port_Mod;
+  m_messageHandlers[fluid_msg::of10::OFPT_BARRIER_REQUEST] = &SdnSwitch::OFHandle_Barrier_Request;
 }
 
 SdnSwitch::~SdnSwitch ()
@@ -94,9 +157,82 @@ SdnSwitch::~SdnSwitch ()
   NS_LOG_FUNCTION (this);
 }
 
+void SdnSwitch::SetTupleSpaceLookup (bool enable)
+{
+  NS_LOG_FUNCTION (this << enable);
+  m_tupleSpaceLookup = enable;
+  m_flowTable.setTupleSpaceLookup (enable);
+}
+
+bool SdnSwitch::GetTupleSpaceLookup (void) const
+{
+  return m_tupleSpaceLookup;
+}
+
+void SdnSwitch::SetMicroflowCacheSize (uint32_t size)
+{
+  NS_LOG_FUNCTION (this << size);
+  m_flowTable.setMicroflowCacheSize (size);
+}
+
+uint32_t SdnSwitch::GetMicroflowCacheSize (void) const
+{
+  return m_flowTable.getMicroflowCacheSize ();
+}
+
+void SdnSwitch::SetTimeoutGranularity (Time granularity)
+{
+  NS_LOG_FUNCTION (this << granularity);
+  m_timerWheel.SetGranularity (granularity);
+}
+
+Time SdnSwitch::GetTimeoutGranularity (void) const
+{
+  return m_timerWheel.GetGranularity ();
+}
+
+void SdnSwitch::SetBufferCapacity (uint32_t capacity)
+{
+  NS_LOG_FUNCTION (this << capacity);
+  m_bufferPool.SetCapacity (capacity);
+  m_switchFeatures.n_buffers = capacity;
+}
+
+uint32_t SdnSwitch::GetBufferCapacity (void) const
+{
+  return m_bufferPool.GetCapacity ();
+}
+
+void SdnSwitch::SetBufferMaxAge (Time maxAge)
+{
+  NS_LOG_FUNCTION (this << maxAge);
+  m_bufferPool.SetMaxAge (maxAge);
+}
+
+Time SdnSwitch::GetBufferMaxAge (void) const
+{
+  return m_bufferPool.GetMaxAge ();
+}
+
+void SdnSwitch::HandleBufferEviction (Ptr<const Packet> packet)
+{
+  NS_LOG_FUNCTION (this << packet);
+  m_bufferEvictionTrace (packet);
+}
+
 void SdnSwitch::DoDispose (void)
 {
   NS_LOG_FUNCTION (this);
+  m_directController = 0;
+  m_timerWheel.Clear ();
+  m_bufferPool.Clear ();
+  m_portIndex.clear ();
+  m_portMap.clear ();
+  for (std::vector<fluid_msg::of10::FlowRemoved*>::iterator i = m_pendingFlowRemoved.begin(); i != m_pendingFlowRemoved.end(); ++i)
+    {
+      delete *i;
+    }
+  m_pendingFlowRemoved.clear();
 
   Application::DoDispose ();
 }
@@ -178,6 +314,14 @@ void SdnSwitch::EstablishControllerConnection (Ptr<NetDevice> device,
   NS_LOG_FUNCTION (this << device << localAddress << remoteAddress);
   NS_LOG_INFO (Simulator::Now().GetSeconds());
 
+  if (m_directController)
+    {
+      m_controllerConn = CreateObject<SdnConnection> (device, Ptr<Socket> (0));
+      m_controllerConn->set_receive_callback (MakeCallback (&SdnSwitch::HandleControllerMessages, this));
+      m_directController->ConnectDirect (m_controllerConn);
+      return;
+    }
+
   // Create a socket for this switch.
   TypeId tid = TypeId::LookupByName ("ns3::TcpSocketFactory");
   if (m_kernel)
@@ -235,7 +379,8 @@ void SdnSwitch::EstablishConnection (Ptr<NetDevice> device,
   if(l2Device)
     {
       l2Device->SetSdnEnable(true);
-      l2Device->SetSdnReceiveCallback(MakeCallback(&SdnSwitch::HandleReadFromNetDevice, this));
+      //The port number travels with every received packet, so ingress needs no lookup
+      l2Device->SetSdnReceiveCallback(MakeCallback(&SdnSwitch::HandleReadFromNetDevice, this).Bind (switchPort));
       Ptr<SdnConnection> c = CreateObject<SdnConnection> (device, socket);
       Ptr<Layer2P2PChannel> channel = DynamicCast<Layer2P2PChannel>(device->GetChannel());
       uint32_t portFeaturesMask = 0;
@@ -263,6 +408,11 @@ void SdnSwitch::EstablishConnection (Ptr<NetDevice> device,
 	}
       Ptr<SdnPort> p = CreateObject<SdnPort> (device, c, switchPort, 0, 0, portFeaturesMask);
       m_portMap.insert (std::make_pair (p->getPortNumber(),p));
+      if (m_portIndex.size () <= p->getPortNumber ())
+        {
+          m_portIndex.resize (p->getPortNumber () + 1);
+        }
+      m_portIndex[p->getPortNumber ()] = p;
     }
 }
 
@@ -290,108 +440,65 @@ SdnSwitch::ConnectionFailed (Ptr<Socket> socket)
 void SdnSwitch::HandleReadController (Ptr<Socket> socket)
 {
   NS_LOG_FUNCTION (this << socket);
-  uint32_t rxBytesAvailable = 0;
-    do
-      {
-        if (!m_pendingBytes)
-          {
-            // Starting with a new OpenFlow message.
-            // At least 8 bytes (OpenFlow header) must be available.
-            rxBytesAvailable = socket->GetRxAvailable ();
-            if (rxBytesAvailable < 8)
-              {
-                return; // Wait for more bytes.
-              }
-
-            // Receive the OpenFlow header and get the OpenFlow message size
-            uint8_t header[8];
-            m_pendingPacket = socket->RecvFrom (sizeof(header), 0, m_pendingFrom);
-            m_pendingPacket->CopyData ((uint8_t*)&header, sizeof(header));
-            fluid_msg::OFMsg* msg = new fluid_msg::OFMsg (header);
-            m_pendingBytes = msg->length() - sizeof(header);
-          }
+  NS_ASSERT (m_controllerConn->get_socket () == socket);
 
-        // Receive the remaining OpenFlow message
-        if (m_pendingBytes)
-          {
-            if (rxBytesAvailable < m_pendingBytes)
-              {
-                // We need to wait for more bytes
-                return;
-              }
-            m_pendingPacket->AddAtEnd (socket->Recv (m_pendingBytes, 0));
-          }
+  Ptr<Packet> packet;
+  Address from;
+  while ((packet = socket->RecvFrom (from)))
+    {
+      if (InetSocketAddress::IsMatchingType (from))
+        {
+          NS_LOG_LOGIC ("At time " << Simulator::Now ().GetSeconds () <<
+                        "s the OpenFlow switch received " << packet->GetSize () <<
+                        " bytes from controller " << InetSocketAddress::ConvertFrom (from).GetIpv4 () <<
+                        " socket " << socket <<
+                        " port " << InetSocketAddress::ConvertFrom (from).GetPort ());
+        }
+      m_controllerConn->receive (packet);
+    }
+  HandleControllerMessages (m_controllerConn);
+}
 
-        if (InetSocketAddress::IsMatchingType (m_pendingFrom))
-          {
-            Ipv4Address ipv4 = InetSocketAddress::ConvertFrom (m_pendingFrom).GetIpv4 ();
-            uint16_t port = InetSocketAddress::ConvertFrom (m_pendingFrom).GetPort ();
-            NS_LOG_LOGIC ("At time " << Simulator::Now ().GetSeconds () <<
-                          "s the OpenFlow switch received " << m_pendingPacket->GetSize () <<
-                          " bytes from controller " << ipv4 <<
-                          " socket " << socket <<
-                          " port " << port);
-
-            NS_ASSERT (m_controllerConn->get_socket () == socket);
-
-            m_pendingPacket->RemoveAllPacketTags ();
-            m_pendingPacket->RemoveAllByteTags ();
-
-            uint8_t buffer[m_pendingPacket->GetSize ()];
-            m_pendingPacket->CopyData (buffer,m_pendingPacket->GetSize ());
-            fluid_msg::OFMsg* message = new fluid_msg::OFMsg (buffer);
-
-            //These handlers should return number of bytes sent
-            if (message->type () == fluid_msg::of10::OFPT_HELLO)
-              {
-                OFHandle_Hello_Request(message);
-              }
-            if (message->type () == fluid_msg::of10::OFPT_FEATURES_REQUEST)
-              {
-                OFHandle_Feature_Request(message);
-              }
-            if (message->type () == fluid_msg::of10::OFPT_GET_CONFIG_REQUEST)
-              {
-                OFHandle_Get_Config_Request();
-              }
-            if (message->type () == fluid_msg::of10::OFPT_SET_CONFIG)
-              {
-                OFHandle_Set_Config(buffer);
-              }
-            if (message->type () == fluid_msg::of10::OFPT_FLOW_MOD)
-              {
-                OFHandle_Flow_Mod(buffer);
-              }
-            if (message->type () == fluid_msg::of10::OFPT_STATS_REQUEST)
-              {
-                OFHandle_Stats_Request(buffer);
-              }
-            if (message->type () == fluid_msg::of10::OFPT_PACKET_OUT)
-              {
-                OFHandle_Packet_Out(buffer);
-              }
-            if (message->type () == fluid_msg::of10::OFPT_PORT_MOD)
-              {
-                OFHandle_Port_Mod(buffer);
-              }
-            if (message->type () == fluid_msg::of10::OFPT_BARRIER_REQUEST)
-              {
-                OFHandle_Barrier_Request(buffer);
-              }
-            delete (message);
-          }
-        m_pendingPacket = 0;
-        m_pendingBytes = 0;
+void SdnSwitch::HandleControllerMessages (Ptr<SdnConnection> c)
+{
+  NS_LOG_FUNCTION (this << c);
 
-        // Repeat until socket buffer gets empty
-      }
-    while (socket->GetRxAvailable ());
+  //Messages can span or share segments, the connection hands back whole ones
+  std::vector<uint8_t*> flowMods;
+  uint8_t* message;
+  while ((message = c->next_message ()))
+    {
+      uint8_t type = SdnMessageStream::GetType (message);
+      if (type == fluid_msg::of10::OFPT_FLOW_MOD)
+        {
+          //Consecutive flow mods reach the table as one batch
+          flowMods.push_back (message);
+          continue;
+        }
+      if (!flowMods.empty ())
+        {
+          OFHandle_Flow_Mods (flowMods);
+          flowMods.clear ();
+        }
+      if (type < m_messageHandlers.size () && m_messageHandlers[type])
+        {
+          (this->*m_messageHandlers[type]) (message);
+        }
+      else
+        {
+          NS_LOG_WARN ("Ignoring OpenFlow message of type " << (uint32_t)type);
+        }
+    }
+  if (!flowMods.empty ())
+    {
+      OFHandle_Flow_Mods (flowMods);
+    }
 }
 
 //Handles a packet from a non-controller
-bool SdnSwitch::HandleReadFromNetDevice (Ptr<NetDevice> device, Ptr<const Packet> originalPacket, uint16_t protocol, const Address &source )
+bool SdnSwitch::HandleReadFromNetDevice (uint16_t inPort, Ptr<NetDevice> device, Ptr<const Packet> originalPacket, uint16_t protocol, const Address &source )
 {
-  NS_LOG_FUNCTION (this << device << originalPacket << protocol << source);
+  NS_LOG_FUNCTION (this << inPort << device << originalPacket << protocol << source);
 
   if(m_controllerConn->get_state() != fluid_base::OFConnection::STATE_RUNNING)
     {
@@ -400,36 +507,36 @@ bool SdnSwitch::HandleReadFromNetDevice (Ptr<NetDevice> device, Ptr<const Packet
     }
   Ptr<Packet> packet = originalPacket->Copy();
 
-  uint16_t inPort = 0;
-  for(std::map<uint16_t,Ptr<SdnPort> >::iterator portIterator = m_portMap.begin(); portIterator != m_portMap.end(); ++portIterator)
-    {
-      if(portIterator->second && portIterator->second->getDevice() == device)
-        {
-          inPort = portIterator->first;
-          break;
-        }
-    }
-
   return HandlePacket (packet, inPort);
 }
 
 bool SdnSwitch::HandlePacket (Ptr<Packet>packet, uint16_t inPort)
 {
   NS_LOG_FUNCTION (this << packet << inPort);
-  std::vector<uint16_t> outPorts = m_flowTable.handlePacket (packet, inPort);
+  std::vector<uint16_t> outPorts;
+  bool matched = m_flowTable.handlePacket (packet, inPort, outPorts);
+  if (m_flowTable.getMicroflowCacheSize ())
+    {
+      m_microflowHits = m_flowTable.m_cache_hits;
+      m_microflowMisses = m_flowTable.m_cache_misses;
+    }
 
-  //Handle packet in message
-  if (outPorts.empty() && m_portMap.count(inPort))
+  //Only a table miss goes to the controller, a matched flow without actions drops the packet
+  if (!matched)
     {
-      SendPacketInToController(packet, m_portMap[inPort]->getDevice (), fluid_msg::of10::OFPR_NO_MATCH);
-      return 1;
+      if (GetPort (inPort))
+        {
+          SendPacketInToController(packet, inPort, fluid_msg::of10::OFPR_NO_MATCH);
+          return 1;
+        }
+      return 0;
     }
   //Send out on port assuming it's enabled
   for (std::vector<uint16_t>::iterator outPort = outPorts.begin(); outPort != outPorts.end(); ++outPort)
   {
-    if ((*outPort == fluid_msg::of10::OFPP_CONTROLLER) && m_portMap.count(inPort))
+    if ((*outPort == fluid_msg::of10::OFPP_CONTROLLER) && GetPort (inPort))
       {
-        SendPacketInToController(packet, m_portMap[inPort]->getDevice (), fluid_msg::of10::OFPR_ACTION);
+        SendPacketInToController(packet, inPort, fluid_msg::of10::OFPR_ACTION);
         return 1;
       }
     //Handle flooding
@@ -439,10 +546,10 @@ bool SdnSwitch::HandlePacket (Ptr<Packet>packet, uint16_t inPort)
         return 1;
       }
     //Handle packet output
-    if (m_portMap.count (*outPort) != 0)
+    Ptr<SdnPort> portStruct = GetPort (*outPort);
+    if (portStruct)
       {
-        Ptr<SdnPort> portStruct = m_portMap[*outPort];
-        if(portStruct && !(portStruct->getConfig() & (fluid_msg::of10::OFPPC_PORT_DOWN | fluid_msg::of10::OFPPC_NO_RECV | fluid_msg::of10::OFPPC_NO_FWD)))
+        if(!(portStruct->getConfig() & (fluid_msg::of10::OFPPC_PORT_DOWN | fluid_msg::of10::OFPPC_NO_RECV | fluid_msg::of10::OFPPC_NO_FWD)))
           {
             portStruct->getConn()->sendOnNetDevice (packet);
           }
@@ -451,108 +558,117 @@ bool SdnSwitch::HandlePacket (Ptr<Packet>packet, uint16_t inPort)
   return 0;
 }
 
-void SdnSwitch::OFHandle_Hello_Request (fluid_msg::OFMsg* message)
+void SdnSwitch::OFHandle_Hello_Request (uint8_t* buffer)
 {
-  NS_LOG_FUNCTION (this << message);
-  fluid_msg::of10::Hello* helloMessage = new fluid_msg::of10::Hello(message->xid());
-  if (NegotiateVersion (message))
+  NS_LOG_FUNCTION (this << buffer);
+  fluid_msg::OFMsg message (buffer);
+  if (NegotiateVersion (&message))
     {
-      m_controllerConn->send (helloMessage);
+      fluid_msg::of10::Hello helloMessage (message.xid());
+      m_controllerConn->send (&helloMessage);
       m_controllerConn->set_state(fluid_base::OFConnection::STATE_RUNNING);
       return;
     }
   else
     {
       m_controllerConn->set_state(fluid_base::OFConnection::STATE_FAILED);
-      fluid_msg::of10::Error* errorMessage =
-        new fluid_msg::of10::Error (
+      fluid_msg::of10::Error errorMessage (
           SdnCommon::GenerateXId(),
           fluid_msg::of10::OFPET_HELLO_FAILED,
           fluid_msg::of10::OFPHFC_INCOMPATIBLE);
-      m_controllerConn->send(errorMessage);
+      m_controllerConn->send(&errorMessage);
       return;
     }
 }
 
-void SdnSwitch::OFHandle_Feature_Request (fluid_msg::OFMsg* message)
+void SdnSwitch::OFHandle_Feature_Request (uint8_t* buffer)
 {
-  NS_LOG_FUNCTION (this << message);
+  NS_LOG_FUNCTION (this << buffer);
   std::vector<fluid_msg::of10::Port> fluidPorts;
   for(std::map<uint16_t, Ptr<SdnPort> >::iterator i = m_portMap.begin(); i != m_portMap.end(); ++i)
   {
     fluidPorts.push_back(i->second->getFluidPort());
   }
 
-  fluid_msg::of10::FeaturesReply* featuresReply =
-    new fluid_msg::of10::FeaturesReply (message->xid (),
+  fluid_msg::of10::FeaturesReply featuresReply (SdnMessageStream::GetXid (buffer),
 					((uint64_t)((uint64_t)OF_DATAPATH_ID_PADDING << 48) | GetMacAddress ()),
                                         m_switchFeatures.n_buffers,
                                         m_switchFeatures.n_tables,
                                         GetCapabilities (),
                                         GetActions (),
                                         fluidPorts);
-  m_controllerConn->send (featuresReply);
+  m_controllerConn->send (&featuresReply);
   return;
 }
 
-void SdnSwitch::OFHandle_Get_Config_Request()
+void SdnSwitch::OFHandle_Get_Config_Request(uint8_t* buffer)
 {
-  NS_LOG_FUNCTION (this);
-  fluid_msg::of10::GetConfigReply* getConfigReply =
-    new fluid_msg::of10::GetConfigReply (SdnCommon::GenerateXId(),
+  NS_LOG_FUNCTION (this << buffer);
+  fluid_msg::of10::GetConfigReply getConfigReply (SdnMessageStream::GetXid (buffer),
                                          0, //Flags of 0 for fragmentation
                                          m_missSendLen);
-   m_controllerConn->send (getConfigReply);
+  m_controllerConn->send (&getConfigReply);
 }
 
 void SdnSwitch::OFHandle_Set_Config(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::SetConfig* setConfig = new fluid_msg::of10::SetConfig();
-  setConfig->unpack(buffer);
-  if (setConfig)
-    {
-      m_missSendLen = setConfig->miss_send_len();
-    }
+  fluid_msg::of10::SetConfig setConfig;
+  setConfig.unpack(buffer);
+  m_missSendLen = setConfig.miss_send_len();
 }
 
 void SdnSwitch::OFHandle_Flow_Mod(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::FlowMod* flowMod = new fluid_msg::of10::FlowMod();
-  flowMod->unpack(buffer);
-  if (flowMod)
+  std::vector<uint8_t*> buffers (1, buffer);
+  OFHandle_Flow_Mods (buffers);
+}
+
+void SdnSwitch::OFHandle_Flow_Mods(const std::vector<uint8_t*> &buffers)
+{
+  NS_LOG_FUNCTION (this << buffers.size ());
+  m_flowTable.beginUpdate ();
+  for (std::vector<uint8_t*>::const_iterator buffer = buffers.begin (); buffer != buffers.end (); ++buffer)
     {
-      switch (flowMod->command())
+      fluid_msg::of10::FlowMod flowMod;
+      flowMod.unpack(*buffer);
+      switch (flowMod.command())
         {
           case fluid_msg::of10::OFPFC_ADD:
-            addFlow(flowMod);
+            addFlow(&flowMod);
             break;
           case fluid_msg::of10::OFPFC_MODIFY:
-            modifyFlow(flowMod);
+            modifyFlow(&flowMod);
             break;
           case fluid_msg::of10::OFPFC_MODIFY_STRICT:
-            modifyFlowStrict(flowMod);
+            modifyFlowStrict(&flowMod);
             break;
           case fluid_msg::of10::OFPFC_DELETE:
-            deleteFlow(flowMod);
+            deleteFlow(&flowMod);
             break;
           case fluid_msg::of10::OFPFC_DELETE_STRICT:
-            deleteFlowStrict(flowMod);
+            deleteFlowStrict(&flowMod);
             break;
         }
 
-      if (flowMod->command () != fluid_msg::of10::OFPFC_DELETE &&
-	      flowMod->command () != fluid_msg::of10::OFPFC_DELETE_STRICT)
-	{
-          if ((flowMod->buffer_id () != (uint32_t)(-1)) &&
-      	    (m_packetBuffers.count (flowMod->buffer_id ())))
+      if (flowMod.command () != fluid_msg::of10::OFPFC_DELETE &&
+          flowMod.command () != fluid_msg::of10::OFPFC_DELETE_STRICT &&
+          flowMod.buffer_id () != (uint32_t)(-1))
+        {
+          //The buffered packet goes through the table as this flow mod left it, before the next one
+          m_flowTable.endUpdate ();
+          uint32_t inPort;
+          Ptr<Packet> packet = m_bufferPool.Take (flowMod.buffer_id (), &inPort);
+          if (packet)
             {
-              Ptr<Packet> copyPacket = m_packetBuffers[flowMod->buffer_id ()]->Copy ();
-              HandlePacket (copyPacket, flowMod->match ().in_port ());
+              HandlePacket (packet, inPort);
             }
-	}
+          m_flowTable.beginUpdate ();
+        }
     }
+  m_flowTable.endUpdate ();
+  m_bufferOccupancy = m_bufferPool.GetOccupancy ();
 }
 
 void SdnSwitch::addFlow(fluid_msg::of10::FlowMod* message)
@@ -563,13 +679,25 @@ void SdnSwitch::addFlow(fluid_msg::of10::FlowMod* message)
   if(flow.cookie_ != message->cookie())
     {
     
-      fluid_msg::of10::Error* errorMessage = new fluid_msg::of10::Error(SdnCommon::GenerateXId(),
+      fluid_msg::of10::Error errorMessage (SdnCommon::GenerateXId(),
 	      fluid_msg::of10::OFPET_FLOW_MOD_FAILED,fluid_msg::of10::OFPFMFC_OVERLAP);
-      m_controllerConn->send(errorMessage);
+      m_controllerConn->send(&errorMessage);
       return;
     }
 }
 
+void SdnSwitch::PreloadFlow (fluid_msg::of10::FlowMod* message)
+{
+  NS_LOG_FUNCTION (this << message);
+  m_flowTable.addFlow (message);
+}
+
+void SdnSwitch::SetDirectController (Ptr<SdnController> controller)
+{
+  NS_LOG_FUNCTION (this << controller);
+  m_directController = controller;
+}
+
 void SdnSwitch::modifyFlow(fluid_msg::of10::FlowMod* message)
 {
   NS_LOG_FUNCTION (this << message);
@@ -578,9 +706,8 @@ void SdnSwitch::modifyFlow(fluid_msg::of10::FlowMod* message)
 
 void SdnSwitch::modifyFlowStrict(fluid_msg::of10::FlowMod* message)
 {
-// HACK FOR COMPILE
   NS_LOG_FUNCTION (this << message);
-  m_flowTable.modifyFlow(message);
+  m_flowTable.modifyFlowStrict(message);
 }
 
 void SdnSwitch::deleteFlow(fluid_msg::of10::FlowMod* message)
@@ -591,64 +718,61 @@ void SdnSwitch::deleteFlow(fluid_msg::of10::FlowMod* message)
 
 void SdnSwitch::deleteFlowStrict(fluid_msg::of10::FlowMod* message)
 {
-// HACK FOR COMPILE
   NS_LOG_FUNCTION (this << message);
-  m_flowTable.deleteFlow(message);
+  m_flowTable.deleteFlowStrict(message);
 }
 
 void SdnSwitch::OFHandle_Port_Mod (uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::PortMod* portMod = new fluid_msg::of10::PortMod();
-  portMod->unpack(buffer);
-  if (portMod)
-  {
-    if (m_portMap.count(portMod->port_no()) != 0)
-      {
-        Ptr<SdnPort> port = m_portMap[portMod->port_no()];
-        uint32_t newConfig = ((portMod->config() & portMod->mask()) | (port->getConfig() & ~portMod->mask())); // & port->getAdvertised();
-        port->setConfig(newConfig);
-      }
-  }
+  fluid_msg::of10::PortMod portMod;
+  portMod.unpack(buffer);
+  Ptr<SdnPort> port = GetPort (portMod.port_no());
+  if (port)
+    {
+      uint32_t newConfig = ((portMod.config() & portMod.mask()) | (port->getConfig() & ~portMod.mask())); // & port->getAdvertised();
+      port->setConfig(newConfig);
+    }
 }
 
 //Need some more groundwork in here
 void SdnSwitch::OFHandle_Stats_Request(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::StatsRequest* statsRequest = new fluid_msg::of10::StatsRequest();
-  statsRequest->unpack(buffer);
-  fluid_msg::of10::StatsReply* statsReply = new fluid_msg::of10::StatsReply();
-  if (statsRequest)
+  fluid_msg::of10::StatsRequest statsRequest;
+  statsRequest.unpack(buffer);
+  fluid_msg::of10::StatsReply* statsReply = 0;
+  switch (statsRequest.stats_type())
     {
-      switch (statsRequest->stats_type())
-        {
-          case fluid_msg::of10::OFPST_DESC:
-            statsReply = replyWithDescription();
-            break;
-          case fluid_msg::of10::OFPST_FLOW:
-            statsReply = replyWithFlow(buffer);
-            break;
-          case fluid_msg::of10::OFPST_AGGREGATE:
-            statsReply = replyWithAggregate(buffer);
-            break;
-          case fluid_msg::of10::OFPST_TABLE:
-            statsReply = replyWithTable(buffer);
-            break;
-          case fluid_msg::of10::OFPST_PORT:
-            statsReply = replyWithPort(buffer);
-            break;
-          case fluid_msg::of10::OFPST_QUEUE:
-            statsReply = replyWithQueue();
-            break;
-          case fluid_msg::of10::OFPST_VENDOR:
-            statsReply = replyWithVendor();
-            break;
-        }
+      case fluid_msg::of10::OFPST_DESC:
+        statsReply = replyWithDescription();
+        break;
+      case fluid_msg::of10::OFPST_FLOW:
+        //Streamed, the replies are sent as they fill up
+        replyWithFlow(buffer, statsRequest.xid());
+        break;
+      case fluid_msg::of10::OFPST_AGGREGATE:
+        statsReply = replyWithAggregate(buffer, statsRequest.xid());
+        break;
+      case fluid_msg::of10::OFPST_TABLE:
+        statsReply = replyWithTable(buffer);
+        break;
+      case fluid_msg::of10::OFPST_PORT:
+        statsReply = replyWithPort(buffer);
+        break;
+      case fluid_msg::of10::OFPST_QUEUE:
+        statsReply = replyWithQueue();
+        break;
+      case fluid_msg::of10::OFPST_VENDOR:
+        statsReply = replyWithVendor();
+        break;
+    }
+  //The helpers allocate the reply, it is released once packed and sent
+  if (statsReply)
+    {
+      m_controllerConn->send(statsReply);
+      delete statsReply;
     }
-  //Establish statsReply here
-  m_controllerConn->send(statsReply);
-  return;
 }
 
 //stat utility functions
@@ -659,48 +783,59 @@ fluid_msg::of10::StatsReplyDesc* SdnSwitch::replyWithDescription()
   return statsReply;
 }
 
-fluid_msg::of10::StatsReplyFlow* SdnSwitch::replyWithFlow(uint8_t* buffer)
+void SdnSwitch::replyWithFlow(uint8_t* buffer, uint32_t xid)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::StatsRequestFlow* flowRequest = new fluid_msg::of10::StatsRequestFlow();
-  flowRequest->unpack(buffer);
-  std::vector<Flow> matchingFlows = m_flowTable.matchingFlows(flowRequest->match());
-  std::vector<fluid_msg::of10::FlowStats> matchFlowStats;
-  for(std::vector<Flow>::iterator flow = matchingFlows.begin(); flow != matchingFlows.end(); ++flow)
-    {
-      fluid_msg::of10::FlowStats* flowStat = (*flow).convertToFlowStats();
-      matchFlowStats.push_back(*flowStat);
-    }
-  fluid_msg::of10::StatsReplyFlow* flowReply = new fluid_msg::of10::StatsReplyFlow(SdnCommon::GenerateXId (), 0, matchFlowStats); //0 flags because 1.0.0 hasn't defined it yet
-  return flowReply;
+  fluid_msg::of10::StatsRequestFlow flowRequest;
+  flowRequest.unpack(buffer);
+  SdnMultipartWriter<fluid_msg::of10::StatsReplyFlow, fluid_msg::of10::FlowStats> writer (m_controllerConn, xid, 12); //sizeof (ofp_stats_reply)
+  m_flowTable.writeFlowStats(flowRequest.match(), flowRequest.out_port(), writer);
+  writer.Finish();
+  NS_LOG_DEBUG ("Flow stats sent in " << writer.GetNSent() << " replies");
 }
 
-fluid_msg::of10::StatsReplyAggregate* SdnSwitch::replyWithAggregate(uint8_t* buffer)
+fluid_msg::of10::StatsReplyAggregate* SdnSwitch::replyWithAggregate(uint8_t* buffer, uint32_t xid)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::StatsRequestAggregate* aggregateRequest = new fluid_msg::of10::StatsRequestAggregate();
- aggregateRequest->unpack(buffer);
-  uint64_t packet_count = 0;
-  uint64_t byte_count = 0;
-  uint32_t flow_count = 0;
-  std::vector<Flow> matchingFlows = m_flowTable.matchingFlows(aggregateRequest->match());
-  for(std::vector<Flow>::iterator flow = matchingFlows.begin(); flow != matchingFlows.end(); ++flow)
-    {
-      packet_count += (*flow).packet_count_;
-      byte_count += (*flow).byte_count_;
+  fluid_msg::of10::StatsRequestAggregate aggregateRequest;
+  aggregateRequest.unpack(buffer);
+  //Sums the stats handed over by the flow table
+  struct Totals
+  {
+    Totals () : packet_count (0), byte_count (0), flow_count (0) {}
+    void Add (fluid_msg::of10::FlowStats stats)
+    {
+      packet_count += stats.packet_count();
+      byte_count += stats.byte_count();
       flow_count++;
     }
-  fluid_msg::of10::StatsReplyAggregate* aggregateReply  = new fluid_msg::of10::StatsReplyAggregate(SdnCommon::GenerateXId(), 0, packet_count, byte_count, flow_count);
+    uint64_t packet_count;
+    uint64_t byte_count;
+    uint32_t flow_count;
+  } totals;
+  fluid_msg::of10::Match match = aggregateRequest.match();
+  if (match.wildcards() == fluid_msg::of10::OFPFW_ALL && aggregateRequest.out_port() == fluid_msg::of10::OFPP_NONE)
+    {
+      //Every flow, the table keeps these up to date
+      totals.packet_count = m_flowTable.m_packet_total;
+      totals.byte_count = m_flowTable.m_byte_total;
+      totals.flow_count = m_flowTable.m_active_count;
+    }
+  else
+    {
+      m_flowTable.writeFlowStats(match, aggregateRequest.out_port(), totals);
+    }
+  fluid_msg::of10::StatsReplyAggregate* aggregateReply  = new fluid_msg::of10::StatsReplyAggregate(xid, 0, totals.packet_count, totals.byte_count, totals.flow_count);
   return aggregateReply;
 }
 
 fluid_msg::of10::StatsReplyTable* SdnSwitch::replyWithTable(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::StatsRequestTable* tableRequest = new fluid_msg::of10::StatsRequestTable();
-  tableRequest->unpack(buffer);
+  fluid_msg::of10::StatsRequestTable tableRequest;
+  tableRequest.unpack(buffer);
   std::vector<fluid_msg::of10::TableStats> tableStats;
-  tableStats.push_back(*(m_flowTable.convertToTableStats()));
+  tableStats.push_back(m_flowTable.convertToTableStats());
   fluid_msg::of10::StatsReplyTable* tableReply = new fluid_msg::of10::StatsReplyTable(SdnCommon::GenerateXId(), 0, tableStats);
   return tableReply;
 }
@@ -708,19 +843,19 @@ fluid_msg::of10::StatsReplyTable* SdnSwitch::replyWithTable(uint8_t* buffer)
 fluid_msg::of10::StatsReplyPort* SdnSwitch::replyWithPort(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::StatsRequestPort* portRequest = new fluid_msg::of10::StatsRequestPort();
-  portRequest->unpack(buffer);
+  fluid_msg::of10::StatsRequestPort portRequest;
+  portRequest.unpack(buffer);
   std::vector<fluid_msg::of10::PortStats> portStats;
-  if(portRequest->port_no() == fluid_msg::of10::OFPP_NONE)
+  if(portRequest.port_no() == fluid_msg::of10::OFPP_NONE)
   {
     for(std::map<uint16_t,Ptr<SdnPort> >::iterator port = m_portMap.begin(); port != m_portMap.end(); ++port)
     {
-      portStats.push_back(*(port->second->convertToPortStats()));
+      portStats.push_back(port->second->convertToPortStats());
     }
   }
-  else if (m_portMap.count(portRequest->port_no()) != 0)
+  else if (GetPort (portRequest.port_no()))
   {
-    portStats.push_back(*(m_portMap[portRequest->port_no()]->convertToPortStats()));
+    portStats.push_back(GetPort (portRequest.port_no())->convertToPortStats());
   }
   fluid_msg::of10::StatsReplyPort* portReply = new fluid_msg::of10::StatsReplyPort(SdnCommon::GenerateXId(), 0, portStats);
   return portReply;
@@ -741,43 +876,41 @@ fluid_msg::of10::StatsReplyVendor* SdnSwitch::replyWithVendor()
 void SdnSwitch::OFHandle_Barrier_Request(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::BarrierRequest* barrierRequest = new fluid_msg::of10::BarrierRequest ();
-  barrierRequest->unpack(buffer);
   //Finish computing all other messages we've queued. Whatever that means for us.
-  fluid_msg::of10::BarrierReply* barrierReply = new fluid_msg::of10::BarrierReply(barrierRequest->xid ());
-  m_controllerConn->send(barrierReply);
+  fluid_msg::of10::BarrierReply barrierReply (SdnMessageStream::GetXid (buffer));
+  m_controllerConn->send(&barrierReply);
 }
 
 void SdnSwitch::OFHandle_Packet_Out(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::PacketOut* packetOut = new fluid_msg::of10::PacketOut ();
-  fluid_msg::of_error status = packetOut->unpack(buffer);
+  fluid_msg::of10::PacketOut packetOut;
+  fluid_msg::of_error status = packetOut.unpack(buffer);
   NS_ASSERT (status != fluid_msg::OF_ERROR);
 
   Ptr<Packet> packet;
   // Buffer ID == -1 => PacketOut should contain packet.
-  if (packetOut->buffer_id () == (uint32_t)(-1))
+  if (packetOut.buffer_id () == (uint32_t)(-1))
     {
-      uint32_t dataSize = (uint32_t)packetOut->data_len();
+      uint32_t dataSize = (uint32_t)packetOut.data_len();
       uint8_t* dataBuffer;
-      dataBuffer = (uint8_t*)packetOut->data();
+      dataBuffer = (uint8_t*)packetOut.data();
       packet = Create<Packet>(dataBuffer, dataSize);
     }
-  // Buffer ID matches one from packet buffers.
-  else if (m_packetBuffers.count (packetOut->buffer_id ()))
-    {
-      packet = m_packetBuffers[packetOut->buffer_id ()]->Copy ();
-//      m_packetBuffers.erase (packetOut->buffer_id ());
-    }
+  // Buffer ID matches one from packet buffers, which releases the buffer.
   else
     {
-      NS_LOG_WARN ("Received buffer id without an associated packet");
-      return;
+      packet = m_bufferPool.Take (packetOut.buffer_id ());
+      m_bufferOccupancy = m_bufferPool.GetOccupancy ();
+      if (!packet)
+        {
+          NS_LOG_WARN ("Received buffer id without an associated packet");
+          return;
+        }
     }
   uint16_t outPort = fluid_msg::of10::OFPP_NONE;
   
-  std::list<fluid_msg::Action*> action_list = packetOut->actions().action_list();
+  std::list<fluid_msg::Action*> action_list = packetOut.actions().action_list();
 
   fluid_msg::Action* action;
   for (std::list<fluid_msg::Action*>::iterator j = action_list.begin (); j != action_list.end(); ++j)
@@ -794,59 +927,58 @@ void SdnSwitch::OFHandle_Packet_Out(uint8_t* buffer)
     }
   if(outPort == fluid_msg::of10::OFPP_FLOOD)
     {
-      Flood(packet, packetOut->in_port());
+      Flood(packet, packetOut.in_port());
       return;
     }
   if (outPort == fluid_msg::of10::OFPP_TABLE)
     {
-	  HandlePacket (packet, packetOut->in_port());
+	  HandlePacket (packet, packetOut.in_port());
 	  return;
     }
-  if (m_portMap.count(outPort) != 0)
+  Ptr<SdnPort> outputPort = GetPort (outPort);
+  if (outputPort)
     {
-      Ptr<SdnPort> outputPort = m_portMap[outPort]; //Might be wrong?
       outputPort->getConn()->sendOnNetDevice(packet);
     }
 }
 
-void SdnSwitch::SendPacketInToController(Ptr<Packet> packet, Ptr<NetDevice> device, uint8_t reason)
+void SdnSwitch::SendPacketInToController(Ptr<Packet> packet, uint16_t inPort, uint8_t reason)
 {
-  NS_LOG_FUNCTION (this << packet << device << reason);
-  Ptr<SdnPort> port;
-  for(std::map<uint16_t,Ptr<SdnPort> >::iterator portIterator = m_portMap.begin(); portIterator != m_portMap.end(); ++portIterator)
+  NS_LOG_FUNCTION (this << packet << inPort << reason);
+  Ptr<SdnPort> port = GetPort (inPort);
+  if (!port)
     {
-      if(portIterator->second && portIterator->second->getDevice() == device)
-        {
-          port = portIterator->second;
-          break;
-        }
+      NS_LOG_WARN ("No port " << inPort << " to report a PacketIn for");
+      return;
     }
-  
-  // While the maximum number of buffered packets has not been exceeded, add the
-  // packet to the buffer before sending
-  fluid_msg::of10::PacketIn* packetIn;
-  if (m_packetBuffers.size () <= MAX_BUFFERS)
-    {
-      uint32_t newId = 0;
-      do
-	{
-	  newId = m_bufferIdStream->GetInteger ();
-	} while (m_packetBuffers.count (newId) == 1);
 
-      m_packetBuffers[newId] = packet->Copy ();
-      packetIn = new fluid_msg::of10::PacketIn(SdnCommon::GenerateXId(),
-    	  newId, port->getPortNumber(), packet->GetSize(), reason);
+  // Buffer the packet if a buffer is available, otherwise its buffer id is -1
+  uint32_t bufferId = m_bufferPool.Store (packet, port->getPortNumber());
+  m_bufferOccupancy = m_bufferPool.GetOccupancy ();
+  fluid_msg::of10::PacketIn packetIn (SdnCommon::GenerateXId(),
+      bufferId, port->getPortNumber(), packet->GetSize(), reason);
+
+  //An unbuffered packet goes whole, since the controller has no other way to get it
+  uint32_t dataLength = 0;
+  if (bufferId == SDN_NO_BUFFER)
+    {
+      dataLength = packet->GetSize ();
     }
-  else
+  else if (m_packetInData)
     {
-      packetIn = new fluid_msg::of10::PacketIn(SdnCommon::GenerateXId(),
-    	  -1, port->getPortNumber(), packet->GetSize(), reason);
+      dataLength = std::min (packet->GetSize (), (uint32_t)m_missSendLen);
+    }
+  if (dataLength > 0)
+    {
+      if (m_packetInScratch.size () < dataLength)
+        {
+          m_packetInScratch.resize (dataLength);
+        }
+      packet->CopyData (&m_packetInScratch[0], dataLength);
+      packetIn.data(&m_packetInScratch[0], dataLength);
     }
-  uint8_t buffer[packet->GetSize ()];
-  packet->CopyData (buffer,packet->GetSize ());
-  packetIn->data(buffer,packet->GetSize());
 
-  if (packetIn) m_controllerConn->send(packetIn);
+  m_controllerConn->send(&packetIn);
 }
 
 void SdnSwitch::SendFlowRemovedMessageToController(Flow flow, uint8_t reason)
@@ -855,14 +987,31 @@ void SdnSwitch::SendFlowRemovedMessageToController(Flow flow, uint8_t reason)
   fluid_msg::of10::FlowRemoved* flowRemoved = new fluid_msg::of10::FlowRemoved(
 	  SdnCommon::GenerateXId(), flow.cookie_, flow.priority_, reason, flow.duration_sec_,
 	  flow.duration_nsec_, flow.idle_timeout_, flow.packet_count_, flow.byte_count_);
-  m_controllerConn->send(flowRemoved);
+  m_pendingFlowRemoved.push_back(flowRemoved);
+}
+
+void SdnSwitch::HandleFlowTimer(SdnTimer timer)
+{
+  NS_LOG_FUNCTION (this);
+  m_flowTable.expireTimer(timer);
+}
+
+void SdnSwitch::FlushFlowRemoved(void)
+{
+  NS_LOG_FUNCTION (this << m_pendingFlowRemoved.size());
+  for (std::vector<fluid_msg::of10::FlowRemoved*>::iterator i = m_pendingFlowRemoved.begin(); i != m_pendingFlowRemoved.end(); ++i)
+    {
+      m_controllerConn->send(*i);
+      delete *i;
+    }
+  m_pendingFlowRemoved.clear();
 }
 
 void SdnSwitch::SendPortStatusMessageToController(fluid_msg::of10::Port port, uint8_t reason)
 {
   NS_LOG_FUNCTION (this << reason);
-  fluid_msg::of10::PortStatus* portStatus = new fluid_msg::of10::PortStatus(SdnCommon::GenerateXId(), reason, port);  
-  m_controllerConn->send(portStatus);
+  fluid_msg::of10::PortStatus portStatus (SdnCommon::GenerateXId(), reason, port);
+  m_controllerConn->send(&portStatus);
 }
 
 void SdnSwitch::Flood(Ptr<Packet> packet, uint16_t portNum)
@@ -948,8 +1097,8 @@ bool SdnSwitch::NegotiateVersion (fluid_msg::OFMsg* msg)
 uint16_t SdnSwitch::getNewPortNumber ()
 {
   NS_LOG_FUNCTION (this);
-  TOTAL_PORTS++;
-  return TOTAL_PORTS == OFCONTROLLERPORT ? ++TOTAL_PORTS : TOTAL_PORTS;
+  TOTAL_PORTS = SdnCommon::NextPortNumber (TOTAL_PORTS);
+  return TOTAL_PORTS;
 }
 
 std::string SdnSwitch::getNewSerialNumber ()
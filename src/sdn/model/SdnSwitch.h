@@ -22,6 +22,8 @@
 //Sdn Common library
 #include "SdnCommon.h"
 #include "SdnFlowTable.h"
+#include "SdnTimerWheel.h"
+#include "SdnBufferPool.h"
 #include "SdnConnection.h"
 #include "SdnPort.h"
 //NS3 objects
@@ -39,6 +41,8 @@
 #include "ns3/string.h"
 #include "ns3/integer.h"
 #include "ns3/uinteger.h"
+#include "ns3/traced-value.h"
+#include "ns3/traced-callback.h"
 //libfluid libraries
 #include <fluid/of10msg.hh>
 #include <fluid/OFServer.hh>
@@ -50,11 +54,11 @@
 
 //Special Openflow Global Constants
 #define OF_DATAPATH_ID_PADDING 0x00
-#define OFCONTROLLERPORT 6633
 
 namespace ns3 {
 
 class SdnSwitch;
+class SdnController;
 
 /**
  * \ingroup sdn
@@ -136,9 +140,73 @@ public:
    */
   static TypeId GetTypeId (void);
   /**
-   * \brief Sends a Flow Removed Message To Controller. Used by the flow table so it's public
+   * \brief Queues a Flow Removed Message To Controller. Used by the flow table so it's public.
+   * Queued messages are sent together at the end of the timer wheel tick that removed the flows.
    */
   void SendFlowRemovedMessageToController(Flow flow, uint8_t reason);
+  /**
+   * \return The timer wheel the flow tables of this switch register their timeouts with
+   */
+  SdnTimerWheel& GetTimerWheel (void) { return m_timerWheel; }
+  /**
+   * \brief Sets the tick length of the flow timeout wheel
+   * \param granularity The tick length. Flows expire at most this much later than their timeout
+   */
+  void SetTimeoutGranularity (Time granularity);
+  /**
+   * \return The tick length of the flow timeout wheel
+   */
+  Time GetTimeoutGranularity (void) const;
+  /**
+   * \brief Sizes the pool of packets buffered for PacketIn messages. Only allowed while no packet is buffered.
+   * \param capacity Number of buffers, zero to send every packet whole
+   */
+  void SetBufferCapacity (uint32_t capacity);
+  /**
+   * \return The number of buffers
+   */
+  uint32_t GetBufferCapacity (void) const;
+  /**
+   * \brief Sets the age from which a buffered packet may be reclaimed for a new one
+   * \param maxAge The age
+   */
+  void SetBufferMaxAge (Time maxAge);
+  /**
+   * \return The age from which a buffered packet may be reclaimed for a new one
+   */
+  Time GetBufferMaxAge (void) const;
+  /**
+   * \brief Selects the classifier the flow table classifies packets with
+   * \param enable True to use tuple space search, false for a linear scan
+   */
+  void SetTupleSpaceLookup (bool enable);
+  /**
+   * \return True if the flow table uses tuple space search
+   */
+  bool GetTupleSpaceLookup (void) const;
+  /**
+   * \brief Sizes the exact match cache in front of the flow table
+   * \param size Maximum number of cached packet keys. Zero disables the cache
+   */
+  void SetMicroflowCacheSize (uint32_t size);
+  /**
+   * \return The maximum number of cached packet keys
+   */
+  uint32_t GetMicroflowCacheSize (void) const;
+  /**
+   * \brief Adds a flow straight to the flow table, without a controller or any
+   * message exchanged. Allowed before the switch starts.
+   * \param message The flow mod describing the flow, with an OFPFC_ADD command
+   */
+  void PreloadFlow (fluid_msg::of10::FlowMod* message);
+  /**
+   * \brief Connects to the controller through a direct control channel instead of TCP
+   * over the point to point link to it, see SdnController::ConnectDirect. The link is
+   * still needed to tell the controller port apart, but carries no control traffic.
+   * Set before the switch starts.
+   * \param controller The controller
+   */
+  void SetDirectController (Ptr<SdnController> controller);
   SdnSwitch ();
   ~SdnSwitch ();
   static uint32_t TOTAL_SERIAL_NUMBERS; //!< Global counter for all unique switch IDs
@@ -172,13 +240,21 @@ protected:
 		  Ipv4Address localAddress,
 		  Ipv4Address remoteAddress);
   /**
-   * \brief Overarching receive callback function to handle data from a controller. Calls many other supporting functions
+   * \brief Overarching receive callback function to handle data from a controller. Reads what the
+   * socket has into the controller connection and handles the messages
    */
   virtual void HandleReadController (Ptr<Socket> socket);
+  /**
+   * \brief Takes the complete OpenFlow messages off the controller connection and dispatches
+   * each to its handler by message type
+   * \param c The controller connection
+   */
+  virtual void HandleControllerMessages (Ptr<SdnConnection> c);
   /**
    * \brief Overarching receive callback function to handle data from a switch. Calls many other supporting functions
+   * \param inPort The port of the receiving device, bound into the callback when the port is created
    */
-  virtual bool HandleReadFromNetDevice (Ptr<NetDevice>, Ptr<const Packet>, uint16_t, const Address &);
+  virtual bool HandleReadFromNetDevice (uint16_t inPort, Ptr<NetDevice>, Ptr<const Packet>, uint16_t, const Address &);
   /**
    * \brief Handle the packet
    */
@@ -198,10 +274,10 @@ protected:
   /**
    * \brief send a packet in message to the controller. Usually sent when a packet is not handled in the flow table
    * \param packet The packet to send to the controller
-   * \param device The device the original packet was received from
+   * \param inPort The port the original packet was received on
    * \param reason a fluid_msg OFPR reason for sending the packet in to the controller. The default is set to no match
    */
-  virtual void SendPacketInToController(Ptr<Packet> packet,Ptr<NetDevice> device, uint8_t reason = fluid_msg::of10::OFPR_NO_MATCH);
+  virtual void SendPacketInToController(Ptr<Packet> packet, uint16_t inPort, uint8_t reason = fluid_msg::of10::OFPR_NO_MATCH);
   /**
    * \brief send a port status message to the controller. Usually sent when requested a port status message from the controller. This very rarely gets called in ns3 unless you are adding and removing nodes from the program
    * \param port a libfluid port structure defining the port we're concerned with
@@ -211,17 +287,19 @@ protected:
   //ControllerRead Action Utilities
   /**
    * \brief A message handler for dealing with hello requests
-   * \param message The original message parsed
+   * \param buffer a byte buffer of the original message
    */
-  virtual void OFHandle_Hello_Request (fluid_msg::OFMsg* message);
+  virtual void OFHandle_Hello_Request (uint8_t* buffer);
   /**
    * \brief A message handler for dealing with feature requests
+   * \param buffer a byte buffer of the original message
    */
-  virtual void OFHandle_Feature_Request (fluid_msg::OFMsg* message);
+  virtual void OFHandle_Feature_Request (uint8_t* buffer);
   /**
    * \brief A message handler for dealing with config requests
+   * \param buffer a byte buffer of the original message
    */
-  virtual void OFHandle_Get_Config_Request ();
+  virtual void OFHandle_Get_Config_Request (uint8_t* buffer);
   /**
    * \brief A message handler for dealing with set config messages
    * \param buffer a byte buffer of the original message. Converted to a fluid_msg SetConfig class
@@ -237,6 +315,12 @@ protected:
    * \param buffer a byte buffer of the original message. Converted to a fluid_msg FlowMod class
    */
   virtual void OFHandle_Flow_Mod (uint8_t* buffer);
+  /**
+   * \brief A message handler for a run of consecutive flow mod messages. Applies them in order as one
+   * table update, releasing the buffered packet of a flow mod right after applying it
+   * \param buffers byte buffers of the original messages. Each is converted to a fluid_msg FlowMod class
+   */
+  virtual void OFHandle_Flow_Mods (const std::vector<uint8_t*> &buffers);
   /**
    * \brief A message handler for dealing with port mod messages
    * \param buffer a byte buffer of the original message. Converted to a fluid_msg PortMod class
@@ -284,17 +368,20 @@ protected:
    */
   fluid_msg::of10::StatsReplyDesc* replyWithDescription();
   /**
-   * \brief Create a stats reply of a flow on the switch
+   * \brief Send the stats of the flows a request selects. Large tables are streamed over several
+   * replies flagged OFPSF_REPLY_MORE, see SdnMultipartWriter
    * \param buffer a byte buffer of the original message. Converted to a fluid_msg StatsRequestFlow
-   * \return A StatsReplyFlow describing a flow on the switch
+   * \param xid The xid of the request, echoed by every reply
    */
-  fluid_msg::of10::StatsReplyFlow* replyWithFlow(uint8_t* buffer);
+  void replyWithFlow(uint8_t* buffer, uint32_t xid);
   /**
-   * \brief Create a stats reply of an aggregate of all the flows on the switch
+   * \brief Create a stats reply of an aggregate of all the flows on the switch. A request for every
+   * flow is answered from the running totals of the table instead of scanning it
    * \param buffer a byte buffer of the original message. Converted to a fluid_msg StatsRequestAggregate
+   * \param xid The xid of the request, echoed by the reply
    * \return A StatsReplyAggregate describing all flows on the switch
    */
-  fluid_msg::of10::StatsReplyAggregate* replyWithAggregate(uint8_t* buffer);
+  fluid_msg::of10::StatsReplyAggregate* replyWithAggregate(uint8_t* buffer, uint32_t xid);
   /**
    * \brief Create a stats reply of a table on the switch. Note that in NS-SDN we only allow one table on the switch
    * \param buffer a byte buffer of the original message. Converted to a fluid_msg StatsRequestTable
@@ -364,24 +451,59 @@ protected:
   uint32_t m_datapathID; //!< Unique Datapath ID number
   uint32_t m_vendor; //!< Vendor value set by vendor. For ns-SDN we set all of 0xFFFF (invalid)
   uint16_t m_missSendLen; //!< A value defining how many byte of a packet to send to the controller in packet in messages
+  bool m_packetInData; //!< Whether PacketIn messages for buffered packets carry packet bytes at all
+  std::vector<uint8_t> m_packetInScratch; //!< Packet bytes copied into the PacketIn being built, reused across PacketIns
   fluid_msg::SwitchDesc m_switchDescription; //!< A SwitchDesc statically describing this switch
   EventId m_sendEvent; //!< A temporary EventId held when a new sendEvent is generated from this switch
   EventId m_recvEvent; //!< A temportary EventId held when a new revEvent is generated for this switch
   Ptr<SdnConnection> m_controllerConn;
+  Ptr<SdnController> m_directController; //!< Controller to connect to over a direct channel, 0 for TCP
   Features m_switchFeatures; //!<Features on the switch that we need to return when asked from the controller
   PortMap m_portMap; //!<Making a mapping of all devices to the virtual ports for the flow table to use
+  std::vector<Ptr<SdnPort> > m_portIndex; //!< The ports of m_portMap indexed by port number, 0 where there is none
+
+  /**
+   * \brief Constant time port lookup for the packet path
+   * \param portNumber The port number
+   * \return The port, or 0 if the switch has no such port
+   */
+  Ptr<SdnPort> GetPort (uint32_t portNumber) const
+  {
+    return portNumber < m_portIndex.size () ? m_portIndex[portNumber] : 0;
+  }
 
   static uint32_t xid; //!< A Unique XID for the switch. XIDs are global unique identifiers for messages/siwtches/controllers within sdn
   uint16_t TOTAL_PORTS; //!< A counter counting the total number of ports ever used by this switch
 
-  Ptr<UniformRandomVariable> m_bufferIdStream;
-  std::map< uint32_t, Ptr<Packet> > m_packetBuffers;
+  SdnBufferPool m_bufferPool; //!< Packets sent to the controller in PacketIn messages, by buffer_id
+  TracedValue<uint32_t> m_bufferOccupancy; //!< Packets held by the buffer pool
+  TracedCallback<Ptr<const Packet> > m_bufferEvictionTrace; //!< Fired for each buffered packet reclaimed before use
+
+  /**
+   * \brief Reports a buffered packet reclaimed for a new one before the controller used it
+   * \param packet The reclaimed packet
+   */
+  void HandleBufferEviction (Ptr<const Packet> packet);
 
-  Ptr<Packet> m_pendingPacket;
-  uint32_t m_pendingBytes;
-  Address m_pendingFrom;
+  typedef void (SdnSwitch::*MessageHandler) (uint8_t* buffer); //!< Handler of one OpenFlow message type
+  std::vector<MessageHandler> m_messageHandlers; //!< Handlers indexed by OpenFlow message type, 0 for ignored types
 
   bool m_kernel; //!< Use the Linux kernel stack (DCE-only)
+  bool m_tupleSpaceLookup; //!< Classify packets with tuple space search instead of a linear scan
+  SdnTimerWheel m_timerWheel; //!< Idle and hard timeouts of every flow on this switch
+  std::vector<fluid_msg::of10::FlowRemoved*> m_pendingFlowRemoved; //!< Flow removed messages waiting for the end of the tick
+
+  /**
+   * \brief Hands an expired flow timer to the flow table holding the flow
+   * \param timer The expired timer
+   */
+  void HandleFlowTimer (SdnTimer timer);
+  /**
+   * \brief Sends the flow removed messages queued during a timer wheel tick
+   */
+  void FlushFlowRemoved (void);
+  TracedValue<uint32_t> m_microflowHits;   //!< Packets resolved by the microflow cache
+  TracedValue<uint32_t> m_microflowMisses; //!< Packets that missed the microflow cache
 
   virtual void ConnectionSucceeded (Ptr<Socket> socket);
   virtual void ConnectionFailed (Ptr<Socket> socket);
@@ -20,7 +20,9 @@
 #include "SdnSwitch13.h"
 #include "SdnController.h"
 #include "SdnConnection.h"
+#include "SdnMultipartWriter.h"
 #include "ns3/log.h"
+#include "ns3/abort.h"
 #include "ns3/socket.h"
 #include "ns3/socket-factory.h"
 #include "ns3/packet.h"
@@ -30,6 +32,7 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/layer2-p2p-module.h"
 #include "ns3/ipv4.h"
+#include <algorithm>
 
 #include "fluid/util/ethaddr.hh"
 
@@ -40,8 +43,7 @@ namespace ns3 {
 #define MB 8000000
 #define mb 1000000
 
-#define MAX_BUFFERS 1000000000
-
+#define DEFAULT_MISS_SEND_LEN 128 //OFP_DEFAULT_MISS_SEND_LEN of the specification
 #ifndef INT16_MAX
 #define INT16_MAX 32767
 #endif
@@ -58,6 +60,43 @@ TypeId SdnSwitch13::GetTypeId (void)
   static TypeId tid = TypeId ("ns3::SdnSwitch13")
     .SetParent<Application> ()
     .AddConstructor<SdnSwitch13> ()
+    .AddAttribute ("TupleSpaceLookup",
+                   "Classify packets with tuple space search instead of a linear scan of the flow tables.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&SdnSwitch13::SetTupleSpaceLookup,
+                                        &SdnSwitch13::GetTupleSpaceLookup),
+                   MakeBooleanChecker ())
+    .AddAttribute ("TimeoutGranularity",
+                   "Tick length of the timing wheel that expires idle and hard flow timeouts.",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&SdnSwitch13::SetTimeoutGranularity,
+                                     &SdnSwitch13::GetTimeoutGranularity),
+                   MakeTimeChecker ())
+    .AddAttribute ("BufferCapacity",
+                   "Number of packets the switch can hold for the controller to refer to by buffer_id. Zero sends every packet whole.",
+                   UintegerValue (256),
+                   MakeUintegerAccessor (&SdnSwitch13::SetBufferCapacity,
+                                         &SdnSwitch13::GetBufferCapacity),
+                   MakeUintegerChecker<uint32_t> (0, SDN_MAX_BUFFER_SLOTS))
+    .AddAttribute ("BufferMaxAge",
+                   "Time after which a buffered packet the controller has not used may be reclaimed for a new one.",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&SdnSwitch13::SetBufferMaxAge,
+                                     &SdnSwitch13::GetBufferMaxAge),
+                   MakeTimeChecker ())
+    .AddAttribute ("PacketInData",
+                   "Whether PacketIn messages carry the first miss_send_len bytes of the packet. When false a buffered packet is reported by its buffer_id and match only.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&SdnSwitch13::m_packetInData),
+                   MakeBooleanChecker ())
+    .AddTraceSource ("BufferOccupancy",
+                     "Number of packets held for the controller",
+                     MakeTraceSourceAccessor (&SdnSwitch13::m_bufferOccupancy),
+                     "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource ("BufferEviction",
+                     "A buffered packet was reclaimed before the controller used it",
+                     MakeTraceSourceAccessor (&SdnSwitch13::m_bufferEvictionTrace),
+                     "ns3::Packet::TracedCallback")
   ;
   return tid;
 }
@@ -68,18 +107,40 @@ SdnSwitch13::SdnSwitch13 ()
   PacketMetadata::Enable();
   m_datapathID =  getNewDatapathID ();
   m_vendor = 0xFFFF;
-  m_missSendLen = INT16_MAX;
+  m_missSendLen = DEFAULT_MISS_SEND_LEN;
+  m_packetInData = true;
   m_recvEvent = EventId ();
   TOTAL_PORTS = 0;
   m_controllerConn = CreateObject<SdnConnection> ();
 
-  m_bufferIdStream = CreateObject<UniformRandomVariable> ();
-  m_bufferIdStream->SetAttribute("Min", DoubleValue(0.0));
-  m_bufferIdStream->SetAttribute("Max", DoubleValue(MAX_BUFFERS));
-  m_switchFeatures.n_buffers = MAX_BUFFERS;
-
-  m_flowTable13 = SdnFlowTable13::addTablesForNewSwitch(this);
+  m_messageHandlers.assign (fluid_msg::of13::OFPT_METER_MOD + 1, 0);
+  m_messageHandlers[fluid_msg::of13::OFPT_HELLO] = &SdnSwitch13::OFHandle_Hello_Request;
+  m_messageHandlers[fluid_msg::of13::OFPT_FEATURES_REQUEST] = &SdnSwitch13::OFHandle_Feature_Request;
+  m_messageHandlers[fluid_msg::of13::OFPT_GET_CONFIG_REQUEST] = &SdnSwitch13::OFHandle_Get_Config_Request;
+  m_messageHandlers[fluid_msg::of13::OFPT_SET_CONFIG] = &SdnSwitch13::OFHandle_Set_Config;
+  m_messageHandlers[fluid_msg::of13::OFPT_FLOW_MOD] = &SdnSwitch13::OFHandle_Flow_Mod;
+  m_messageHandlers[fluid_msg::of13::OFPT_GROUP_MOD] = &SdnSwitch13::OFHandle_Group_Mod;
+  m_messageHandlers[fluid_msg::of13::OFPT_PACKET_OUT] = &SdnSwitch13::OFHandle_Packet_Out;
+  m_messageHandlers[fluid_msg::of13::OFPT_PORT_MOD] = &SdnSwitch13::OFHandle_Port_Mod;
+  m_messageHandlers[fluid_msg::of13::OFPT_BARRIER_REQUEST] = &SdnSwitch13::OFHandle_Barrier_Request;
+  m_messageHandlers[fluid_msg::of13::OFPT_MULTIPART_REQUEST] = &SdnSwitch13::OFHandle_Multipart_Request;
+
+  m_switchFeatures.n_buffers = 0;
+  m_bufferPool.SetEvictCallback (MakeCallback (&SdnSwitch13::HandleBufferEviction, this));
+
+  m_switchFeatures.n_tables = SDN_OF13_TABLES;
+  m_tables.reserve (SDN_OF13_TABLES);
+  for (uint32_t i = 0; i < SDN_OF13_TABLES; ++i)
+    {
+      Ptr<SdnFlowTable13> table = Create<SdnFlowTable13> (this);
+      table->setTableID (i);
+      m_tables.push_back (table);
+    }
+  m_flowTable13 = m_tables[0];
   m_kernel = false;
+  m_tupleSpaceLookup = false;
+  m_timerWheel.SetExpireCallback (MakeCallback (&SdnSwitch13::HandleFlowTimer, this));
+  m_timerWheel.SetTickCallback (MakeCallback (&SdnSwitch13::FlushFlowRemoved, this));
 }
 
 SdnSwitch13::~SdnSwitch13 ()
@@ -87,9 +148,78 @@ SdnSwitch13::~SdnSwitch13 ()
   NS_LOG_FUNCTION (this);
 }
 
+void SdnSwitch13::SetTupleSpaceLookup (bool enable)
+{
+  NS_LOG_FUNCTION (this << enable);
+  m_tupleSpaceLookup = enable;
+  for (std::vector<Ptr<SdnFlowTable13> >::iterator i = m_tables.begin (); i != m_tables.end (); ++i)
+    {
+      (*i)->setTupleSpaceLookup (enable);
+    }
+}
+
+bool SdnSwitch13::GetTupleSpaceLookup (void) const
+{
+  return m_tupleSpaceLookup;
+}
+
+void SdnSwitch13::SetTimeoutGranularity (Time granularity)
+{
+  NS_LOG_FUNCTION (this << granularity);
+  m_timerWheel.SetGranularity (granularity);
+}
+
+Time SdnSwitch13::GetTimeoutGranularity (void) const
+{
+  return m_timerWheel.GetGranularity ();
+}
+
+void SdnSwitch13::SetBufferCapacity (uint32_t capacity)
+{
+  NS_LOG_FUNCTION (this << capacity);
+  m_bufferPool.SetCapacity (capacity);
+  m_switchFeatures.n_buffers = capacity;
+}
+
+uint32_t SdnSwitch13::GetBufferCapacity (void) const
+{
+  return m_bufferPool.GetCapacity ();
+}
+
+void SdnSwitch13::SetBufferMaxAge (Time maxAge)
+{
+  NS_LOG_FUNCTION (this << maxAge);
+  m_bufferPool.SetMaxAge (maxAge);
+}
+
+Time SdnSwitch13::GetBufferMaxAge (void) const
+{
+  return m_bufferPool.GetMaxAge ();
+}
+
+void SdnSwitch13::HandleBufferEviction (Ptr<const Packet> packet)
+{
+  NS_LOG_FUNCTION (this << packet);
+  m_bufferEvictionTrace (packet);
+}
+
 void SdnSwitch13::DoDispose (void)
 {
   NS_LOG_FUNCTION (this);
+  m_directController = 0;
+  m_timerWheel.Clear ();
+  m_bufferPool.Clear ();
+  m_portIndex.clear ();
+  m_portMap.clear ();
+  //The tables point back at the switch
+  m_flowTable13 = 0;
+  m_tables.clear ();
+  m_groupTable.clear ();
+  for (std::vector<fluid_msg::of13::FlowRemoved*>::iterator i = m_pendingFlowRemoved.begin(); i != m_pendingFlowRemoved.end(); ++i)
+    {
+      delete *i;
+    }
+  m_pendingFlowRemoved.clear();
 
   Application::DoDispose ();
 }
@@ -101,6 +231,14 @@ void SdnSwitch13::EstablishControllerConnection (Ptr<NetDevice> device,
   NS_LOG_FUNCTION (this << device << localAddress << remoteAddress);
   NS_LOG_INFO (Simulator::Now().GetSeconds());
 
+  if (m_directController)
+    {
+      m_controllerConn = CreateObject<SdnConnection> (device, Ptr<Socket> (0));
+      m_controllerConn->set_receive_callback (MakeCallback (&SdnSwitch13::HandleControllerMessages, this));
+      m_directController->ConnectDirect (m_controllerConn);
+      return;
+    }
+
   // Create a socket for this switch.
   TypeId tid = TypeId::LookupByName ("ns3::TcpSocketFactory");
   if (m_kernel)
@@ -158,7 +296,8 @@ void SdnSwitch13::EstablishConnection (Ptr<NetDevice> device,
   if(l2Device)
     {
       l2Device->SetSdnEnable(true);
-      l2Device->SetSdnReceiveCallback(MakeCallback(&SdnSwitch13::HandleReadFromNetDevice, this));
+      //The port number travels with every received packet, so ingress needs no lookup
+      l2Device->SetSdnReceiveCallback(MakeCallback(&SdnSwitch13::HandleReadFromNetDevice, this).Bind ((uint32_t)switchPort));
       Ptr<SdnConnection> c = CreateObject<SdnConnection> (device, socket);
       Ptr<Layer2P2PChannel> channel = DynamicCast<Layer2P2PChannel>(device->GetChannel());
       uint32_t portFeaturesMask = 0;
@@ -186,6 +325,11 @@ void SdnSwitch13::EstablishConnection (Ptr<NetDevice> device,
 	}
       Ptr<SdnPort> p = CreateObject<SdnPort> (device, c, switchPort, 0, 0, portFeaturesMask);
       m_portMap.insert (std::make_pair (p->getPortNumber(),p));
+      if (m_portIndex.size () <= p->getPortNumber ())
+        {
+          m_portIndex.resize (p->getPortNumber () + 1);
+        }
+      m_portIndex[p->getPortNumber ()] = p;
     }
 }
 
@@ -282,7 +426,8 @@ SdnSwitch13::ConnectionFailed (Ptr<Socket> socket)
 void SdnSwitch13::HandleReadController (Ptr<Socket> socket)
 {
   NS_LOG_FUNCTION (this << socket);
-  NS_LOG_INFO (Simulator::Now().GetSeconds());
+  NS_ASSERT (m_controllerConn->get_socket () == socket);
+
   Ptr<Packet> packet;
   Address from;
   while ((packet = socket->RecvFrom (from)))
@@ -293,71 +438,51 @@ void SdnSwitch13::HandleReadController (Ptr<Socket> socket)
                        InetSocketAddress::ConvertFrom (from).GetIpv4 () << " port " <<
                        InetSocketAddress::ConvertFrom (from).GetPort ());
         }
+      m_controllerConn->receive (packet);
+    }
+  HandleControllerMessages (m_controllerConn);
+}
 
-      NS_ASSERT (m_controllerConn->get_socket () == socket);
-
-      packet->RemoveAllPacketTags ();
-      packet->RemoveAllByteTags ();
-
-      NS_LOG_DEBUG ("Switch recv " << packet->GetSize () << " bytes");
-
-      uint8_t buffer[packet->GetSize ()];
-      packet->CopyData (buffer,packet->GetSize ());
-      fluid_msg::OFMsg* message = new fluid_msg::OFMsg (buffer);
+void SdnSwitch13::HandleControllerMessages (Ptr<SdnConnection> c)
+{
+  NS_LOG_FUNCTION (this << c);
 
-      //These handlers should return number of bytes sent
-      if (message->type () == fluid_msg::of13::OFPT_HELLO)
-        {
-          OFHandle_Hello_Request(message);
-        }
-      if (message->type () == fluid_msg::of13::OFPT_FEATURES_REQUEST)
-        {
-          OFHandle_Feature_Request(message);
-        }
-      if (message->type () == fluid_msg::of13::OFPT_GET_CONFIG_REQUEST)
-        {
-          OFHandle_Get_Config_Request();
-        }
-      if (message->type () == fluid_msg::of13::OFPT_SET_CONFIG)
-        {
-          OFHandle_Set_Config(buffer);
-        }
-      if (message->type () == fluid_msg::of13::OFPT_FLOW_MOD)
-        {
-          OFHandle_Flow_Mod(buffer);
-        }
-      if (message->type () == fluid_msg::of13::OFPT_GROUP_MOD)
+  //Messages can span or share segments, the connection hands back whole ones
+  std::vector<uint8_t*> flowMods;
+  uint8_t* message;
+  while ((message = c->next_message ()))
+    {
+      uint8_t type = SdnMessageStream::GetType (message);
+      if (type == fluid_msg::of13::OFPT_FLOW_MOD)
         {
-    	  OFHandle_Group_Mod(buffer);
+          //Consecutive flow mods reach the table as one batch
+          flowMods.push_back (message);
+          continue;
         }
-//      if (message->type () == fluid_msg::of10::OFPT_PORT_STATUS)
-//        {
-//          OFHandle_Port_Status(buffer);
-//        }
-      if (message->type () == fluid_msg::of13::OFPT_PACKET_OUT)
+      if (!flowMods.empty ())
         {
-          OFHandle_Packet_Out(buffer);
+          OFHandle_Flow_Mods (flowMods);
+          flowMods.clear ();
         }
-      if (message->type () == fluid_msg::of13::OFPT_PORT_MOD)
+      if (type < m_messageHandlers.size () && m_messageHandlers[type])
         {
-          OFHandle_Port_Mod(buffer);
+          (this->*m_messageHandlers[type]) (message);
         }
-      if (message->type () == fluid_msg::of13::OFPT_BARRIER_REQUEST)
+      else
         {
-          OFHandle_Barrier_Request(buffer);
+          NS_LOG_WARN ("Ignoring OpenFlow message of type " << (uint32_t)type);
         }
-      if (message->type() == fluid_msg::of13::OFPT_MULTIPART_REQUEST)
-       {
-    	  OFHandle_Multipart_Request(buffer);
-       }
-      delete (message);
+    }
+  if (!flowMods.empty ())
+    {
+      OFHandle_Flow_Mods (flowMods);
     }
 }
 
 //Handles a packet from a non-controller
-bool SdnSwitch13::HandleReadFromNetDevice (Ptr<NetDevice> device, Ptr<const Packet> originalPacket, uint16_t protocol, const Address &source )
+bool SdnSwitch13::HandleReadFromNetDevice (uint32_t inPort, Ptr<NetDevice> device, Ptr<const Packet> originalPacket, uint16_t protocol, const Address &source )
 {
-  NS_LOG_FUNCTION (this << device << originalPacket << protocol << source);
+  NS_LOG_FUNCTION (this << inPort << device << originalPacket << protocol << source);
 
   if(m_controllerConn->get_state() != fluid_base::OFConnection::STATE_RUNNING)
     {
@@ -366,28 +491,34 @@ bool SdnSwitch13::HandleReadFromNetDevice (Ptr<NetDevice> device, Ptr<const Pack
     }
   Ptr<Packet> packet = originalPacket->Copy();
 
-  uint32_t inPort = 0;
-  for(std::map<uint32_t,Ptr<SdnPort> >::iterator portIterator = m_portMap.begin(); portIterator != m_portMap.end(); ++portIterator)
-    {
-      if(portIterator->second && portIterator->second->getDevice() == device)
-        {
-          inPort = portIterator->first;
-          break;
-        }
-    }
-
   return HandlePacket (packet, inPort);
 }
 
 bool SdnSwitch13::HandlePacket (Ptr<Packet>packet, uint32_t inPort)
 {
   NS_LOG_FUNCTION (this << packet << inPort);
-  fluid_msg::ActionSet *action_set = new fluid_msg::ActionSet ();
+  SdnPipelineState state;
   std::vector<uint32_t> outPorts;
-  fluid_msg::ActionSet *resulting_action_set = m_flowTable13->handlePacket (packet, action_set, inPort);
+  SdnPacketParser::Parse (packet, inPort, m_packetKey);
+  uint32_t table = 0;
+  while (true)
+    {
+      m_tables[table]->handlePacket (packet, m_packetKey, state, inPort);
+      if (state.nextTable < 0)
+        {
+          break;
+        }
+      //Goto may only go forward, which also keeps a packet from looping in the pipeline
+      if ((uint32_t)state.nextTable <= table || (uint32_t)state.nextTable >= m_tables.size ())
+        {
+          NS_LOG_WARN ("Table " << table << " sends packets to invalid table " << state.nextTable);
+          break;
+        }
+      table = state.nextTable;
+    }
 
   // Process action set instead of sending out port vector (need to send reason along with messages to controller
-  outPorts = m_flowTable13->handleActions (packet, resulting_action_set);
+  outPorts = m_flowTable13->handleActions (packet, m_packetKey, &state.actionSet);
 
   if (!outPorts.empty())
   {
@@ -405,8 +536,11 @@ void SdnSwitch13::HandlePorts (Ptr<Packet> packet, std::vector<uint32_t> outPort
 		    {
 			  if (*outPort == fluid_msg::of13::OFPP_IN_PORT)
 			    {
-				  Ptr<SdnPort> outputPort = m_portMap[inPort];
-				  outputPort->getConn()->sendOnNetDevice(packet);
+				  Ptr<SdnPort> outputPort = GetPort (inPort);
+				  if (outputPort)
+				    {
+				      outputPort->getConn()->sendOnNetDevice(packet);
+				    }
 			    }
 			  else if (*outPort == fluid_msg::of13::OFPP_TABLE)
 				{
@@ -428,7 +562,7 @@ void SdnSwitch13::HandlePorts (Ptr<Packet> packet, std::vector<uint32_t> outPort
 			    {
 				  // Send to controller with a reason
 				  uint8_t reason = (outPort + 1 == outPorts.end() ? fluid_msg::of13::OFPR_NO_MATCH : fluid_msg::of13::OFPR_ACTION);
-			      SendPacketInToController(packet, m_portMap[inPort]->getDevice (), reason);
+			      SendPacketInToController(packet, inPort, reason);
 			    }
 			  else if (*outPort == fluid_msg::of13::OFPP_LOCAL)
 			    {
@@ -440,140 +574,142 @@ void SdnSwitch13::HandlePorts (Ptr<Packet> packet, std::vector<uint32_t> outPort
 				}
 			  continue;
 		    }
-		  if (m_portMap.count(*outPort) != 0)
+		  Ptr<SdnPort> outputPort = GetPort (*outPort);
+		  if (outputPort)
 			{
-			  Ptr<SdnPort> outputPort = m_portMap[*outPort]; //Might be wrong?
 			  outputPort->getConn()->sendOnNetDevice(packet);
 			}
 	    }
 }
 
-void SdnSwitch13::OFHandle_Hello_Request (fluid_msg::OFMsg* message)
+void SdnSwitch13::OFHandle_Hello_Request (uint8_t* buffer)
 {
-  NS_LOG_FUNCTION (this << message);
-  fluid_msg::of13::Hello* helloMessage = new fluid_msg::of13::Hello(message->xid());
-  if (NegotiateVersion (message))
+  NS_LOG_FUNCTION (this << buffer);
+  fluid_msg::OFMsg message (buffer);
+  if (NegotiateVersion (&message))
     {
-      m_controllerConn->send (helloMessage);
+      fluid_msg::of13::Hello helloMessage (message.xid());
+      m_controllerConn->send (&helloMessage);
       m_controllerConn->set_state(fluid_base::OFConnection::STATE_RUNNING);
       return;
     }
   else
     {
       m_controllerConn->set_state(fluid_base::OFConnection::STATE_FAILED);
-      fluid_msg::of13::Error* errorMessage =
-        new fluid_msg::of13::Error (
+      fluid_msg::of13::Error errorMessage (
           SdnCommon::GenerateXId(),
           fluid_msg::of13::OFPET_HELLO_FAILED,
           fluid_msg::of13::OFPHFC_INCOMPATIBLE);
-      m_controllerConn->send(errorMessage);
+      m_controllerConn->send(&errorMessage);
       return;
     }
 }
 
-void SdnSwitch13::OFHandle_Feature_Request (fluid_msg::OFMsg* message)
+void SdnSwitch13::OFHandle_Feature_Request (uint8_t* buffer)
 {
-  NS_LOG_FUNCTION (this << message);
+  NS_LOG_FUNCTION (this << buffer);
 
-  fluid_msg::of13::FeaturesReply* featuresReply =
-    new fluid_msg::of13::FeaturesReply (message->xid (),
+  fluid_msg::of13::FeaturesReply featuresReply (SdnMessageStream::GetXid (buffer),
 					((uint64_t)((uint64_t)OF_DATAPATH_ID_PADDING << 48) | GetMacAddress ()),
                                         m_switchFeatures.n_buffers,
                                         m_switchFeatures.n_tables,
 										0,
                                         GetCapabilities ());
-  m_controllerConn->send (featuresReply);
+  m_controllerConn->send (&featuresReply);
   return;
 }
 
-void SdnSwitch13::OFHandle_Get_Config_Request()
+void SdnSwitch13::OFHandle_Get_Config_Request(uint8_t* buffer)
 {
-  NS_LOG_FUNCTION (this);
-  fluid_msg::of10::GetConfigReply* getConfigReply =
-    new fluid_msg::of10::GetConfigReply (SdnCommon::GenerateXId(),
+  NS_LOG_FUNCTION (this << buffer);
+  fluid_msg::of10::GetConfigReply getConfigReply (SdnMessageStream::GetXid (buffer),
                                          0, //Flags of 0 for fragmentation
                                          m_missSendLen);
-   m_controllerConn->send (getConfigReply);
+  m_controllerConn->send (&getConfigReply);
 }
 
 void SdnSwitch13::OFHandle_Set_Config(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of10::SetConfig* setConfig = new fluid_msg::of10::SetConfig();
-  setConfig->unpack(buffer);
-  if (setConfig)
-    {
-      m_missSendLen = setConfig->miss_send_len();
-    }
+  fluid_msg::of10::SetConfig setConfig;
+  setConfig.unpack(buffer);
+  m_missSendLen = setConfig.miss_send_len();
 }
 
 void SdnSwitch13::OFHandle_Flow_Mod(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of13::FlowMod* flowMod = new fluid_msg::of13::FlowMod();
-  flowMod->unpack(buffer);
-  if (flowMod)
+  std::vector<uint8_t*> buffers (1, buffer);
+  OFHandle_Flow_Mods (buffers);
+}
+
+void SdnSwitch13::OFHandle_Flow_Mods(const std::vector<uint8_t*> &buffers)
+{
+  NS_LOG_FUNCTION (this << buffers.size ());
+  for (std::vector<uint8_t*>::const_iterator buffer = buffers.begin (); buffer != buffers.end (); ++buffer)
     {
-      switch (flowMod->command())
+      fluid_msg::of13::FlowMod flowMod;
+      flowMod.unpack(*buffer);
+      switch (flowMod.command())
         {
           case fluid_msg::of13::OFPFC_ADD:
-            addFlow(flowMod);
+            addFlow(&flowMod);
             break;
           case fluid_msg::of13::OFPFC_MODIFY:
-            modifyFlow(flowMod);
+            modifyFlow(&flowMod);
             break;
           case fluid_msg::of13::OFPFC_MODIFY_STRICT:
-            modifyFlowStrict(flowMod);
+            modifyFlowStrict(&flowMod);
             break;
           case fluid_msg::of13::OFPFC_DELETE:
-            deleteFlow(flowMod);
+            deleteFlow(&flowMod);
             break;
           case fluid_msg::of13::OFPFC_DELETE_STRICT:
-            deleteFlowStrict(flowMod);
+            deleteFlowStrict(&flowMod);
             break;
         }
 
-		if (flowMod->command () != fluid_msg::of13::OFPFC_DELETE &&
-				flowMod->command () != fluid_msg::of13::OFPFC_DELETE_STRICT)
-		{
-			if ((flowMod->buffer_id () != (uint32_t)(-1)) &&
-			(m_packetBuffers.count (flowMod->buffer_id ())))
-			{
-			  Ptr<Packet> copyPacket = m_packetBuffers[flowMod->buffer_id ()]->Copy ();
-			  HandlePacket (copyPacket, flowMod->match ().in_port ()->value ());
-			}
-		}
+      if (flowMod.command () != fluid_msg::of13::OFPFC_DELETE &&
+          flowMod.command () != fluid_msg::of13::OFPFC_DELETE_STRICT &&
+          flowMod.buffer_id () != (uint32_t)(-1))
+        {
+          //The buffered packet goes through the table as this flow mod left it, before the next one
+          uint32_t inPort;
+          Ptr<Packet> packet = m_bufferPool.Take (flowMod.buffer_id (), &inPort);
+          if (packet)
+            {
+              HandlePacket (packet, inPort);
+            }
+        }
     }
+  m_bufferOccupancy = m_bufferPool.GetOccupancy ();
 }
 
 void SdnSwitch13::OFHandle_Group_Mod(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of13::GroupMod* groupMod = new fluid_msg::of13::GroupMod();
-  groupMod->unpack(buffer);
-  if (groupMod)
+  fluid_msg::of13::GroupMod groupMod;
+  groupMod.unpack(buffer);
+  switch (groupMod.command())
     {
-      switch (groupMod->command())
-        {
-          case fluid_msg::of13::OFPGC_ADD:
-            addGroup(groupMod);
-            break;
-          case fluid_msg::of13::OFPGC_MODIFY:
-            modifyGroup(groupMod);
-            break;
-          case fluid_msg::of13::OFPGC_DELETE:
-            deleteGroup(groupMod);
-            break;
-        }
+      case fluid_msg::of13::OFPGC_ADD:
+        addGroup(&groupMod);
+        break;
+      case fluid_msg::of13::OFPGC_MODIFY:
+        modifyGroup(&groupMod);
+        break;
+      case fluid_msg::of13::OFPGC_DELETE:
+        deleteGroup(&groupMod);
+        break;
     }
 }
 
 void SdnSwitch13::OFHandle_Multipart_Request(uint8_t* buffer)
 {
 	  NS_LOG_FUNCTION (this << buffer);
-	  fluid_msg::of13::MultipartRequest* multipartRequest = new fluid_msg::of13::MultipartRequest ();
-	  multipartRequest->unpack(buffer);
-	  if (multipartRequest->mpart_type()==fluid_msg::of13::OFPMP_PORT_DESC)
+	  fluid_msg::of13::MultipartRequest multipartRequest;
+	  multipartRequest.unpack(buffer);
+	  if (multipartRequest.mpart_type()==fluid_msg::of13::OFPMP_PORT_DESC)
 	  {
 		  std::vector<fluid_msg::of13::Port> fluidPorts;
 		  for(std::map<uint32_t, Ptr<SdnPort> >::iterator i = m_portMap.begin(); i != m_portMap.end(); ++i)
@@ -581,152 +717,324 @@ void SdnSwitch13::OFHandle_Multipart_Request(uint8_t* buffer)
 			  fluid_msg::of10::Port curPort (i->second->getFluidPort());
 			  uint32_t curr_speed =0;
 			  uint32_t max_speed=0;
-			  std::cout<< curPort.port_no()<<std::endl;
 			  fluid_msg::of13::Port makePort (
 					  (uint32_t)curPort.port_no(),curPort.hw_addr(), curPort.name(), curPort.config(), curPort.state(),
 					  curPort.curr(), curPort.advertised(), curPort.supported(), curPort.peer(), curr_speed, max_speed );
-			  std::cout<<makePort.port_no()<<std::endl;
 		      fluidPorts.push_back(makePort);
 		  }
-	      fluid_msg::of13::MultipartReplyPortDescription* multipartReplyPortDesc =
-			  new fluid_msg::of13::MultipartReplyPortDescription(multipartRequest ->xid(),multipartRequest->flags(),fluidPorts);
-	      m_controllerConn->send (multipartReplyPortDesc);
+	      fluid_msg::of13::MultipartReplyPortDescription multipartReplyPortDesc (
+			  multipartRequest.xid(),multipartRequest.flags(),fluidPorts);
+	      m_controllerConn->send (&multipartReplyPortDesc);
+	  }
+	  else if (multipartRequest.mpart_type()==fluid_msg::of13::OFPMP_FLOW)
+	  {
+	      replyWithFlow (buffer, multipartRequest.xid());
+	  }
+	  else if (multipartRequest.mpart_type()==fluid_msg::of13::OFPMP_AGGREGATE)
+	  {
+	      replyWithAggregate (buffer, multipartRequest.xid());
+	  }
+	  else if (multipartRequest.mpart_type()==fluid_msg::of13::OFPMP_TABLE)
+	  {
+	      replyWithTable (multipartRequest.xid());
 	  }
 }
 
+void SdnSwitch13::replyWithFlow(uint8_t* buffer, uint32_t xid)
+{
+  NS_LOG_FUNCTION (this << buffer);
+  fluid_msg::of13::MultipartRequestFlow flowRequest;
+  flowRequest.unpack(buffer);
+  SdnMultipartWriter<fluid_msg::of13::MultipartReplyFlow, fluid_msg::of13::FlowStats> writer (m_controllerConn, xid, 16); //sizeof (ofp_multipart_reply)
+  for (uint32_t i = 0; i < m_tables.size (); ++i)
+    {
+      if (flowRequest.table_id() == fluid_msg::of13::OFPTT_ALL || flowRequest.table_id() == i)
+        {
+          m_tables[i]->writeFlowStats(flowRequest.match(), flowRequest.cookie(), flowRequest.cookie_mask(), writer);
+        }
+    }
+  writer.Finish();
+  NS_LOG_DEBUG ("Flow stats sent in " << writer.GetNSent() << " replies");
+}
+
+void SdnSwitch13::replyWithAggregate(uint8_t* buffer, uint32_t xid)
+{
+  NS_LOG_FUNCTION (this << buffer);
+  fluid_msg::of13::MultipartRequestAggregate aggregateRequest;
+  aggregateRequest.unpack(buffer);
+  //Sums the stats handed over by the flow tables
+  struct Totals
+  {
+    Totals () : packet_count (0), byte_count (0), flow_count (0) {}
+    void Add (fluid_msg::of13::FlowStats stats)
+    {
+      packet_count += stats.packet_count();
+      byte_count += stats.byte_count();
+      flow_count++;
+    }
+    uint64_t packet_count;
+    uint64_t byte_count;
+    uint32_t flow_count;
+  } totals;
+  fluid_msg::of13::Match match = aggregateRequest.match();
+  bool everyFlow = match.oxm_fields_len() == 0 && aggregateRequest.cookie_mask() == 0;
+  for (uint32_t i = 0; i < m_tables.size (); ++i)
+    {
+      if (aggregateRequest.table_id() != fluid_msg::of13::OFPTT_ALL && aggregateRequest.table_id() != i)
+        {
+          continue;
+        }
+      if (everyFlow)
+        {
+          //The tables keep these up to date
+          totals.packet_count += m_tables[i]->m_packet_total;
+          totals.byte_count += m_tables[i]->m_byte_total;
+          totals.flow_count += m_tables[i]->m_active_count;
+        }
+      else
+        {
+          m_tables[i]->writeFlowStats(match, aggregateRequest.cookie(), aggregateRequest.cookie_mask(), totals);
+        }
+    }
+  fluid_msg::of13::MultipartReplyAggregate aggregateReply (xid, 0, totals.packet_count, totals.byte_count, totals.flow_count);
+  m_controllerConn->send(&aggregateReply);
+}
+
+void SdnSwitch13::replyWithTable(uint32_t xid)
+{
+  NS_LOG_FUNCTION (this);
+  //24 bytes per table, the whole pipeline fits in one reply
+  std::vector<fluid_msg::of13::TableStats> tableStats;
+  tableStats.reserve (m_tables.size ());
+  for (std::vector<Ptr<SdnFlowTable13> >::iterator i = m_tables.begin (); i != m_tables.end (); ++i)
+    {
+      tableStats.push_back((*i)->convertToTableStats());
+    }
+  fluid_msg::of13::MultipartReplyTable tableReply (xid, 0, tableStats);
+  m_controllerConn->send(&tableReply);
+}
+
 void SdnSwitch13::addFlow(fluid_msg::of13::FlowMod* message)
 {
   NS_LOG_FUNCTION (this << message);
-  Flow13 flow = m_flowTable13->addFlow(message);
+  Ptr<SdnFlowTable13> table = GetTable (message->table_id());
+  if (!table)
+    {
+      fluid_msg::of13::Error errorMessage (SdnCommon::GenerateXId(),
+	      fluid_msg::of13::OFPET_FLOW_MOD_FAILED,fluid_msg::of13::OFPFMFC_BAD_TABLE_ID);
+      m_controllerConn->send(&errorMessage);
+      return;
+    }
+  Flow13 flow = table->addFlow(message);
   
   if(flow.cookie_ != message->cookie())
     {
     
-      fluid_msg::of13::Error* errorMessage = new fluid_msg::of13::Error(SdnCommon::GenerateXId(),
+      fluid_msg::of13::Error errorMessage (SdnCommon::GenerateXId(),
 	      fluid_msg::of13::OFPET_FLOW_MOD_FAILED,fluid_msg::of13::OFPFMFC_OVERLAP);
-      m_controllerConn->send(errorMessage);
+      m_controllerConn->send(&errorMessage);
       return;
     }
 }
 
+void SdnSwitch13::PreloadFlow (fluid_msg::of13::FlowMod* message)
+{
+  NS_LOG_FUNCTION (this << message);
+  Ptr<SdnFlowTable13> table = GetTable (message->table_id ());
+  NS_ABORT_MSG_UNLESS (table, "Preloaded flow for table " << (uint32_t)message->table_id () << " the switch does not have");
+  table->addFlow (message);
+}
+
+void SdnSwitch13::SetDirectController (Ptr<SdnController> controller)
+{
+  NS_LOG_FUNCTION (this << controller);
+  m_directController = controller;
+}
+
 void SdnSwitch13::modifyFlow(fluid_msg::of13::FlowMod* message)
 {
   NS_LOG_FUNCTION (this << message);
-  m_flowTable13->modifyFlow(message);
+  Ptr<SdnFlowTable13> table = GetTable (message->table_id());
+  if (table)
+    {
+      table->modifyFlow(message);
+    }
 }
 
 void SdnSwitch13::modifyFlowStrict(fluid_msg::of13::FlowMod* message)
 {
 // HACK FOR COMPILE
   NS_LOG_FUNCTION (this << message);
-  m_flowTable13->modifyFlow(message);
+  Ptr<SdnFlowTable13> table = GetTable (message->table_id());
+  if (table)
+    {
+      table->modifyFlow(message);
+    }
 }
 
 void SdnSwitch13::deleteFlow(fluid_msg::of13::FlowMod* message)
 {
   NS_LOG_FUNCTION (this << message);
-  m_flowTable13->deleteFlow(message);
+  Ptr<SdnFlowTable13> table = GetTable (message->table_id());
+  if (table)
+    {
+      table->deleteFlow(message);
+    }
+  else if (message->table_id() == fluid_msg::of13::OFPTT_ALL)
+    {
+      for (std::vector<Ptr<SdnFlowTable13> >::iterator i = m_tables.begin (); i != m_tables.end (); ++i)
+        {
+          (*i)->deleteFlow(message);
+        }
+    }
 }
 
 void SdnSwitch13::deleteFlowStrict(fluid_msg::of13::FlowMod* message)
 {
 // HACK FOR COMPILE
   NS_LOG_FUNCTION (this << message);
-  m_flowTable13->deleteFlow(message);
+  Ptr<SdnFlowTable13> table = GetTable (message->table_id());
+  if (table)
+    {
+      table->deleteFlow(message);
+    }
+  else if (message->table_id() == fluid_msg::of13::OFPTT_ALL)
+    {
+      for (std::vector<Ptr<SdnFlowTable13> >::iterator i = m_tables.begin (); i != m_tables.end (); ++i)
+        {
+          (*i)->deleteFlow(message);
+        }
+    }
 }
 
 void SdnSwitch13::addGroup(fluid_msg::of13::GroupMod* message)
 {
   NS_LOG_FUNCTION (this << message);
-  Ptr<SdnGroup13> group = m_flowTable13->addGroup(message);
+  NS_LOG_DEBUG ("Adding new group on switch at time" << Simulator::Now ().GetSeconds ());
 
-  if(group)
+  // If matching group already exists, cannot add.
+  if(m_groupTable.count(message->group_id()))
     {
 
-      fluid_msg::of13::Error* errorMessage = new fluid_msg::of13::Error(SdnCommon::GenerateXId(),
+      fluid_msg::of13::Error errorMessage (SdnCommon::GenerateXId(),
 	      fluid_msg::of13::OFPET_GROUP_MOD_FAILED,fluid_msg::of13::OFPGMFC_GROUP_EXISTS);
-      m_controllerConn->send(errorMessage);
+      m_controllerConn->send(&errorMessage);
       return;
     }
+  m_groupTable[message->group_id()] = CreateObject<SdnGroup13> (message);
 }
 
 void SdnSwitch13::modifyGroup(fluid_msg::of13::GroupMod* message)
 {
   NS_LOG_FUNCTION (this << message);
-  m_flowTable13->modifyGroup(message);
+  NS_LOG_DEBUG ("Modifying group on switch at time" << Simulator::Now ().GetSeconds ());
+
+  // If no matching group already exists, cannot modify.
+  if(m_groupTable.count(message->group_id()) == 0)
+    {
+      fluid_msg::of13::Error errorMessage (SdnCommon::GenerateXId(),
+	      fluid_msg::of13::OFPET_GROUP_MOD_FAILED,fluid_msg::of13::OFPGMFC_UNKNOWN_GROUP);
+      m_controllerConn->send(&errorMessage);
+      return;
+    }
+  m_groupTable[message->group_id()] = CreateObject<SdnGroup13> (message);
+}
+
+bool SdnSwitch13::IsPortLive (uint32_t portNumber)
+{
+  Ptr<SdnPort> port = GetPort (portNumber);
+  return port && !(port->getConfig() & fluid_msg::of13::OFPPC_PORT_DOWN)
+    && !(port->getState() & fluid_msg::of13::OFPPS_LINK_DOWN);
+}
+
+bool SdnSwitch13::IsGroupLive (uint32_t groupId)
+{
+  Ptr<SdnGroup13> group = GetGroup (groupId);
+  return group && group->GetNBuckets () > 0;
+}
+
+Ptr<SdnGroup13> SdnSwitch13::GetGroup (uint32_t groupId) const
+{
+  std::map<uint32_t, Ptr<SdnGroup13> >::const_iterator entry = m_groupTable.find (groupId);
+  return entry != m_groupTable.end () ? entry->second : 0;
 }
 
 void SdnSwitch13::deleteGroup(fluid_msg::of13::GroupMod* message)
 {
   NS_LOG_FUNCTION (this << message);
-  m_flowTable13->deleteGroup(message);
+  NS_LOG_DEBUG ("Deleting group on switch at time" << Simulator::Now ().GetSeconds ());
+  if (message->group_id() == fluid_msg::of13::OFPG_ALL)
+    {
+      m_groupTable.clear();
+    }
+  else
+    {
+      m_groupTable.erase(message->group_id());
+    }
 }
 
 void SdnSwitch13::OFHandle_Port_Mod (uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of13::PortMod* portMod = new fluid_msg::of13::PortMod();
-  portMod->unpack(buffer);
-  if (portMod)
-  {
-    if (m_portMap.count(portMod->port_no()) != 0)
-      {
-        Ptr<SdnPort> port = m_portMap[portMod->port_no()];
-        uint32_t newConfig = ((portMod->config() & portMod->mask()) | (port->getConfig() & ~portMod->mask())); // & port->getAdvertised();
-        port->setConfig(newConfig);
-      }
-  }
+  fluid_msg::of13::PortMod portMod;
+  portMod.unpack(buffer);
+  Ptr<SdnPort> port = GetPort (portMod.port_no());
+  if (port)
+    {
+      uint32_t newConfig = ((portMod.config() & portMod.mask()) | (port->getConfig() & ~portMod.mask())); // & port->getAdvertised();
+      port->setConfig(newConfig);
+    }
 }
 
 void SdnSwitch13::OFHandle_Barrier_Request(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of13::BarrierRequest* barrierRequest = new fluid_msg::of13::BarrierRequest ();
-  barrierRequest->unpack(buffer);
   //Finish computing all other messages we've queued. Whatever that means for us.
-  fluid_msg::of13::BarrierReply* barrierReply = new fluid_msg::of13::BarrierReply(barrierRequest->xid ());
-  m_controllerConn->send(barrierReply);
+  fluid_msg::of13::BarrierReply barrierReply (SdnMessageStream::GetXid (buffer));
+  m_controllerConn->send(&barrierReply);
 }
 
 void SdnSwitch13::OFHandle_Packet_Out(uint8_t* buffer)
 {
   NS_LOG_FUNCTION (this << buffer);
-  fluid_msg::of13::PacketOut* packetOut = new fluid_msg::of13::PacketOut ();
-  fluid_msg::of_error status = packetOut->unpack(buffer);
+  fluid_msg::of13::PacketOut packetOut;
+  fluid_msg::of_error status = packetOut.unpack(buffer);
   NS_ASSERT (status != fluid_msg::OF_ERROR);
 
   size_t structSize = sizeof(struct fluid_msg::of13::ofp_packet_out);
   uint8_t *testP = buffer + structSize;
 
   fluid_msg::ActionList testActions;
-  testActions.length(packetOut->actions_len());
+  testActions.length(packetOut.actions_len());
   testActions.unpack13(testP);
 
   Ptr<Packet> packet;
-  uint32_t inPort = packetOut->in_port();
+  uint32_t inPort = packetOut.in_port();
   // Buffer ID == -1 => PacketOut should contain packet.
-  if (packetOut->buffer_id () == (uint32_t)(-1))
+  if (packetOut.buffer_id () == (uint32_t)(-1))
     {
-      uint32_t dataSize = (uint32_t)packetOut->data_len();
+      uint32_t dataSize = (uint32_t)packetOut.data_len();
       uint8_t* dataBuffer;
-      dataBuffer = (uint8_t*)packetOut->data();
+      dataBuffer = (uint8_t*)packetOut.data();
       packet = Create<Packet>(dataBuffer, dataSize);
     }
-  // Buffer ID matches one from packet buffers.
-  else if (m_packetBuffers.count (packetOut->buffer_id ()))
-    {
-      packet = m_packetBuffers[packetOut->buffer_id ()]->Copy ();
-//      m_packetBuffers.erase (packetOut->buffer_id ());
-    }
+  // Buffer ID matches one from packet buffers, which releases the buffer.
   else
     {
-      NS_LOG_WARN ("Received buffer id without an associated packet");
-      return;
+      packet = m_bufferPool.Take (packetOut.buffer_id ());
+      m_bufferOccupancy = m_bufferPool.GetOccupancy ();
+      if (!packet)
+        {
+          NS_LOG_WARN ("Received buffer id without an associated packet");
+          return;
+        }
     }
   std::vector<uint32_t> outPorts;
-  
+  //An output to the controller reports the match of this packet
+  SdnPacketParser::Parse (packet, inPort, m_packetKey);
+
   fluid_msg::ActionList action_list = testActions;
-  outPorts = m_flowTable13->handleActions (packet, &action_list);
+  outPorts = m_flowTable13->handleActions (packet, m_packetKey, &action_list);
 
   if (!outPorts.empty())
   {
@@ -734,58 +1042,53 @@ void SdnSwitch13::OFHandle_Packet_Out(uint8_t* buffer)
   }
 }
 
-void SdnSwitch13::SendPacketInToController(Ptr<Packet> packet, Ptr<NetDevice> device, uint8_t reason)
+void SdnSwitch13::SendPacketInToController(Ptr<Packet> packet, uint32_t inPort, uint8_t reason)
 {
-  NS_LOG_FUNCTION (this << packet << device << reason);
-  Ptr<SdnPort> port;
-  for(std::map<uint32_t,Ptr<SdnPort> >::iterator portIterator = m_portMap.begin(); portIterator != m_portMap.end(); ++portIterator)
+  NS_LOG_FUNCTION (this << packet << inPort << reason);
+  Ptr<SdnPort> port = GetPort (inPort);
+  if (!port)
     {
-      if(portIterator->second && portIterator->second->getDevice() == device)
-        {
-          port = portIterator->second;
-          break;
-        }
+      NS_LOG_WARN ("No port " << inPort << " to report a PacketIn for");
+      return;
     }
-  
-  // While the maximum number of buffered packets has not been exceeded, add the
-  // packet to the buffer before sending
-  fluid_msg::of13::PacketIn* packetIn;
-  if (m_packetBuffers.size () <= MAX_BUFFERS)
-    {
-      uint32_t newId = 0;
-      do
-	{
-	  newId = m_bufferIdStream->GetInteger ();
-	} while (m_packetBuffers.count (newId) == 1);
-      std::cout<<"newId is "<<newId<<std::endl;
 
-      m_packetBuffers[newId] = packet->Copy ();
-      packetIn = new fluid_msg::of13::PacketIn(SdnCommon::GenerateXId(),
-    	  newId, packet->GetSize(), reason, 0, 0); // Last 2 are table ID and cookie.
-    }
-  else
+  // Buffer the packet if a buffer is available, otherwise its buffer id is -1.
+  // A miss_send_len of OFPCML_NO_BUFFER asks for every packet whole.
+  uint32_t bufferId = SDN_NO_BUFFER;
+  if (m_missSendLen != fluid_msg::of13::OFPCML_NO_BUFFER)
     {
-      packetIn = new fluid_msg::of13::PacketIn(SdnCommon::GenerateXId(),
-    	  -1, packet->GetSize(), reason, 0, 0);
+      bufferId = m_bufferPool.Store (packet, (uint32_t)port->getFluidPort().port_no());
+      m_bufferOccupancy = m_bufferPool.GetOccupancy ();
     }
+  fluid_msg::of13::PacketIn packetIn (SdnCommon::GenerateXId(),
+      bufferId, packet->GetSize(), reason, 0, 0); // Last 2 are table ID and cookie.
 
-  m_flowTable13->DestructHeader(packet);
-  fluid_msg::of13::Match match = m_flowTable13->getPacketFields((uint32_t)port->getFluidPort().port_no());
-  m_flowTable13->RestructHeader(packet);
-
-  for (uint8_t i=0; i<OXM_NUM; ++i){
-	  if (match.oxm_field(i))
-	    packetIn->add_oxm_field(match.oxm_field(i));
-
-  }
+  //The flow tables already parsed the packet, its key gives the match
+  fluid_msg::of13::Match match;
+  SdnFlowMatch::ToOf13 (m_packetKey, match);
+  packetIn.match(match);
 
-  uint8_t buffer[packet->GetSize ()];
-  packet->CopyData (buffer,packet->GetSize ());
-  //packetIn->unpack(buffer);
-  packetIn->data(buffer,42);
+  //An unbuffered packet goes whole, since the controller has no other way to get it
+  uint32_t dataLength = 0;
+  if (bufferId == SDN_NO_BUFFER)
+    {
+      dataLength = packet->GetSize ();
+    }
+  else if (m_packetInData)
+    {
+      dataLength = std::min (packet->GetSize (), (uint32_t)m_missSendLen);
+    }
+  if (dataLength > 0)
+    {
+      if (m_packetInScratch.size () < dataLength)
+        {
+          m_packetInScratch.resize (dataLength);
+        }
+      packet->CopyData (&m_packetInScratch[0], dataLength);
+      packetIn.data(&m_packetInScratch[0], dataLength);
+    }
 
-  if (packetIn) m_controllerConn->send(packetIn);
- // delete(packetIn);
+  m_controllerConn->send(&packetIn);
 }
 
 void SdnSwitch13::SendFlowRemovedMessageToController(Flow13 flow, uint8_t reason)
@@ -794,14 +1097,35 @@ void SdnSwitch13::SendFlowRemovedMessageToController(Flow13 flow, uint8_t reason
   fluid_msg::of13::FlowRemoved* flowRemoved = new fluid_msg::of13::FlowRemoved(
 	  SdnCommon::GenerateXId(), flow.cookie_, flow.priority_, reason, flow.table_id_, flow.duration_sec_,
 	  flow.duration_nsec_, flow.idle_timeout_, flow.hard_timeout_, flow.packet_count_, flow.byte_count_);
-  m_controllerConn->send(flowRemoved);
+  m_pendingFlowRemoved.push_back(flowRemoved);
+}
+
+void SdnSwitch13::HandleFlowTimer(SdnTimer timer)
+{
+  NS_LOG_FUNCTION (this);
+  Ptr<SdnFlowTable13> table = GetTable (timer.table_id);
+  if (table)
+    {
+      table->expireTimer(timer);
+    }
+}
+
+void SdnSwitch13::FlushFlowRemoved(void)
+{
+  NS_LOG_FUNCTION (this << m_pendingFlowRemoved.size());
+  for (std::vector<fluid_msg::of13::FlowRemoved*>::iterator i = m_pendingFlowRemoved.begin(); i != m_pendingFlowRemoved.end(); ++i)
+    {
+      m_controllerConn->send(*i);
+      delete *i;
+    }
+  m_pendingFlowRemoved.clear();
 }
 
 void SdnSwitch13::SendPortStatusMessageToController(fluid_msg::of13::Port port, uint8_t reason)
 {
   NS_LOG_FUNCTION (this << reason);
-  fluid_msg::of13::PortStatus* portStatus = new fluid_msg::of13::PortStatus(SdnCommon::GenerateXId(), reason, port);
-  m_controllerConn->send(portStatus);
+  fluid_msg::of13::PortStatus portStatus (SdnCommon::GenerateXId(), reason, port);
+  m_controllerConn->send(&portStatus);
 }
 
 void SdnSwitch13::Flood(Ptr<Packet> packet, uint32_t portNum)
@@ -875,8 +1199,8 @@ bool SdnSwitch13::NegotiateVersion (fluid_msg::OFMsg* msg)
 uint16_t SdnSwitch13::getNewPortNumber ()
 {
   NS_LOG_FUNCTION (this);
-  TOTAL_PORTS++;
-  return TOTAL_PORTS == OFCONTROLLERPORT ? ++TOTAL_PORTS : TOTAL_PORTS;
+  TOTAL_PORTS = SdnCommon::NextPortNumber (TOTAL_PORTS);
+  return TOTAL_PORTS;
 }
 
 uint32_t SdnSwitch13::getNewDatapathID ()
@@ -0,0 +1,163 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "SdnTimerWheel.h"
+#include "ns3/log.h"
+#include "ns3/abort.h"
+#include "ns3/simulator.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("SdnTimerWheel");
+
+#define LEVEL1_SPAN   ((uint64_t)1 << 8)  //!< Ticks covered by level 0
+#define LEVEL2_SPAN   ((uint64_t)1 << 14) //!< Ticks covered by levels 0 and 1
+#define OVERFLOW_SPAN ((uint64_t)1 << 20) //!< Ticks covered by all three levels
+
+SdnTimerWheel::SdnTimerWheel ()
+  : m_granularity (MilliSeconds (100)),
+    m_now (0),
+    m_pending (0)
+{
+}
+
+SdnTimerWheel::~SdnTimerWheel ()
+{
+  m_tickEvent.Cancel ();
+}
+
+void
+SdnTimerWheel::SetGranularity (Time granularity)
+{
+  NS_ABORT_MSG_UNLESS (granularity.IsStrictlyPositive (), "Timer wheel granularity must be positive");
+  NS_ABORT_MSG_UNLESS (m_pending == 0, "Timer wheel granularity cannot change while timers are pending");
+  m_granularity = granularity;
+}
+
+void
+SdnTimerWheel::Schedule (Time delay, const SdnTimer &timer)
+{
+  int64_t step = m_granularity.GetTimeStep ();
+  if (m_pending == 0)
+    {
+      //The wheel stood still while empty, move it to the current tick
+      m_now = Simulator::Now ().GetTimeStep () / step;
+    }
+  Entry entry;
+  entry.timer = timer;
+  entry.tick = ((Simulator::Now () + delay).GetTimeStep () + step - 1) / step;
+  if (entry.tick <= m_now)
+    {
+      entry.tick = m_now + 1;
+    }
+  Insert (entry);
+  m_pending++;
+  if (!m_tickEvent.IsRunning ())
+    {
+      m_tickEvent = Simulator::Schedule (TimeStep ((m_now + 1) * step) - Simulator::Now (), &SdnTimerWheel::Tick, this);
+    }
+}
+
+void
+SdnTimerWheel::Clear (void)
+{
+  m_tickEvent.Cancel ();
+  for (uint32_t i = 0; i < 256; ++i)
+    {
+      m_level0[i].clear ();
+    }
+  for (uint32_t i = 0; i < 64; ++i)
+    {
+      m_level1[i].clear ();
+      m_level2[i].clear ();
+    }
+  m_overflow.clear ();
+  m_pending = 0;
+}
+
+void
+SdnTimerWheel::Insert (const Entry &entry)
+{
+  uint64_t delta = entry.tick - m_now;
+  if (delta < LEVEL1_SPAN)
+    {
+      m_level0[entry.tick & 255].push_back (entry);
+    }
+  else if (delta < LEVEL2_SPAN)
+    {
+      m_level1[(entry.tick >> 8) & 63].push_back (entry);
+    }
+  else if (delta < OVERFLOW_SPAN)
+    {
+      m_level2[(entry.tick >> 14) & 63].push_back (entry);
+    }
+  else
+    {
+      m_overflow.push_back (entry);
+    }
+}
+
+void
+SdnTimerWheel::Cascade (Slot &slot)
+{
+  Slot moved;
+  moved.swap (slot);
+  for (Slot::iterator i = moved.begin (); i != moved.end (); ++i)
+    {
+      Insert (*i);
+    }
+}
+
+void
+SdnTimerWheel::Tick (void)
+{
+  m_tickEvent = EventId ();
+  m_now++;
+  if ((m_now & (OVERFLOW_SPAN - 1)) == 0)
+    {
+      Cascade (m_overflow);
+    }
+  if ((m_now & (LEVEL2_SPAN - 1)) == 0)
+    {
+      Cascade (m_level2[(m_now >> 14) & 63]);
+    }
+  if ((m_now & (LEVEL1_SPAN - 1)) == 0)
+    {
+      Cascade (m_level1[(m_now >> 8) & 63]);
+    }
+
+  Slot due;
+  due.swap (m_level0[m_now & 255]);
+  uint32_t expired = 0;
+  for (Slot::iterator i = due.begin (); i != due.end (); ++i)
+    {
+      m_pending--;
+      expired++;
+      m_expire (i->timer);
+    }
+  NS_LOG_DEBUG ("Tick " << m_now << " expired " << expired << " timers, " << m_pending << " pending");
+  if (expired && !m_tick.IsNull ())
+    {
+      m_tick ();
+    }
+  //Expiry handlers may already have restarted the wheel
+  if (m_pending > 0 && !m_tickEvent.IsRunning ())
+    {
+      m_tickEvent = Simulator::Schedule (m_granularity, &SdnTimerWheel::Tick, this);
+    }
+}
+
+} //End namespace ns3
@@ -0,0 +1,132 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_TIMER_WHEEL_H
+#define SDN_TIMER_WHEEL_H
+
+//Stdlib packages
+#include <stdint.h>
+#include <vector>
+//ns3 utilities
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/callback.h"
+
+namespace ns3 {
+
+/**
+ * \brief A flow timeout held by an SdnTimerWheel
+ */
+struct SdnTimer
+{
+  enum Kind
+  {
+    IDLE_TIMEOUT,
+    HARD_TIMEOUT
+  };
+  uint64_t entry_id; //!< Entry id of the flow
+  uint16_t priority; //!< Priority of the flow
+  uint8_t table_id;  //!< Flow table holding the flow
+  uint8_t kind;      //!< IDLE_TIMEOUT or HARD_TIMEOUT
+};
+
+/**
+ * \ingroup sdn
+ *
+ * \brief Hierarchical timing wheel for the flow timeouts of one switch.
+ *
+ * Time is cut into ticks of a configurable granularity and timers expire on
+ * the first tick at or after their due time. The wheel keeps one scheduler
+ * event for the next tick, only while timers are pending, instead of one
+ * event per timer. Level 0 holds the next 256 ticks one slot each, the two
+ * levels above it hold 64 slots of 256 and 16384 ticks, and timers further
+ * out wait in an overflow list. Upper slots are cascaded down as the wheel
+ * turns, so scheduling and expiring a timer are both O(1).
+ *
+ * Timers cannot be cancelled. The owner checks on expiry whether the flow
+ * still exists, which is cheap because entry ids are never reused.
+ */
+class SdnTimerWheel
+{
+public:
+  typedef Callback<void, SdnTimer> ExpireCallback; //!< Called for each expired timer
+  typedef Callback<void> TickCallback;             //!< Called after a tick expired at least one timer
+
+  SdnTimerWheel ();
+  ~SdnTimerWheel ();
+
+  /**
+   * \brief Sets the tick length. Only allowed while no timer is pending.
+   * \param granularity The tick length, must be positive
+   */
+  void SetGranularity (Time granularity);
+  /**
+   * \return The tick length
+   */
+  Time GetGranularity (void) const { return m_granularity; }
+  /**
+   * \param cb Receives every expired timer
+   */
+  void SetExpireCallback (ExpireCallback cb) { m_expire = cb; }
+  /**
+   * \param cb Called once per tick after all its timers were expired
+   */
+  void SetTickCallback (TickCallback cb) { m_tick = cb; }
+  /**
+   * \brief Adds a timer
+   * \param delay Time from now until the timer is due
+   * \param timer The timer to hand back on expiry
+   */
+  void Schedule (Time delay, const SdnTimer &timer);
+  /**
+   * \return The number of timers not expired yet
+   */
+  uint32_t GetNPending (void) const { return m_pending; }
+  /**
+   * \brief Drops every pending timer and stops the wheel
+   */
+  void Clear (void);
+
+private:
+  /// \brief A timer with its absolute expiry tick
+  struct Entry
+  {
+    uint64_t tick;  //!< Tick the timer expires on
+    SdnTimer timer; //!< The timer
+  };
+  typedef std::vector<Entry> Slot;
+
+  void Insert (const Entry &entry);
+  void Cascade (Slot &slot);
+  void Tick (void);
+
+  SdnTimerWheel (const SdnTimerWheel &);
+  SdnTimerWheel& operator= (const SdnTimerWheel &);
+
+  Time m_granularity;      //!< Tick length
+  uint64_t m_now;          //!< Last tick processed
+  uint32_t m_pending;      //!< Timers held by the wheel
+  EventId m_tickEvent;     //!< The next tick, running only while timers are pending
+  Slot m_level0[256];      //!< One slot per tick
+  Slot m_level1[64];       //!< One slot per 256 ticks
+  Slot m_level2[64];       //!< One slot per 16384 ticks
+  Slot m_overflow;         //!< Timers more than 2^20 ticks out
+  ExpireCallback m_expire; //!< Expired timer handler
+  TickCallback m_tick;     //!< End of tick handler
+};
+
+} //End namespace ns3
+#endif /* SDN_TIMER_WHEEL_H */
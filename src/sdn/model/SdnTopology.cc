@@ -0,0 +1,535 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <queue>
+#include <algorithm>
+#include "SdnTopology.h"
+#include "ns3/log.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("SdnTopology");
+
+SdnTopology::SdnTopology ()
+  : m_nextComponent (0),
+    m_visit (0)
+{
+}
+
+bool
+SdnTopology::AddSwitch (uint64_t dpid)
+{
+  if (HasSwitch (dpid))
+    {
+      return false;
+    }
+  Switch &sw = m_switches[dpid];
+  sw.component = m_nextComponent++;
+  m_componentSize[sw.component] = 1;
+  NS_LOG_DEBUG ("Switch " << dpid << " added");
+  return true;
+}
+
+bool
+SdnTopology::RemoveSwitch (uint64_t dpid)
+{
+  std::map<uint64_t, Switch>::iterator it = m_switches.find (dpid);
+  if (it == m_switches.end ())
+    {
+      return false;
+    }
+  std::vector<uint64_t> neighbors;
+  for (LinkMap::iterator i = it->second.out.begin (); i != it->second.out.end (); ++i)
+    {
+      neighbors.push_back (i->first);
+    }
+  for (uint32_t i = 0; i < neighbors.size (); ++i)
+    {
+      RemoveLink (dpid, neighbors[i]);
+    }
+  neighbors.assign (it->second.in.begin (), it->second.in.end ());
+  for (uint32_t i = 0; i < neighbors.size (); ++i)
+    {
+      RemoveLink (neighbors[i], dpid);
+    }
+
+  //Without links the switch is a tree of its own
+  uint32_t component = it->second.component;
+  if (--m_componentSize[component] == 0)
+    {
+      m_componentSize.erase (component);
+    }
+  m_paths.erase (dpid);
+  m_switches.erase (it);
+  NS_LOG_DEBUG ("Switch " << dpid << " removed");
+  return true;
+}
+
+bool
+SdnTopology::AddLink (const SdnTopologyLink &link)
+{
+  if (link.srcDpid == link.dstDpid)
+    {
+      return false;
+    }
+  AddSwitch (link.srcDpid);
+  AddSwitch (link.dstDpid);
+
+  //A port only has one link arriving, whatever arrived there before was unplugged
+  std::map<PortKey, uint64_t>::iterator port = m_ports.find (PortKey (link.dstDpid, link.dstPort));
+  if (port != m_ports.end () && port->second != link.srcDpid)
+    {
+      RemoveLink (port->second, link.dstDpid);
+    }
+
+  Switch &src = m_switches[link.srcDpid];
+  Switch &dst = m_switches[link.dstDpid];
+  SdnTopologyLink added = link;
+  LinkMap::iterator reverse = dst.out.find (link.srcDpid);
+  if (reverse != dst.out.end ())
+    {
+      //Each direction knows the port the other arrives at
+      if (added.srcPort == SDN_TOPOLOGY_NO_PORT)
+        {
+          added.srcPort = reverse->second.dstPort;
+        }
+      reverse->second.srcPort = added.dstPort;
+    }
+
+  LinkMap::iterator existing = src.out.find (link.dstDpid);
+  if (existing != src.out.end ())
+    {
+      SdnTopologyLink old = existing->second;
+      if (old.srcPort == added.srcPort && old.dstPort == added.dstPort && old.cost == added.cost)
+        {
+          return false;
+        }
+      m_ports.erase (PortKey (old.dstDpid, old.dstPort));
+      m_ports[PortKey (added.dstDpid, added.dstPort)] = added.srcDpid;
+      existing->second = added;
+      if (added.cost > old.cost)
+        {
+          InvalidateRemoved (old);
+        }
+      else if (added.cost < old.cost)
+        {
+          InvalidateAdded (added);
+        }
+      if (src.tree.count (link.dstDpid) && !m_treeCallback.IsNull ()
+          && (old.srcPort != added.srcPort || old.dstPort != added.dstPort))
+        {
+          m_treeCallback (old, false);
+          m_treeCallback (added, true);
+        }
+      return true;
+    }
+
+  bool adjacent = IsAdjacent (link.srcDpid, link.dstDpid);
+  src.out[link.dstDpid] = added;
+  dst.in.insert (link.srcDpid);
+  m_ports[PortKey (added.dstDpid, added.dstPort)] = added.srcDpid;
+  InvalidateAdded (added);
+  NS_LOG_DEBUG ("Link " << link.srcDpid << " -> " << link.dstDpid << " port " << link.dstPort << " added");
+
+  if (adjacent)
+    {
+      if (src.tree.count (link.dstDpid) && !m_treeCallback.IsNull ())
+        {
+          m_treeCallback (added, true);
+        }
+    }
+  else if (src.component != dst.component)
+    {
+      AddTreeEdge (link.srcDpid, link.dstDpid);
+    }
+  return true;
+}
+
+bool
+SdnTopology::RemoveLink (uint64_t srcDpid, uint64_t dstDpid)
+{
+  std::map<uint64_t, Switch>::iterator src = m_switches.find (srcDpid);
+  if (src == m_switches.end ())
+    {
+      return false;
+    }
+  LinkMap::iterator it = src->second.out.find (dstDpid);
+  if (it == src->second.out.end ())
+    {
+      return false;
+    }
+  SdnTopologyLink link = it->second;
+  src->second.out.erase (it);
+  m_switches[dstDpid].in.erase (srcDpid);
+  std::map<PortKey, uint64_t>::iterator port = m_ports.find (PortKey (dstDpid, link.dstPort));
+  if (port != m_ports.end () && port->second == srcDpid)
+    {
+      m_ports.erase (port);
+    }
+  InvalidateRemoved (link);
+  NS_LOG_DEBUG ("Link " << srcDpid << " -> " << dstDpid << " removed");
+
+  if (src->second.tree.count (dstDpid))
+    {
+      if (!m_treeCallback.IsNull ())
+        {
+          m_treeCallback (link, false);
+        }
+      if (!IsAdjacent (srcDpid, dstDpid))
+        {
+          CutTreeEdge (srcDpid, dstDpid);
+        }
+    }
+  return true;
+}
+
+uint32_t
+SdnTopology::RemovePort (uint64_t dpid, uint32_t port)
+{
+  std::map<uint64_t, Switch>::iterator it = m_switches.find (dpid);
+  if (it == m_switches.end ())
+    {
+      return 0;
+    }
+  std::vector<uint64_t> leaving;
+  for (LinkMap::iterator i = it->second.out.begin (); i != it->second.out.end (); ++i)
+    {
+      if (i->second.srcPort == port)
+        {
+          leaving.push_back (i->first);
+        }
+    }
+  uint32_t removed = 0;
+  for (uint32_t i = 0; i < leaving.size (); ++i)
+    {
+      removed += RemoveLink (dpid, leaving[i]);
+    }
+  std::map<PortKey, uint64_t>::iterator arriving = m_ports.find (PortKey (dpid, port));
+  if (arriving != m_ports.end ())
+    {
+      removed += RemoveLink (arriving->second, dpid);
+    }
+  return removed;
+}
+
+const SdnTopologyLink*
+SdnTopology::FindLink (uint64_t srcDpid, uint64_t dstDpid) const
+{
+  std::map<uint64_t, Switch>::const_iterator src = m_switches.find (srcDpid);
+  if (src == m_switches.end ())
+    {
+      return 0;
+    }
+  LinkMap::const_iterator it = src->second.out.find (dstDpid);
+  return it == src->second.out.end () ? 0 : &it->second;
+}
+
+const SdnTopologyLink*
+SdnTopology::FindLinkAt (uint64_t dpid, uint32_t port) const
+{
+  std::map<PortKey, uint64_t>::const_iterator it = m_ports.find (PortKey (dpid, port));
+  return it == m_ports.end () ? 0 : FindLink (it->second, dpid);
+}
+
+void
+SdnTopology::GetLinks (uint64_t dpid, std::vector<SdnTopologyLink> &links) const
+{
+  std::map<uint64_t, Switch>::const_iterator it = m_switches.find (dpid);
+  if (it == m_switches.end ())
+    {
+      return;
+    }
+  for (LinkMap::const_iterator i = it->second.out.begin (); i != it->second.out.end (); ++i)
+    {
+      links.push_back (i->second);
+    }
+}
+
+bool
+SdnTopology::IsTreeLink (uint64_t srcDpid, uint64_t dstDpid) const
+{
+  std::map<uint64_t, Switch>::const_iterator src = m_switches.find (srcDpid);
+  return src != m_switches.end () && src->second.out.count (dstDpid) && src->second.tree.count (dstDpid);
+}
+
+void
+SdnTopology::GetTreeLinks (std::vector<SdnTopologyLink> &links) const
+{
+  for (std::map<uint64_t, Switch>::const_iterator i = m_switches.begin (); i != m_switches.end (); ++i)
+    {
+      for (std::set<uint64_t>::const_iterator j = i->second.tree.begin (); j != i->second.tree.end (); ++j)
+        {
+          LinkMap::const_iterator link = i->second.out.find (*j);
+          if (link != i->second.out.end ())
+            {
+              links.push_back (link->second);
+            }
+        }
+    }
+}
+
+bool
+SdnTopology::GetPath (uint64_t srcDpid, uint64_t dstDpid, std::vector<SdnTopologyLink> &path)
+{
+  path.clear ();
+  const PathTree &tree = GetPathTree (srcDpid);
+  if (tree.find (dstDpid) == tree.end ())
+    {
+      return false;
+    }
+  for (uint64_t hop = dstDpid; hop != srcDpid; )
+    {
+      uint64_t prev = tree.find (hop)->second.second;
+      path.push_back (*FindLink (prev, hop));
+      hop = prev;
+    }
+  std::reverse (path.begin (), path.end ());
+  return true;
+}
+
+bool
+SdnTopology::GetPathCost (uint64_t srcDpid, uint64_t dstDpid, uint64_t &cost)
+{
+  const PathTree &tree = GetPathTree (srcDpid);
+  PathTree::const_iterator it = tree.find (dstDpid);
+  if (it == tree.end ())
+    {
+      return false;
+    }
+  cost = it->second.first;
+  return true;
+}
+
+void
+SdnTopology::Clear (void)
+{
+  m_switches.clear ();
+  m_ports.clear ();
+  m_componentSize.clear ();
+  m_paths.clear ();
+}
+
+bool
+SdnTopology::IsAdjacent (uint64_t a, uint64_t b) const
+{
+  return FindLink (a, b) || FindLink (b, a);
+}
+
+void
+SdnTopology::ReportTree (uint64_t a, uint64_t b, bool added)
+{
+  if (m_treeCallback.IsNull ())
+    {
+      return;
+    }
+  const SdnTopologyLink* link = FindLink (a, b);
+  if (link)
+    {
+      m_treeCallback (*link, added);
+    }
+  link = FindLink (b, a);
+  if (link)
+    {
+      m_treeCallback (*link, added);
+    }
+}
+
+void
+SdnTopology::AddTreeEdge (uint64_t a, uint64_t b)
+{
+  Switch &sa = m_switches[a];
+  Switch &sb = m_switches[b];
+  //Merge the smaller tree into the larger one
+  uint64_t smaller = m_componentSize[sa.component] < m_componentSize[sb.component] ? a : b;
+  uint32_t from = m_switches[smaller].component;
+  uint32_t into = smaller == a ? sb.component : sa.component;
+
+  std::vector<uint64_t> side;
+  side.push_back (smaller);
+  m_visit++;
+  m_switches[smaller].visit = m_visit;
+  for (uint32_t i = 0; i < side.size (); ++i)
+    {
+      Switch &sw = m_switches[side[i]];
+      for (std::set<uint64_t>::iterator j = sw.tree.begin (); j != sw.tree.end (); ++j)
+        {
+          Switch &next = m_switches[*j];
+          if (next.visit != m_visit)
+            {
+              next.visit = m_visit;
+              side.push_back (*j);
+            }
+        }
+    }
+  Relabel (side, into);
+  m_componentSize[into] += side.size ();
+  m_componentSize.erase (from);
+
+  sa.tree.insert (b);
+  sb.tree.insert (a);
+  ReportTree (a, b, true);
+}
+
+void
+SdnTopology::CutTreeEdge (uint64_t a, uint64_t b)
+{
+  Switch &sa = m_switches[a];
+  sa.tree.erase (b);
+  m_switches[b].tree.erase (a);
+
+  //Collect the side of the tree a is left on
+  std::vector<uint64_t> side;
+  side.push_back (a);
+  m_visit++;
+  sa.visit = m_visit;
+  for (uint32_t i = 0; i < side.size (); ++i)
+    {
+      Switch &sw = m_switches[side[i]];
+      for (std::set<uint64_t>::iterator j = sw.tree.begin (); j != sw.tree.end (); ++j)
+        {
+          Switch &next = m_switches[*j];
+          if (next.visit != m_visit)
+            {
+              next.visit = m_visit;
+              side.push_back (*j);
+            }
+        }
+    }
+
+  //Any link from that side to a switch of the same tree not on it reconnects the two sides
+  uint32_t component = sa.component;
+  for (uint32_t i = 0; i < side.size (); ++i)
+    {
+      Switch &sw = m_switches[side[i]];
+      std::vector<uint64_t> neighbors;
+      for (LinkMap::iterator j = sw.out.begin (); j != sw.out.end (); ++j)
+        {
+          neighbors.push_back (j->first);
+        }
+      neighbors.insert (neighbors.end (), sw.in.begin (), sw.in.end ());
+      for (uint32_t j = 0; j < neighbors.size (); ++j)
+        {
+          Switch &other = m_switches[neighbors[j]];
+          if (other.visit != m_visit && other.component == component)
+            {
+              sw.tree.insert (neighbors[j]);
+              other.tree.insert (side[i]);
+              ReportTree (side[i], neighbors[j], true);
+              return;
+            }
+        }
+    }
+
+  uint32_t split = m_nextComponent++;
+  Relabel (side, split);
+  m_componentSize[split] = side.size ();
+  m_componentSize[component] -= side.size ();
+  NS_LOG_DEBUG ("Spanning tree split, " << side.size () << " switches cut off");
+}
+
+void
+SdnTopology::Relabel (const std::vector<uint64_t> &dpids, uint32_t component)
+{
+  for (uint32_t i = 0; i < dpids.size (); ++i)
+    {
+      m_switches[dpids[i]].component = component;
+    }
+}
+
+void
+SdnTopology::InvalidateAdded (const SdnTopologyLink &link)
+{
+  std::map<uint64_t, PathTree>::iterator it = m_paths.begin ();
+  while (it != m_paths.end ())
+    {
+      PathTree::iterator src = it->second.find (link.srcDpid);
+      PathTree::iterator dst = it->second.find (link.dstDpid);
+      //Only a cheaper way to the far end of the link changes anything
+      if (src != it->second.end () &&
+          (dst == it->second.end () || src->second.first + link.cost < dst->second.first))
+        {
+          m_paths.erase (it++);
+        }
+      else
+        {
+          ++it;
+        }
+    }
+}
+
+void
+SdnTopology::InvalidateRemoved (const SdnTopologyLink &link)
+{
+  std::map<uint64_t, PathTree>::iterator it = m_paths.begin ();
+  while (it != m_paths.end ())
+    {
+      //Only path trees that went through the link change
+      PathTree::iterator dst = it->second.find (link.dstDpid);
+      if (dst != it->second.end () && it->first != link.dstDpid && dst->second.second == link.srcDpid)
+        {
+          m_paths.erase (it++);
+        }
+      else
+        {
+          ++it;
+        }
+    }
+}
+
+const SdnTopology::PathTree&
+SdnTopology::GetPathTree (uint64_t srcDpid)
+{
+  std::map<uint64_t, PathTree>::iterator cached = m_paths.find (srcDpid);
+  if (cached != m_paths.end ())
+    {
+      return cached->second;
+    }
+
+  if (!HasSwitch (srcDpid))
+    {
+      static const PathTree none;
+      return none;
+    }
+  PathTree &tree = m_paths[srcDpid];
+  typedef std::pair<uint64_t, uint64_t> Entry; //!< (cost, dpid)
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > pending;
+  tree[srcDpid] = std::make_pair (0, srcDpid);
+  pending.push (Entry (0, srcDpid));
+  while (!pending.empty ())
+    {
+      Entry top = pending.top ();
+      pending.pop ();
+      if (top.first > tree[top.second].first)
+        {
+          continue;
+        }
+      const LinkMap &out = m_switches[top.second].out;
+      for (LinkMap::const_iterator i = out.begin (); i != out.end (); ++i)
+        {
+          uint64_t cost = top.first + i->second.cost;
+          PathTree::iterator known = tree.find (i->first);
+          if (known == tree.end () || cost < known->second.first)
+            {
+              tree[i->first] = std::make_pair (cost, top.second);
+              pending.push (Entry (cost, i->first));
+            }
+        }
+    }
+  NS_LOG_DEBUG ("Path tree of " << srcDpid << " computed, " << tree.size () << " switches reachable");
+  return tree;
+}
+
+} //End namespace ns3
@@ -0,0 +1,215 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_TOPOLOGY_H
+#define SDN_TOPOLOGY_H
+
+//Stdlib packages
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <vector>
+//NS3 objects
+#include "ns3/callback.h"
+
+#define SDN_TOPOLOGY_NO_PORT 0xffffffff //!< Port of a link end that is not known (yet)
+
+namespace ns3 {
+
+/**
+ * \ingroup sdn
+ *
+ * \brief One direction of a link between two switches, as discovered by a
+ * probe sent by srcDpid and received by dstDpid.
+ */
+struct SdnTopologyLink
+{
+  SdnTopologyLink ()
+    : srcDpid (0), srcPort (SDN_TOPOLOGY_NO_PORT), dstDpid (0), dstPort (SDN_TOPOLOGY_NO_PORT), cost (0) {}
+  uint64_t srcDpid; //!< Switch the link leaves
+  uint32_t srcPort; //!< Port the link leaves srcDpid on, SDN_TOPOLOGY_NO_PORT until known
+  uint64_t dstDpid; //!< Switch the link arrives at
+  uint32_t dstPort; //!< Port the link arrives at dstDpid on
+  uint64_t cost;    //!< Cost of the link for shortest paths, e.g. its measured delay
+};
+
+/**
+ * \ingroup sdn
+ *
+ * \brief Switch level topology of a controller, kept up to date link by link
+ * as discovery probes and port status messages come in.
+ *
+ * Switches are keyed by DPID, each with its outgoing links keyed by the DPID
+ * at the other end and the DPIDs of its incoming links. At most one link is
+ * kept per ordered pair of switches. The port a link leaves from is filled in
+ * from the reverse link when the discovery cannot tell it.
+ *
+ * A spanning tree over the switches, treating a pair linked in either
+ * direction as adjacent, is maintained as links come and go: a new link joins
+ * the tree only if it connects two trees, and a tree link that goes away is
+ * replaced by searching the links out of the side of the tree it cut off, so
+ * links far from the change are never looked at. Each link entering or
+ * leaving the tree is reported through the tree callback.
+ *
+ * Shortest paths are computed per source switch with Dijkstra's algorithm and
+ * cached. A link change only drops the cached sources it can affect: those
+ * whose path tree used a removed or dearer link, or to which a new or cheaper
+ * link gives a shorter path.
+ */
+class SdnTopology
+{
+public:
+  typedef Callback<void, const SdnTopologyLink&, bool> TreeCallback; //!< A link entered (true) or left (false) the spanning tree
+
+  SdnTopology ();
+
+  /**
+   * \param cb Called for each link entering or leaving the spanning tree
+   */
+  void SetTreeCallback (TreeCallback cb) { m_treeCallback = cb; }
+
+  /**
+   * \brief Adds a switch with no links
+   * \param dpid The datapath id of the switch
+   * \return True if the switch was not known
+   */
+  bool AddSwitch (uint64_t dpid);
+  /**
+   * \brief Removes a switch and every link to or from it
+   * \param dpid The datapath id of the switch
+   * \return True if the switch was known
+   */
+  bool RemoveSwitch (uint64_t dpid);
+  /**
+   * \param dpid The datapath id of a switch
+   * \return True if the switch is known
+   */
+  bool HasSwitch (uint64_t dpid) const { return m_switches.find (dpid) != m_switches.end (); }
+  /**
+   * \return The number of switches
+   */
+  uint32_t GetNSwitches (void) const { return m_switches.size (); }
+
+  /**
+   * \brief Adds a link, or updates the ports and cost of a known one. Unknown
+   * switches at either end are added.
+   * \param link The link
+   * \return True if the link is new or changed
+   */
+  bool AddLink (const SdnTopologyLink &link);
+  /**
+   * \brief Removes one direction of a link
+   * \param srcDpid The switch the link leaves
+   * \param dstDpid The switch the link arrives at
+   * \return True if the link was known
+   */
+  bool RemoveLink (uint64_t srcDpid, uint64_t dstDpid);
+  /**
+   * \brief Removes every link leaving or arriving at a port, as when the port goes down
+   * \param dpid The switch
+   * \param port The port
+   * \return The number of links removed
+   */
+  uint32_t RemovePort (uint64_t dpid, uint32_t port);
+  /**
+   * \param srcDpid The switch the link leaves
+   * \param dstDpid The switch the link arrives at
+   * \return The link, or 0 if unknown. Valid until the next change to the topology
+   */
+  const SdnTopologyLink* FindLink (uint64_t srcDpid, uint64_t dstDpid) const;
+  /**
+   * \param dpid A switch
+   * \param port A port of that switch
+   * \return The link arriving at the port, or 0 if none. Valid until the next change to the topology
+   */
+  const SdnTopologyLink* FindLinkAt (uint64_t dpid, uint32_t port) const;
+  /**
+   * \param dpid A switch
+   * \param links Receives the links leaving the switch
+   */
+  void GetLinks (uint64_t dpid, std::vector<SdnTopologyLink> &links) const;
+
+  /**
+   * \param srcDpid The switch the link leaves
+   * \param dstDpid The switch the link arrives at
+   * \return True if the link is known and part of the spanning tree
+   */
+  bool IsTreeLink (uint64_t srcDpid, uint64_t dstDpid) const;
+  /**
+   * \param links Receives every link of the spanning tree
+   */
+  void GetTreeLinks (std::vector<SdnTopologyLink> &links) const;
+
+  /**
+   * \brief Finds a least cost path
+   * \param srcDpid The first switch
+   * \param dstDpid The last switch
+   * \param path Receives the links of the path in order, none if srcDpid is dstDpid
+   * \return True if dstDpid can be reached from srcDpid
+   */
+  bool GetPath (uint64_t srcDpid, uint64_t dstDpid, std::vector<SdnTopologyLink> &path);
+  /**
+   * \param srcDpid The first switch
+   * \param dstDpid The last switch
+   * \param cost Receives the cost of a least cost path
+   * \return True if dstDpid can be reached from srcDpid
+   */
+  bool GetPathCost (uint64_t srcDpid, uint64_t dstDpid, uint64_t &cost);
+
+  /**
+   * \brief Removes every switch and link
+   */
+  void Clear (void);
+
+private:
+  typedef std::map<uint64_t, SdnTopologyLink> LinkMap;        //!< Links keyed by the DPID at the other end
+  typedef std::pair<uint64_t, uint32_t> PortKey;              //!< A switch port
+  typedef std::map<uint64_t, std::pair<uint64_t, uint64_t> > PathTree; //!< Destination to (cost, previous hop)
+
+  /// \brief A switch and its adjacency
+  struct Switch
+  {
+    Switch () : component (0), visit (0) {}
+    LinkMap out;                 //!< Links leaving the switch
+    std::set<uint64_t> in;       //!< Switches with a link arriving here
+    std::set<uint64_t> tree;     //!< Neighbors in the spanning tree
+    uint32_t component;          //!< Spanning tree the switch belongs to
+    uint32_t visit;              //!< Mark of the last search through the switch
+  };
+
+  bool IsAdjacent (uint64_t a, uint64_t b) const;
+  void ReportTree (uint64_t a, uint64_t b, bool added);
+  void AddTreeEdge (uint64_t a, uint64_t b);
+  /**
+   * \brief Cuts a tree edge and reconnects the two sides through another link if there is one
+   */
+  void CutTreeEdge (uint64_t a, uint64_t b);
+  void Relabel (const std::vector<uint64_t> &dpids, uint32_t component);
+  void InvalidateAdded (const SdnTopologyLink &link);
+  void InvalidateRemoved (const SdnTopologyLink &link);
+  const PathTree& GetPathTree (uint64_t srcDpid);
+
+  std::map<uint64_t, Switch> m_switches;           //!< Every switch by DPID
+  std::map<PortKey, uint64_t> m_ports;             //!< Switch port to the switch the link arriving there comes from
+  std::map<uint32_t, uint32_t> m_componentSize;    //!< Number of switches of each spanning tree
+  uint32_t m_nextComponent;                        //!< Id of the next spanning tree
+  uint32_t m_visit;                                //!< Mark of the current search
+  std::map<uint64_t, PathTree> m_paths;            //!< Cached least cost path trees by source
+  TreeCallback m_treeCallback;                     //!< Spanning tree change handler
+};
+
+} //End namespace ns3
+#endif /* SDN_TOPOLOGY_H */
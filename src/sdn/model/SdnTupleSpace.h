@@ -0,0 +1,221 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SDN_TUPLE_SPACE_H
+#define SDN_TUPLE_SPACE_H
+
+//Stdlib packages
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+//Sdn classes
+#include "SdnFlowKey.h"
+
+namespace ns3 {
+
+/**
+ * \ingroup sdn
+ *
+ * \brief Tuple space search classifier over flow entries.
+ *
+ * Entries are grouped by their match mask. Each group (tuple) is an exact
+ * match hash table keyed on the masked match value, so a lookup costs one
+ * hash probe per distinct mask instead of one comparison per flow. Tuples
+ * are visited by descending maximum priority, which lets the search stop
+ * as soon as no remaining tuple can beat the best entry found.
+ *
+ * Results are the same as a linear scan that picks the highest priority
+ * matching entry, breaking ties in favor of the oldest entry. The
+ * classifier only holds pointers; T must expose a compiled_match
+ * (SdnFlowMatch), a priority_ and an entry_id, none of which may change
+ * while the entry is inserted.
+ */
+template <class T>
+class SdnTupleSpace
+{
+public:
+  SdnTupleSpace () {}
+  ~SdnTupleSpace () { Clear (); }
+
+  /**
+   * \brief Strict ordering of entries. Higher priority first, then older first.
+   */
+  static bool Precedes (const T *lhs, const T *rhs)
+  {
+    if (lhs->priority_ != rhs->priority_)
+      {
+        return lhs->priority_ > rhs->priority_;
+      }
+    return lhs->entry_id < rhs->entry_id;
+  }
+
+  /**
+   * \brief Adds an entry to the classifier
+   * \param entry The entry to add. Must stay valid until removed.
+   */
+  void Insert (const T *entry)
+  {
+    const SdnFlowMatch &match = entry->compiled_match;
+    Tuple *tuple;
+    typename TupleIndex::iterator it = m_tupleIndex.find (match.GetMask ());
+    if (it == m_tupleIndex.end ())
+      {
+        tuple = new Tuple ();
+        tuple->mask = match.GetMask ();
+        m_tupleIndex[tuple->mask] = tuple;
+        m_tuples.push_back (tuple);
+      }
+    else
+      {
+        tuple = it->second;
+      }
+    Bucket &bucket = tuple->entries[match.GetValue ()];
+    bucket.insert (std::upper_bound (bucket.begin (), bucket.end (), entry, &SdnTupleSpace<T>::Precedes), entry);
+    tuple->priorities[entry->priority_]++;
+    SortTuples ();
+  }
+
+  /**
+   * \brief Removes an entry from the classifier. Unknown entries are ignored.
+   * \param entry The entry to remove
+   */
+  void Remove (const T *entry)
+  {
+    const SdnFlowMatch &match = entry->compiled_match;
+    typename TupleIndex::iterator it = m_tupleIndex.find (match.GetMask ());
+    if (it == m_tupleIndex.end ())
+      {
+        return;
+      }
+    Tuple *tuple = it->second;
+    typename TupleTable::iterator bucket = tuple->entries.find (match.GetValue ());
+    if (bucket == tuple->entries.end ())
+      {
+        return;
+      }
+    typename Bucket::iterator pos = std::find (bucket->second.begin (), bucket->second.end (), entry);
+    if (pos == bucket->second.end ())
+      {
+        return;
+      }
+    bucket->second.erase (pos);
+    if (bucket->second.empty ())
+      {
+        tuple->entries.erase (bucket);
+      }
+    if (--tuple->priorities[entry->priority_] == 0)
+      {
+        tuple->priorities.erase (entry->priority_);
+      }
+    if (tuple->entries.empty ())
+      {
+        m_tupleIndex.erase (it);
+        m_tuples.erase (std::find (m_tuples.begin (), m_tuples.end (), tuple));
+        delete tuple;
+      }
+    SortTuples ();
+  }
+
+  /**
+   * \brief Finds the entry a packet should be handled by
+   * \param packet The key extracted from the packet
+   * \param metadata The OpenFlow 1.3 pipeline metadata of the packet, checked
+   * against the entries the key selects
+   * \return The highest priority matching entry, or 0 if none match
+   */
+  const T* Lookup (const SdnFlowKey &packet, uint64_t metadata = 0) const
+  {
+    const T *best = 0;
+    SdnFlowKey masked;
+    for (typename std::vector<Tuple *>::const_iterator i = m_tuples.begin (); i != m_tuples.end (); ++i)
+      {
+        const Tuple *tuple = *i;
+        if (best && tuple->MaxPriority () < best->priority_)
+          {
+            break;
+          }
+        SdnFlowMatch::ApplyMask (packet, tuple->mask, masked);
+        typename TupleTable::const_iterator bucket = tuple->entries.find (masked);
+        if (bucket != tuple->entries.end ())
+          {
+            //The bucket is in Precedes order, so the first entry whose metadata matches is its best
+            for (typename Bucket::const_iterator e = bucket->second.begin (); e != bucket->second.end (); ++e)
+              {
+                if ((*e)->compiled_match.MatchesMetadata (metadata))
+                  {
+                    if (!best || Precedes (*e, best))
+                      {
+                        best = *e;
+                      }
+                    break;
+                  }
+              }
+          }
+      }
+    return best;
+  }
+
+  /**
+   * \brief Removes every entry
+   */
+  void Clear (void)
+  {
+    for (typename std::vector<Tuple *>::iterator i = m_tuples.begin (); i != m_tuples.end (); ++i)
+      {
+        delete *i;
+      }
+    m_tuples.clear ();
+    m_tupleIndex.clear ();
+  }
+
+  /**
+   * \return The number of distinct masks currently held
+   */
+  uint32_t GetNTuples (void) const { return m_tuples.size (); }
+
+private:
+  typedef std::vector<const T *> Bucket; //!< Entries sharing mask and value, in Precedes order
+  typedef std::unordered_map<SdnFlowKey, Bucket, SdnFlowKeyHash, SdnFlowKeyEqual> TupleTable;
+
+  /// \brief All entries sharing one mask
+  struct Tuple
+  {
+    SdnFlowKey mask;                          //!< The shared mask
+    TupleTable entries;                       //!< Entries keyed on their masked value
+    std::map<uint16_t, uint32_t> priorities;  //!< Number of entries at each priority
+    uint16_t MaxPriority (void) const { return priorities.rbegin ()->first; }
+  };
+  typedef std::unordered_map<SdnFlowKey, Tuple *, SdnFlowKeyHash, SdnFlowKeyEqual> TupleIndex;
+
+  static bool HigherTuple (const Tuple *lhs, const Tuple *rhs)
+  {
+    return lhs->MaxPriority () > rhs->MaxPriority ();
+  }
+  void SortTuples (void)
+  {
+    std::stable_sort (m_tuples.begin (), m_tuples.end (), &SdnTupleSpace<T>::HigherTuple);
+  }
+
+  SdnTupleSpace (const SdnTupleSpace &);
+  SdnTupleSpace& operator= (const SdnTupleSpace &);
+
+  std::vector<Tuple *> m_tuples; //!< Tuples by descending maximum priority
+  TupleIndex m_tupleIndex;       //!< Tuples keyed on their mask
+};
+
+} //End namespace ns3
+#endif /* SDN_TUPLE_SPACE_H */
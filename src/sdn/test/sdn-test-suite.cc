@@ -1,9 +1,37 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
 // Include a header file from your module to test.
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ (2, 33)
+#include <malloc.h>
+#define SDN_TEST_MALLINFO2
+#endif
+#endif
 
 // An essential include is test.h
 #include "ns3/test.h"
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/layer2-p2p-module.h"
+
+#include "ns3/SdnController.h"
+#include "ns3/SdnSwitch.h"
+#include "ns3/SdnSwitch13.h"
+#include "ns3/SdnListener.h"
+#include "ns3/SdnFlowKey.h"
+#include "ns3/SdnTupleSpace.h"
+#include "ns3/SdnTopology.h"
+#include "ns3/SdnFirewallTable.h"
+#include "ns3/SdnLearningTable.h"
+
+#include <fluid/of10msg.hh>
+#include <fluid/of13msg.hh>
 
 // Do not put your test classes in namespace ns3.  You may find it useful
 // to use the using directive to access the ns3 namespace directly
@@ -45,6 +73,883 @@ SdnTestCase1::DoRun (void)
   NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
 }
 
+// A classifier entry with the fields SdnTupleSpace reads
+struct SdnTestRule
+{
+  SdnFlowMatch compiled_match;
+  uint16_t priority_;
+  uint64_t entry_id;
+};
+
+// Loads overlapping wildcard rules of few priorities into an SdnTupleSpace,
+// inserting and removing at random, and checks every lookup against a
+// linear scan for the highest priority, oldest matching rule.
+class SdnTupleSpaceTestCase : public TestCase
+{
+public:
+  SdnTupleSpaceTestCase ();
+
+private:
+  virtual void DoRun (void);
+  SdnTestRule* MakeRule (uint64_t id);
+  SdnFlowKey MakeKey (void);
+
+  Ptr<UniformRandomVariable> m_random;
+};
+
+SdnTupleSpaceTestCase::SdnTupleSpaceTestCase ()
+  : TestCase ("Tuple space lookups equal a linear scan")
+{
+}
+
+SdnTestRule*
+SdnTupleSpaceTestCase::MakeRule (uint64_t id)
+{
+  //Few values per field, so rules overlap and share masks
+  fluid_msg::of10::Match match;
+  match.in_port (m_random->GetInteger (1, 3));
+  match.dl_type (m_random->GetInteger (0, 1) ? 0x0800 : 0x0806);
+  match.nw_proto (m_random->GetInteger (0, 1) ? 6 : 17);
+  match.tp_dst (m_random->GetInteger (1, 4));
+  match.nw_dst (fluid_msg::IPAddress ((uint32_t)(0x0a000000 | m_random->GetInteger (0, 3) << 8 | m_random->GetInteger (0, 3))));
+  uint32_t wildcards = 0;
+  uint32_t fields[] = { fluid_msg::of10::OFPFW_IN_PORT, fluid_msg::of10::OFPFW_DL_TYPE,
+                        fluid_msg::of10::OFPFW_NW_PROTO, fluid_msg::of10::OFPFW_TP_DST };
+  for (uint32_t i = 0; i < sizeof (fields) / sizeof (fields[0]); ++i)
+    {
+      if (m_random->GetInteger (0, 1))
+        {
+          wildcards |= fields[i];
+        }
+    }
+  wildcards |= fluid_msg::of10::OFPFW_DL_SRC | fluid_msg::of10::OFPFW_DL_DST | fluid_msg::of10::OFPFW_DL_VLAN |
+    fluid_msg::of10::OFPFW_DL_VLAN_PCP | fluid_msg::of10::OFPFW_NW_TOS | fluid_msg::of10::OFPFW_TP_SRC;
+  match.wildcards (wildcards);
+  uint32_t lengths[] = { 0, 16, 24, 32 };
+  uint32_t length = lengths[m_random->GetInteger (0, 3)];
+  uint32_t nwDstIgnore = length == 0 ? 0xffffffff : (uint32_t)((1ULL << (32 - length)) - 1);
+
+  SdnTestRule *rule = new SdnTestRule;
+  rule->compiled_match = SdnFlowMatch::FromOf10 (match, 0xffffffff, nwDstIgnore);
+  rule->priority_ = m_random->GetInteger (1, 4);
+  rule->entry_id = id;
+  return rule;
+}
+
+SdnFlowKey
+SdnTupleSpaceTestCase::MakeKey (void)
+{
+  SdnFlowKey key;
+  key.in_port = m_random->GetInteger (1, 3);
+  key.dl_type = m_random->GetInteger (0, 1) ? 0x0800 : 0x0806;
+  key.nw_proto = m_random->GetInteger (0, 1) ? 6 : 17;
+  key.tp_src = m_random->GetInteger (1, 4);
+  key.tp_dst = m_random->GetInteger (1, 4);
+  uint32_t dst = 0x0a000000 | m_random->GetInteger (0, 3) << 8 | m_random->GetInteger (0, 3);
+  std::memcpy (key.nw_dst, &dst, sizeof (dst));
+  return key;
+}
+
+void
+SdnTupleSpaceTestCase::DoRun (void)
+{
+  m_random = CreateObject<UniformRandomVariable> ();
+  m_random->SetStream (1);
+
+  SdnTupleSpace<SdnTestRule> classifier;
+  std::vector<SdnTestRule *> rules;
+  uint64_t nextId = 0;
+  for (uint32_t step = 0; step < 2000; ++step)
+    {
+      if (rules.empty () || m_random->GetValue () < 0.6)
+        {
+          rules.push_back (MakeRule (nextId++));
+          classifier.Insert (rules.back ());
+        }
+      else
+        {
+          uint32_t index = m_random->GetInteger (0, rules.size () - 1);
+          classifier.Remove (rules[index]);
+          delete rules[index];
+          rules.erase (rules.begin () + index);
+        }
+
+      for (uint32_t i = 0; i < 20; ++i)
+        {
+          SdnFlowKey key = MakeKey ();
+          const SdnTestRule *expected = 0;
+          for (std::vector<SdnTestRule *>::const_iterator r = rules.begin (); r != rules.end (); ++r)
+            {
+              if ((*r)->compiled_match.Matches (key)
+                  && (!expected || SdnTupleSpace<SdnTestRule>::Precedes (*r, expected)))
+                {
+                  expected = *r;
+                }
+            }
+          const SdnTestRule *found = classifier.Lookup (key);
+          NS_TEST_ASSERT_MSG_EQ (found, expected, "Lookup differs from the linear scan at step " << step
+                                 << " with " << rules.size () << " rules");
+        }
+    }
+
+  for (std::vector<SdnTestRule *>::iterator r = rules.begin (); r != rules.end (); ++r)
+    {
+      classifier.Remove (*r);
+      delete *r;
+    }
+  NS_TEST_ASSERT_MSG_EQ (classifier.GetNTuples (), 0u, "Tuples left after removing every rule");
+}
+
+// Adds, re-costs and removes links between a few switches at random and
+// after every change checks that the spanning tree covers each connected
+// set of switches without a cycle, and that every cached least cost path
+// agrees with a Dijkstra run from scratch.
+class SdnTopologyTestCase : public TestCase
+{
+public:
+  SdnTopologyTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void CheckTree (SdnTopology &topology, uint32_t step);
+  void CheckPaths (SdnTopology &topology, uint32_t step);
+  static uint64_t FindRoot (std::map<uint64_t, uint64_t> &parent, uint64_t dpid);
+
+  Ptr<UniformRandomVariable> m_random;
+};
+
+#define SDN_TEST_TOPOLOGY_SWITCHES 8 //!< Switches of the random topology, DPIDs 1 to 8
+
+SdnTopologyTestCase::SdnTopologyTestCase ()
+  : TestCase ("Topology keeps a spanning tree and fresh paths under link churn")
+{
+}
+
+uint64_t
+SdnTopologyTestCase::FindRoot (std::map<uint64_t, uint64_t> &parent, uint64_t dpid)
+{
+  while (parent[dpid] != dpid)
+    {
+      parent[dpid] = parent[parent[dpid]];
+      dpid = parent[dpid];
+    }
+  return dpid;
+}
+
+void
+SdnTopologyTestCase::CheckTree (SdnTopology &topology, uint32_t step)
+{
+  //Switches joined by a link in either direction, and by a tree edge
+  std::map<uint64_t, uint64_t> linked;
+  std::map<uint64_t, uint64_t> tree;
+  for (uint64_t dpid = 1; dpid <= SDN_TEST_TOPOLOGY_SWITCHES; ++dpid)
+    {
+      linked[dpid] = dpid;
+      tree[dpid] = dpid;
+    }
+  for (uint64_t dpid = 1; dpid <= SDN_TEST_TOPOLOGY_SWITCHES; ++dpid)
+    {
+      std::vector<SdnTopologyLink> links;
+      topology.GetLinks (dpid, links);
+      for (std::vector<SdnTopologyLink>::iterator l = links.begin (); l != links.end (); ++l)
+        {
+          linked[FindRoot (linked, l->srcDpid)] = FindRoot (linked, l->dstDpid);
+        }
+    }
+
+  //Each pair of switches is one tree edge, whichever directions of it are linked
+  std::vector<SdnTopologyLink> treeLinks;
+  topology.GetTreeLinks (treeLinks);
+  std::set<std::pair<uint64_t, uint64_t> > edges;
+  for (std::vector<SdnTopologyLink>::iterator l = treeLinks.begin (); l != treeLinks.end (); ++l)
+    {
+      edges.insert (std::make_pair (std::min (l->srcDpid, l->dstDpid), std::max (l->srcDpid, l->dstDpid)));
+    }
+  for (std::set<std::pair<uint64_t, uint64_t> >::iterator e = edges.begin (); e != edges.end (); ++e)
+    {
+      uint64_t a = FindRoot (tree, e->first);
+      uint64_t b = FindRoot (tree, e->second);
+      NS_TEST_ASSERT_MSG_NE (a, b, "Tree edge " << e->first << "-" << e->second << " closes a cycle at step " << step);
+      tree[a] = b;
+    }
+  for (uint64_t dpid = 1; dpid <= SDN_TEST_TOPOLOGY_SWITCHES; ++dpid)
+    {
+      for (uint64_t other = dpid + 1; other <= SDN_TEST_TOPOLOGY_SWITCHES; ++other)
+        {
+          bool connected = FindRoot (linked, dpid) == FindRoot (linked, other);
+          bool spanned = FindRoot (tree, dpid) == FindRoot (tree, other);
+          NS_TEST_ASSERT_MSG_EQ (spanned, connected, "Tree disagrees with the links between " << dpid
+                                 << " and " << other << " at step " << step);
+        }
+    }
+}
+
+void
+SdnTopologyTestCase::CheckPaths (SdnTopology &topology, uint32_t step)
+{
+  for (uint64_t src = 1; src <= SDN_TEST_TOPOLOGY_SWITCHES; ++src)
+    {
+      //Plain Dijkstra over the current links
+      std::map<uint64_t, uint64_t> cost;
+      std::set<uint64_t> done;
+      cost[src] = 0;
+      while (true)
+        {
+          uint64_t next = 0;
+          for (std::map<uint64_t, uint64_t>::iterator c = cost.begin (); c != cost.end (); ++c)
+            {
+              if (!done.count (c->first) && (next == 0 || c->second < cost[next]))
+                {
+                  next = c->first;
+                }
+            }
+          if (next == 0)
+            {
+              break;
+            }
+          done.insert (next);
+          std::vector<SdnTopologyLink> links;
+          topology.GetLinks (next, links);
+          for (std::vector<SdnTopologyLink>::iterator l = links.begin (); l != links.end (); ++l)
+            {
+              if (!cost.count (l->dstDpid) || cost[next] + l->cost < cost[l->dstDpid])
+                {
+                  cost[l->dstDpid] = cost[next] + l->cost;
+                }
+            }
+        }
+
+      for (uint64_t dst = 1; dst <= SDN_TEST_TOPOLOGY_SWITCHES; ++dst)
+        {
+          uint64_t cached = 0;
+          bool reachable = topology.GetPathCost (src, dst, cached);
+          bool expected = cost.count (dst) == 1;
+          NS_TEST_ASSERT_MSG_EQ (reachable, expected, "Reachability of " << dst << " from " << src
+                                 << " is stale at step " << step);
+          if (!reachable)
+            {
+              continue;
+            }
+          NS_TEST_ASSERT_MSG_EQ (cached, cost[dst], "Cost from " << src << " to " << dst << " is stale at step " << step);
+          std::vector<SdnTopologyLink> path;
+          topology.GetPath (src, dst, path);
+          uint64_t hop = src;
+          uint64_t sum = 0;
+          for (std::vector<SdnTopologyLink>::iterator l = path.begin (); l != path.end (); ++l)
+            {
+              NS_TEST_ASSERT_MSG_EQ (l->srcDpid, hop, "Path from " << src << " to " << dst << " is broken at step " << step);
+              hop = l->dstDpid;
+              sum += l->cost;
+            }
+          NS_TEST_ASSERT_MSG_EQ (hop, dst, "Path from " << src << " ends at " << hop << " instead of " << dst);
+          NS_TEST_ASSERT_MSG_EQ (sum, cached, "Path from " << src << " to " << dst << " does not add up at step " << step);
+        }
+    }
+}
+
+void
+SdnTopologyTestCase::DoRun (void)
+{
+  m_random = CreateObject<UniformRandomVariable> ();
+  m_random->SetStream (2);
+
+  SdnTopology topology;
+  for (uint64_t dpid = 1; dpid <= SDN_TEST_TOPOLOGY_SWITCHES; ++dpid)
+    {
+      topology.AddSwitch (dpid);
+    }
+  for (uint32_t step = 0; step < 1000; ++step)
+    {
+      uint64_t src = m_random->GetInteger (1, SDN_TEST_TOPOLOGY_SWITCHES);
+      uint64_t dst = m_random->GetInteger (1, SDN_TEST_TOPOLOGY_SWITCHES - 1);
+      if (dst >= src)
+        {
+          dst++;
+        }
+      //Slightly more adds than removes, so the topology drifts between sparse and dense
+      if (m_random->GetValue () < 0.55)
+        {
+          //A port per neighbor, so a link never unplugs another one arriving at its port
+          SdnTopologyLink link;
+          link.srcDpid = src;
+          link.srcPort = dst;
+          link.dstDpid = dst;
+          link.dstPort = src;
+          link.cost = m_random->GetInteger (1, 10);
+          topology.AddLink (link);
+        }
+      else
+        {
+          topology.RemoveLink (src, dst);
+        }
+      CheckTree (topology, step);
+      //Only some steps fill the cache, so invalidations pile up between the checks
+      if (step % 3 == 0)
+        {
+          CheckPaths (topology, step);
+        }
+    }
+}
+
+// Fills an SdnFirewallTable with random overlapping rules over a small
+// address block and checks every packet of the block: Lookup must agree
+// with a linear scan of Covers, and the rules Compile reduces the table to
+// must block exactly the same packets.
+class SdnFirewallTableTestCase : public TestCase
+{
+public:
+  SdnFirewallTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+  SdnFirewallRule MakeRule (void);
+  static SdnFirewallRule MakePacket (uint32_t src, uint32_t dst, uint8_t proto, uint16_t srcPort, uint16_t dstPort);
+
+  Ptr<UniformRandomVariable> m_random;
+};
+
+#define SDN_TEST_FIREWALL_BASE 0x0a000000 //!< 10.0.0.0, the addresses tested are its low six bits
+#define SDN_TEST_FIREWALL_HOSTS 64        //!< Addresses tested on each side
+#define SDN_TEST_FIREWALL_PORTS 4         //!< Ports 1 to 4 are tested on each side
+
+SdnFirewallTableTestCase::SdnFirewallTableTestCase ()
+  : TestCase ("Firewall table lookups and compiled rules equal a linear scan")
+{
+}
+
+SdnFirewallRule
+SdnFirewallTableTestCase::MakeRule (void)
+{
+  //Prefixes around the tested block, so rules nest, overlap and have mergeable siblings
+  uint8_t lengths[] = { 0, 8, 26, 27, 28, 29, 30, 31, 32 };
+  uint8_t protos[] = { 0, 1, 6, 17 };
+  SdnFirewallRule rule;
+  rule.src = SDN_TEST_FIREWALL_BASE | m_random->GetInteger (0, SDN_TEST_FIREWALL_HOSTS - 1);
+  rule.srcLen = lengths[m_random->GetInteger (0, sizeof (lengths) - 1)];
+  rule.dst = SDN_TEST_FIREWALL_BASE | m_random->GetInteger (0, SDN_TEST_FIREWALL_HOSTS - 1);
+  rule.dstLen = lengths[m_random->GetInteger (0, sizeof (lengths) - 1)];
+  rule.proto = protos[m_random->GetInteger (0, sizeof (protos) - 1)];
+  if (rule.proto != 1 && m_random->GetInteger (0, 2) == 0)
+    {
+      rule.dstPortMin = m_random->GetInteger (1, SDN_TEST_FIREWALL_PORTS);
+      rule.dstPortMax = m_random->GetInteger (rule.dstPortMin, SDN_TEST_FIREWALL_PORTS);
+      if (m_random->GetInteger (0, 1))
+        {
+          rule.srcPortMin = rule.srcPortMax = m_random->GetInteger (1, SDN_TEST_FIREWALL_PORTS);
+        }
+    }
+  return rule;
+}
+
+SdnFirewallRule
+SdnFirewallTableTestCase::MakePacket (uint32_t src, uint32_t dst, uint8_t proto, uint16_t srcPort, uint16_t dstPort)
+{
+  //A packet is the rule matching only itself. Ports only exist for TCP and UDP.
+  SdnFirewallRule packet;
+  packet.src = src;
+  packet.srcLen = 32;
+  packet.dst = dst;
+  packet.dstLen = 32;
+  packet.proto = proto;
+  if (proto == 6 || proto == 17)
+    {
+      packet.srcPortMin = packet.srcPortMax = srcPort;
+      packet.dstPortMin = packet.dstPortMax = dstPort;
+    }
+  return packet;
+}
+
+void
+SdnFirewallTableTestCase::DoRun (void)
+{
+  m_random = CreateObject<UniformRandomVariable> ();
+  m_random->SetStream (3);
+
+  uint8_t protos[] = { 1, 6, 17 };
+  for (uint32_t trial = 0; trial < 10; ++trial)
+    {
+      SdnFirewallTable table;
+      std::vector<SdnFirewallRule> rules;
+      uint32_t nRules = m_random->GetInteger (1, 40);
+      for (uint32_t i = 0; i < nRules; ++i)
+        {
+          SdnFirewallRule rule = MakeRule ();
+          if (table.Add (rule))
+            {
+              rules.push_back (rule);
+            }
+        }
+      std::vector<SdnFirewallRule> compiled;
+      table.Compile (compiled);
+      NS_TEST_ASSERT_MSG_LT_OR_EQ (compiled.size (), rules.size (), "Compile grew the rule set in trial " << trial);
+      SdnFirewallTable compiledTable;
+      for (std::vector<SdnFirewallRule>::iterator r = compiled.begin (); r != compiled.end (); ++r)
+        {
+          compiledTable.Add (*r);
+        }
+
+      for (uint32_t s = 0; s < SDN_TEST_FIREWALL_HOSTS; ++s)
+        {
+          for (uint32_t d = 0; d < SDN_TEST_FIREWALL_HOSTS; ++d)
+            {
+              uint32_t src = SDN_TEST_FIREWALL_BASE | s;
+              uint32_t dst = SDN_TEST_FIREWALL_BASE | d;
+              for (uint32_t p = 0; p < sizeof (protos); ++p)
+                {
+                  bool transport = protos[p] != 1;
+                  uint16_t maxPort = transport ? SDN_TEST_FIREWALL_PORTS : 0;
+                  for (uint16_t srcPort = transport; srcPort <= maxPort; ++srcPort)
+                    {
+                      for (uint16_t dstPort = transport; dstPort <= maxPort; ++dstPort)
+                        {
+                          SdnFirewallRule packet = MakePacket (src, dst, protos[p], srcPort, dstPort);
+                          bool expected = false;
+                          for (std::vector<SdnFirewallRule>::iterator r = rules.begin (); r != rules.end () && !expected; ++r)
+                            {
+                              expected = r->Covers (packet);
+                            }
+                          const SdnFirewallRule *found = table.Lookup (src, dst, protos[p], srcPort, dstPort);
+                          bool hit = found != 0;
+                          NS_TEST_ASSERT_MSG_EQ (hit, expected, "Lookup differs from the linear scan in trial "
+                                                 << trial << " for " << s << " -> " << d << " proto " << (uint32_t)protos[p]
+                                                 << " ports " << srcPort << " -> " << dstPort);
+                          if (found)
+                            {
+                              NS_TEST_ASSERT_MSG_EQ (found->Covers (packet), true, "Lookup returned a rule not matching the packet");
+                            }
+                          bool blocked = compiledTable.Lookup (src, dst, protos[p], srcPort, dstPort) != 0;
+                          NS_TEST_ASSERT_MSG_EQ (blocked, expected, "Compiled rules differ from the table in trial "
+                                                 << trial << " for " << s << " -> " << d << " proto " << (uint32_t)protos[p]
+                                                 << " ports " << srcPort << " -> " << dstPort);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Exercises the open addressed SdnLearningTable: removals inside a probe
+// chain that wraps around the end of the array, ForgetPort, growth and
+// aging, checking every address against what was learned.
+class SdnLearningTableTestCase : public TestCase
+{
+public:
+  SdnLearningTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void DoRunChains (void);
+  void DoRunGrowth (void);
+  void DoRunAging (void);
+  /**
+   * \brief Checks every address of a reference against the table
+   */
+  void CheckAll (SdnLearningTable &table, const std::map<uint64_t, uint32_t> &expected, const std::string &when);
+  static uint32_t HomeOf (uint64_t mac, uint32_t mask);
+};
+
+SdnLearningTableTestCase::SdnLearningTableTestCase ()
+  : TestCase ("Learning table keeps its entries through removals, growth and aging")
+{
+}
+
+uint32_t
+SdnLearningTableTestCase::HomeOf (uint64_t mac, uint32_t mask)
+{
+  //Same hash as SdnLearningTable::Home for an untagged address, so chains can be built on purpose
+  uint64_t key = (mac & 0xffffffffffffULL) << 12;
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return (uint32_t)key & mask;
+}
+
+void
+SdnLearningTableTestCase::CheckAll (SdnLearningTable &table, const std::map<uint64_t, uint32_t> &expected, const std::string &when)
+{
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), expected.size (), "Wrong number of entries " << when);
+  for (std::map<uint64_t, uint32_t>::const_iterator i = expected.begin (); i != expected.end (); ++i)
+    {
+      NS_TEST_ASSERT_MSG_EQ (table.Lookup (i->first, 0), i->second, "Address " << i->first << " lost " << when);
+    }
+}
+
+void
+SdnLearningTableTestCase::DoRunChains (void)
+{
+  //Eight addresses homed on the last two slots and the first one of a 16 slot
+  //table, so their probe chain runs over the end of the array and back to its start
+  const uint32_t mask = 15;
+  uint32_t homes[] = { 14, 14, 14, 15, 15, 0, 14, 15 };
+  std::vector<uint64_t> macs;
+  for (uint32_t h = 0; h < sizeof (homes) / sizeof (homes[0]); ++h)
+    {
+      uint64_t mac = macs.empty () ? 1 : macs.back () + 1;
+      while (HomeOf (mac, mask) != homes[h])
+        {
+          mac++;
+        }
+      macs.push_back (mac);
+    }
+
+  //Each address removed alone, then in pairs, from a full chain
+  for (uint32_t a = 0; a < macs.size (); ++a)
+    {
+      for (uint32_t b = a; b < macs.size (); ++b)
+        {
+          SdnLearningTable table (16);
+          NS_TEST_ASSERT_MSG_EQ (table.GetCapacity (), mask + 1, "Table not sized as asked");
+          std::map<uint64_t, uint32_t> expected;
+          for (uint32_t i = 0; i < macs.size (); ++i)
+            {
+              table.Learn (macs[i], 0, i + 1);
+              expected[macs[i]] = i + 1;
+            }
+          table.Forget (macs[a], 0);
+          expected.erase (macs[a]);
+          if (b != a)
+            {
+              table.Forget (macs[b], 0);
+              expected.erase (macs[b]);
+            }
+          NS_TEST_ASSERT_MSG_EQ (table.GetCapacity (), mask + 1, "Table grew below its load limit");
+          CheckAll (table, expected, "after forgetting chain entries " + std::to_string (a) + " and " + std::to_string (b));
+          NS_TEST_ASSERT_MSG_EQ (table.Lookup (macs[a], 0), SDN_LEARNING_NO_PORT, "Forgotten address still found");
+        }
+    }
+
+  //ForgetPort removes every other entry of the chain at once
+  SdnLearningTable table (16);
+  std::map<uint64_t, uint32_t> expected;
+  for (uint32_t i = 0; i < macs.size (); ++i)
+    {
+      table.Learn (macs[i], 0, i % 2);
+      if (i % 2)
+        {
+          expected[macs[i]] = 1;
+        }
+    }
+  NS_TEST_ASSERT_MSG_EQ (table.ForgetPort (0), macs.size () / 2, "ForgetPort removed the wrong number of entries");
+  CheckAll (table, expected, "after forgetting a port");
+}
+
+void
+SdnLearningTableTestCase::DoRunGrowth (void)
+{
+  Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable> ();
+  random->SetStream (4);
+
+  //Starts at 16 slots and grows several times, with ports forgotten along the way
+  SdnLearningTable table (16);
+  std::map<uint64_t, uint32_t> expected;
+  for (uint32_t step = 0; step < 2000; ++step)
+    {
+      uint32_t capacity = table.GetCapacity ();
+      uint64_t mac = random->GetInteger (1, 1000);
+      uint32_t port = random->GetInteger (1, 8);
+      if (random->GetValue () < 0.1)
+        {
+          bool known = expected.erase (mac) == 1;
+          NS_TEST_ASSERT_MSG_EQ (table.Forget (mac, 0), known, "Forget disagrees at step " << step);
+        }
+      else
+        {
+          table.Learn (mac, 0, port);
+          expected[mac] = port;
+        }
+      if (table.GetCapacity () != capacity)
+        {
+          CheckAll (table, expected, "after growing to " + std::to_string (table.GetCapacity ()) + " slots");
+        }
+      if (step % 500 == 499)
+        {
+          uint32_t forgotten = 0;
+          for (std::map<uint64_t, uint32_t>::iterator i = expected.begin (); i != expected.end (); )
+            {
+              if (i->second == port)
+                {
+                  expected.erase (i++);
+                  forgotten++;
+                }
+              else
+                {
+                  ++i;
+                }
+            }
+          NS_TEST_ASSERT_MSG_EQ (table.ForgetPort (port), forgotten, "ForgetPort removed the wrong number of entries");
+          CheckAll (table, expected, "after forgetting port " + std::to_string (port));
+        }
+    }
+  NS_TEST_ASSERT_MSG_GT (table.GetCapacity (), 16u, "The table never grew");
+  CheckAll (table, expected, "at the end");
+}
+
+void
+SdnLearningTableTestCase::DoRunAging (void)
+{
+  SdnLearningTable table (16);
+  table.SetMaxAge (Seconds (10));
+  std::map<uint64_t, uint32_t> expected;
+  for (uint64_t mac = 1; mac <= 6; ++mac)
+    {
+      table.Learn (mac, 0, 1);
+    }
+  Simulator::Stop (Seconds (5));
+  Simulator::Run ();
+  for (uint64_t mac = 4; mac <= 9; ++mac)
+    {
+      //4 to 6 are learned again, which restarts their age
+      table.Learn (mac, 0, 2);
+      expected[mac] = 2;
+    }
+
+  //At 12 s only the addresses learned at 0 s are too old
+  Simulator::Stop (Seconds (7));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (table.Expire (), 3u, "Expire removed the wrong number of entries");
+  CheckAll (table, expected, "after expiring");
+  NS_TEST_ASSERT_MSG_EQ (table.Lookup (1, 0), SDN_LEARNING_NO_PORT, "Aged out address still found");
+
+  //At 16 s the rest is too old too, and a lookup removes what it finds aged out
+  Simulator::Stop (Seconds (4));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (table.Lookup (4, 0), SDN_LEARNING_NO_PORT, "Aged out address still found");
+  NS_TEST_ASSERT_MSG_EQ (table.GetSize (), 5u, "Lookup did not remove the aged out entry");
+  NS_TEST_ASSERT_MSG_EQ (table.Learn (5, 0, 2), true, "Learning an aged out address again is not reported new");
+  NS_TEST_ASSERT_MSG_EQ (table.Expire (), 4u, "Expire removed the wrong number of entries");
+  NS_TEST_ASSERT_MSG_EQ (table.Lookup (5, 0), 2u, "Address learned again was expired");
+}
+
+void
+SdnLearningTableTestCase::DoRun (void)
+{
+  DoRunChains ();
+  DoRunGrowth ();
+  DoRunAging ();
+  Simulator::Destroy ();
+}
+
+// Installs an idle-timeout flow for every PacketIn, out of the port opposite
+// the one the frame came in on, and polls flow stats, so a run goes through
+// the PacketIn, FlowMod, FlowRemoved and StatsReply paths over and over.
+class SdnChurnListener : public SdnListener
+{
+public:
+  SdnChurnListener () : m_packetIns (0), m_flowRemoveds (0), m_statsReplies (0) {}
+  virtual void event_callback (ControllerEvent* ev)
+  {
+    switch (ev->get_type ())
+      {
+      case EVENT_SWITCH_UP:
+        m_switches.push_back (ev->ofconn);
+        break;
+      case EVENT_PACKET_IN:
+        m_packetIns++;
+        InstallFlow (ev->ofconn, static_cast<PacketInEvent*> (ev)->data);
+        break;
+      case EVENT_FLOW_REMOVED:
+        m_flowRemoveds++;
+        break;
+      case EVENT_STATS_REPLY:
+        m_statsReplies++;
+        break;
+      }
+  }
+  void PollStats (void)
+  {
+    for (std::vector<Ptr<SdnConnection> >::iterator i = m_switches.begin (); i != m_switches.end (); ++i)
+      {
+        if ((*i)->get_version () == fluid_msg::of13::OFP_VERSION)
+          {
+            fluid_msg::of13::Match match;
+            fluid_msg::of13::MultipartRequestFlow request (SdnCommon::GenerateXId (), 0, fluid_msg::of13::OFPTT_ALL,
+                                                           fluid_msg::of13::OFPP_ANY, fluid_msg::of13::OFPG_ANY, 0, 0, match);
+            (*i)->send (&request);
+          }
+        else
+          {
+            fluid_msg::of10::Match match;
+            fluid_msg::of10::StatsRequestFlow request (SdnCommon::GenerateXId (), 0, match, 0xff, fluid_msg::of10::OFPP_NONE);
+            (*i)->send (&request);
+          }
+      }
+    Simulator::Schedule (MilliSeconds (500), &SdnChurnListener::PollStats, this);
+  }
+  void InstallFlow (Ptr<SdnConnection> ofconn, void* data)
+  {
+    if (ofconn->get_version () == fluid_msg::of13::OFP_VERSION)
+      {
+        fluid_msg::of13::PacketIn pi;
+        pi.unpack ((uint8_t*)data);
+        if (!pi.match ().in_port () || pi.data_len () < 14)
+          {
+            return;
+          }
+        uint32_t inPort = pi.match ().in_port ()->value ();
+        fluid_msg::of13::FlowMod fm (pi.xid (), 0, 0xffffffffffffffff, 0, fluid_msg::of13::OFPFC_ADD, 1, 0, 100,
+                                     pi.buffer_id (), 0, 0, fluid_msg::of13::OFPFF_SEND_FLOW_REM);
+        fluid_msg::of13::InPort matchPort (inPort);
+        fluid_msg::of13::EthType matchType (FrameType (pi.data ()));
+        fm.add_oxm_field (matchPort);
+        fm.add_oxm_field (matchType);
+        fluid_msg::of13::OutputAction act (inPort == 1 ? 2 : 1, 1024);
+        fluid_msg::of13::ApplyActions inst;
+        inst.add_action (act);
+        fm.add_instruction (inst);
+        ofconn->send (&fm);
+      }
+    else
+      {
+        fluid_msg::of10::PacketIn pi;
+        pi.unpack ((uint8_t*)data);
+        if (pi.data_len () < 14)
+          {
+            return;
+          }
+        fluid_msg::of10::FlowMod fm (pi.xid (), 0, fluid_msg::of10::OFPFC_ADD, 1, 0, 100,
+                                     pi.buffer_id (), 0, fluid_msg::of10::OFPFF_SEND_FLOW_REM);
+        fluid_msg::of10::Match match;
+        match.in_port (pi.in_port ());
+        match.dl_type (FrameType (pi.data ()));
+        fm.match (match);
+        fluid_msg::of10::OutputAction act (pi.in_port () == 1 ? 2 : 1, 1024);
+        fm.add_action (act);
+        ofconn->send (&fm);
+      }
+  }
+  static uint16_t FrameType (void* frame)
+  {
+    return (uint16_t)((((uint8_t*)frame)[12] << 8) | ((uint8_t*)frame)[13]);
+  }
+
+  std::vector<Ptr<SdnConnection> > m_switches;
+  uint32_t m_packetIns;
+  uint32_t m_flowRemoveds;
+  uint32_t m_statsReplies;
+};
+
+// Runs a long reactive workload through one switch and checks that the heap
+// stops growing once the flow table and buffers churn steadily: every
+// OpenFlow message, flow and controller event allocated per packet must be
+// released again. The heap is read with mallinfo2, so it is only checked on
+// glibc 2.33 or later.
+class SdnSteadyStateMemoryTestCase : public TestCase
+{
+public:
+  SdnSteadyStateMemoryTestCase (bool of13);
+
+private:
+  virtual void DoRun (void);
+  void SendFrame (void);
+  void SampleHeap (void);
+
+  bool m_of13;                   //!< Run an SdnSwitch13 instead of an SdnSwitch
+  Ptr<NetDevice> m_source;       //!< Host device frames are sent from
+  Address m_destination;         //!< Host device frames are sent to
+  uint32_t m_sent;               //!< Frames sent so far
+  std::vector<uint64_t> m_heap;  //!< Bytes in use at each sample
+};
+
+SdnSteadyStateMemoryTestCase::SdnSteadyStateMemoryTestCase (bool of13)
+  : TestCase (of13 ? "Heap stays flat over a long reactive OpenFlow 1.3 run" : "Heap stays flat over a long reactive OpenFlow 1.0 run"),
+    m_of13 (of13),
+    m_sent (0)
+{
+}
+
+void
+SdnSteadyStateMemoryTestCase::SendFrame (void)
+{
+  //Ethertypes without a parser, the payload is never looked into. Each one
+  //comes back after 2 s, once the 1 s idle flow for it has expired
+  m_source->Send (Create<Packet> (64), m_destination, 0x9000 + m_sent++ % 2000);
+  Simulator::Schedule (MilliSeconds (1), &SdnSteadyStateMemoryTestCase::SendFrame, this);
+}
+
+void
+SdnSteadyStateMemoryTestCase::SampleHeap (void)
+{
+#ifdef SDN_TEST_MALLINFO2
+  struct mallinfo2 info = mallinfo2 ();
+  m_heap.push_back (info.uordblks);
+#endif
+}
+
+void
+SdnSteadyStateMemoryTestCase::DoRun (void)
+{
+  NodeContainer controllerNode, switchNode, hostNodes;
+  controllerNode.Create (1);
+  switchNode.Create (1);
+  hostNodes.Create (2);
+
+  Layer2P2PHelper layer2P2P;
+  layer2P2P.SetDeviceAttribute ("DataRate", StringValue ("100Mbps"));
+  layer2P2P.SetChannelAttribute ("Delay", StringValue ("1ms"));
+  PointToPointHelper pointToPoint;
+  pointToPoint.SetDeviceAttribute ("DataRate", StringValue ("1Gbps"));
+  pointToPoint.SetChannelAttribute ("Delay", StringValue ("1ms"));
+
+  NetDeviceContainer left = layer2P2P.Install (hostNodes.Get (0), switchNode.Get (0));
+  NetDeviceContainer right = layer2P2P.Install (switchNode.Get (0), hostNodes.Get (1));
+  NetDeviceContainer control = pointToPoint.Install (switchNode.Get (0), controllerNode.Get (0));
+
+  InternetStackHelper internet;
+  internet.Install (controllerNode);
+  internet.Install (switchNode);
+  internet.Install (hostNodes);
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.0.0.0", "255.0.0.0");
+  ipv4.Assign (left);
+  ipv4.Assign (right);
+  ipv4.SetBase ("192.168.0.0", "255.255.0.0");
+  ipv4.Assign (control);
+
+  Ptr<SdnChurnListener> listener = CreateObject<SdnChurnListener> ();
+  Ptr<SdnController> controller = CreateObject<SdnController> (listener);
+  controller->SetStartTime (Seconds (0.0));
+  controllerNode.Get (0)->AddApplication (controller);
+  Ptr<Application> sdnSwitch;
+  if (m_of13)
+    {
+      sdnSwitch = CreateObject<SdnSwitch13> ();
+    }
+  else
+    {
+      sdnSwitch = CreateObject<SdnSwitch> ();
+    }
+  sdnSwitch->SetStartTime (Seconds (0.1));
+  switchNode.Get (0)->AddApplication (sdnSwitch);
+
+  m_source = left.Get (0);
+  m_destination = right.Get (1)->GetAddress ();
+  Simulator::Schedule (Seconds (1.0), &SdnSteadyStateMemoryTestCase::SendFrame, this);
+  Simulator::Schedule (Seconds (1.0), &SdnChurnListener::PollStats, listener);
+  //Flows start expiring after 2 s and the table holds a steady 1000 after that
+  Simulator::Schedule (Seconds (10.0), &SdnSteadyStateMemoryTestCase::SampleHeap, this);
+  Simulator::Schedule (Seconds (100.0), &SdnSteadyStateMemoryTestCase::SampleHeap, this);
+
+  Simulator::Stop (Seconds (100.5));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_GT (listener->m_packetIns, 90000, "Frames did not reach the controller");
+  NS_TEST_ASSERT_MSG_GT (listener->m_flowRemoveds, 90000, "Idle flows were not reported removed");
+  NS_TEST_ASSERT_MSG_GT (listener->m_statsReplies, 190, "Flow stats requests were not answered");
+#ifdef SDN_TEST_MALLINFO2
+  NS_TEST_ASSERT_MSG_EQ (m_heap.size (), 2u, "Heap was not sampled");
+  //Leaking a single message per PacketIn would add several MB over 90000 of them
+  uint64_t grown = m_heap[1] > m_heap[0] ? m_heap[1] - m_heap[0] : 0;
+  NS_TEST_ASSERT_MSG_LT (grown, 1024 * 1024, "Heap grew by " << grown << " bytes in steady state");
+#else
+  std::clog << "Skipping the heap check of \"" << GetName () << "\": it needs mallinfo2 from glibc 2.33 or later" << std::endl;
+#endif
+
+  Simulator::Destroy ();
+}
+
 // The TestSuite class names the TestSuite, identifies what type of TestSuite,
 // and enables the TestCases to be run.  Typically, only the constructor for
 // this class must be defined
@@ -60,6 +965,12 @@ SdnTestSuite::SdnTestSuite ()
 {
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
   AddTestCase (new SdnTestCase1, TestCase::QUICK);
+  AddTestCase (new SdnTupleSpaceTestCase, TestCase::QUICK);
+  AddTestCase (new SdnTopologyTestCase, TestCase::QUICK);
+  AddTestCase (new SdnFirewallTableTestCase, TestCase::QUICK);
+  AddTestCase (new SdnLearningTableTestCase, TestCase::QUICK);
+  AddTestCase (new SdnSteadyStateMemoryTestCase (false), TestCase::EXTENSIVE);
+  AddTestCase (new SdnSteadyStateMemoryTestCase (true), TestCase::EXTENSIVE);
 }
 
 // Do not forget to allocate an instance of this TestSuite